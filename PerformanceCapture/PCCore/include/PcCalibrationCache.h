@@ -0,0 +1,140 @@
+#ifndef PCCALIBRATIONCACHE_H
+#define PCCALIBRATIONCACHE_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <boost/cstdint.hpp>
+
+#include <string>
+#include <vector>
+
+namespace pcc
+{
+    /// \brief The maximum length of a camera GUID stored in the calibration cache, terminating null included.
+    static size_t const PCC_CACHE_ID_LENGTH = 64u;
+
+    /// \brief The maximum number of distortion coefficients stored in the calibration cache.
+    static size_t const PCC_CACHE_DIST_COUNT = 8u;
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief The cached calibration of one camera. Packed, since arrays of records are written to disk as they are.
+    ///
+    /// Matrices are stored row-major as doubles. The rig pose is only meaningful for the rig described by RigKey
+    /// (see PcCalibrationCache::RigKey), while the intrinsics hold for the camera wherever it is.
+#pragma pack(push, 1)
+    struct PcCameraRecord
+    {
+        char                CameraId[PCC_CACHE_ID_LENGTH];          ///< The camera GUID, null-terminated.
+        boost::uint32_t     Width;                                  ///< The frame width the camera was calibrated at, in pixels.
+        boost::uint32_t     Height;                                 ///< The frame height the camera was calibrated at, in pixels.
+        double              CameraMatrix[9];                        ///< The intrinsic camera matrix.
+        boost::uint32_t     DistCount;                              ///< The number of distortion coefficients.
+        double              DistCoeffs[PCC_CACHE_DIST_COUNT];       ///< The distortion coefficients, 0 past DistCount.
+        double              Rms;                                    ///< The RMS reprojection error of the calibration, in pixels.
+        boost::int64_t      Date;                                   ///< The calibration date, in seconds since the epoch.
+        boost::uint64_t     RigKey;                                 ///< The rig the pose belongs to, 0 if there is no pose.
+        double              Rotation[9];                            ///< The rotation from the rig frame to the camera frame.
+        double              Translation[3];                         ///< The translation from the rig frame to the camera frame.
+    };
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief The cached calibration of one stereo pair. Packed, like PcCameraRecord.
+    struct PcStereoRecord
+    {
+        char                LeftId[PCC_CACHE_ID_LENGTH];            ///< The GUID of the left camera, null-terminated.
+        char                RightId[PCC_CACHE_ID_LENGTH];           ///< The GUID of the right camera, null-terminated.
+        double              Rotation[9];                            ///< The rotation from the left camera to the right camera.
+        double              Translation[3];                         ///< The translation from the left camera to the right camera.
+        double              Essential[9];                           ///< The essential matrix.
+        double              Fundamental[9];                         ///< The fundamental matrix.
+        double              Rms;                                    ///< The RMS reprojection error of the stereo calibration, in pixels.
+        boost::int64_t      Date;                                   ///< The calibration date, in seconds since the epoch.
+    };
+#pragma pack(pop)
+
+    /// \brief The extension of the calibration cache files.
+    static char const* const PCC_CALIBRATION_EXTENSION = ".pccal";
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Keeps the calibrations of cameras and stereo pairs across sessions.
+    ///
+    /// Camera records are keyed by camera GUID and stereo records by the GUIDs of both cameras, in order. The cache is
+    /// stored as a small header followed by the two record arrays, so loading it takes two reads and no parsing.
+    /// Saving writes a temporary file first and renames it over the previous cache, so an interrupted save never
+    /// leaves a truncated cache behind.
+    ///
+    /// The cache is not thread-safe; its owner is expected to lock it.
+    class PcCalibrationCache
+    {
+    public:
+        /// \brief Default constructor. Creates an empty cache.
+        PCCORE_EXPORT PcCalibrationCache ();
+
+        /// \brief Replaces the cache contents with the contents of a file.
+        /// \param [in] iPath       the path of the cache file
+        /// \return true upon success, false if the file is missing or invalid, in which case the cache is unchanged
+        PCCORE_EXPORT bool Load ( std::string const& iPath );
+
+        /// \brief Writes the cache contents to a file.
+        /// \param [in] iPath       the path of the cache file
+        /// \return true upon success, false otherwise
+        PCCORE_EXPORT bool Save ( std::string const& iPath ) const;
+
+        /// \brief Looks for the calibration of a camera.
+        /// \param [in]  iCameraId  the camera GUID
+        /// \param [out] oRecord    the cached calibration
+        /// \return true if the camera is in the cache
+        PCCORE_EXPORT bool FindCamera ( std::string const& iCameraId, PcCameraRecord& oRecord ) const;
+
+        /// \brief Adds the calibration of a camera, replacing any previous one.
+        /// \param [in] iRecord     the calibration to be cached
+        PCCORE_EXPORT void StoreCamera ( PcCameraRecord const& iRecord );
+
+        /// \brief Looks for the calibration of a stereo pair.
+        /// \param [in]  iLeftId    the GUID of the left camera
+        /// \param [in]  iRightId   the GUID of the right camera
+        /// \param [out] oRecord    the cached calibration
+        /// \return true if the pair is in the cache
+        PCCORE_EXPORT bool FindStereo ( std::string const& iLeftId, std::string const& iRightId, PcStereoRecord& oRecord ) const;
+
+        /// \brief Adds the calibration of a stereo pair, replacing any previous one.
+        /// \param [in] iRecord     the calibration to be cached
+        PCCORE_EXPORT void StoreStereo ( PcStereoRecord const& iRecord );
+
+        /// \brief Identifies a rig from the GUIDs of its cameras, in any order.
+        /// \param [in] iCameraIds  the GUIDs of the rig cameras
+        /// \return a 64-bit hash of the sorted GUIDs, never 0
+        PCCORE_EXPORT static boost::uint64_t RigKey ( VEC(std::string) const& iCameraIds );
+
+        /// \brief Copies a GUID into a record field, truncating it if needed.
+        /// \param [in]  iId        the GUID
+        /// \param [out] oField     the record field, PCC_CACHE_ID_LENGTH characters long
+        PCCORE_EXPORT static void WriteId ( std::string const& iId, char* oField );
+
+        /// \brief Copies a matrix into a record field.
+        /// \param [in]  iMatrix    the matrix, of any floating-point type
+        /// \param [in]  iCount     the number of elements of the field
+        /// \param [out] oField     the record field
+        /// \return true if the matrix holds exactly iCount elements, false otherwise, in which case the field is zeroed
+        PCCORE_EXPORT static bool WriteMatrix ( cv::Mat const& iMatrix, size_t const& iCount, double* oField );
+
+        /// \brief Creates a matrix from a record field.
+        /// \param [in] iField      the record field
+        /// \param [in] iRows       the number of matrix rows
+        /// \param [in] iCols       the number of matrix columns
+        /// \return a new CV_64F matrix holding a copy of the field
+        PCCORE_EXPORT static cv::Mat ReadMatrix ( double const* iField, int const& iRows, int const& iCols );
+
+    private:
+        VEC(PcCameraRecord)             m_cameras;      ///< The camera records.
+        VEC(PcStereoRecord)             m_stereo;       ///< The stereo pair records.
+    };
+}
+
+#endif // PCCALIBRATIONCACHE_H
@@ -0,0 +1,139 @@
+#ifndef PCCALIBRATIONCAPTURE_H
+#define PCCALIBRATIONCAPTURE_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+#include "PcCamera.h"
+#include "PcFrame.h"
+#include "PcRecordingIndex.h"
+
+#include <opencv2/opencv.hpp>
+
+#define BOOST_ALL_DYN_LINK
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <deque>
+#include <vector>
+
+namespace pcc
+{
+    /// \ingroup PCCORE
+    ///
+    /// \brief Gathers the calibration frames of the acquiring cameras into synchronised frame sets.
+    ///
+    /// Cameras picking their calibration frames on their own would see the board at different instants, so their views
+    /// couldn't be used together for the extrinsics. The capture rather works on frame sets:
+    ///     - A set is opened by the first frame of a camera that wants a view (see PcCamera::WantsCalibrationView), and
+    ///       takes the frame of every other camera within a timestamp tolerance of it, whether the camera wants a view
+    ///       or not. It is closed by the first frame past the tolerance, which may open the next set.
+    ///     - Closed sets wait in a bounded queue, PcCalibrationHelper::FrameQueueCapacity sets long, and the set that
+    ///       doesn't fit is dropped according to PcCalibrationHelper::FrameDropPolicy. The frames are copied into the
+    ///       buffers of the sets processed before, so that the memory held by the capture is fixed.
+    ///     - Closing a set schedules a drain task unless one is already scheduled or running. The task searches the
+    ///       target in every frame of a set at once, one camera per thread, with the detector of each camera (see
+    ///       PcCamera::ProcessCalibrationFrame), which keeps its frame as an intrinsic view if it is due.
+    ///     - The sets where at least two cameras found the target are handed to the rig calibrator, if any, with the
+    ///       instant of the set as their common timestamp, and kept by every camera that found the target as a shared
+    ///       view for the stereo calibration (see PcCamera::AddSharedCalibrationView). The others only served the
+    ///       intrinsics.
+    ///
+    /// Every method may be called from any thread.
+    class PcCalibrationCapture
+    {
+    public:
+        /// \brief Constructor.
+        /// \param [in] iTolerance      the maximum difference between the timestamps of the frames of a set
+        PCCORE_EXPORT explicit PcCalibrationCapture ( boost::uint64_t const& iTolerance = PCC_FRAME_SET_TOLERANCE );
+
+        /// \brief Destructor. Waits for the drain task in flight.
+        PCCORE_EXPORT ~PcCalibrationCapture ();
+
+        /// \brief Offers a frame of an acquiring camera to the capture. Thread-safe.
+        ///
+        /// The frame is copied if it belongs to a set, and ignored otherwise, so the caller may reuse it at once.
+        ///
+        /// \param [in] iCamera         the camera that took the frame
+        /// \param [in] iFrame          the frame
+        PCCORE_EXPORT void PushFrame ( PcCameraPtr const& iCamera, PcFramePtr const& iFrame );
+
+        /// \brief Drops the open set and the queued ones, and resets the counters. Thread-safe.
+        ///
+        /// Doesn't wait for the set being processed, whose views are dropped by the cameras whose calibration restarted.
+        PCCORE_EXPORT void Clear ();
+
+        /// \brief Gets the number of sets processed since the last Clear. Thread-safe.
+        /// \return the number of processed sets
+        PCCORE_EXPORT boost::uint64_t GetSetCount ();
+
+        /// \brief Gets the number of processed sets where at least two cameras found the target. Thread-safe.
+        /// \return the number of shared sets
+        PCCORE_EXPORT boost::uint64_t GetSharedSetCount ();
+
+        /// \brief Gets the number of sets dropped because the queue was full. Thread-safe.
+        /// \return the number of dropped sets
+        PCCORE_EXPORT boost::uint64_t GetDroppedSets ();
+
+    private:
+        /// \brief The frames of the cameras at one instant. Kept for reuse once processed.
+        struct FrameSet
+        {
+            boost::uint64_t             Id;             ///< The number of the set, increasing from 1.
+            boost::uint64_t             Timestamp;      ///< The timestamp of the frame that opened the set.
+            size_t                      Size;           ///< The number of frames in the set; the buffers past it are free.
+            VEC(PcCameraPtr)            Cameras;        ///< The camera of every frame.
+            VEC(cv::Mat)                Images;         ///< The frames, in the same order.
+            VEC(boost::uint64_t)        Timestamps;     ///< The camera timestamp of every frame.
+            VEC(boost::uint64_t)        FrameIds;       ///< The camera frame ID of every frame.
+        };
+
+        typedef boost::shared_ptr<FrameSet> FrameSetPtr;    ///< A reference-counted pointer to a FrameSet.
+
+        /// \brief Private copy constructor.
+        ///
+        /// Disables copy of PcCalibrationCapture objects.
+        /// \param [in] iOther      the object to be copied
+        PcCalibrationCapture ( PcCalibrationCapture const& iOther ) {}
+
+        /// \brief Private assignment operator.
+        ///
+        /// Disables assignment of PcCalibrationCapture objects.
+        /// \param [in] iOther      the object to be assigned to this object.
+        /// \return this object, unchanged
+        PcCalibrationCapture& operator= ( PcCalibrationCapture const& iOther ) { return (*this); }
+
+        /// \brief Queues the open set, dropping a set if the queue is full. m_mutex must be held.
+        /// \return true if a drain task must be scheduled
+        bool CloseSet ();
+
+        /// \brief Releases the cameras of a set and returns it to the pool. m_mutex must be held.
+        /// \param [in] iSet            the set, which mustn't be queued anymore
+        void Recycle ( FrameSetPtr const& iSet );
+
+        /// \brief Processes the queued sets until the queue is empty. Runs as a PcThreadPool task.
+        void Drain ();
+
+        /// \brief Processes the frame of one camera of a set. Runs as a PcThreadPool::ParallelFor body.
+        /// \param [in]  iSet           the set
+        /// \param [out] oCorners       the detected target points of every frame of the set
+        /// \param [out] oIsFound       whether the target was found, for every frame of the set
+        /// \param [in]  iFrame         the index of the frame in the set
+        static void ProcessFrame ( FrameSet const* iSet, VECOFVECS(cv::Point2f)* oCorners, VEC(unsigned char)* oIsFound, size_t const& iFrame );
+
+    private:
+        boost::uint64_t                 m_tolerance;        ///< The timestamp tolerance of a set.
+        boost::mutex                    m_mutex;            ///< Locks the sets and the counters.
+        boost::condition_variable       m_idle;             ///< Signalled when the drain task returns.
+        bool                            m_isDraining;       ///< Whether a drain task is scheduled or running.
+        FrameSetPtr                     m_current;          ///< The open set, null if none.
+        std::deque<FrameSetPtr>         m_pending;          ///< The closed sets waiting to be processed.
+        VEC(FrameSetPtr)                m_free;             ///< The sets whose buffers are free for reuse.
+        boost::uint64_t                 m_nextId;           ///< The number of the next set.
+        boost::uint64_t                 m_setCount;         ///< The number of sets processed since the last Clear.
+        boost::uint64_t                 m_sharedSetCount;   ///< The number of processed sets where at least two cameras found the target.
+        boost::uint64_t                 m_droppedSets;      ///< The number of sets dropped since the last Clear.
+    };
+}
+
+#endif // PCCALIBRATIONCAPTURE_H
@@ -1,14 +1,25 @@
 #ifndef PCCALIBRATIONHELPER_H
 #define PCCALIBRATIONHELPER_H
 
+#include "PcExport.h"
 #include "PcCommon.h"
 
-#include "PcChessboard.h"
+#include "PcCalibrationTarget.h"
+#include "PcDebugImageExporter.h"
+#include "PcDriftMonitor.h"
+#include "PcRigCalibrator.h"
+#include "PcWandCalibrator.h"
 
 #include <opencv2/calib3d/calib3d.hpp>
 
 namespace pcc
 {
+    /// \brief Tells which frame set a full calibration queue gives up when a new one is closed.
+    enum PcDropPolicy {
+        PCC_DROP_OLDEST =   0x00,   ///< The oldest queued set is dropped, so the queue always holds the latest sets.
+        PCC_DROP_NEWEST =   0x01,   ///< The new set is dropped, so queued sets are never lost.
+    };
+
     /// \class      PcCalibrationHelper
     ///
     /// \ingroup    PCCORE
@@ -32,13 +43,14 @@ namespace pcc
         /// Allocates a new instance upon first invocation.
         /// 
         /// \return The singleton instance of PcCalibrationHelper
-        static PcCalibrationHelper& GetInstance ();
+        PCCORE_EXPORT static PcCalibrationHelper& GetInstance ();
 
         /// \brief  Destroys the currently allocated singleton instance of PcCalibrationHelper.
         static void DestroyInstance ();
 
-        /// \brief  Gets the capture delay between two consecutive calibration frames.
+        /// \brief  Gets the minimum delay between the camera timestamps of two consecutive calibration views.
         ///
+        /// Frames within the delay of the last accepted view are rejected before detection.
         /// \return A constant reference to an unsigned int variable
         inline unsigned int const& FrameDelay () const { return m_frameDelay; }
 
@@ -47,19 +59,198 @@ namespace pcc
         /// \return A constant reference to an unsigned int variable
         inline unsigned int const& FrameCount () const { return m_frameCount; }
 
-        /// \brief  Gets a vector of point sets describing the chessboard to be detected within each frame.
+        /// \brief  Tells whether the intrinsics are re-estimated after every accepted view.
+        ///
+        /// In incremental mode, each new view triggers a solve warm-started from the previous estimate, and the
+        /// acquisition stops early once the intrinsics have converged (see ConvergenceThreshold).
+        /// Otherwise, a single solve runs once FrameCount () views have been collected.
+        ///
+        /// \return A constant reference to a bool variable
+        inline bool const& IsIncremental () const { return m_isIncremental; }
+
+        /// \brief  Gets the number of views collected before the first incremental solve.
+        ///
+        /// \return A constant reference to an unsigned int variable
+        inline unsigned int const& MinimumViews () const { return m_minimumViews; }
+
+        /// \brief  Gets the standard deviation below which the focal lengths and principal point are considered converged.
+        ///
+        /// \return A constant reference to a double variable, in pixels
+        inline double const& ConvergenceThreshold () const { return m_convergenceThreshold; }
+
+        /// \brief  Sets the incremental calibration configuration.
+        ///
+        /// \param [in] iIncremental    whether to re-estimate the intrinsics after every accepted view
+        /// \param [in] iMinimumViews   the number of views collected before the first incremental solve
+        /// \param [in] iThreshold      the standard deviation of fx, fy, cx and cy below which the acquisition stops, in pixels
+        inline void SetIncremental ( bool const& iIncremental, unsigned int const& iMinimumViews, double const& iThreshold )
+        {
+            m_isIncremental = iIncremental;
+            m_minimumViews = iMinimumViews;
+            m_convergenceThreshold = iThreshold;
+        }
+
+        /// \brief  Tells whether the calibration only keeps the views that improve its pose coverage (see PcViewSelector).
+        ///
+        /// \return A constant reference to a bool variable
+        inline bool const& SelectsViews () const { return m_selectsViews; }
+
+        /// \brief  Sets whether the calibration only keeps the views that improve its pose coverage.
+        ///
+        /// \param [in] iSelect     false to keep every view where the chessboard is found
+        inline void SetViewSelection ( bool const& iSelect ) { m_selectsViews = iSelect; }
+
+        /// \brief  Gets the sharpness below which candidate frames are rejected before detection (see PcSharpness).
+        ///
+        /// \return A constant reference to a double variable, in squared intensity levels, 0 to accept every frame
+        inline double const& MinimumSharpness () const { return m_minimumSharpness; }
+
+        /// \brief  Sets the sharpness below which candidate frames are rejected before detection.
         ///
-        /// Assumes the chessboard is the same for all of the calibration frames, but since OpenCV won't 
-        /// account for this use case, multiple copies of the same chessboard are added to the list for 
+        /// \param [in] iSharpness  the minimum variance of the frame Laplacian, 0 to accept every frame
+        inline void SetMinimumSharpness ( double const& iSharpness ) { m_minimumSharpness = iSharpness; }
+
+        /// \brief  Gets the maximum number of synchronised frame sets queued, waiting for chessboard detection.
+        ///
+        /// The PcCalibrationCapture keeps at most FrameQueueCapacity () + 2 frame buffers per camera during calibration.
+        ///
+        /// \return A constant reference to an unsigned int variable
+        inline unsigned int const& FrameQueueCapacity () const { return m_frameQueueCapacity; }
+
+        /// \brief  Gets the frame set dropped when a set is closed on a full calibration queue.
+        ///
+        /// \return A constant reference to a PcDropPolicy variable
+        inline PcDropPolicy const& FrameDropPolicy () const { return m_frameDropPolicy; }
+
+        /// \brief  Gets the maximum width of the thumbnails kept for every accepted calibration view.
+        ///
+        /// \return A constant reference to an unsigned int variable, 0 if no thumbnail is kept
+        inline unsigned int const& ThumbnailWidth () const { return m_thumbnailWidth; }
+
+        /// \brief  Sets the maximum width of the thumbnails kept for every accepted calibration view.
+        ///
+        /// \param [in] iWidth      the maximum thumbnail width in pixels, 0 to keep no thumbnail
+        inline void SetThumbnailWidth ( unsigned int const& iWidth ) { m_thumbnailWidth = iWidth; }
+
+        /// \brief  Sets the calibration frame queue configuration, applied to the frame sets closed afterwards.
+        ///
+        /// \param [in] iCapacity   the maximum number of frame sets queued
+        /// \param [in] iPolicy     the frame set dropped when the queue is full
+        inline void SetFrameQueue ( unsigned int const& iCapacity, PcDropPolicy const& iPolicy )
+        {
+            m_frameQueueCapacity = iCapacity;
+            m_frameDropPolicy = iPolicy;
+        }
+
+        /// \brief  Gets the path of the calibration cache (see PcCalibrationCache).
+        ///
+        /// \return A constant reference to a string, empty if calibrations aren't cached
+        inline std::string const& CachePath () const { return m_cachePath; }
+
+        /// \brief  Sets the path of the calibration cache, read when the PcSystem is set up.
+        ///
+        /// \param [in] iPath       the path of the cache file, empty to disable the cache
+        inline void SetCachePath ( std::string const& iPath ) { m_cachePath = iPath; }
+
+        /// \brief  Gets a vector of point sets describing the target to be detected within each frame.
+        ///
+        /// Assumes the target is the same for all of the calibration frames, but since OpenCV won't 
+        /// account for this use case, multiple copies of the same target are added to the list for 
         /// every frame.
         /// 
         /// \return A vector of vectors of cv::Point3f values
-        VECOFVECS(cv::Point3f) GetChessboardPoints ();
+        PCCORE_EXPORT VECOFVECS(cv::Point3f) GetTargetPoints () const;
+
+        /// \brief  Gets a vector of point sets describing the target, for a given number of views.
+        ///
+        /// \param [in] iViewCount  the number of views
+        /// 
+        /// \return A vector of vectors of cv::Point3f values
+        PCCORE_EXPORT VECOFVECS(cv::Point3f) GetTargetPoints ( unsigned int const& iViewCount ) const;
+
+        /// \brief  Gets the calibration target's dimensions.
+        ///
+        /// \return A cv::Size instance holding the number of target points per row and column.
+        inline cv::Size GetTargetSize () const { return GetTarget ()->GetSize (); }
+
+        /// \brief  Gets the calibration target. Safe to call from any thread.
+        ///
+        /// \return The target, a 7x10 chessboard with 10 unit squares by default
+        inline PcCalibrationTargetPtr GetTarget () const { return boost::atomic_load ( &m_target ); }
+
+        /// \brief  Sets the calibration target.
+        ///
+        /// Camera calibrations keep the target they were started with, so the new target is used from the next
+        /// PcCamera::StartCalibration on.
+        ///
+        /// \param [in] iTarget     the calibration target
+        inline void SetTarget ( PcCalibrationTarget const& iTarget ) { boost::atomic_store ( &m_target, PcCalibrationTargetPtr ( new PcCalibrationTarget ( iTarget ) ) ); }
+
+        /// \brief  Starts exporting the calibration frames, with their detected chessboard corners.
+        ///
+        /// Creates a PcDebugImageExporter that the calibration of every camera hands its accepted frames to.
+        /// Any export in progress is stopped first. Calibration frames aren't exported unless this is called.
+        ///
+        /// \param [in] iDirectory  the directory the images are exported to
+        /// \param [in] iFormat     the file format of the images
+        PCCORE_EXPORT void StartImageExport ( std::string const& iDirectory, PcImageExportFormat const& iFormat = PCC_EXPORT_PNG );
+
+        /// \brief  Stops exporting calibration frames.
+        ///
+        /// Blocks until every queued image has been written, unless a calibration task still holds the exporter.
+        PCCORE_EXPORT void StopImageExport ();
+
+        /// \brief  Gets the calibration frame exporter. Safe to call from any thread.
+        ///
+        /// \return The exporter, null if calibration frames aren't being exported
+        inline PcDebugImageExporterPtr GetImageExporter () const { return boost::atomic_load ( &m_imageExporter ); }
+
+        /// \brief  Starts collecting the chessboard observations of every camera for the rig calibration.
+        ///
+        /// Creates a PcRigCalibrator that the calibration of every camera hands its detected chessboards to, replacing
+        /// any previous one. The observations are then solved by PcSystem::CalibrateRig.
+        PCCORE_EXPORT void StartRigCalibration ();
+
+        /// \brief  Stops collecting chessboard observations for the rig calibration, and drops those collected so far.
+        PCCORE_EXPORT void StopRigCalibration ();
+
+        /// \brief  Gets the rig calibrator. Safe to call from any thread.
+        ///
+        /// \return The rig calibrator, null if observations aren't being collected
+        inline PcRigCalibratorPtr GetRigCalibrator () const { return boost::atomic_load ( &m_rigCalibrator ); }
+
+        /// \brief  Starts collecting wand observations for the wand calibration of the capture volume.
+        ///
+        /// Creates a PcWandCalibrator that every camera frame is pushed to, replacing any previous one. The
+        /// observations are solved by PcSystem::CalibrateWand, and again by PcSystem::UpdateCameras as they accumulate.
+        ///
+        /// \param [in] iMarkerPositions   the distance of every wand marker from the first one, in world units
+        PCCORE_EXPORT void StartWandCalibration ( VEC(double) const& iMarkerPositions );
+
+        /// \brief  Stops collecting wand observations, and drops those collected so far.
+        PCCORE_EXPORT void StopWandCalibration ();
+
+        /// \brief  Gets the wand calibrator. Safe to call from any thread.
+        ///
+        /// \return The wand calibrator, null if wand observations aren't being collected
+        inline PcWandCalibratorPtr GetWandCalibrator () const { return boost::atomic_load ( &m_wandCalibrator ); }
+
+        /// \brief  Starts watching the calibrations of the cameras for drift while they stream.
+        ///
+        /// Creates a PcDriftMonitor that every camera frame is pushed to, replacing any previous one. It searches the
+        /// current calibration target, and PcSystem::UpdateCameras keeps it up to date with the calibration and rig pose
+        /// of every camera, and reports the cameras that drifted.
+        ///
+        /// \param [in] iBudget    the fraction of a processor core the monitor may use on average
+        PCCORE_EXPORT void StartDriftMonitor ( double const& iBudget = 0.02 );
+
+        /// \brief  Stops watching the calibrations for drift.
+        PCCORE_EXPORT void StopDriftMonitor ();
 
-        /// \brief  Gets the calibration chessboard's inner dimensions.
+        /// \brief  Gets the calibration drift monitor. Safe to call from any thread.
         ///
-        /// \return A cv::Size instance describing the chessboard dimensions.
-        inline cv::Size const& GetChessboardSize () { return sm_chessboard.GetSize(); }
+        /// \return The drift monitor, null if the calibrations aren't being watched
+        inline PcDriftMonitorPtr GetDriftMonitor () const { return boost::atomic_load ( &m_driftMonitor ); }
 
     private:
 
@@ -88,10 +279,23 @@ namespace pcc
 
     private:
         static PcCalibrationHelper*             sm_pInstance;   ///< The singleton instance of the calibration helper.
-        static PcChessboard                     sm_chessboard;  ///< The chessboard descriptor to be used during the calibration process.
 
-        unsigned int                            m_frameDelay;   ///< The delay in ms between consecutive frame captures. Defaults to 1000ms.
+        unsigned int                            m_frameDelay;   ///< The minimum delay in ms between consecutive calibration views. Defaults to 1000ms.
         unsigned int                            m_frameCount;   ///< The number of frames to be used for calibration. Defaults to 15.
+        bool                                    m_isIncremental;        ///< Whether the intrinsics are re-estimated after every view. Defaults to true.
+        unsigned int                            m_minimumViews;         ///< The number of views before the first incremental solve. Defaults to 4.
+        double                                  m_convergenceThreshold; ///< The convergence threshold of the incremental calibration. Defaults to 1 pixel.
+        bool                                    m_selectsViews;         ///< Whether views are selected for their pose coverage. Defaults to true.
+        double                                  m_minimumSharpness;     ///< The sharpness below which frames are rejected. Defaults to 50.
+        unsigned int                            m_frameQueueCapacity;   ///< The maximum number of queued candidate frame sets. Defaults to 4.
+        PcDropPolicy                            m_frameDropPolicy;      ///< The frame dropped when the queue is full. Defaults to PCC_DROP_OLDEST.
+        unsigned int                            m_thumbnailWidth;       ///< The maximum width of the view thumbnails, 0 for none. Defaults to 160.
+        std::string                             m_cachePath;            ///< The path of the calibration cache. Defaults to "calibration.pccal".
+        PcDebugImageExporterPtr                 m_imageExporter;    ///< The calibration frame exporter, null by default. Accessed atomically.
+        PcRigCalibratorPtr                      m_rigCalibrator;    ///< The rig calibrator, null by default. Accessed atomically.
+        PcWandCalibratorPtr                     m_wandCalibrator;   ///< The wand calibrator, null by default. Accessed atomically.
+        PcDriftMonitorPtr                       m_driftMonitor;     ///< The calibration drift monitor, null by default. Accessed atomically.
+        PcCalibrationTargetPtr                  m_target;           ///< The calibration target. Accessed atomically.
     };
 }
 
@@ -0,0 +1,81 @@
+#ifndef PCCALIBRATIONMATH_H
+#define PCCALIBRATIONMATH_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+
+namespace pcc
+{
+    /// \ingroup PCCORE
+    ///
+    /// \brief Estimates the standard deviations of the intrinsic parameters of a camera calibration.
+    ///
+    /// OpenCV 2.4 doesn't report how well the calibration views constrain the solution, so this is computed
+    /// from the reprojection Jacobians of the solution: for each view, the Jacobian is split between the intrinsic
+    /// parameters and the view's pose, and the pose is marginalised out with a Schur complement. The resulting
+    /// information matrix, scaled by the residual variance, is inverted into the covariance of the intrinsics.
+    ///
+    /// \param [in]  iObjectPoints  the chessboard points of each view, as passed to cv::calibrateCamera
+    /// \param [in]  iImagePoints   the detected chessboard corners of each view, as passed to cv::calibrateCamera
+    /// \param [in]  iRvecs         the rotation of each view, as returned by cv::calibrateCamera
+    /// \param [in]  iTvecs         the translation of each view, as returned by cv::calibrateCamera
+    /// \param [in]  iCameraMatrix  the calibrated camera matrix
+    /// \param [in]  iDistCoeffs    the calibrated distortion coefficients
+    /// \param [in]  iFlags         the flags the calibration was run with, telling which parameters were held fixed
+    /// \param [out] oDeviations    the standard deviations of fx, fy, cx, cy and of the distortion coefficients, in this
+    ///                             order, as a row of doubles; 0 for the parameters held fixed
+    /// \return true upon success, false if there are too few observations or the parameters are not constrained
+    PCCORE_EXPORT bool PcIntrinsicDeviations (
+        cv::InputArrayOfArrays      iObjectPoints,
+        cv::InputArrayOfArrays      iImagePoints,
+        VEC(cv::Mat) const&         iRvecs,
+        VEC(cv::Mat) const&         iTvecs,
+        cv::Mat const&              iCameraMatrix,
+        cv::Mat const&              iDistCoeffs,
+        int const&                  iFlags,
+        cv::Mat&                    oDeviations
+    );
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Calibrates the intrinsics of a camera, the way every calibration path of the library does.
+    ///
+    /// Solves the intrinsics with the higher-order radial coefficients k4 to k6 held fixed, with PcSolveIntrinsics for
+    /// planar targets and cv::calibrateCamera otherwise, then estimates the standard deviations of the solution with
+    /// PcIntrinsicDeviations.
+    ///
+    /// \param [in]    iObjectPoints   the target points of each view
+    /// \param [in]    iImagePoints    the detected target points of each view
+    /// \param [in]    iImageSize      the size of the frames, in pixels
+    /// \param [inout] ioCameraMatrix  the camera matrix, used as the initial estimate if iUseGuess is true
+    /// \param [inout] ioDistCoeffs    the distortion coefficients, used as the initial estimate if iUseGuess is true
+    /// \param [in]    iUseGuess       whether to start from the given intrinsics
+    /// \param [out]   oDeviations     the standard deviations of the intrinsics (see PcIntrinsicDeviations), empty if
+    ///                                 they couldn't be estimated
+    /// \return the RMS reprojection error, in pixels
+    PCCORE_EXPORT double PcCalibrateIntrinsics (
+        cv::InputArrayOfArrays      iObjectPoints,
+        cv::InputArrayOfArrays      iImagePoints,
+        cv::Size const&             iImageSize,
+        cv::Mat&                    ioCameraMatrix,
+        cv::Mat&                    ioDistCoeffs,
+        bool const&                 iUseGuess,
+        cv::Mat&                    oDeviations
+    );
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Triangulates a point seen by several cameras, with the linear (DLT) method.
+    ///
+    /// \param [in]  iProjections   the 3x4 matrix [ R | t ] of each camera, as doubles
+    /// \param [in]  iPoints        the undistorted, normalised image coordinates of the point in each camera
+    /// \param [out] oPoint         the point
+    /// \return true if the point lies in front of every camera, false otherwise
+    PCCORE_EXPORT bool PcTriangulate ( VEC(cv::Mat) const& iProjections, VEC(cv::Point2f) const& iPoints, cv::Point3d& oPoint );
+}
+
+#endif // PCCALIBRATIONMATH_H
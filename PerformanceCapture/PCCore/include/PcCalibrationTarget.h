@@ -0,0 +1,79 @@
+#ifndef PCCALIBRATIONTARGET_H
+#define PCCALIBRATIONTARGET_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+
+#include <opencv2/opencv.hpp>
+
+#define BOOST_ALL_DYN_LINK
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+
+namespace pcc
+{
+    /// \brief The kinds of calibration targets.
+    enum PcTargetType
+    {
+        PCC_TARGET_CHESSBOARD,              ///< A chessboard, described by its inner corners (see PcChessboard).
+        PCC_TARGET_CIRCLES,                 ///< A symmetric grid of dark circles on a light background.
+        PCC_TARGET_ASYMMETRIC_CIRCLES       ///< An asymmetric grid of dark circles, every other row shifted by half a column.
+    };
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Describes the calibration target: its kind, its dimensions and the coordinates of its points.
+    ///
+    /// The points are the inner corners of a chessboard or the circle centres of a circle grid, in the order the
+    /// detector returns them (see PcTargetDetector). Chessboard points follow PcChessboard. Circle grid points follow
+    /// the OpenCV convention: a symmetric grid has its circles at ( column, row ) x spacing, and an asymmetric grid at
+    /// ( 2 column + row % 2, row ) x spacing, so the spacing of an asymmetric grid is half the distance between two
+    /// circles of the same row.
+    class PcCalibrationTarget
+    {
+    public:
+        /// \brief Constructor. Calculates the coordinates of every target point.
+        /// \param [in] iType       the kind of target
+        /// \param [in] iRows       the number of points in a column of the target
+        /// \param [in] iCols       the number of points in a row of the target
+        /// \param [in] iSpacing    the chessboard square size or the circle spacing, in a user-defined scale
+        PCCORE_EXPORT PcCalibrationTarget (
+            PcTargetType const&     iType,
+            unsigned int const&     iRows,
+            unsigned int const&     iCols,
+            float const&            iSpacing
+        );
+
+        /// \brief Gets the kind of target.
+        /// \return the target type
+        inline PcTargetType const& GetType () const { return m_type; }
+
+        /// \brief Gets the dimensions of the target.
+        /// \return the number of points per target row and column
+        inline cv::Size const& GetSize () const { return m_size; }
+
+        /// \brief Gets the chessboard square size or the circle spacing.
+        /// \return the spacing, in the user-defined scale
+        inline float const& GetSpacing () const { return m_spacing; }
+
+        /// \brief Gets the list of points in 3D space describing the target.
+        /// \return a vector containing all of the target points, in detection order
+        inline VEC(cv::Point3f) const& GetPoints () const { return m_points; }
+
+        /// \brief Creates an array with a given number of copies of the target points.
+        /// \param [in] iFrameCount     the number of copies needed (the size of the output array)
+        /// \return the array, to be used directly by the calibration method of the cameras
+        PCCORE_EXPORT VECOFVECS(cv::Point3f) CreateInputArray ( unsigned int const& iFrameCount ) const;
+
+    private:
+        PcTargetType                m_type;         ///< The kind of target.
+        cv::Size                    m_size;         ///< The number of points per target row and column.
+        float                       m_spacing;      ///< The chessboard square size or the circle spacing.
+        VEC(cv::Point3f)            m_points;       ///< The real-world coordinates of the target points.
+    };
+
+    typedef boost::shared_ptr<PcCalibrationTarget const> PcCalibrationTargetPtr;  ///< A reference-counted pointer to an immutable PcCalibrationTarget.
+}
+
+#endif // PCCALIBRATIONTARGET_H
@@ -5,6 +5,9 @@
 #include "PcCommon.h"
 
 #include "PcCameraCalibration.h"
+#include "PcCalibrationCache.h"
+#include "PcRemap.h"
+#include "PcPointUndistorter.h"
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/calib3d/calib3d.hpp>
@@ -111,13 +114,28 @@ namespace pcc
         /// Aborts the calibration process through the camera's PcCameraCalibration object.
         PCCORE_EXPORT void AbortCalibration ();
 
-        /// \brief Tries to register a new frame to be used on the calibration process.
+        /// \brief Tells whether a frame taken at a given time would be a candidate calibration view.
         ///
-        /// Tries to register a frame to be used on calibration, on the PcCameraCalibration member instance.
-        /// This method ensures the capture delay between two consecutive calibration frames.
+        /// See PcCameraCalibration::WantsView for more information.
+        /// \param [in] iTimestamp  the camera timestamp of the frame
+        /// \return true if the calibration is acquiring and the capture delay elapsed since the last view
+        PCCORE_EXPORT bool WantsCalibrationView ( boost::uint64_t const& iTimestamp );
+
+        /// \brief Searches the calibration target in a frame, and keeps it as a calibration view if it is due.
+        ///
+        /// See PcCameraCalibration::ProcessFrame for more information.
+        /// \param [in]  iView      the description of the frame
+        /// \param [in]  iFrame     the frame
+        /// \param [out] oCorners   the detected target points
+        /// \return true if the target was found
+        PCCORE_EXPORT bool ProcessCalibrationFrame ( PcCalibrationView const& iView, cv::Mat const& iFrame, VEC(cv::Point2f)& oCorners );
+
+        /// \brief Keeps the target points of a frame set where other cameras found the target as well.
         ///
-        /// \param [in] iFrame      the frame to be queued for calibration
-        PCCORE_EXPORT void TryPushFrame ( PcFramePtr const& iFrame );
+        /// See PcCameraCalibration::AddSharedView for more information.
+        /// \param [in] iView       the description of the frame
+        /// \param [in] iCorners    the detected target points
+        PCCORE_EXPORT void AddSharedCalibrationView ( PcCalibrationView const& iView, VEC(cv::Point2f) const& iCorners );
         
         /// \brief Reads the current state of the calibration process.
         /// \return the current calibration state
@@ -128,6 +146,30 @@ namespace pcc
         /// \return a double in the interval [0,1] representing the progress of the calibration
         PCCORE_EXPORT double GetCalibrationProgress () const;
 
+        /// \brief Gets the reprojection error of the latest intrinsic solve.
+        ///
+        /// See PcCameraCalibration::GetCalibrationRms for more information.
+        /// \return the RMS reprojection error in pixels, negative if no solve completed yet
+        PCCORE_EXPORT double GetCalibrationRms () const;
+
+        /// \brief Gets the sharpness of the latest candidate calibration frame.
+        ///
+        /// See PcCameraCalibration::GetSharpness for more information.
+        /// \return the variance of the frame Laplacian, negative if unknown
+        PCCORE_EXPORT double GetCalibrationSharpness () const;
+
+        /// \brief Gets the filled fraction of the calibration view coverage map.
+        ///
+        /// See PcCameraCalibration::GetCoverage for more information.
+        /// \return a double in the interval [0,1]
+        PCCORE_EXPORT double GetCalibrationCoverage () const;
+
+        /// \brief Tells the operator which calibration views are still missing.
+        ///
+        /// See PcCameraCalibration::GetGuidance for more information.
+        /// \return a short instruction, empty if there is none
+        PCCORE_EXPORT std::string GetCalibrationGuidance () const;
+
         /// \brief Gets the list of detected chessboard corners in each calibration frame.
         ///
         /// See PcCameraCalibration::GetChessboardCorners for more information.
@@ -135,16 +177,112 @@ namespace pcc
         /// \return a vector of vectors of transformed chessboard point's coordinates
         PCCORE_EXPORT VECOFVECS(cv::Point2f) const& GetChessboardCorners () const;
 
+        /// \brief Gets the descriptions of the calibration views accepted so far.
+        ///
+        /// See PcCameraCalibration::GetViews for more information.
+        ///
+        /// \return a list of views, in the same order as the chessboard corners
+        PCCORE_EXPORT VEC(PcCalibrationView) GetCalibrationViews () const;
+
+        /// \brief Gets copies of the calibration views accepted so far and of their detected points.
+        ///
+        /// See PcCameraCalibration::GetObservations for more information. Must not be called from a calibration
+        /// callback, which runs with the calibration locked.
+        ///
+        /// \param [out] oViews     the views
+        /// \param [out] oCorners   the detected points of every view, in the same order
+        PCCORE_EXPORT void GetCalibrationObservations ( VEC(PcCalibrationView)& oViews, VECOFVECS(cv::Point2f)& oCorners ) const;
+
+        /// \brief Gets copies of the calibration views shared with other cameras and of their detected points.
+        ///
+        /// See PcCameraCalibration::GetSharedObservations for more information. Must not be called from a calibration
+        /// callback, which runs with the calibration locked.
+        ///
+        /// \param [out] oViews     the views, in increasing set order
+        /// \param [out] oCorners   the detected points of every view, in the same order
+        PCCORE_EXPORT void GetSharedCalibrationObservations ( VEC(PcCalibrationView)& oViews, VECOFVECS(cv::Point2f)& oCorners ) const;
+
         /// \brief Actually launches the camera calibration process.
         ///
         /// Calls the corresponding OpenCV function to calculate the intrinsic calibration matrix and the distortion coefficient, from
         /// a set of chessboard descriptors and their detected projections on the calibration frames.
+        /// Also estimates the standard deviations of the intrinsic parameters (see PcIntrinsicDeviations).
+        ///
         /// \param [in] iChessboardPoints           a list of lists of points in 3D space describing the chessboards detected in each calibration frame
         /// \param [in] iDetectedChessboardPoints   a list of lists of the detected chessboard points in each calibration image
         /// \param [in] iImageSize                  the dimensions of the image where the chessboards were detected, in pixels
+        /// \param [in] iUseGuess                   whether to start from the current intrinsic parameters, which must come from a previous calibration
         /// \return the average reprojection error over all images. The reprojection error is the error between the projection of the chessboard points
         ///         using the calculated matrix and the detected points given as input.        
-        double DoCalibration ( cv::InputArrayOfArrays iChessboardPoints, cv::InputArrayOfArrays iDetectedChessboardPoints, cv::Size iImageSize );
+        double DoCalibration ( cv::InputArrayOfArrays iChessboardPoints, cv::InputArrayOfArrays iDetectedChessboardPoints, cv::Size iImageSize, bool const& iUseGuess = false );
+
+        /// \brief Describes the current calibration of the camera, for the calibration cache.
+        /// \param [out] oRecord    the record to be filled
+        PCCORE_EXPORT void GetCacheRecord ( PcCameraRecord& oRecord );
+
+        /// \brief Restores a cached calibration, so that the camera doesn't need to be calibrated again.
+        ///
+        /// The record is rejected if it was calibrated at a different resolution than the camera's current one, or if
+        /// its matrices aren't valid. Otherwise, the camera becomes CALIBRATED without notifying the calibration
+        /// callbacks, since there are no calibration views to calibrate stereo pairs from.
+        ///
+        /// \param [in] iRecord     the cached calibration
+        /// \return true if the calibration was restored, false otherwise
+        PCCORE_EXPORT bool RestoreCalibration ( PcCameraRecord const& iRecord );
+
+        /// \brief Sets the pose of the camera in a rig.
+        /// \param [in] iRigKey         the rig the pose belongs to (see PcCalibrationCache::RigKey)
+        /// \param [in] iRotation       the rotation from the rig frame to the camera frame, as a 3x3 matrix
+        /// \param [in] iTranslation    the translation from the rig frame to the camera frame, as a 3x1 matrix
+        PCCORE_EXPORT void SetRigPose ( boost::uint64_t const& iRigKey, cv::Mat const& iRotation, cv::Mat const& iTranslation );
+
+        /// \brief Gets the rig the camera pose belongs to (read-only).
+        /// \return the rig key, 0 if the camera has no rig pose
+        inline boost::uint64_t const& RigKey () const { return m_rigKey; }
+
+        /// \brief Gets the rotation from the rig frame to the camera frame (read-only).
+        /// \return a 3x3 matrix, empty if the camera has no rig pose
+        inline cv::Mat const& RigRotation () const { return m_rigRotation; }
+
+        /// \brief Gets the translation from the rig frame to the camera frame (read-only).
+        /// \return a 3x1 matrix, empty if the camera has no rig pose
+        inline cv::Mat const& RigTranslation () const { return m_rigTranslation; }
+
+        /// \brief Enables or disables the undistortion of the frames of the camera.
+        ///
+        /// The map is built, or dropped, by the next UpdateUndistortMap.
+        ///
+        /// \param [in] iEnable     true to undistort the frames once the camera is calibrated
+        inline void SetUndistortion ( bool const& iEnable ) { m_isUndistorting = iEnable; }
+
+        /// \brief Tells whether the frames of the camera are to be undistorted (read-only).
+        /// \return true if the undistortion is enabled
+        inline bool const& IsUndistorting () const { return m_isUndistorting; }
+
+        /// \brief Rebuilds the undistortion map if the intrinsics changed since it was built.
+        ///
+        /// Only builds a map for a calibrated camera, so the previous map keeps being used during a recalibration,
+        /// and is swapped for the new one at once. Must be called from the thread that starts the calibrations.
+        PCCORE_EXPORT void UpdateUndistortMap ();
+
+        /// \brief Gets the map that undistorts the frames of the camera (see PcRemap). Safe to call from any thread.
+        /// \return the map, null if the undistortion is disabled or the camera was never calibrated
+        inline PcRemapMapPtr GetUndistortMap () const { return boost::atomic_load ( &m_undistortMap ); }
+
+        /// \brief Rebuilds the point undistorter if the intrinsics changed since it was built.
+        ///
+        /// Like UpdateUndistortMap, only builds an undistorter for a calibrated camera. Must be called from the thread
+        /// that starts the calibrations.
+        PCCORE_EXPORT void UpdatePointUndistorter ();
+
+        /// \brief Gets the undistorter of the points detected in the frames of the camera, e.g. marker centroids.
+        /// Safe to call from any thread.
+        /// \return the undistorter, null if the camera was never calibrated
+        inline PcPointUndistorterPtr GetPointUndistorter () const { return boost::atomic_load ( &m_pointUndistorter ); }
+
+        /// \brief Gets the date of the current intrinsic calibration (read-only).
+        /// \return the calibration date in seconds since the epoch, 0 if the camera was never calibrated
+        inline boost::int64_t const& CalibrationDate () const { return m_calibrationDate; }
 
         /// \brief Gets the underlying camera's GUID (read-only).
         /// \return a constant string reference to the camera's GUID
@@ -166,6 +304,10 @@ namespace pcc
         /// \return a constant reference to the array of distortion coefficients
         inline cv::Mat const& DistCoeffs () const { return (m_distCoeffs); };
 
+        /// \brief Gets the standard deviations of the intrinsic parameters estimated by the last calibration (read-only).
+        /// \return a row of doubles holding the deviations of fx, fy, cx, cy and of the distortion coefficients, empty if unknown
+        inline cv::Mat const& IntrinsicDeviations () const { return (m_intrinsicDeviations); };
+
         /// \brief Gets the current PTP syncrhonisation status (read only)
         /// \return a constant string reference to the PTP synchronisation status. The string contains:
         ///             - "Off" if synchronisation process has not been started.
@@ -195,6 +337,15 @@ namespace pcc
         /// \return a cv::Size structure containing the frame's dimensions
         inline cv::Size const& GetFrameSize () { return m_frameSize; }
 
+        /// \brief Gets the frequency of the timestamp clock of the camera, read from the camera upon setup (read-only).
+        /// \return the number of timestamp ticks per second, 1 GHz if the camera doesn't report it
+        inline boost::uint64_t const& TimestampFrequency () const { return m_timestampFrequency; }
+
+        /// \brief Converts a timestamp of the camera to nanoseconds, so that timestamps compare across cameras.
+        /// \param [in] iTicks      the timestamp, in ticks of the camera clock
+        /// \return the timestamp, in nanoseconds
+        PCCORE_EXPORT boost::uint64_t ToNanoseconds ( boost::uint64_t const& iTicks ) const;
+
     private:
         //void Release ();
         //void DoCopy ( PcCamera const& iOther );
@@ -291,12 +442,22 @@ namespace pcc
         std::string                                     m_ptpStatus;        ///< The PTP synchronisation status.
 
         cv::Size                                        m_frameSize;        ///< The frame dimensions obtained from the camera.
+        boost::uint64_t                                 m_timestampFrequency;   ///< The frequency of the timestamp clock obtained from the camera.
 
         cv::Mat                                         m_cameraMatrix;     ///< The intrinsic camera matrix obtained from the calibration process.
         cv::Mat                                         m_distCoeffs;       ///< The distortion coefficients obtained from the calibration process.
+        cv::Mat                                         m_intrinsicDeviations;  ///< The standard deviations of the intrinsic parameters obtained from the calibration process.
+        boost::int64_t                                  m_calibrationDate;  ///< The date of the intrinsic calibration, in seconds since the epoch.
+        unsigned int                                    m_calibrationVersion;   ///< Counts the changes of the intrinsics.
+        bool                                            m_isUndistorting;   ///< Whether the frames are to be undistorted.
+        unsigned int                                    m_undistortVersion; ///< The intrinsics the undistortion map was built from.
+        PcRemapMapPtr                                   m_undistortMap;     ///< The undistortion map, null if none. Accessed atomically.
+        unsigned int                                    m_pointUndistorterVersion;  ///< The intrinsics the point undistorter was built from.
+        PcPointUndistorterPtr                           m_pointUndistorter; ///< The point undistorter, null if none. Accessed atomically.
+        boost::uint64_t                                 m_rigKey;           ///< The rig the camera pose belongs to, 0 if none.
+        cv::Mat                                         m_rigRotation;      ///< The rotation from the rig frame to the camera frame.
+        cv::Mat                                         m_rigTranslation;   ///< The translation from the rig frame to the camera frame.
         
-        unsigned int                                    m_frameCount;       ///< How many frames have been acquired since the beginning of the calibration process.
-        unsigned int                                    m_lastFrameCount;   ///< The value of the frame counter when the last valid calibration frame was added to the calibration frame queue.
         PcCameraCalibration*                            m_calibration;      ///< The calibrator instance for the camera.
     };
     
@@ -3,6 +3,8 @@
 
 #include "PcCommon.h"
 #include "PcFrame.h"
+#include "PcTargetDetector.h"
+#include "PcViewSelector.h"
 
 #define BOOST_ALL_DYN_LINK
 #include <boost/thread.hpp>
@@ -23,6 +25,20 @@ namespace pcc
         CALIBRATED  =   0x03,   ///< Calibration process completed
     };
 
+    /// \ingroup PCCORE
+    ///
+    /// \brief Describes a calibration view, i.e. a frame where the chessboard was found.
+    ///
+    /// The frame itself isn't kept, since calibration only needs the detected corners, which are stored separately
+    /// (see PcCameraCalibration::GetChessboardCorners).
+    struct PcCalibrationView
+    {
+        boost::uint64_t         Timestamp;      ///< The camera timestamp of the frame.
+        boost::uint64_t         FrameId;        ///< The camera frame ID of the frame.
+        boost::uint64_t         SetId;          ///< The synchronised frame set the frame belongs to (see PcCalibrationCapture).
+        cv::Mat                 Thumbnail;      ///< A downscaled copy of the frame for review, empty if thumbnails are disabled.
+    };
+
     /// \ingroup PCCORE
     ///
     /// \brief Performs the calibration process of a given camera.
@@ -39,22 +55,36 @@ namespace pcc
     /// a chessboard of known dimensions in front of the cameras, changing it's position and orientation
     /// continuously in time.
     ///
-    /// The calibration process is thread-safe and takes place on it's own independent thread.
+    /// The calibration process is thread-safe and runs as tasks on the shared PcThreadPool, so that calibrating many
+    /// cameras at once doesn't take one mostly idle thread per camera.
     ///
     /// Globally, the process works like this:
-    ///     - A frame queue is kept where the frame acquisition thread can register
-    ///       candidate frames to the calibration
-    ///     - The calibration thread periodically checks for a new frame on the queue and tries to find a chessboard
-    ///       on it. If it succeeds, it keeps that frame for usage on the actual calibration step, marks the position
-    ///       of the detected corners of the chessboard on the image and exports it to a file. If it fails, the frame is
-    ///       discarded.
-    ///     - Once a predetermined number of frames has been collected, the thread moves to the actual calibration phase,
-    ///       during which it will calculate all of the intrinsic parameters for the camera. After this step, the camera
-    ///       is considered as calibrated and the thread exits.
+    ///     - The frames are gathered by a PcCalibrationCapture into synchronised frame sets, so that the views of all the
+    ///       cameras are taken at the same instants. A set is opened by a camera that wants a view (see WantsView), i.e.
+    ///       whose last view was accepted at least PcCalibrationHelper::FrameDelay ago, so the views are spread in time
+    ///       without throttling the acquisition thread. Frames where no view was accepted don't start the interval, so
+    ///       the board is searched on every frame until found.
+    ///     - Every frame of a set is handed to ProcessFrame, from the capture task, one camera per thread. The frame is
+    ///       scored with PcSharpness, and frames below PcCalibrationHelper::MinimumSharpness are rejected, since
+    ///       motion-blurred boards are slow to search and degrade the solve.
+    ///     - ProcessFrame then tries to find the calibration target with a PcTargetDetector, set up for the target
+    ///       PcCalibrationHelper::GetTarget returned when the calibration started. If it succeeds and the interval
+    ///       elapsed, it keeps the detected corners for usage on the actual calibration step, along with a
+    ///       PcCalibrationView holding the frame metadata and an optional thumbnail, unless the PcViewSelector finds it
+    ///       adds nothing to the views collected so far (see PcCalibrationHelper::SelectsViews), and, if
+    ///       PcCalibrationHelper::StartImageExport was called, hands it to the PcDebugImageExporter together with the
+    ///       detected corners. If it fails, the frame is discarded.
+    ///     - The sets where at least two cameras found the target are also kept apart, as shared views (see
+    ///       AddSharedView), for the stereo calibration, whether or not they were accepted for the intrinsics.
+    ///     - In incremental mode (see PcCalibrationHelper::IsIncremental), every accepted view past a minimum count
+    ///       schedules a solve task, warm-started from the previous estimate. The acquisition stops as soon as the
+    ///       standard deviations of the focal lengths and principal point fall below a threshold.
+    ///     - Otherwise, or if the intrinsics didn't converge, the acquisition stops once a predetermined number of frames
+    ///       has been collected, and a final solve runs on all of them. After this step, the camera is considered as calibrated.
     class PcCameraCalibration {
     private:
-        typedef boost::thread                                                           ThreadType;         ///< The thread class to be used to manage the calibration thread.
         typedef boost::shared_mutex                                                     MutexType;          ///< The mutex type to be used to lock shared resources
+        typedef boost::unique_lock<MutexType>                                           LockType;           ///< The RAII lock guard used to wait for the calibration tasks
         typedef boost::upgrade_lock<MutexType>                                          UpgradeLockType;    ///< The RAII lock guard that allows to upgrade a shared mutex to unique mutex
         typedef boost::upgrade_to_unique_lock<MutexType>                                UniqueLockType;     ///< The RAII lock guard that actually upgrades a shared mutex to unique
         typedef boost::function3<void, PcCamera*, CalibrationState, CalibrationState>   CallbackFn;         ///< The functor type to represent state-change listener functions
@@ -69,7 +99,7 @@ namespace pcc
 
         /// \brief The destructor method.
         ///
-        /// Interrupts the calibration thread if there is one and deletes the memory used by the manager object of type ThreadType.
+        /// Aborts the calibration and waits for its task to return, if one is in flight.
         ~PcCameraCalibration ();
 
         /// \brief Starts the calibration process.
@@ -82,23 +112,38 @@ namespace pcc
         /// Internally locks the shared resources mutex and calls PcCameraCalibration::DoAbortCalibration.
         void AbortCalibration ();
 
-        /// \brief Processes the calibration frame queue on a separate thread.
+        /// \brief Marks the camera as calibrated from a cached calibration.
         ///
-        /// Loops while the calibration process is in the acquisition phase. On each iteration, performs the following actions:
-        ///     - Sleeps for a predefined amount of time to avoid using the processor while there aren't frames in the queue
-        ///     - Pop the front of the frame queue (if it's not empty)
-        ///     - Check if the frame contains a chessboard in it
-        ///     - If it does, push the list of coordinates of the corresponding chessboard on the frame image, marks them on the frame and exports it to a png file
-        /// 
-        /// Once the calibration has the required amount of frames, it passes to the actual calibration phase.
-        /// This phase calls the DoCalibration method on the parent PcCamera object, providing the detected corners information and the chessboard descriptors.
-        /// Once the calibration method finishes it's job, the thread empties the callback list and outputs
-        /// the calculated matrices on the screen. 
-        void Process ();
+        /// Doesn't notify the callbacks, since there are no views for them to work with.
+        ///
+        /// \param [in] iRms        the reprojection error of the cached calibration
+        /// \return true upon success, false if a calibration is in progress
+        bool RestoreCalibration ( double const& iRms );
 
-        /// \brief Pushes a frame into the calibration queue.
-        /// \param [in] iFrame      the frame to be put on the queue
-        void PushFrame ( PcFramePtr const& iFrame );
+        /// \brief Tells whether a frame taken at a given time would be a candidate view.
+        /// \param [in] iTimestamp  the camera timestamp of the frame
+        /// \return true if the calibration is acquiring and PcCalibrationHelper::FrameDelay elapsed since the last view
+        bool WantsView ( boost::uint64_t const& iTimestamp );
+
+        /// \brief Searches the calibration target in a frame, and keeps it as a view if it is due and adds to the others.
+        ///
+        /// Runs in the calling thread, which waits for it on abort. Must not be called for a second frame before it
+        /// returns. Frames too blurred (see PcCalibrationHelper::MinimumSharpness), or passed while the calibration
+        /// isn't acquiring, are ignored.
+        ///
+        /// \param [in]  iView      the description of the frame, without its thumbnail
+        /// \param [in]  iFrame     the frame
+        /// \param [out] oCorners   the detected target points
+        /// \return true if the target was found, whether or not the view was kept
+        bool ProcessFrame ( PcCalibrationView const& iView, cv::Mat const& iFrame, VEC(cv::Point2f)& oCorners );
+
+        /// \brief Keeps the target points of a frame set where other cameras found the target as well.
+        ///
+        /// Ignored unless the calibration is acquiring or solving the last views.
+        ///
+        /// \param [in] iView       the description of the frame, whose SetId identifies the set
+        /// \param [in] iCorners    the detected target points
+        void AddSharedView ( PcCalibrationView const& iView, VEC(cv::Point2f) const& iCorners );
 
         /// \brief Reads the current calibration state.
         /// \return a copy of the current calibration state
@@ -110,6 +155,36 @@ namespace pcc
         /// \return a double in the interval [0,1] representing the progress of the calibration process
         double GetCalibrationProgress () const;
 
+        /// \brief Gets the filled fraction of the view coverage map (see PcViewSelector::GetCoverage).
+        /// \return a double in the interval [0,1]
+        double GetCoverage ();
+
+        /// \brief Tells the operator which views are still missing (see PcViewSelector::GetGuidance).
+        /// \return a short instruction, empty if the coverage is complete or the calibration isn't acquiring
+        std::string GetGuidance ();
+
+        /// \brief Gets the sharpness of the latest frame processed during the acquisition (see PcSharpness).
+        /// \return the variance of the frame Laplacian, negative if no frame was processed since the calibration started
+        double GetSharpness ();
+
+        /// \brief Gets the reprojection error of the latest solve.
+        /// \return the RMS reprojection error in pixels, negative if no solve completed since the calibration started
+        double GetCalibrationRms ();
+
+        /// \brief Gets the descriptions of the views accepted so far.
+        /// \return a copy of the list of views, in the same order as the chessboard corners
+        VEC(PcCalibrationView) GetViews ();
+
+        /// \brief Gets copies of the views accepted so far and of their detected points, consistent with each other.
+        /// \param [out] oViews     the views
+        /// \param [out] oCorners   the detected points of every view, in the same order
+        void GetObservations ( VEC(PcCalibrationView)& oViews, VECOFVECS(cv::Point2f)& oCorners );
+
+        /// \brief Gets copies of the shared views kept so far and of their detected points (see AddSharedView).
+        /// \param [out] oViews     the views, in increasing set order
+        /// \param [out] oCorners   the detected points of every view, in the same order
+        void GetSharedObservations ( VEC(PcCalibrationView)& oViews, VECOFVECS(cv::Point2f)& oCorners );
+
         /// \brief Gets the chessboard corners detected during the acquisition phase.
         ///
         /// \return a vector of vectors of points describing the detected chessboard corners
@@ -143,7 +218,7 @@ namespace pcc
         /// \brief Private copy constructor.
         /// 
         /// Disables copy operations on PcCameraCalibration objects.
-        PcCameraCalibration ( PcCameraCalibration const& iOther) {}
+        PcCameraCalibration ( PcCameraCalibration const& iOther) : m_detector ( iOther.m_detector ), m_selector ( iOther.m_selector ) {}
 
         /// \brief Private assignment operator.
         /// 
@@ -151,17 +226,53 @@ namespace pcc
         /// \return this object, unchanged
         PcCameraCalibration& operator= ( PcCameraCalibration const& iOther ) { return (*this); }
 
+        /// \brief Performs ProcessFrame for a given calibration run.
+        ///
+        /// Checks if the frame contains a chessboard in it, and if it does, keeps the view and queues the frame on the
+        /// debug image exporter, if any. Schedules PcCameraCalibration::Solve after every view in incremental mode,
+        /// and once the calibration has the required amount of frames, at which point it passes to the actual
+        /// calibration phase.
+        ///
+        /// \param [in]  iGeneration    the calibration run the frame was passed to; the view is dropped if it was aborted since
+        /// \param [in]  iView          the description of the frame
+        /// \param [in]  iFrame         the frame
+        /// \param [out] oCorners       the detected target points
+        /// \return true if the target was found
+        bool DoProcessFrame ( unsigned int const& iGeneration, PcCalibrationView iView, cv::Mat const& iFrame, VEC(cv::Point2f)& oCorners );
+
+        /// \brief Calculates the camera's intrinsic parameters, as a task of the shared thread pool.
+        ///
+        /// Calls the DoCalibration method on the parent PcCamera object, providing the detected corners information and the chessboard descriptors,
+        /// and repeats while new views arrive. Every solve but the first starts from the previous estimate.
+        /// If the intrinsics converged, or the acquisition is over and every view was used, the task empties the callback list and outputs
+        /// the calculated matrices on the screen.
+        ///
+        /// \param [in] iGeneration the calibration run that scheduled the task
+        void Solve ( unsigned int const& iGeneration );
+
+        /// \brief Tells whether a frame is far enough in time from the last accepted view. m_mutex must be held.
+        /// \param [in] iTimestamp  the camera timestamp of the frame
+        /// \return true if no view was accepted yet or PcCalibrationHelper::FrameDelay elapsed since the last one
+        bool IsDue ( boost::uint64_t const& iTimestamp ) const;
+
+        /// \brief Schedules PcCameraCalibration::Solve unless a solve task is already in flight. m_mutex must be held.
+        void ScheduleSolve ();
+
         /// \brief Performs the calibration startup steps.
         /// 
-        /// Aborts any currently running calibration, sets the calibration state to ACQUIRING and launches a new
-        /// thread to process the frame queue.
-        void DoStartCalibration ();
+        /// Aborts any currently running calibration, empties the list of shared views and sets the calibration state
+        /// to ACQUIRING.
+        ///
+        /// \param [in] ioLock      the lock held on m_mutex
+        void DoStartCalibration ( LockType& ioLock );
 
         /// \brief Performs the calibration abort steps.
         ///
-        /// Sets the calibration state to UNKNOWN, deletes the current processing thread, empties the frame queue,
-        /// empties the list of frames containing a chessboard and empties the list of detected chessboard corners.
-        void DoAbortCalibration ();
+        /// Sets the calibration state to UNKNOWN, waits for the tasks in flight to return, empties the list of views,
+        /// the list of detected chessboard corners and the list of shared views.
+        ///
+        /// \param [in] ioLock      the lock held on m_mutex, released while waiting for the task
+        void DoAbortCalibration ( LockType& ioLock );
 
         /// \brief Changes the current calibration state.
         ///
@@ -171,17 +282,28 @@ namespace pcc
         void SetCalibrationState ( CalibrationState const& iNewState );
 
     private:
-        MutexType                       m_mutex;        ///< The shared mutex used to lock the frame queue.
+        MutexType                       m_mutex;        ///< The shared mutex used to lock the views.
         MutexType                       m_stateMutex;   ///< The shared mutex used to lock the state variable.
         CalibrationState                m_calibState;   ///< The current calibration state.
-        ThreadType*                     m_calibThread;  ///< The thread that processes the frame queue.
-        QUEUE(cv::Mat)                  m_frameQueue;   ///< The queue of frames to be processed.
-        VEC(cv::Mat)                    m_frameList;    ///< The list of frames where a chessboard has been found.
+        boost::condition_variable_any   m_idle;         ///< Signalled when a task in flight returns.
+        unsigned int                    m_taskCount;    ///< The number of frames being processed and solve tasks scheduled or running.
+        bool                            m_isSolving;    ///< Whether a solve task is scheduled or running.
+        unsigned int                    m_generation;   ///< The calibration run counter, increased on every abort.
+        PcTargetDetector                m_detector;     ///< The target detector, only used by ProcessFrame.
+        PcViewSelector                  m_selector;     ///< The selector of the views worth keeping.
+        VEC(PcCalibrationView)          m_views;        ///< The descriptions of the frames where a chessboard has been found.
         VECOFVECS(cv::Point2f)          m_corners;      ///< The list of coordinates of the chessboard corners detected on each frame.
+        VEC(PcCalibrationView)          m_sharedViews;  ///< The descriptions of the frames of the sets where other cameras found the chessboard too.
+        VECOFVECS(cv::Point2f)          m_sharedCorners;    ///< The chessboard corners detected on each shared view.
 
         PcCamera*                       m_camera;       ///< The parent PcCamera
 
         unsigned int                    m_count;        ///< The frame counter used to build the filenames of outputted frames.
+        bool                            m_hasView;      ///< Whether a view was accepted since the calibration started.
+        boost::uint64_t                 m_lastViewTimestamp;    ///< The camera timestamp of the last accepted view.
+        unsigned int                    m_solvedViews;  ///< The number of views used by the latest solve.
+        double                          m_rms;          ///< The reprojection error of the latest solve, negative if none.
+        double                          m_sharpness;    ///< The sharpness of the latest processed frame, negative if none.
         VEC(CallbackFn)                 m_listeners;    ///< The list of listeners to be notified of a state change.
     };
 }
@@ -0,0 +1,71 @@
+#ifndef PCCHESSBOARDDETECTOR_H
+#define PCCHESSBOARDDETECTOR_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+
+namespace pcc
+{
+    /// \ingroup PCCORE
+    ///
+    /// \brief Finds a chessboard in a frame by searching a downscaled copy first.
+    ///
+    /// Running cv::findChessboardCorners on a full-resolution frame is slow, and slowest on frames that don't show
+    /// a board at all, which are the majority while collecting calibration views. The detector therefore:
+    ///     - Downscales the frame by a power of two (with PcBoxDownscale) until it is at most a given width wide.
+    ///     - Searches the chessboard on the downscaled frame. Frames without a board are rejected here.
+    ///     - Maps the coarse corners back to full resolution and refines them with cv::cornerSubPix, in windows just
+    ///       large enough to absorb the downscaling error and small enough not to reach the neighbouring corners.
+    ///
+    /// Consecutive frames of a calibration session usually show the board close to where it was last found, so after
+    /// a detection the search starts in a region around the previous board, at the same downscaling factor as the
+    /// full frame. The full frame is only searched if the board isn't found there, and the region is forgotten if
+    /// the board isn't found at all.
+    ///
+    /// A detector keeps its scratch images between calls, so each thread should use its own detector.
+    class PcChessboardDetector
+    {
+    public:
+        /// \brief Constructor.
+        /// \param [in] iPatternSize    the number of inner corners per chessboard row and column
+        /// \param [in] iSearchWidth    the maximum width of the frame searched for the chessboard, in pixels
+        PCCORE_EXPORT PcChessboardDetector ( cv::Size const& iPatternSize, unsigned int const& iSearchWidth = 640u );
+
+        /// \brief Looks for the chessboard in a frame.
+        /// \param [in]  iFrame     the frame, 8-bit grayscale or BGR
+        /// \param [out] oCorners   the chessboard corners in full-resolution pixel coordinates, in row-major order
+        /// \return true if the whole chessboard was found, false otherwise
+        PCCORE_EXPORT bool Detect ( cv::Mat const& iFrame, VEC(cv::Point2f)& oCorners );
+
+        /// \brief Gets the number of inner corners per chessboard row and column.
+        /// \return the chessboard pattern size
+        inline cv::Size const& GetPatternSize () const { return m_patternSize; }
+
+    private:
+        /// \brief Searches the chessboard in a region of a frame, downscaled by a given factor.
+        /// \param [in]  iGray      the full-resolution grayscale frame
+        /// \param [in]  iRegion    the region searched
+        /// \param [in]  iScale     the downscaling factor
+        /// \param [out] oCorners   the coarse corners in full-resolution pixel coordinates
+        /// \return true if the whole chessboard was found, false otherwise
+        bool Search ( cv::Mat const& iGray, cv::Rect const& iRegion, unsigned int const& iScale, VEC(cv::Point2f)& oCorners );
+
+        /// \brief Sets the region searched first in the next frame around the corners found in the current one.
+        /// \param [in] iCorners    the corners found
+        /// \param [in] iFrameSize  the size of the frame
+        void UpdateRegion ( VEC(cv::Point2f) const& iCorners, cv::Size const& iFrameSize );
+
+    private:
+        cv::Size                        m_patternSize;  ///< The number of inner corners per chessboard row and column.
+        unsigned int                    m_searchWidth;  ///< The maximum width of the searched frame, in pixels.
+        cv::Mat                         m_gray;         ///< The grayscale copy of colour frames.
+        cv::Mat                         m_level;        ///< The downscaled frame.
+        cv::Rect                        m_region;       ///< The region searched first, empty if the previous frame had no board.
+    };
+}
+
+#endif // PCCHESSBOARDDETECTOR_H
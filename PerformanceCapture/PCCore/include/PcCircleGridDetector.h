@@ -0,0 +1,60 @@
+#ifndef PCCIRCLEGRIDDETECTOR_H
+#define PCCIRCLEGRIDDETECTOR_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+
+namespace pcc
+{
+    /// \ingroup PCCORE
+    ///
+    /// \brief Finds a grid of dark circles in a frame by searching a downscaled copy first.
+    ///
+    /// Circle centres are found as blobs, which is much cheaper than the quad search of a chessboard, and their
+    /// centroids stay on the circle centres when motion blur smears the circles along a line. The detector:
+    ///     - Downscales the frame by a power of two (with PcBoxDownscale) until it is at most a given width wide.
+    ///     - Searches the grid with cv::findCirclesGrid on the downscaled frame, with a blob detector using few
+    ///       thresholds and accepting elongated blobs.
+    ///     - Maps the centres back to full resolution and refines each of them to the intensity-weighted centroid of
+    ///       its circle, in a window reaching halfway to the nearest neighbouring circle.
+    ///
+    /// A detector keeps its scratch images between calls, so each thread should use its own detector.
+    class PcCircleGridDetector
+    {
+    public:
+        /// \brief Constructor.
+        /// \param [in] iPatternSize    the number of circles per grid row and column
+        /// \param [in] iIsAsymmetric   whether every other row of the grid is shifted by half a column
+        /// \param [in] iSearchWidth    the maximum width of the frame searched for the grid, in pixels
+        PCCORE_EXPORT PcCircleGridDetector ( cv::Size const& iPatternSize, bool const& iIsAsymmetric, unsigned int const& iSearchWidth = 640u );
+
+        /// \brief Looks for the circle grid in a frame.
+        /// \param [in]  iFrame     the frame, 8-bit grayscale or BGR
+        /// \param [out] oCenters   the circle centres in full-resolution pixel coordinates, in row-major order
+        /// \return true if the whole grid was found, false otherwise
+        PCCORE_EXPORT bool Detect ( cv::Mat const& iFrame, VEC(cv::Point2f)& oCenters );
+
+        /// \brief Gets the number of circles per grid row and column.
+        /// \return the grid pattern size
+        inline cv::Size const& GetPatternSize () const { return m_patternSize; }
+
+    private:
+        /// \brief Moves every centre to the intensity-weighted centroid of the dark pixels around it.
+        /// \param [in]    iGray        the full-resolution grayscale frame
+        /// \param [inout] ioCenters    the centres to refine
+        static void RefineCenters ( cv::Mat const& iGray, VEC(cv::Point2f)& ioCenters );
+
+    private:
+        cv::Size                        m_patternSize;  ///< The number of circles per grid row and column.
+        bool                            m_isAsymmetric; ///< Whether every other row is shifted by half a column.
+        unsigned int                    m_searchWidth;  ///< The maximum width of the searched frame, in pixels.
+        cv::Mat                         m_gray;         ///< The grayscale copy of colour frames.
+        cv::Mat                         m_level;        ///< The downscaled frame.
+    };
+}
+
+#endif // PCCIRCLEGRIDDETECTOR_H
@@ -0,0 +1,142 @@
+#ifndef PCDEBUGIMAGEEXPORTER_H
+#define PCDEBUGIMAGEEXPORTER_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+
+#include <opencv2/opencv.hpp>
+
+#define BOOST_ALL_DYN_LINK
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace pcc
+{
+    /// \brief The file formats debug images can be exported to.
+    enum PcImageExportFormat {
+        PCC_EXPORT_RAW      =   0x00,   ///< Uncompressed binary PGM/PPM, the cheapest to write.
+        PCC_EXPORT_PNG      =   0x01,   ///< PNG with the default compression level.
+        PCC_EXPORT_FAST_PNG =   0x02,   ///< PNG with the lowest compression level, larger but much faster to encode.
+    };
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief A calibration frame waiting to be exported.
+    struct PcDebugImage
+    {
+        std::string             CameraId;       ///< The GUID of the camera that captured the frame.
+        unsigned int            Index;          ///< The index of the frame among the camera's calibration frames.
+        cv::Mat                 Image;          ///< The frame. The corners are drawn onto it by the encoder.
+        VEC(cv::Point2f)        Corners;        ///< The chessboard corners detected on the frame.
+        cv::Size                PatternSize;    ///< The number of inner corners per chessboard row and column.
+    };
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Exports the calibration frames, with their detected chessboard corners, on background encoder threads.
+    ///
+    /// Drawing the corners and encoding the file both happen on the encoder threads, so exporting a frame only
+    /// costs the caller a queue insertion. The queue is bounded: when the encoders fall behind, the frames that don't
+    /// fit are dropped and counted by GetDroppedImages, rather than delaying the calibration.
+    ///
+    /// Frames are written to \<directory\>/\<camera GUID\>/\<index\>.\<extension\>.
+    class PcDebugImageExporter
+    {
+    private:
+        typedef boost::mutex                    MutexType;      ///< The mutex type used to lock the image queue.
+        typedef boost::unique_lock<MutexType>   LockType;       ///< The lock type used together with the condition variable.
+        typedef boost::lock_guard<MutexType>    GuardType;      ///< The RAII lock guard used together with MutexType.
+        typedef boost::condition_variable       ConditionType;  ///< The condition variable used to wake the encoder threads.
+
+    public:
+        /// \brief Constructor. Launches the encoder threads.
+        /// \param [in] iDirectory      the directory the images are exported to
+        /// \param [in] iFormat         the file format of the images
+        /// \param [in] iCapacity       the maximum number of images waiting to be encoded
+        /// \param [in] iThreadCount    the number of encoder threads
+        PCCORE_EXPORT PcDebugImageExporter (
+            std::string const&          iDirectory,
+            PcImageExportFormat const&  iFormat         = PCC_EXPORT_PNG,
+            unsigned int const&         iCapacity       = 16u,
+            unsigned int const&         iThreadCount    = 2u
+        );
+
+        /// \brief Destructor. Encodes the images still queued and joins the encoder threads.
+        PCCORE_EXPORT ~PcDebugImageExporter ();
+
+        /// \brief Queues a calibration frame to be exported, without blocking.
+        ///
+        /// The exporter takes over the image, which must not be modified by the caller afterwards.
+        ///
+        /// \param [in] iCameraId       the GUID of the camera that captured the frame
+        /// \param [in] iIndex          the index of the frame among the camera's calibration frames
+        /// \param [in] iImage          the frame
+        /// \param [in] iCorners        the chessboard corners detected on the frame
+        /// \param [in] iPatternSize    the number of inner corners per chessboard row and column
+        /// \return true if the frame was queued, false if it was dropped because the queue is full
+        PCCORE_EXPORT bool Export (
+            std::string const&          iCameraId,
+            unsigned int const&         iIndex,
+            cv::Mat const&              iImage,
+            VEC(cv::Point2f) const&     iCorners,
+            cv::Size const&             iPatternSize
+        );
+
+        /// \brief Gets the number of frames dropped because the encoders fell behind.
+        /// \return the number of dropped frames
+        inline boost::uint64_t GetDroppedImages () const { return m_dropped; }
+
+        /// \brief Gets the directory the images are exported to.
+        /// \return a constant reference to the export directory
+        inline std::string const& GetDirectory () const { return m_directory; }
+
+        /// \brief Gets the file format of the exported images.
+        /// \return the export format
+        inline PcImageExportFormat GetFormat () const { return m_format; }
+
+    private:
+        /// \brief Private copy constructor.
+        ///
+        /// Disables copy of PcDebugImageExporter objects.
+        PcDebugImageExporter ( PcDebugImageExporter const& iOther ) {}
+
+        /// \brief Private assignment operator.
+        ///
+        /// Disables assignment of PcDebugImageExporter objects.
+        /// \return this object, unchanged
+        PcDebugImageExporter& operator= ( PcDebugImageExporter const& iOther ) { return (*this); }
+
+        /// \brief Drains the image queue on an encoder thread.
+        ///
+        /// Exits once the exporter is being destroyed and the queue is empty.
+        void Process ();
+
+        /// \brief Draws the corners onto a frame and writes it to its file.
+        /// \param [in] ioImage     the frame to be written
+        void Write ( PcDebugImage& ioImage );
+
+    private:
+        MutexType                       m_mutex;        ///< The mutex used to lock the queue.
+        ConditionType                   m_condition;    ///< Signalled whenever an image is queued or the exporter is stopped.
+        boost::thread_group             m_threads;      ///< The encoder threads.
+
+        std::string                     m_directory;    ///< The export directory.
+        PcImageExportFormat             m_format;       ///< The file format of the images.
+        VEC(int)                        m_parameters;   ///< The encoding parameters passed to cv::imwrite.
+
+        std::deque<PcDebugImage>        m_queue;        ///< The images waiting to be encoded.
+        unsigned int                    m_capacity;     ///< The maximum number of images in the queue.
+        boost::atomic<boost::uint64_t>  m_dropped;      ///< The number of images dropped so far.
+        bool                            m_isOpen;       ///< Indicates whether the exporter accepts new images.
+    };
+
+    typedef boost::shared_ptr<PcDebugImageExporter> PcDebugImageExporterPtr;    ///< A reference-counted pointer to a PcDebugImageExporter.
+}
+
+#endif // PCDEBUGIMAGEEXPORTER_H
@@ -0,0 +1,181 @@
+#ifndef PCDRIFTMONITOR_H
+#define PCDRIFTMONITOR_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+#include "PcCalibrationTarget.h"
+#include "PcFrame.h"
+#include "PcRecordingIndex.h"
+#include "PcTargetDetector.h"
+
+#include <opencv2/opencv.hpp>
+
+#define BOOST_ALL_DYN_LINK
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace pcc
+{
+    /// \brief The calibration health of a monitored camera.
+    struct PcDriftStatus
+    {
+        double                          Baseline;       ///< The mean error of the first checks after the calibration was set, in pixels, negative until known.
+        double                          Error;          ///< The smoothed error of the recent checks, in pixels, negative before the first check.
+        double                          Trend;          ///< The slope of the error over the recent checks, in pixels per second.
+        size_t                          CheckCount;     ///< The number of checks the camera took part in since its calibration was set.
+        bool                            HasDrifted;     ///< Whether the error rose far enough above the baseline for the camera to need recalibrating.
+    };
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Watches the stored calibrations of a rig of cameras for drift while they stream, e.g. a bumped tripod.
+    ///
+    /// A check takes the frames every camera captured at the same instant, within a timestamp tolerance, and searches
+    /// them for the calibration target. For every camera, the target points are triangulated from the other cameras
+    /// that found the target, with their stored intrinsics and rig poses, and reprojected into the camera: the RMS
+    /// distance to the detected points is the error of the camera. A moved camera would also raise the error of the
+    /// cameras it helps triangulate for, so the cameras already flagged are left out of the triangulations, and so is
+    /// the camera whose removal lowers the others' error most when an error stands out in a check. A moved camera
+    /// therefore shows an error rising above its own baseline, while the error of the others barely changes.
+    /// Correspondences from another source, such as tracked markers, may be checked with AddCorrespondences.
+    ///
+    /// Every camera keeps the mean and deviation of its first errors as its baseline, and a smoothed error. It is
+    /// flagged as drifted once its smoothed error exceeds the baseline by a margin, and cleared once the error falls
+    /// back, so that it can be recalibrated alone. A change of calibration restarts the baselines of every camera,
+    /// since the error of each depends on the calibration of the others.
+    ///
+    /// Checks run one at a time as PcThreadPool tasks, and cost about one frame copy per camera, a target search per
+    /// frame and a few triangulations per point. The time each check takes sets when the next one starts, so that
+    /// the monitor keeps within a fixed fraction of a processor core on average, whatever the number and resolution
+    /// of the cameras. Frames arriving between checks are ignored after a timestamp comparison.
+    ///
+    /// Only cameras whose calibration was set take part in the checks. A check needs the target in at least three of
+    /// them, and four to tell which camera moved. Every method may be called from any thread.
+    class PcDriftMonitor
+    {
+    public:
+        /// \brief Constructor.
+        /// \param [in] iTarget         the calibration target searched in the frames
+        /// \param [in] iBudget         the fraction of a processor core the checks may use on average, between 0 and 1
+        /// \param [in] iTolerance      the maximum difference between the timestamps of the frames of a check
+        PCCORE_EXPORT PcDriftMonitor ( PcCalibrationTarget const& iTarget, double const& iBudget = 0.02, boost::uint64_t const& iTolerance = PCC_FRAME_SET_TOLERANCE );
+
+        /// \brief Destructor. Waits for the check in flight.
+        PCCORE_EXPORT ~PcDriftMonitor ();
+
+        /// \brief Sets the stored calibration of a camera, starting to monitor it. Thread-safe.
+        ///
+        /// Does nothing if the calibration is unchanged. Otherwise, restarts the baselines of every camera.
+        ///
+        /// \param [in] iCameraId       the camera GUID
+        /// \param [in] iCameraMatrix   the intrinsic camera matrix
+        /// \param [in] iDistCoeffs     the distortion coefficients
+        /// \param [in] iRotation       the rotation from the rig frame to the camera frame, as a 3x3 matrix
+        /// \param [in] iTranslation    the translation from the rig frame to the camera frame, as a 3x1 matrix
+        PCCORE_EXPORT void SetCalibration ( std::string const& iCameraId, cv::Mat const& iCameraMatrix, cv::Mat const& iDistCoeffs, cv::Mat const& iRotation, cv::Mat const& iTranslation );
+
+        /// \brief Stops monitoring a camera, and restarts the baselines of the others. Thread-safe.
+        /// \param [in] iCameraId       the camera GUID
+        PCCORE_EXPORT void RemoveCamera ( std::string const& iCameraId );
+
+        /// \brief Offers a camera frame to the next check. Thread-safe.
+        ///
+        /// The frame is copied if it belongs to the instant of the next check, and ignored otherwise, so the caller
+        /// may reuse it at once.
+        ///
+        /// \param [in] iCameraId       the GUID of the camera that took the frame
+        /// \param [in] iFrame          the frame
+        PCCORE_EXPORT void PushFrame ( std::string const& iCameraId, PcFramePtr const& iFrame );
+
+        /// \brief Checks a set of corresponding points seen at the same instant, in the calling thread. Thread-safe.
+        /// \param [in] iTimestamp      the camera timestamp of the instant
+        /// \param [in] iPoints         the points seen by every camera, indexed by camera GUID, in the same order for every camera
+        PCCORE_EXPORT void AddCorrespondences ( boost::uint64_t const& iTimestamp, STRMAP(VEC(cv::Point2f)) const& iPoints );
+
+        /// \brief Gets the calibration health of a camera. Thread-safe.
+        /// \param [in]  iCameraId      the camera GUID
+        /// \param [out] oStatus        the status of the camera
+        /// \return true if the camera is monitored, false otherwise
+        PCCORE_EXPORT bool GetStatus ( std::string const& iCameraId, PcDriftStatus& oStatus );
+
+        /// \brief Gets the cameras flagged as drifted. Thread-safe.
+        /// \return the GUIDs of the cameras whose calibration drifted
+        PCCORE_EXPORT VEC(std::string) GetDriftedCameras ();
+
+        /// \brief Gets the number of checks run so far. Thread-safe.
+        /// \return the number of checks
+        inline boost::uint64_t GetCheckCount () const { return m_checkCount.load (); }
+
+    private:
+        /// \brief The stored calibration of a monitored camera.
+        struct Calibration
+        {
+            cv::Mat                     CameraMatrix;   ///< The intrinsic camera matrix, as doubles.
+            cv::Mat                     DistCoeffs;     ///< The distortion coefficients, as doubles.
+            cv::Mat                     Rotation;       ///< The rotation from the rig frame to the camera frame, as a 3x3 matrix of doubles.
+            cv::Mat                     Translation;    ///< The translation from the rig frame to the camera frame, as a 3x1 matrix of doubles.
+        };
+
+        /// \brief The error history of a monitored camera.
+        struct History
+        {
+            PcDriftStatus               Status;         ///< The current status.
+            double                      ErrorSum;       ///< The sum of the errors of the baseline checks.
+            double                      SquareSum;      ///< The sum of the squared errors of the baseline checks.
+            double                      Deviation;      ///< The standard deviation of the errors of the baseline checks.
+            VEC(double)                 Times;          ///< The time of the recent checks, in seconds.
+            VEC(double)                 Errors;         ///< The error of the recent checks, in pixels.
+        };
+
+        /// \brief Private copy constructor.
+        ///
+        /// Disables copy of PcDriftMonitor objects.
+        /// \param [in] iOther      the object to be copied
+        PcDriftMonitor ( PcDriftMonitor const& iOther ) : m_detector ( iOther.m_detector ) {}
+
+        /// \brief Private assignment operator.
+        ///
+        /// Disables assignment of PcDriftMonitor objects.
+        /// \param [in] iOther      the object to be assigned to this object.
+        /// \return this object, unchanged
+        PcDriftMonitor& operator= ( PcDriftMonitor const& iOther ) { return (*this); }
+
+        /// \brief Clears the error history of every camera, with m_mutex held.
+        void ResetHistories ();
+
+        /// \brief Adds the error of a check to the history of a camera, with m_mutex held.
+        /// \param [in] iCameraId       the camera GUID
+        /// \param [in] iTime           the time of the check, in seconds
+        /// \param [in] iError          the RMS reprojection error of the camera, in pixels
+        void AddError ( std::string const& iCameraId, double const& iTime, double const& iError );
+
+        /// \brief Searches the target in the frames of the check, and checks the points found. Runs as a PcThreadPool task.
+        void Check ();
+
+    private:
+        double                          m_budget;           ///< The fraction of a processor core the checks may use.
+        boost::uint64_t                 m_tolerance;        ///< The timestamp tolerance of a check.
+        PcTargetDetector                m_detector;         ///< The target detector, only used by the check in flight.
+        boost::mutex                    m_mutex;            ///< Locks the calibrations, the histories and the frames of the next check.
+        boost::condition_variable       m_idle;             ///< Signalled when a check returns.
+        boost::atomic<bool>             m_isChecking;       ///< Whether a check is scheduled or running.
+        boost::atomic<boost::uint64_t>  m_nextCheck;        ///< The camera timestamp from which frames are taken for the next check.
+        boost::atomic<boost::uint64_t>  m_checkCount;       ///< The number of checks run so far.
+        boost::uint64_t                 m_instant;          ///< The timestamp of the first frame of the next check, 0 if none yet.
+        double                          m_copyTime;         ///< The time spent copying the frames of the next check, in seconds.
+        STRMAP(cv::Mat)                 m_images;           ///< The frames of the next check, indexed by camera GUID.
+        STRMAP(Calibration)             m_calibrations;     ///< The stored calibration of every monitored camera.
+        STRMAP(History)                 m_histories;        ///< The error history of every monitored camera.
+        size_t                          m_generation;       ///< Counts the history resets, so that a check started before a reset is dropped.
+    };
+
+    typedef boost::shared_ptr<PcDriftMonitor> PcDriftMonitorPtr;  ///< A reference-counted pointer to a PcDriftMonitor object.
+}
+
+#endif // PCDRIFTMONITOR_H
@@ -2,12 +2,14 @@
 #define PCFRAME_H
 
 #include "PcExport.h"
+#include "PcRemap.h"
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/gpu/gpu.hpp>
 
 #define BOOST_ALL_DYN_LINK
 #include <boost/thread/thread.hpp>
+#include <boost/cstdint.hpp>
 
 namespace pcc
 {
@@ -70,6 +72,14 @@ namespace pcc
         /// \return a const reference to the cv::Mat representation of the image frame
         PCCORE_EXPORT cv::Mat const& GetImagePoints () const { return (m_cpuImage); }
 
+        /// \brief Gets the camera timestamp of the image frame.
+        /// \return the timestamp reported by the camera, in nanoseconds of the camera clock (see PcCamera::ToNanoseconds)
+        inline boost::uint64_t const& Timestamp () const { return m_timestamp; }
+
+        /// \brief Gets the camera frame ID of the image frame.
+        /// \return the frame ID reported by the camera
+        inline boost::uint64_t const& FrameId () const { return m_frameId; }
+
     private:
         /// \brief Private copy constructor.
         /// Disables copies of PcFrame objects.
@@ -93,11 +103,23 @@ namespace pcc
         /// \param [in] iHeight         the height of the new image frame
         /// \param [in] iNumChannels    the number of color channels on the new image frame's data
         /// \param [in] iData           the byte array representing the new image frame's data
+        /// \param [in] iTimestamp      the camera timestamp of the new image frame
+        /// \param [in] iFrameId        the camera frame ID of the new image frame
         void Reset (
             unsigned int const&     iWidth,
             unsigned int const&     iHeight,
             unsigned int const&     iNumChannels,
-            unsigned char const*&   iData
+            unsigned char const*&   iData,
+            boost::uint64_t const&  iTimestamp = 0u,
+            boost::uint64_t const&  iFrameId = 0u
+        );
+
+        /// \brief Replaces the frame with a resampled copy of another frame, e.g. to undistort it (see PcRemap).
+        /// \param [in] iSource     the frame to resample, which keeps its timestamp and frame ID
+        /// \param [in] iMap        the map, whose size is the size of the new image frame
+        void Remap (
+            PcFrame const&          iSource,
+            PcRemapMap const&       iMap
         );
 
         /// \brief Externally locks the frame for multithreaded usage.
@@ -107,11 +129,15 @@ namespace pcc
         void Unlock () { m_mutex.unlock (); }
 
     private:
-        MutexType                   m_mutex         ///< The mutex to block concurrent access to the frame data.
+        MutexType                   m_mutex;        ///< The mutex to block concurrent access to the frame data.
     
         // Data containers
         cv::gpu::GpuMat             m_gpuImage;     ///< The GPU representation of the frame data.
         cv::Mat                     m_cpuImage;     ///< The CPU representation of the frame data.
+
+        // Metadata
+        boost::uint64_t             m_timestamp;    ///< The camera timestamp of the frame.
+        boost::uint64_t             m_frameId;      ///< The camera frame ID of the frame.
     };
 
     typedef boost::shared_ptr<PcFrame> PcFramePtr;  ///< A reference-counted pointer to a PcFrame.
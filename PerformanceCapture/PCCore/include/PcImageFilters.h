@@ -0,0 +1,45 @@
+#ifndef PCIMAGEFILTERS_H
+#define PCIMAGEFILTERS_H
+
+#include "PcExport.h"
+
+#include <opencv2/opencv.hpp>
+
+/// \def    PCC_USE_SSE2
+///
+/// \brief  Defined when the SSE2 code paths of the image filters are compiled in.
+#if !defined(PCC_NO_SIMD) && ( defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__) )
+#define PCC_USE_SSE2
+#endif
+
+namespace pcc
+{
+    /// \ingroup PCCORE
+    ///
+    /// \brief Downscales an 8-bit image by averaging square blocks of pixels.
+    ///
+    /// The output has ( iSrc.cols / iFactor ) x ( iSrc.rows / iFactor ) pixels, each the rounded mean of an iFactor x
+    /// iFactor block of the input; the last columns and rows are dropped when the input size isn't a multiple of the
+    /// factor. Single-channel images downscaled by 4 take an SSE2 path; other cases fall back to cv::resize.
+    ///
+    /// \param [in]  iSrc       the image to downscale
+    /// \param [in]  iFactor    the downscaling factor along each axis
+    /// \param [out] oDst       the downscaled image. Reallocated only if its size or type don't match
+    PCCORE_EXPORT void PcBoxDownscale ( cv::Mat const& iSrc, unsigned int const& iFactor, cv::Mat& oDst );
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Measures the sharpness of an 8-bit image as the variance of its Laplacian, on a subset of its rows.
+    ///
+    /// The Laplacian is the 4-neighbour kernel, evaluated on every column of every iRowStep-th row. Blur removes the
+    /// high frequencies the Laplacian responds to, so motion-blurred or defocused frames score much lower than sharp
+    /// ones of the same scene. Single-channel images take an SSE2 path; other types are converted to grayscale and
+    /// fall back to cv::Laplacian on the whole image.
+    ///
+    /// \param [in] iSrc        the image to measure, at least 3x3 pixels
+    /// \param [in] iRowStep    the distance between two sampled rows
+    /// \return the variance of the Laplacian, in squared intensity levels, 0 for images smaller than 3x3 pixels
+    PCCORE_EXPORT double PcSharpness ( cv::Mat const& iSrc, unsigned int const& iRowStep = 4u );
+}
+
+#endif // PCIMAGEFILTERS_H
@@ -0,0 +1,51 @@
+#ifndef PCINTRINSICSOLVER_H
+#define PCINTRINSICSOLVER_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+
+namespace pcc
+{
+    /// \ingroup PCCORE
+    ///
+    /// \brief Calibrates the intrinsics of a camera with a block-sparse Levenberg-Marquardt solver.
+    ///
+    /// Solves the same problem as cv::calibrateCamera with the k4 to k6 coefficients held fixed: the focal lengths,
+    /// principal point and k1, k2, p1, p2, k3 distortion coefficients shared by every view, and the pose of the target
+    /// in each view. The normal equations are made of a 9x9 intrinsic block, a 6x6 block per view and the coupling
+    /// between them, so the view poses are eliminated with a Schur complement and only a 9x9 system is solved per
+    /// iteration. The work of an iteration is therefore linear in the number of views, instead of cubic for the dense
+    /// system cv::calibrateCamera solves.
+    ///
+    /// The residuals, Jacobians and per-view blocks are evaluated on the shared PcThreadPool, two points at a time
+    /// with SSE2 where available. Without a guess, the solver starts like cv::calibrateCamera, from
+    /// cv::initCameraMatrix2D and no distortion, with the view poses given by cv::solvePnP.
+    ///
+    /// \param [in]    iObjectPoints    the target points of each view, on the z = 0 plane
+    /// \param [in]    iImagePoints     the detected target points of each view
+    /// \param [in]    iImageSize       the size of the frames, in pixels
+    /// \param [inout] ioCameraMatrix   the 3x3 camera matrix, used as the initial estimate if iUseGuess is true
+    /// \param [inout] ioDistCoeffs     the 5 distortion coefficients, used as the initial estimate if iUseGuess is true
+    /// \param [out]   oRvecs           the rotation of each view
+    /// \param [out]   oTvecs           the translation of each view
+    /// \param [in]    iUseGuess        whether to start from the given intrinsics
+    /// \param [in]    iMaxIterations   the maximum number of Levenberg-Marquardt iterations
+    /// \return the RMS reprojection error in pixels, negative if the solver couldn't be initialised
+    PCCORE_EXPORT double PcSolveIntrinsics (
+        VECOFVECS(cv::Point3f) const&   iObjectPoints,
+        VECOFVECS(cv::Point2f) const&   iImagePoints,
+        cv::Size const&                 iImageSize,
+        cv::Mat&                        ioCameraMatrix,
+        cv::Mat&                        ioDistCoeffs,
+        VEC(cv::Mat)&                   oRvecs,
+        VEC(cv::Mat)&                   oTvecs,
+        bool const&                     iUseGuess,
+        unsigned int const&             iMaxIterations = 100u
+    );
+}
+
+#endif // PCINTRINSICSOLVER_H
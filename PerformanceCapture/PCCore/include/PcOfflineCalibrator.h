@@ -0,0 +1,171 @@
+#ifndef PCOFFLINECALIBRATOR_H
+#define PCOFFLINECALIBRATOR_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+#include "PcCalibrationCache.h"
+#include "PcCalibrationTarget.h"
+#include "PcRigCalibrator.h"
+#include "PcTakeReader.h"
+
+#include <opencv2/opencv.hpp>
+
+#define BOOST_ALL_DYN_LINK
+#include <boost/cstdint.hpp>
+
+#include <string>
+#include <vector>
+
+namespace pcc
+{
+    /// \brief The intrinsic calibration of one camera, as calculated by a PcOfflineCalibrator.
+    struct PcOfflineCameraResult
+    {
+        std::string                     CameraId;       ///< The camera GUID.
+        cv::Size                        FrameSize;      ///< The size of the camera frames, in pixels.
+        cv::Mat                         CameraMatrix;   ///< The intrinsic camera matrix, empty if the camera wasn't calibrated.
+        cv::Mat                         DistCoeffs;     ///< The distortion coefficients, empty if the camera wasn't calibrated.
+        cv::Mat                         Deviations;     ///< The standard deviations of the intrinsics (see PcIntrinsicDeviations), empty if unknown.
+        double                          Rms;            ///< The RMS reprojection error, in pixels, negative if the camera wasn't calibrated.
+        unsigned int                    FrameCount;     ///< The number of frames read.
+        unsigned int                    DetectionCount; ///< The number of frames where the target was found.
+        unsigned int                    ViewCount;      ///< The number of views the intrinsics were solved from.
+    };
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Calibrates cameras from recorded frames instead of a live session.
+    ///
+    /// The frames of every camera come either from a take recorded by PcRecorder or from a directory of images, so a
+    /// calibration can be redone with another target or other settings without going back on stage. Calibrate:
+    ///     - Searches the target in every frame of every camera on the shared PcThreadPool. The frames of each camera
+    ///       are split into runs of consecutive frames, each searched by its own PcTargetDetector, so the detectors
+    ///       still benefit from the board being close to where they last found it.
+    ///     - Replays the frames of every camera in order through the acceptance policy of the live calibration
+    ///       (see PcCameraCalibration): blurred frames, frames within PcCalibrationHelper::FrameDelay of the last
+    ///       accepted view and views the PcViewSelector finds redundant are rejected, up to
+    ///       PcCalibrationHelper::FrameCount views. Every detection that passes the first two filters is recorded for
+    ///       the rig calibration, as it would be live.
+    ///     - Solves the intrinsics of every camera in parallel with PcCalibrateIntrinsics, the solver of the live path.
+    ///     - Solves the camera poses with a PcRigCalibrator, if at least two cameras were calibrated.
+    ///
+    /// Images of a directory have no timestamps: the n-th image of every directory is taken as a single instant, and
+    /// every image is considered far enough from the previous one.
+    class PcOfflineCalibrator
+    {
+    public:
+        /// \brief Constructor.
+        /// \param [in] iTarget     the calibration target shown in the frames
+        PCCORE_EXPORT explicit PcOfflineCalibrator ( PcCalibrationTarget const& iTarget );
+
+        /// \brief Adds the cameras of a recorded take.
+        ///
+        /// Cameras already added from another source are skipped.
+        ///
+        /// \param [in] iManifestPath   the path of the take manifest
+        /// \return true upon success, false if the take couldn't be opened
+        PCCORE_EXPORT bool AddTake ( std::string const& iManifestPath );
+
+        /// \brief Adds a camera whose frames are the images of a directory, in the order of their file names.
+        /// \param [in] iCameraId   the camera GUID
+        /// \param [in] iDirectory  the directory holding the images
+        /// \return true upon success, false if the camera was already added or the directory holds no image
+        PCCORE_EXPORT bool AddImageDirectory ( std::string const& iCameraId, std::string const& iDirectory );
+
+        /// \brief Calibrates the intrinsics of every added camera, then the poses of the rig.
+        /// \param [in] iSolveRig   whether to solve the camera poses
+        /// \return true if at least one camera was calibrated, false otherwise
+        PCCORE_EXPORT bool Calibrate ( bool const& iSolveRig = true );
+
+        /// \brief Gets the intrinsic calibrations calculated by Calibrate.
+        /// \return the calibration of every added camera, in the order they were added
+        inline VEC(PcOfflineCameraResult) const& GetResults () const { return m_results; }
+
+        /// \brief Gets the camera poses calculated by Calibrate.
+        /// \return the rig solution, null if the poses weren't solved
+        inline PcRigSolutionPtr const& GetRigSolution () const { return m_rigSolution; }
+
+        /// \brief Stores the calibrated cameras into a calibration cache, replacing their previous records.
+        ///
+        /// The cameras of the rig solution get their poses, under the rig key of the solved cameras.
+        ///
+        /// \param [inout] ioCache  the calibration cache
+        PCCORE_EXPORT void StoreResults ( PcCalibrationCache& ioCache ) const;
+
+    private:
+        /// \brief The frames of one camera.
+        struct Source
+        {
+            std::string                 CameraId;       ///< The camera GUID.
+            PcTakeReaderPtr             Take;           ///< The take holding the frames, null for a directory.
+            unsigned int                TakeCamera;     ///< The index of the camera in the take.
+            VEC(std::string)            Paths;          ///< The image paths, for a directory.
+            VEC(boost::uint64_t)        Timestamps;     ///< The timestamp of every frame.
+        };
+
+        /// \brief The outcome of the search of the target in one frame.
+        struct Candidate
+        {
+            bool                        IsSharp;        ///< Whether the frame passed the sharpness filter.
+            bool                        IsFound;        ///< Whether the target was found.
+            cv::Size                    FrameSize;      ///< The size of the frame.
+            VEC(cv::Point2f)            Corners;        ///< The detected target points.
+        };
+
+        /// \brief A run of consecutive frames of one camera, searched by a single detector.
+        struct Chunk
+        {
+            size_t                      Source;         ///< The index of the source.
+            size_t                      Begin;          ///< The first frame of the run.
+            size_t                      End;            ///< The frame past the end of the run.
+        };
+
+        /// \brief Private copy constructor.
+        ///
+        /// Disables copy of PcOfflineCalibrator objects.
+        PcOfflineCalibrator ( PcOfflineCalibrator const& iOther ) : m_target ( iOther.m_target ) {}
+
+        /// \brief Private assignment operator.
+        ///
+        /// Disables assignment of PcOfflineCalibrator objects.
+        /// \return this object, unchanged
+        PcOfflineCalibrator& operator= ( PcOfflineCalibrator const& iOther ) { return (*this); }
+
+        /// \brief Tells whether a camera was already added.
+        /// \param [in] iCameraId   the camera GUID
+        /// \return true if a source holds the frames of the camera
+        bool HasCamera ( std::string const& iCameraId ) const;
+
+        /// \brief Reads a frame of a source.
+        /// \param [in]  iSource    the source
+        /// \param [in]  iPosition  the position of the frame in the source
+        /// \param [out] oImage     the frame image
+        /// \return true upon success, false otherwise
+        bool ReadFrame ( Source const& iSource, size_t const& iPosition, cv::Mat& oImage ) const;
+
+        /// \brief Searches the target in a run of frames. Runs as a PcThreadPool::ParallelFor body.
+        /// \param [in] iChunk      the index of the run
+        void DetectChunk ( size_t const& iChunk );
+
+        /// \brief Replays the frames of a source through the acceptance policy of the live calibration.
+        /// \param [in]    iSource  the index of the source
+        /// \param [inout] ioRig    the rig calibrator receiving the observations
+        /// \param [out]   oViews   the detected points of every accepted view
+        void SelectViews ( size_t const& iSource, PcRigCalibrator& ioRig, VECOFVECS(cv::Point2f)& oViews );
+
+        /// \brief Solves the intrinsics of a camera from its accepted views. Runs as a PcThreadPool::ParallelFor body.
+        /// \param [in] iSource     the index of the source
+        void SolveCamera ( size_t const& iSource );
+
+    private:
+        PcCalibrationTarget             m_target;       ///< The calibration target.
+        VEC(Source)                     m_sources;      ///< The frames of every camera.
+        VEC(Chunk)                      m_chunks;       ///< The runs of frames searched in parallel.
+        VECOFVECS(Candidate)            m_candidates;   ///< The search outcome of every frame of every source.
+        VEC(VECOFVECS(cv::Point2f))     m_views;        ///< The accepted views of every source.
+        VEC(PcOfflineCameraResult)      m_results;      ///< The calibration of every source.
+        PcRigSolutionPtr                m_rigSolution;  ///< The camera poses, null if they weren't solved.
+    };
+}
+
+#endif // PCOFFLINECALIBRATOR_H
@@ -0,0 +1,106 @@
+#ifndef PCPOINTUNDISTORTER_H
+#define PCPOINTUNDISTORTER_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+
+#include <opencv2/opencv.hpp>
+
+#define BOOST_ALL_DYN_LINK
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+
+namespace pcc
+{
+    /// \ingroup PCCORE
+    ///
+    /// \brief Undistorts sparse image points, e.g. marker centroids, for a given camera. Never modified once built.
+    ///
+    /// cv::undistortPoints inverts the distortion model with a fixed-point iteration per point, which is slow to
+    /// converge towards the edges of the frame. The undistorter rather precomputes the inverse of the distortion on a
+    /// coarse grid of pixels covering the frame, solved to convergence once and for all. A point is then undistorted in
+    /// two steps:
+    ///     - The bilinear interpolation of the grid gives an estimate within a fraction of a pixel.
+    ///     - A single Newton step on the distortion model takes the estimate to well below 0.01 px, since the error of a
+    ///       Newton step is quadratic in the error of its estimate.
+    ///
+    /// Batches of points take an SSE2 path, which undistorts 4 points at a time in single precision. The grid only
+    /// supports the first 8 distortion coefficients (see cv::calibrateCamera); other models fall back to
+    /// cv::undistortPoints.
+    class PcPointUndistorter
+    {
+    public:
+        /// \brief Constructor. Builds the grid.
+        /// \param [in] iCameraMatrix   the intrinsic camera matrix
+        /// \param [in] iDistCoeffs     the distortion coefficients
+        /// \param [in] iFrameSize      the frame size, in pixels
+        PCCORE_EXPORT PcPointUndistorter ( cv::Mat const& iCameraMatrix, cv::Mat const& iDistCoeffs, cv::Size const& iFrameSize );
+
+        /// \brief Undistorts a batch of points, like cv::undistortPoints. Thread-safe.
+        ///
+        /// The points are expected to lie within the frame. The points slightly outside of it are extrapolated from
+        /// the border of the grid, and lose some accuracy.
+        ///
+        /// \param [in]  iPoints        the distorted points, in pixels
+        /// \param [out] oPoints        the undistorted points, in normalized coordinates, or in pixels of the camera
+        ///                             matrix if iIsPixels is true. May be iPoints
+        /// \param [in]  iIsPixels      whether to project the undistorted points back with the camera matrix
+        PCCORE_EXPORT void Undistort ( VEC(cv::Point2f) const& iPoints, VEC(cv::Point2f)& oPoints, bool const& iIsPixels = false ) const;
+
+        /// \brief Gets the camera matrix the undistorter was built from (read-only).
+        /// \return a 3x3 matrix of doubles
+        inline cv::Mat const& CameraMatrix () const { return m_cameraMatrix; }
+
+        /// \brief Gets the distortion coefficients the undistorter was built from (read-only).
+        /// \return a column of doubles
+        inline cv::Mat const& DistCoeffs () const { return m_distCoeffs; }
+
+    private:
+        /// \brief Private copy constructor.
+        ///
+        /// Disables copy of PcPointUndistorter objects.
+        /// \param [in] iOther      the object to be copied
+        PcPointUndistorter ( PcPointUndistorter const& iOther ) {}
+
+        /// \brief Private assignment operator.
+        ///
+        /// Disables assignment of PcPointUndistorter objects.
+        /// \param [in] iOther      the object to be assigned to this object.
+        /// \return this object, unchanged
+        PcPointUndistorter& operator= ( PcPointUndistorter const& iOther ) { return (*this); }
+
+        /// \brief Inverts the distortion model at a point, to convergence, in double precision.
+        /// \param [in]  iX             the distorted point, in normalized coordinates
+        /// \param [in]  iY             the distorted point, in normalized coordinates
+        /// \param [out] oX             the undistorted point, in normalized coordinates
+        /// \param [out] oY             the undistorted point, in normalized coordinates
+        void Solve ( double const& iX, double const& iY, double& oX, double& oY ) const;
+
+        /// \brief Undistorts a range of points with the grid and a Newton step.
+        /// \param [in]  iPoints        the first distorted point, in pixels
+        /// \param [out] oPoints        the first undistorted point
+        /// \param [in]  iCount         the number of points
+        /// \param [in]  iIsPixels      whether to project the undistorted points back with the camera matrix
+        void UndistortRange ( cv::Point2f const* iPoints, cv::Point2f* oPoints, size_t const& iCount, bool const& iIsPixels ) const;
+
+    private:
+        cv::Mat                         m_cameraMatrix;     ///< The intrinsic camera matrix.
+        cv::Mat                         m_distCoeffs;       ///< The distortion coefficients.
+        bool                            m_hasGrid;          ///< Whether the grid supports the distortion model.
+        double                          m_model[8];         ///< The distortion coefficients, k1, k2, p1, p2, k3, k4, k5, k6.
+        float                           m_coeffs[8];        ///< The distortion coefficients, in single precision.
+        float                           m_focal[2];         ///< The focal lengths, in pixels.
+        float                           m_center[2];        ///< The principal point, in pixels.
+        float                           m_skew;             ///< The skew of the camera matrix.
+        float                           m_origin[2];        ///< The pixel of the first grid node.
+        float                           m_invSpacing;       ///< The inverse of the spacing of the grid nodes, in pixels.
+        int                             m_cols;             ///< The number of grid nodes along x.
+        int                             m_rows;             ///< The number of grid nodes along y.
+        VEC(float)                      m_grid;             ///< The undistorted normalized coordinates of every node, x and y interleaved, row by row.
+    };
+
+    typedef boost::shared_ptr<PcPointUndistorter const> PcPointUndistorterPtr;  ///< A reference-counted pointer to an immutable PcPointUndistorter.
+}
+
+#endif // PCPOINTUNDISTORTER_H
@@ -0,0 +1,286 @@
+#ifndef PCRECORDER_H
+#define PCRECORDER_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+#include "PcFrame.h"
+#include "PcRecordingFormat.h"
+#include "PcRecordingIndex.h"
+
+#define BOOST_ALL_DYN_LINK
+#include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace pcc
+{
+    /// \ingroup PCCORE
+    ///
+    /// \brief A frame waiting to be written to a recording stripe.
+    struct PcRecordingChunk
+    {
+        PcChunkHeader           Header;     ///< The chunk header, as it will be written to disk.
+        VEC(unsigned char)      Data;       ///< The raw frame data.
+    };
+
+    typedef boost::shared_ptr<PcRecordingChunk> PcRecordingChunkPtr;    ///< A reference-counted pointer to a PcRecordingChunk.
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Writes the chunks of a take routed to a single recording target.
+    ///
+    /// Each stripe owns one file on its target directory or device, a bounded queue of pending chunks and
+    /// a writer thread that drains the queue. The writer measures how fast the target absorbs data, so that
+    /// the PcRecorder can route chunks to targets proportionally to their throughput.
+    ///
+    /// Pushing a chunk never blocks: if the queue is full, PcRecordingStripe::TryPush fails and the caller
+    /// is expected to route the chunk elsewhere.
+    ///
+    /// After each chunk, the writer appends a PcIndexEntry to a journal next to the stripe file (see
+    /// PCC_JOURNAL_EXTENSION), so that the take index can be built without scanning the stripe.
+    ///
+    /// A stripe created with a scale greater than 1 holds a proxy stream: the writer thread downscales every frame
+    /// with PcBoxDownscale before writing it, so the acquisition threads never pay for the filter.
+    class PcRecordingStripe
+    {
+    private:
+        typedef boost::mutex                    MutexType;      ///< The mutex type used to lock the chunk queue.
+        typedef boost::unique_lock<MutexType>   LockType;       ///< The lock type used together with the condition variable.
+        typedef boost::lock_guard<MutexType>    GuardType;      ///< The RAII lock guard used together with MutexType.
+        typedef boost::condition_variable       ConditionType;  ///< The condition variable used to wake the writer thread.
+
+    public:
+        /// \brief Constructor.
+        ///
+        /// Builds the stripe file path from the target directory, the take name and the stripe index, or from
+        /// PCC_PROXY_SUFFIX for a proxy stripe. Does not touch the file system until PcRecordingStripe::Open is called.
+        ///
+        /// \param [in] iDirectory  the target directory of the stripe
+        /// \param [in] iTakeName   the name of the take being recorded
+        /// \param [in] iIndex      the index of the stripe within the take
+        /// \param [in] iCapacity   the maximum number of chunks waiting to be written
+        /// \param [in] iScale      the factor frames are downscaled by before being written, 1 to write them as they are
+        PcRecordingStripe (
+            std::string const&      iDirectory,
+            std::string const&      iTakeName,
+            unsigned int const&     iIndex,
+            unsigned int const&     iCapacity,
+            unsigned int const&     iScale = 1u
+        );
+
+        /// \brief Destructor. Closes the stripe if it is still open.
+        ~PcRecordingStripe ();
+
+        /// \brief Creates the target directory and the stripe file, and launches the writer thread.
+        /// \return true upon success, false otherwise
+        bool Open ();
+
+        /// \brief Writes every pending chunk, stops the writer thread and closes the stripe file.
+        void Close ();
+
+        /// \brief Queues a chunk to be written, without blocking.
+        /// \param [in] iChunk      the chunk to be written
+        /// \return true if the chunk was queued, false if the queue is full or the stripe is not writable
+        bool TryPush ( PcRecordingChunkPtr const& iChunk );
+
+        /// \brief Gets the routing weight of the stripe.
+        ///
+        /// The weight is the measured throughput of the target, in bytes per second, scaled down by how full the
+        /// queue is so that a target starting to fall behind receives less data before it actually overflows.
+        ///
+        /// \return the routing weight of the stripe, 0 if the stripe can't accept data
+        double GetWeight ();
+
+        /// \brief Gets the path of the stripe file.
+        /// \return a constant reference to the stripe file path
+        inline std::string const& GetPath () const { return m_path; }
+
+        /// \brief Gets the path of the stripe's index journal.
+        /// \return the journal path
+        inline std::string GetJournalPath () const { return m_path + PCC_JOURNAL_EXTENSION; }
+
+    private:
+        /// \brief Private copy constructor.
+        ///
+        /// Disables copy of PcRecordingStripe objects.
+        PcRecordingStripe ( PcRecordingStripe const& iOther ) {}
+
+        /// \brief Private assignment operator.
+        ///
+        /// Disables assignment of PcRecordingStripe objects.
+        /// \return this object, unchanged
+        PcRecordingStripe& operator= ( PcRecordingStripe const& iOther ) { return (*this); }
+
+        /// \brief Drains the chunk queue on the writer thread.
+        ///
+        /// Waits for chunks to be queued and writes them in order, updating the throughput estimate after each
+        /// write. Exits once the stripe is closed and the queue is empty, or upon a write error.
+        void Process ();
+
+    private:
+        MutexType                       m_mutex;        ///< The mutex used to lock the queue and the throughput estimate.
+        ConditionType                   m_condition;    ///< Signalled whenever a chunk is queued or the stripe is closed.
+        boost::thread*                  m_thread;       ///< The writer thread.
+
+        std::string                     m_directory;    ///< The target directory.
+        std::string                     m_path;         ///< The stripe file path.
+        unsigned int                    m_index;        ///< The index of the stripe within the take.
+        unsigned int                    m_scale;        ///< The downscaling factor of the frames, 1 for none.
+        cv::Mat                         m_scaled;       ///< The last downscaled frame, reused across chunks.
+        FILE*                           m_file;         ///< The stripe file.
+        FILE*                           m_journal;      ///< The index journal.
+        boost::uint64_t                 m_offset;       ///< The offset of the next chunk in the stripe file.
+
+        std::deque<PcRecordingChunkPtr> m_queue;        ///< The chunks waiting to be written.
+        unsigned int                    m_capacity;     ///< The maximum number of chunks in the queue.
+
+        double                          m_throughput;   ///< Moving average of the write throughput, in bytes per second.
+        bool                            m_isOpen;       ///< Indicates whether the stripe accepts new chunks.
+        bool                            m_hasFailed;    ///< Indicates whether a write error happened on the target.
+    };
+
+    typedef boost::shared_ptr<PcRecordingStripe> PcRecordingStripePtr;  ///< A reference-counted pointer to a PcRecordingStripe.
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Records the frames of every camera to a set of striped files.
+    ///
+    /// A single device can't always absorb the data rate of a full camera rig, so the recorder spreads the frames
+    /// of a take across a configurable set of target directories, ideally each on its own device. Each target is
+    /// handled by a PcRecordingStripe with its own queue and writer thread.
+    ///
+    /// Frames are routed with a smooth weighted round-robin, weighted by the throughput each target has shown so far.
+    /// When the preferred target's queue is full, the frame spills over to the next target with room; when every
+    /// queue is full, the frame is dropped. Recording therefore never blocks the acquisition threads, and a single slow
+    /// target only reduces its own share of the data.
+    ///
+    /// A text manifest (see PCC_TAKE_EXTENSION) is written to the first target. It lists the stripe files and the
+    /// recorded cameras, and is everything PcTakeReader needs to reassemble the take. When the recording stops, the
+    /// stripe journals are merged into a PcRecordingIndex written next to the manifest, for fast seeking.
+    ///
+    /// Unless disabled, every recorded frame is also sent to a proxy stripe on the first target, which stores it
+    /// downscaled (1/4 resolution by default, i.e. 1/16 of the data) with its own index. Review tools can open the
+    /// proxy stream with PcTakeReader to scrub a take while reading a fraction of its bytes. The proxy shares the
+    /// recorded chunk, so it costs no extra copy on the acquisition threads; if it falls behind, proxy frames are
+    /// dropped without affecting the full-resolution recording.
+    class PcRecorder
+    {
+    private:
+        typedef boost::mutex                    MutexType;  ///< The mutex used to serialise frame routing.
+        typedef boost::lock_guard<MutexType>    GuardType;  ///< The RAII lock used together with MutexType.
+
+    public:
+        /// \brief Constructor.
+        /// \param [in] iTakeName       the name of the take, used to build the file names
+        /// \param [in] iTargets        the target directories, one stripe per directory
+        /// \param [in] iQueueCapacity  the maximum number of frames waiting to be written on each target
+        /// \param [in] iProxyScale     the downscaling factor of the proxy stream, 1 or less to disable it
+        PCCORE_EXPORT PcRecorder (
+            std::string const&          iTakeName,
+            VEC(std::string) const&     iTargets,
+            unsigned int const&         iQueueCapacity = 16u,
+            unsigned int const&         iProxyScale = 4u
+        );
+
+        /// \brief Destructor. Stops the recording if it is still running.
+        PCCORE_EXPORT ~PcRecorder ();
+
+        /// \brief Opens every stripe and writes the initial take manifest.
+        ///
+        /// Targets that can't be opened are left out of the take.
+        ///
+        /// \return true if at least one stripe could be opened, false otherwise
+        PCCORE_EXPORT bool Start ();
+
+        /// \brief Writes every pending frame, closes the stripes, and writes the take index and the final take manifest.
+        PCCORE_EXPORT void Stop ();
+
+        /// \brief Routes a frame to one of the stripes.
+        ///
+        /// Copies the frame data, so the frame may be reused as soon as this method returns. Never blocks on I/O.
+        ///
+        /// \param [in] iCameraId   the GUID of the camera that produced the frame
+        /// \param [in] iFrame      the frame to be recorded
+        /// \return true if the frame was queued, false if it was dropped
+        PCCORE_EXPORT bool Record ( std::string const& iCameraId, PcFramePtr const& iFrame );
+
+        /// \brief Gets the path of the take manifest.
+        /// \return a constant reference to the manifest path
+        inline std::string const& GetManifestPath () const { return m_manifestPath; }
+
+        /// \brief Gets the number of frames queued for writing since the recording started.
+        /// \return the number of recorded frames
+        PCCORE_EXPORT boost::uint64_t GetRecordedFrames ();
+
+        /// \brief Gets the number of frames that didn't go to their preferred target because its queue was full.
+        /// \return the number of spilled frames
+        PCCORE_EXPORT boost::uint64_t GetSpilledFrames ();
+
+        /// \brief Gets the number of frames dropped because every target's queue was full.
+        /// \return the number of dropped frames
+        PCCORE_EXPORT boost::uint64_t GetDroppedFrames ();
+
+        /// \brief Gets the number of recorded frames left out of the proxy stream because its queue was full.
+        /// \return the number of frames missing from the proxy stream
+        PCCORE_EXPORT boost::uint64_t GetDroppedProxyFrames ();
+
+    private:
+        /// \brief Private copy constructor.
+        ///
+        /// Disables copy of PcRecorder objects.
+        PcRecorder ( PcRecorder const& iOther ) {}
+
+        /// \brief Private assignment operator.
+        ///
+        /// Disables assignment of PcRecorder objects.
+        /// \return this object, unchanged
+        PcRecorder& operator= ( PcRecorder const& iOther ) { return (*this); }
+
+        /// \brief Gets the manifest index of a camera, registering it if it is new. Expects m_mutex to be locked.
+        /// \param [in] iCameraId   the GUID of the camera
+        /// \return the index of the camera in the take manifest
+        unsigned int GetCameraIndex ( std::string const& iCameraId );
+
+        /// \brief Writes the take manifest to the first target.
+        /// \return true upon success, false otherwise
+        bool WriteManifest ();
+
+        /// \brief Merges the journals of a set of stripes into an index. Expects the stripes to be closed.
+        /// \param [in] iStripes    the stripes to be indexed
+        /// \param [in] iPath       the path of the index file
+        /// \return true upon success, false otherwise
+        bool WriteIndex ( VEC(PcRecordingStripePtr) const& iStripes, std::string const& iPath );
+
+    private:
+        MutexType                       m_mutex;            ///< The mutex used to serialise frame routing.
+
+        std::string                     m_takeName;         ///< The name of the take.
+        VEC(std::string)                m_targets;          ///< The target directories.
+        unsigned int                    m_queueCapacity;    ///< The per-target queue capacity.
+        unsigned int                    m_proxyScale;       ///< The downscaling factor of the proxy stream.
+        std::string                     m_manifestPath;     ///< The path of the take manifest.
+        std::string                     m_indexPath;        ///< The path of the take index, empty until it is written.
+        std::string                     m_proxyIndexPath;   ///< The path of the proxy index, empty until it is written.
+
+        VEC(PcRecordingStripePtr)       m_stripes;          ///< The open stripes.
+        PcRecordingStripePtr            m_proxy;            ///< The proxy stripe, null if the proxy stream is disabled.
+        VEC(double)                     m_currentWeights;   ///< The running weights of the smooth weighted round-robin.
+
+        STRMAP(unsigned int)            m_cameraIndices;    ///< The manifest index of each recorded camera, indexed by GUID.
+        VEC(std::string)                m_cameraIds;        ///< The recorded cameras' GUIDs, in manifest order.
+
+        bool                            m_isRecording;      ///< Indicates whether frames are being accepted.
+        boost::uint64_t                 m_sequence;         ///< The sequence number of the next recorded chunk.
+        boost::uint64_t                 m_spilled;          ///< The number of spilled frames.
+        boost::uint64_t                 m_dropped;          ///< The number of dropped frames.
+        boost::uint64_t                 m_proxyDropped;     ///< The number of frames missing from the proxy stream.
+    };
+
+    typedef boost::shared_ptr<PcRecorder> PcRecorderPtr;    ///< A reference-counted pointer to a PcRecorder.
+}
+
+#endif // PCRECORDER_H
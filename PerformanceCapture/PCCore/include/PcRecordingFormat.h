@@ -0,0 +1,96 @@
+#ifndef PCRECORDINGFORMAT_H
+#define PCRECORDINGFORMAT_H
+
+#include <boost/cstdint.hpp>
+
+#include <cstdio>
+#include <string>
+
+#if defined(WIN32)
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+namespace pcc
+{
+    /// \ingroup PCCORE
+    ///
+    /// \brief Header preceding every frame chunk written to a recording stripe.
+    ///
+    /// A take is recorded as a set of stripe files, one per recording target. Each stripe file is a plain
+    /// sequence of chunks, where each chunk is a PcChunkHeader immediately followed by PayloadSize bytes of
+    /// raw frame data. The global Sequence number allows readers to reassemble the take in recording order
+    /// regardless of which stripe a chunk was written to.
+    ///
+    /// The structure is packed so that its on-disk layout does not depend on the compiler.
+#pragma pack(push, 1)
+    struct PcChunkHeader
+    {
+        boost::uint32_t     Magic;          ///< Always PcChunkHeader::MAGIC.
+        boost::uint16_t     Version;        ///< The chunk format version.
+        boost::uint16_t     Camera;         ///< The index of the camera in the take manifest.
+        boost::uint64_t     Sequence;       ///< The take-wide sequence number of the chunk.
+        boost::uint64_t     FrameId;        ///< The camera frame ID.
+        boost::uint64_t     Timestamp;      ///< The camera timestamp, in camera clock ticks.
+        boost::uint32_t     Width;          ///< The frame width, in pixels.
+        boost::uint32_t     Height;         ///< The frame height, in pixels.
+        boost::uint32_t     Channels;       ///< The number of 8-bit channels per pixel.
+        boost::uint32_t     PayloadSize;    ///< The number of bytes of frame data following the header.
+
+        static boost::uint32_t const    MAGIC   = 0x4b4e4350u;  ///< "PCNK" in little-endian order.
+        static boost::uint16_t const    VERSION = 1u;           ///< The current chunk format version.
+    };
+#pragma pack(pop)
+
+    /// \brief The extension of the take manifest files.
+    static char const* const PCC_TAKE_EXTENSION     = ".pctake";
+
+    /// \brief The extension of the stripe files.
+    static char const* const PCC_STRIPE_EXTENSION   = ".pcs";
+
+    /// \brief The suffix added to the take name to name the proxy stream files.
+    static char const* const PCC_PROXY_SUFFIX       = ".proxy";
+
+    /// \brief Moves a file's position indicator to an absolute 64-bit offset.
+    /// \param [in] iFile       the file to seek in
+    /// \param [in] iOffset     the absolute offset, in bytes
+    /// \return true upon success, false otherwise
+    inline bool PcFileSeek ( FILE* iFile, boost::uint64_t const& iOffset )
+    {
+#if defined(WIN32)
+        return ( _fseeki64 ( iFile, (__int64)iOffset, SEEK_SET ) == 0 );
+#else
+        return ( fseeko ( iFile, (off_t)iOffset, SEEK_SET ) == 0 );
+#endif
+    }
+
+    /// \brief Reads a file's current 64-bit position.
+    /// \param [in] iFile       the file to query
+    /// \return the current offset, in bytes
+    inline boost::uint64_t PcFileTell ( FILE* iFile )
+    {
+#if defined(WIN32)
+        return (boost::uint64_t)_ftelli64 ( iFile );
+#else
+        return (boost::uint64_t)ftello ( iFile );
+#endif
+    }
+
+    /// \brief Flushes a file's buffers and asks the operating system to commit its data to the device.
+    /// \param [in] iFile       the file to synchronise
+    /// \return true upon success, false otherwise
+    inline bool PcFileSync ( FILE* iFile )
+    {
+        if ( fflush ( iFile ) != 0 ) {
+            return false;
+        }
+#if defined(WIN32)
+        return ( _commit ( _fileno ( iFile ) ) == 0 );
+#else
+        return ( fsync ( fileno ( iFile ) ) == 0 );
+#endif
+    }
+}
+
+#endif // PCRECORDINGFORMAT_H
@@ -0,0 +1,139 @@
+#ifndef PCRECORDINGINDEX_H
+#define PCRECORDINGINDEX_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+#include "PcRecordingFormat.h"
+
+#include <boost/cstdint.hpp>
+
+#include <string>
+#include <vector>
+
+namespace pcc
+{
+    /// \ingroup PCCORE
+    ///
+    /// \brief Locates one recorded frame. Packed, since arrays of entries are written to disk as they are.
+#pragma pack(push, 1)
+    struct PcIndexEntry
+    {
+        boost::uint64_t     Timestamp;  ///< The camera timestamp of the frame.
+        boost::uint64_t     FrameId;    ///< The camera frame ID of the frame.
+        boost::uint64_t     Sequence;   ///< The take-wide sequence number of the chunk holding the frame.
+        boost::uint64_t     Offset;     ///< The offset of the chunk header inside its stripe file, in bytes.
+        boost::uint16_t     Camera;     ///< The index of the camera in the take manifest.
+        boost::uint16_t     Stripe;     ///< The index of the stripe file holding the chunk.
+        boost::uint32_t     Reserved;   ///< Padding, always 0.
+    };
+#pragma pack(pop)
+
+    /// \brief The extension of the per-stripe index journals, appended to the stripe file name.
+    static char const* const PCC_JOURNAL_EXTENSION  = ".pcj";
+
+    /// \brief The extension of the take index files.
+    static char const* const PCC_INDEX_EXTENSION    = ".pcx";
+
+    /// \brief The default frame-set tolerance, in nanoseconds of frame timestamp (see PcCamera::ToNanoseconds): 1 ms.
+    static boost::uint64_t const PCC_FRAME_SET_TOLERANCE = 1000000u;
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Sorted index of the frames of a take, for O(log n) seeking.
+    ///
+    /// The index keeps one array of PcIndexEntry per camera, sorted by timestamp, so that a frame can be looked up
+    /// by time or by frame ID with a binary search. It also keeps a frame-set index: every frame set groups the frames
+    /// of all cameras taken at the same instant (within a tolerance), and holds for each camera the position of its
+    /// frame in the camera's array, or PcRecordingIndex::NO_FRAME.
+    ///
+    /// While recording, each stripe appends one entry per written chunk to a journal file. The journals are merged
+    /// into the take index when the recording stops, so an interrupted take can still be indexed from its journals.
+    class PcRecordingIndex
+    {
+    public:
+        static boost::uint32_t const    NO_FRAME = 0xffffffffu; ///< Marks a camera missing from a frame set.
+
+        /// \brief Default constructor. Creates an empty index.
+        PCCORE_EXPORT PcRecordingIndex ();
+
+        /// \brief Builds the index from an unordered list of entries.
+        /// \param [in] iEntries        the entries of every recorded frame, in any order
+        /// \param [in] iCameraCount    the number of cameras in the take
+        /// \param [in] iSetTolerance   the maximum timestamp difference between frames of the same frame set
+        PCCORE_EXPORT void Build (
+            VEC(PcIndexEntry) const&    iEntries,
+            unsigned int const&         iCameraCount,
+            boost::uint64_t const&      iSetTolerance
+        );
+
+        /// \brief Writes the index to a file and commits it to the device.
+        /// \param [in] iPath   the path of the index file
+        /// \return true upon success, false otherwise
+        PCCORE_EXPORT bool Save ( std::string const& iPath ) const;
+
+        /// \brief Reads the index from a file.
+        /// \param [in] iPath   the path of the index file
+        /// \return true upon success, false otherwise
+        PCCORE_EXPORT bool Load ( std::string const& iPath );
+
+        /// \brief Appends the entries stored in an index journal to a list.
+        ///
+        /// A partially written entry at the end of the journal is ignored.
+        ///
+        /// \param [in]  iPath      the path of the journal
+        /// \param [out] oEntries   the list the entries are appended to
+        /// \return true if the journal could be opened, false otherwise
+        PCCORE_EXPORT static bool ReadJournal ( std::string const& iPath, VEC(PcIndexEntry)& oEntries );
+
+        /// \brief Gets the number of cameras in the index.
+        /// \return the number of cameras
+        inline unsigned int GetCameraCount () const { return m_cameras.size (); }
+
+        /// \brief Gets the frames of a camera, sorted by timestamp.
+        /// \param [in] iCamera     the index of the camera
+        /// \return a constant reference to the camera's entries
+        inline VEC(PcIndexEntry) const& GetCameraEntries ( unsigned int const& iCamera ) const { return m_cameras[iCamera]; }
+
+        /// \brief Finds the first frame of a camera taken at or after a given time.
+        /// \param [in] iCamera     the index of the camera
+        /// \param [in] iTimestamp  the timestamp to look for
+        /// \return the position of the frame in the camera's entries, or their size if there is none
+        PCCORE_EXPORT size_t FindByTimestamp ( unsigned int const& iCamera, boost::uint64_t const& iTimestamp ) const;
+
+        /// \brief Finds the first frame of a camera whose frame ID is equal to or greater than a given ID.
+        /// \param [in] iCamera     the index of the camera
+        /// \param [in] iFrameId    the frame ID to look for
+        /// \return the position of the frame in the camera's entries, or their size if there is none
+        PCCORE_EXPORT size_t FindByFrameId ( unsigned int const& iCamera, boost::uint64_t const& iFrameId ) const;
+
+        /// \brief Gets the number of frame sets.
+        /// \return the number of frame sets
+        inline size_t GetFrameSetCount () const { return m_setTimestamps.size (); }
+
+        /// \brief Gets the timestamp of a frame set, i.e. the timestamp of its earliest frame.
+        /// \param [in] iSet    the index of the frame set
+        /// \return the timestamp of the frame set
+        inline boost::uint64_t const& GetFrameSetTimestamp ( size_t const& iSet ) const { return m_setTimestamps[iSet]; }
+
+        /// \brief Gets the position of a camera's frame within a frame set.
+        /// \param [in] iSet        the index of the frame set
+        /// \param [in] iCamera     the index of the camera
+        /// \return the position of the frame in the camera's entries, or NO_FRAME if the camera missed the set
+        inline boost::uint32_t const& GetFrameSetFrame ( size_t const& iSet, unsigned int const& iCamera ) const
+        {
+            return m_setFrames[iSet * m_cameras.size () + iCamera];
+        }
+
+        /// \brief Finds the first frame set taken at or after a given time.
+        /// \param [in] iTimestamp  the timestamp to look for
+        /// \return the index of the frame set, or GetFrameSetCount () if there is none
+        PCCORE_EXPORT size_t FindFrameSet ( boost::uint64_t const& iTimestamp ) const;
+
+    private:
+        VECOFVECS(PcIndexEntry)         m_cameras;          ///< The entries of each camera, sorted by timestamp.
+        VEC(boost::uint64_t)            m_setTimestamps;    ///< The timestamp of each frame set.
+        VEC(boost::uint32_t)            m_setFrames;        ///< The per-camera frame positions of each frame set, one row per set.
+    };
+}
+
+#endif // PCRECORDINGINDEX_H
@@ -0,0 +1,85 @@
+#ifndef PCREMAP_H
+#define PCREMAP_H
+
+#include "PcExport.h"
+
+#include <opencv2/opencv.hpp>
+
+#define BOOST_ALL_DYN_LINK
+#include <boost/shared_ptr.hpp>
+
+namespace pcc
+{
+    /// \ingroup PCCORE
+    ///
+    /// \brief A precomputed pixel map, e.g. to undistort or rectify the frames of a camera. Never modified once built.
+    ///
+    /// Every output pixel stores its source position in 16-bit fixed point, like the maps cv::convertMaps produces:
+    /// the integer part of the position in Coordinates, and its fractional part in Weights, as 5 bits along x and 5
+    /// bits along y. A map takes 6 bytes per pixel, against 8 for a pair of float maps, and its bilinear weights need
+    /// no conversion.
+    struct PcRemapMap
+    {
+        cv::Mat                         Coordinates;    ///< The integer source position of every output pixel, as CV_16SC2.
+        cv::Mat                         Weights;        ///< The fractional source position of every output pixel, ( y & 31 ) * 32 + ( x & 31 ), as CV_16UC1.
+        cv::Mat                         CameraMatrix;   ///< The intrinsic matrix of the output image, as a 3x3 matrix of doubles.
+    };
+
+    typedef boost::shared_ptr<PcRemapMap const> PcRemapMapPtr;   ///< A reference-counted pointer to an immutable PcRemapMap.
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Builds the map that undistorts the frames of a camera.
+    ///
+    /// The undistorted image keeps the camera matrix of the camera, so points keep their meaning across both images
+    /// except for the distortion. The output pixels whose source falls outside of the frame are black.
+    ///
+    /// \param [in] iCameraMatrix   the intrinsic camera matrix
+    /// \param [in] iDistCoeffs     the distortion coefficients
+    /// \param [in] iFrameSize      the frame size, in pixels
+    /// \return the map, null if the frame size is empty
+    PCCORE_EXPORT PcRemapMapPtr PcCreateUndistortMap ( cv::Mat const& iCameraMatrix, cv::Mat const& iDistCoeffs, cv::Size const& iFrameSize );
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Builds the maps that rectify the frames of a stereo pair, so that corresponding points share their row.
+    ///
+    /// \param [in]  iLeftCameraMatrix  the intrinsic matrix of the left camera
+    /// \param [in]  iLeftDistCoeffs    the distortion coefficients of the left camera
+    /// \param [in]  iRightCameraMatrix the intrinsic matrix of the right camera
+    /// \param [in]  iRightDistCoeffs   the distortion coefficients of the right camera
+    /// \param [in]  iFrameSize         the frame size of both cameras, in pixels
+    /// \param [in]  iRotation          the rotation from the left camera to the right camera
+    /// \param [in]  iTranslation       the translation from the left camera to the right camera
+    /// \param [out] oLeft              the map of the left camera
+    /// \param [out] oRight             the map of the right camera
+    /// \param [out] oDisparityToDepth  the 4x4 disparity-to-depth matrix of the rectified pair (see cv::reprojectImageTo3D)
+    /// \return true upon success, false if the frame size is empty or the rectification failed
+    PCCORE_EXPORT bool PcCreateRectifyMaps (
+        cv::Mat const&          iLeftCameraMatrix,
+        cv::Mat const&          iLeftDistCoeffs,
+        cv::Mat const&          iRightCameraMatrix,
+        cv::Mat const&          iRightDistCoeffs,
+        cv::Size const&         iFrameSize,
+        cv::Mat const&          iRotation,
+        cv::Mat const&          iTranslation,
+        PcRemapMapPtr&          oLeft,
+        PcRemapMapPtr&          oRight,
+        cv::Mat&                oDisparityToDepth
+    );
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Resamples an image through a map, with bilinear interpolation.
+    ///
+    /// The output is split into tiles that run in parallel on the shared PcThreadPool. Single-channel 8-bit images
+    /// take an SSE2 path, which interpolates 8 pixels at a time in fixed point; other types fall back to cv::remap.
+    /// The output pixels whose source falls outside of the image are black.
+    ///
+    /// \param [in]  iSrc       the image to resample, which mustn't share its data with oDst
+    /// \param [in]  iMap       the map, whose size is the output size
+    /// \param [out] oDst       the resampled image. Reallocated only if its size or type don't match
+    PCCORE_EXPORT void PcRemap ( cv::Mat const& iSrc, PcRemapMap const& iMap, cv::Mat& oDst );
+}
+
+#endif // PCREMAP_H
@@ -0,0 +1,144 @@
+#ifndef PCRIGCALIBRATOR_H
+#define PCRIGCALIBRATOR_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+#include "PcRecordingIndex.h"
+
+#include <opencv2/opencv.hpp>
+
+#define BOOST_ALL_DYN_LINK
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace pcc
+{
+    /// \brief The camera poses calculated by a PcRigCalibrator. Published as a whole and never modified afterwards.
+    struct PcRigSolution
+    {
+        std::string                     WorldCamera;    ///< The GUID of the camera whose frame is the world frame.
+        STRMAP(cv::Mat)                 Rotations;      ///< The 3x3 rotation from the world frame to each solved camera frame.
+        STRMAP(cv::Mat)                 Translations;   ///< The 3x1 translation from the world frame to each solved camera frame.
+        double                          Rms;            ///< The RMS reprojection error over every used observation, in pixels.
+    };
+
+    typedef boost::shared_ptr<PcRigSolution const> PcRigSolutionPtr;    ///< A reference-counted pointer to an immutable PcRigSolution.
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Calibrates the poses of every camera of a rig in a single world frame.
+    ///
+    /// The calibrator collects the chessboard observations of all cameras and groups those taken at the same instant,
+    /// within a timestamp tolerance, into board views. Given the intrinsics of every camera, Solve then:
+    ///     - Builds the co-visibility graph of the cameras, where two cameras are linked by the number of board views
+    ///       both of them observed.
+    ///     - Picks the camera with the most observations as the world frame and walks a maximum spanning tree of the
+    ///       graph from it, chaining the relative pose of every camera to its parent, estimated from the board poses
+    ///       given by cv::solvePnP in the views they share.
+    ///     - Refines the poses of all cameras and board views together with a sparse bundle adjustment (Levenberg-Marquardt).
+    ///       Each board view only involves the cameras that observed it, so the board poses are eliminated with a Schur
+    ///       complement and only the reduced camera system, 6 unknowns per camera, is solved densely. The Jacobians and
+    ///       the per-view blocks are evaluated on the shared PcThreadPool.
+    ///
+    /// Apart from the reduced camera system, the work of every iteration is linear in the number of board views.
+    /// The intrinsics are held fixed. Views seen by a single camera don't constrain the extrinsics and are ignored, as
+    /// are cameras the co-visibility graph doesn't connect to the world camera.
+    ///
+    /// Every method may be called from any thread. Solve is meant to run as a background task: it works on a snapshot of
+    /// the observations and intrinsics, and publishes its result atomically as a PcRigSolution once done.
+    class PcRigCalibrator
+    {
+    public:
+        /// \brief Constructor.
+        /// \param [in] iBoardPoints    the chessboard points, in board coordinates, in the order the corners are detected
+        /// \param [in] iTolerance      the maximum difference between the timestamps of the observations of a board view
+        PCCORE_EXPORT PcRigCalibrator ( VEC(cv::Point3f) const& iBoardPoints, boost::uint64_t const& iTolerance = PCC_FRAME_SET_TOLERANCE );
+
+        /// \brief Registers a camera and its intrinsics. Only the observations of registered cameras are used by Solve. Thread-safe.
+        /// \param [in] iCameraId       the camera GUID
+        /// \param [in] iCameraMatrix   the intrinsic camera matrix
+        /// \param [in] iDistCoeffs     the distortion coefficients
+        PCCORE_EXPORT void SetIntrinsics ( std::string const& iCameraId, cv::Mat const& iCameraMatrix, cv::Mat const& iDistCoeffs );
+
+        /// \brief Records a chessboard observation. Thread-safe.
+        /// \param [in] iCameraId       the GUID of the camera that observed the board
+        /// \param [in] iTimestamp      the camera timestamp of the frame
+        /// \param [in] iCorners        the detected chessboard corners, in the order of the board points
+        PCCORE_EXPORT void AddObservation ( std::string const& iCameraId, boost::uint64_t const& iTimestamp, VEC(cv::Point2f) const& iCorners );
+
+        /// \brief Calculates the camera poses from the observations recorded so far, and publishes them.
+        ///
+        /// Returns at once if another solve is running.
+        ///
+        /// \param [in] iMaxIterations  the maximum number of bundle adjustment iterations
+        /// \return true upon success, false if another solve is running or if fewer than two registered cameras
+        ///         share board views
+        PCCORE_EXPORT bool Solve ( unsigned int const& iMaxIterations = 50u );
+
+        /// \brief Gets the poses published by the last successful Solve. Thread-safe.
+        /// \return the solution, null if no solve succeeded
+        inline PcRigSolutionPtr GetSolution () const { return boost::atomic_load ( &m_solution ); }
+
+        /// \brief Tells whether a solve is running. Thread-safe.
+        /// \return true while Solve runs
+        inline bool IsSolving () const { return m_isSolving.load (); }
+
+        /// \brief Gets the number of observations recorded so far. Thread-safe.
+        /// \return the number of observations
+        PCCORE_EXPORT size_t GetObservationCount ();
+
+    private:
+        /// \brief A chessboard observation.
+        struct Observation
+        {
+            std::string                 CameraId;       ///< The GUID of the observing camera.
+            boost::uint64_t             Timestamp;      ///< The camera timestamp of the frame.
+            VEC(cv::Point2f)            Corners;        ///< The detected corners.
+        };
+
+        /// \brief The intrinsics of a registered camera.
+        struct Intrinsics
+        {
+            cv::Mat                     CameraMatrix;   ///< The intrinsic camera matrix.
+            cv::Mat                     DistCoeffs;     ///< The distortion coefficients.
+        };
+
+        /// \brief Private copy constructor.
+        ///
+        /// Disables copy of PcRigCalibrator objects.
+        /// \param [in] iOther      the object to be copied
+        PcRigCalibrator ( PcRigCalibrator const& iOther ) {}
+
+        /// \brief Private assignment operator.
+        ///
+        /// Disables assignment of PcRigCalibrator objects.
+        /// \param [in] iOther      the object to be assigned to this object.
+        /// \return this object, unchanged
+        PcRigCalibrator& operator= ( PcRigCalibrator const& iOther ) { return (*this); }
+
+        /// \brief Solves the camera poses, with m_solveMutex held.
+        /// \param [in] iMaxIterations  the maximum number of bundle adjustment iterations
+        /// \return true upon success
+        bool DoSolve ( unsigned int const& iMaxIterations );
+
+    private:
+        VEC(cv::Point3f)                m_boardPoints;  ///< The chessboard points, in board coordinates.
+        boost::uint64_t                 m_tolerance;    ///< The timestamp tolerance of a board view.
+        boost::mutex                    m_mutex;        ///< Locks the observation list and the intrinsics.
+        boost::mutex                    m_solveMutex;   ///< Held while solving, so that solves don't overlap.
+        boost::atomic<bool>             m_isSolving;    ///< Whether a solve is running.
+        VEC(Observation)                m_observations; ///< The observations recorded so far.
+        STRMAP(Intrinsics)              m_intrinsics;   ///< The intrinsics of the registered cameras.
+        PcRigSolutionPtr                m_solution;     ///< The last successful solution, null if none. Accessed atomically.
+    };
+
+    typedef boost::shared_ptr<PcRigCalibrator> PcRigCalibratorPtr;    ///< A reference-counted pointer to a PcRigCalibrator object.
+}
+
+#endif // PCRIGCALIBRATOR_H
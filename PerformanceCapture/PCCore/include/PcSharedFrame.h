@@ -0,0 +1,114 @@
+#ifndef PCSHAREDFRAME_H
+#define PCSHAREDFRAME_H
+
+#define BOOST_ALL_DYN_LINK
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+
+#if defined(WIN32)
+    #include <boost/interprocess/windows_shared_memory.hpp>
+#else
+    #include <boost/interprocess/shared_memory_object.hpp>
+#endif
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <cctype>
+#include <string>
+
+namespace pcc
+{
+#if defined(WIN32)
+    /// \brief The shared memory object type. Native Windows shared memory disappears with its last handle.
+    typedef boost::interprocess::windows_shared_memory      PcSharedMemoryType;
+#else
+    /// \brief The shared memory object type. POSIX shared memory, removed explicitly by the publisher.
+    typedef boost::interprocess::shared_memory_object       PcSharedMemoryType;
+#endif
+
+    /// \brief The alignment of every block inside a shared frame segment, in bytes (one cache line).
+    static boost::uint64_t const PCC_SHARED_ALIGNMENT       = 64u;
+
+    /// \brief The maximum number of cameras listed in the shared camera directory.
+    static unsigned int const PCC_SHARED_MAX_CAMERAS        = 64u;
+
+    /// \brief The maximum length of a camera GUID in the shared camera directory, terminating zero included.
+    static unsigned int const PCC_SHARED_MAX_ID_LENGTH      = 64u;
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Header at the start of a camera's shared frame segment.
+    ///
+    /// A segment holds a ring of SlotCount slots, each made of a PcSharedSlotHeader padded to PCC_SHARED_ALIGNMENT
+    /// followed by up to PayloadCapacity bytes of frame data. Slot k starts at PCC_SHARED_ALIGNMENT + k * SlotStride.
+    /// The frame with sequence number n is written to slot n % SlotCount, and Published holds the number of frames
+    /// published so far, so the latest frame is Published - 1.
+    struct PcSharedSegmentHeader
+    {
+        boost::uint32_t                 Magic;              ///< Always PcSharedSegmentHeader::MAGIC.
+        boost::uint32_t                 Version;            ///< The segment layout version.
+        boost::uint32_t                 SlotCount;          ///< The number of slots in the ring.
+        boost::uint32_t                 Reserved;           ///< Padding, always 0.
+        boost::uint64_t                 SlotStride;         ///< The distance between two slots, in bytes.
+        boost::uint64_t                 PayloadCapacity;    ///< The maximum size of a frame, in bytes.
+        boost::atomic<boost::uint64_t>  Published;          ///< The number of frames published so far.
+
+        static boost::uint32_t const    MAGIC   = 0x4d524650u;  ///< "PFRM" in little-endian order.
+        static boost::uint32_t const    VERSION = 1u;           ///< The current segment layout version.
+    };
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Header of a slot in a shared frame segment.
+    ///
+    /// Slots are guarded by a sequence lock: the publisher makes Lock odd before touching the slot and even again
+    /// once the frame is complete. A consumer reads Lock before and after using the slot, and knows the data is
+    /// consistent if both values are equal and even. The publisher never waits for consumers.
+    struct PcSharedSlotHeader
+    {
+        boost::atomic<boost::uint64_t>  Lock;           ///< The sequence lock of the slot, odd while it is being written.
+        boost::uint64_t                 Sequence;       ///< The publication sequence number of the frame.
+        boost::uint64_t                 Timestamp;      ///< The camera timestamp of the frame.
+        boost::uint64_t                 FrameId;        ///< The camera frame ID of the frame.
+        boost::uint32_t                 Width;          ///< The frame width, in pixels.
+        boost::uint32_t                 Height;         ///< The frame height, in pixels.
+        boost::uint32_t                 Channels;       ///< The number of 8-bit channels per pixel.
+        boost::uint32_t                 PayloadSize;    ///< The number of bytes of frame data in the slot.
+    };
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Segment listing the cameras currently published, so consumers can discover them.
+    struct PcSharedDirectory
+    {
+        boost::uint32_t                 Magic;          ///< Always PcSharedSegmentHeader::MAGIC.
+        boost::atomic<boost::uint32_t>  Count;          ///< The number of valid entries in Cameras.
+        char                            Cameras[PCC_SHARED_MAX_CAMERAS][PCC_SHARED_MAX_ID_LENGTH];  ///< The camera GUIDs.
+    };
+
+    /// \brief The name of the shared camera directory segment.
+    static char const* const PCC_SHARED_DIRECTORY_NAME  = "PcFrames";
+
+    /// \brief Gets the name of a camera's shared frame segment.
+    /// \param [in] iCameraId   the GUID of the camera
+    /// \return the segment name, with any character not allowed in a shared memory name replaced by '_'
+    inline std::string PcSharedSegmentName ( std::string const& iCameraId )
+    {
+        std::string name = std::string ( PCC_SHARED_DIRECTORY_NAME ) + "_" + iCameraId;
+        for ( auto c = name.begin (); c != name.end (); c++ ) {
+            if ( !isalnum ( (unsigned char)*c ) ) {
+                *c = '_';
+            }
+        }
+        return name;
+    }
+
+    /// \brief Rounds a size up to the next multiple of PCC_SHARED_ALIGNMENT.
+    /// \param [in] iSize   the size to round, in bytes
+    /// \return the rounded size, in bytes
+    inline boost::uint64_t PcSharedAlign ( boost::uint64_t const& iSize )
+    {
+        return ( iSize + PCC_SHARED_ALIGNMENT - 1u ) / PCC_SHARED_ALIGNMENT * PCC_SHARED_ALIGNMENT;
+    }
+}
+
+#endif // PCSHAREDFRAME_H
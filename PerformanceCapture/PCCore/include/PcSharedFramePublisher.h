@@ -0,0 +1,163 @@
+#ifndef PCSHAREDFRAMEPUBLISHER_H
+#define PCSHAREDFRAMEPUBLISHER_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+#include "PcSharedFrame.h"
+
+#define BOOST_ALL_DYN_LINK
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <map>
+#include <string>
+
+namespace pcc
+{
+    /// \ingroup PCCORE
+    ///
+    /// \brief The shared frame segment of a single camera, on the publisher side.
+    ///
+    /// Creates the segment with room for SlotCount frames of a fixed maximum size, and writes frames to it
+    /// in a ring. Only one thread may publish to a segment at a time, which is the case since each camera's frames
+    /// are delivered by its own frame observer thread.
+    class PcSharedFrameSegment
+    {
+    public:
+        /// \brief Constructor. Creates and maps the segment, replacing any stale segment with the same name.
+        /// \param [in] iCameraId           the GUID of the camera
+        /// \param [in] iSlotCount          the number of slots in the ring
+        /// \param [in] iPayloadCapacity    the maximum size of a frame, in bytes
+        PcSharedFrameSegment (
+            std::string const&      iCameraId,
+            unsigned int const&     iSlotCount,
+            boost::uint64_t const&  iPayloadCapacity
+        );
+
+        /// \brief Destructor. Unmaps the segment and removes it, so that new consumers can't open it anymore.
+        ~PcSharedFrameSegment ();
+
+        /// \brief Tells whether the segment was successfully created.
+        /// \return true if frames can be published, false otherwise
+        inline bool IsOpen () const { return ( m_header != 0x0 ); }
+
+        /// \brief Gets the maximum size of a frame.
+        /// \return the payload capacity of each slot, in bytes
+        inline boost::uint64_t GetPayloadCapacity () const { return m_header ? m_header->PayloadCapacity : 0u; }
+
+        /// \brief Copies a frame to the next slot of the ring and publishes it.
+        /// \param [in] iWidth      the frame width, in pixels
+        /// \param [in] iHeight     the frame height, in pixels
+        /// \param [in] iChannels   the number of 8-bit channels per pixel
+        /// \param [in] iData       the frame data, iWidth * iHeight * iChannels bytes
+        /// \param [in] iTimestamp  the camera timestamp of the frame
+        /// \param [in] iFrameId    the camera frame ID of the frame
+        /// \return true if the frame was published, false if it doesn't fit in a slot
+        bool Publish (
+            unsigned int const&     iWidth,
+            unsigned int const&     iHeight,
+            unsigned int const&     iChannels,
+            unsigned char const*    iData,
+            boost::uint64_t const&  iTimestamp,
+            boost::uint64_t const&  iFrameId
+        );
+
+    private:
+        /// \brief Private copy constructor.
+        ///
+        /// Disables copy of PcSharedFrameSegment objects.
+        PcSharedFrameSegment ( PcSharedFrameSegment const& iOther ) {}
+
+        /// \brief Private assignment operator.
+        ///
+        /// Disables assignment of PcSharedFrameSegment objects.
+        /// \return this object, unchanged
+        PcSharedFrameSegment& operator= ( PcSharedFrameSegment const& iOther ) { return (*this); }
+
+    private:
+        std::string                             m_name;     ///< The name of the segment.
+        PcSharedMemoryType                      m_memory;   ///< The shared memory object.
+        boost::interprocess::mapped_region      m_region;   ///< The mapping of the segment.
+        PcSharedSegmentHeader*                  m_header;   ///< The segment header, null if the segment couldn't be created.
+    };
+
+    typedef boost::shared_ptr<PcSharedFrameSegment> PcSharedFrameSegmentPtr;    ///< A reference-counted pointer to a PcSharedFrameSegment.
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Publishes the frames of every camera to shared memory, for out-of-process consumers.
+    ///
+    /// Each camera gets its own segment (see PcSharedSegmentName), created when its first frame is published and
+    /// sized after that frame, and is listed in a shared directory segment. Frames are copied into a ring of slots
+    /// guarded by sequence locks, so publishing never waits for a consumer: a slow consumer loses frames instead of
+    /// blocking capture. Consumers read the segments with PcSharedFrameReader.
+    ///
+    /// The segments are removed when the publisher is destroyed. Consumers that still have a segment mapped keep
+    /// reading its last frames until they close it.
+    class PcSharedFramePublisher
+    {
+    private:
+        typedef boost::mutex                    MutexType;  ///< The mutex used to lock the segment map.
+        typedef boost::lock_guard<MutexType>    GuardType;  ///< The RAII lock used together with MutexType.
+
+    public:
+        /// \brief Constructor. Creates the shared camera directory.
+        /// \param [in] iSlotCount  the number of frames kept in each camera's ring
+        PCCORE_EXPORT explicit PcSharedFramePublisher ( unsigned int const& iSlotCount = 8u );
+
+        /// \brief Destructor. Removes every segment.
+        PCCORE_EXPORT ~PcSharedFramePublisher ();
+
+        /// \brief Publishes a frame of a camera, creating the camera's segment on its first frame.
+        /// \param [in] iCameraId   the GUID of the camera
+        /// \param [in] iWidth      the frame width, in pixels
+        /// \param [in] iHeight     the frame height, in pixels
+        /// \param [in] iChannels   the number of 8-bit channels per pixel
+        /// \param [in] iData       the frame data, iWidth * iHeight * iChannels bytes
+        /// \param [in] iTimestamp  the camera timestamp of the frame
+        /// \param [in] iFrameId    the camera frame ID of the frame
+        /// \return true if the frame was published, false otherwise
+        PCCORE_EXPORT bool Publish (
+            std::string const&      iCameraId,
+            unsigned int const&     iWidth,
+            unsigned int const&     iHeight,
+            unsigned int const&     iChannels,
+            unsigned char const*    iData,
+            boost::uint64_t const&  iTimestamp,
+            boost::uint64_t const&  iFrameId
+        );
+
+    private:
+        /// \brief Private copy constructor.
+        ///
+        /// Disables copy of PcSharedFramePublisher objects.
+        PcSharedFramePublisher ( PcSharedFramePublisher const& iOther ) {}
+
+        /// \brief Private assignment operator.
+        ///
+        /// Disables assignment of PcSharedFramePublisher objects.
+        /// \return this object, unchanged
+        PcSharedFramePublisher& operator= ( PcSharedFramePublisher const& iOther ) { return (*this); }
+
+        /// \brief Gets the segment of a camera, creating it if needed. Expects m_mutex to be locked.
+        /// \param [in] iCameraId           the GUID of the camera
+        /// \param [in] iPayloadCapacity    the frame size to create the segment for
+        /// \return the camera's segment, null if it couldn't be created
+        PcSharedFrameSegmentPtr GetSegment ( std::string const& iCameraId, boost::uint64_t const& iPayloadCapacity );
+
+    private:
+        MutexType                               m_mutex;        ///< The mutex used to lock the segment map.
+        unsigned int                            m_slotCount;    ///< The number of slots in each camera's ring.
+
+        PcSharedMemoryType                      m_memory;       ///< The shared memory object of the camera directory.
+        boost::interprocess::mapped_region      m_region;       ///< The mapping of the camera directory.
+        PcSharedDirectory*                      m_directory;    ///< The camera directory, null if it couldn't be created.
+
+        STRMAP(PcSharedFrameSegmentPtr)         m_segments;     ///< The segment of each camera, indexed by GUID.
+    };
+
+    typedef boost::shared_ptr<PcSharedFramePublisher> PcSharedFramePublisherPtr;    ///< A reference-counted pointer to a PcSharedFramePublisher.
+}
+
+#endif // PCSHAREDFRAMEPUBLISHER_H
@@ -0,0 +1,138 @@
+#ifndef PCSHAREDFRAMEREADER_H
+#define PCSHAREDFRAMEREADER_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+#include "PcSharedFrame.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <string>
+#include <vector>
+
+namespace pcc
+{
+    /// \ingroup PCCORE
+    ///
+    /// \brief A frame read from shared memory, without copy.
+    ///
+    /// The image points straight into the publisher's slot, which the publisher will eventually overwrite. The view
+    /// can be used as long as PcSharedFrameReader::IsValid returns true for it, and any result computed from it should
+    /// be checked with PcSharedFrameReader::IsValid once done.
+    struct PcSharedFrameView
+    {
+        cv::Mat             Image;          ///< The frame image, mapped onto the shared slot.
+        boost::uint64_t     Sequence;       ///< The publication sequence number of the frame.
+        boost::uint64_t     Timestamp;      ///< The camera timestamp of the frame.
+        boost::uint64_t     FrameId;        ///< The camera frame ID of the frame.
+        unsigned int        Slot;           ///< The slot holding the frame.
+        boost::uint64_t     Lock;           ///< The value of the slot's sequence lock when the frame was read.
+    };
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Reads the frames a PcSharedFramePublisher publishes for one camera, from another process.
+    ///
+    /// The reader never writes to the camera's segment, so any number of consumers can follow the same camera without
+    /// affecting capture or each other. The segment is nevertheless mapped writable, since 64-bit atomic loads are
+    /// compare-exchanges on 32-bit x86. A consumer that falls more than a ring behind skips to the oldest frame still
+    /// available; the skipped frames are counted by GetLostFrames.
+    ///
+    /// A minimal consumer loop looks like this:
+    /// \code
+    /// pcc::PcSharedFrameReader reader ( cameraId );
+    /// pcc::PcSharedFrameView view;
+    /// while ( running ) {
+    ///     if ( !reader.IsOpen () && !reader.Open () ) { wait (); continue; }
+    ///     if ( !reader.ReadNext ( view ) ) { wait (); continue; }
+    ///     Process ( view.Image );
+    ///     if ( !reader.IsValid ( view ) ) { DiscardResults (); }
+    /// }
+    /// \endcode
+    class PcSharedFrameReader
+    {
+    public:
+        /// \brief Constructor. Does not open the segment.
+        /// \param [in] iCameraId   the GUID of the camera to read
+        PCCORE_EXPORT explicit PcSharedFrameReader ( std::string const& iCameraId );
+
+        /// \brief Opens and maps the camera's segment.
+        ///
+        /// The first frame returned by ReadNext is the latest frame published when the segment is opened.
+        ///
+        /// \return true upon success, false if the camera isn't being published
+        PCCORE_EXPORT bool Open ();
+
+        /// \brief Unmaps the camera's segment.
+        PCCORE_EXPORT void Close ();
+
+        /// \brief Tells whether the segment is open and still published.
+        ///
+        /// The segment is closed automatically when the publisher removes it, e.g. because the camera's frame format
+        /// changed. Calling Open again then maps the new segment.
+        ///
+        /// \return true if the segment can be read, false otherwise
+        PCCORE_EXPORT bool IsOpen ();
+
+        /// \brief Gets the next frame that wasn't read yet.
+        /// \param [out] oView  the frame
+        /// \return true if a new frame was read, false if there is none or the segment is closed
+        PCCORE_EXPORT bool ReadNext ( PcSharedFrameView& oView );
+
+        /// \brief Gets the latest frame, skipping any frame published since the last read.
+        ///
+        /// Skipped frames are not counted as lost.
+        ///
+        /// \param [out] oView  the frame
+        /// \return true if a new frame was read, false if there is none or the segment is closed
+        PCCORE_EXPORT bool ReadLatest ( PcSharedFrameView& oView );
+
+        /// \brief Tells whether a frame view still holds the frame it was read with.
+        /// \param [in] iView   the frame view
+        /// \return true if the publisher didn't touch the slot since the view was read, false otherwise
+        PCCORE_EXPORT bool IsValid ( PcSharedFrameView const& iView ) const;
+
+        /// \brief Copies the frame of a view to private memory.
+        /// \param [in]  iView      the frame view
+        /// \param [out] oImage     the copy of the frame
+        /// \return true if the copy is consistent, false if the slot was overwritten during the copy
+        PCCORE_EXPORT bool CopyFrame ( PcSharedFrameView const& iView, cv::Mat& oImage ) const;
+
+        /// \brief Gets the number of frames the reader fell too far behind to read with ReadNext.
+        /// \return the number of lost frames
+        inline boost::uint64_t GetLostFrames () const { return m_lost; }
+
+        /// \brief Lists the cameras currently published.
+        /// \return the GUIDs of the published cameras, empty if no publisher is running
+        PCCORE_EXPORT static VEC(std::string) ListCameras ();
+
+    private:
+        /// \brief Private copy constructor.
+        ///
+        /// Disables copy of PcSharedFrameReader objects.
+        PcSharedFrameReader ( PcSharedFrameReader const& iOther ) {}
+
+        /// \brief Private assignment operator.
+        ///
+        /// Disables assignment of PcSharedFrameReader objects.
+        /// \return this object, unchanged
+        PcSharedFrameReader& operator= ( PcSharedFrameReader const& iOther ) { return (*this); }
+
+        /// \brief Reads a given frame from its slot.
+        /// \param [in]  iSequence  the sequence number of the frame
+        /// \param [out] oView      the frame
+        /// \return true if the slot holds the frame and is consistent, false otherwise
+        bool ReadFrame ( boost::uint64_t const& iSequence, PcSharedFrameView& oView );
+
+    private:
+        std::string                             m_name;     ///< The name of the camera's segment.
+        PcSharedMemoryType                      m_memory;   ///< The shared memory object.
+        boost::interprocess::mapped_region      m_region;   ///< The mapping of the segment.
+        PcSharedSegmentHeader const*            m_header;   ///< The segment header, null while the segment is closed.
+
+        boost::uint64_t                         m_next;     ///< The sequence number of the next frame to read.
+        boost::uint64_t                         m_lost;     ///< The number of frames lost so far.
+    };
+}
+
+#endif // PCSHAREDFRAMEREADER_H
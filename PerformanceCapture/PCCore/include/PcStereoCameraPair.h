@@ -5,13 +5,44 @@
 
 #include "PcCommon.h"
 #include "PcCamera.h"
+#include "PcCalibrationCache.h"
+#include "PcFrame.h"
+#include "PcRemap.h"
 #include <opencv2/opencv.hpp>
 
+#define BOOST_ALL_DYN_LINK
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
 namespace pcc
 {
     class PcFrame;
     enum CalibrationState;
 
+    /// \brief A stereo calibration. Published as a whole and never modified afterwards.
+    struct PcStereoCalibration
+    {
+        cv::Mat                         Rotation;       ///< The rotation matrix from the left camera to the right camera.
+        cv::Mat                         Translation;    ///< The translation matrix from the left camera to the right camera.
+        cv::Mat                         Essential;      ///< The essential matrix.
+        cv::Mat                         Fundamental;    ///< The fundamental matrix.
+        double                          Rms;            ///< The RMS reprojection error of the stereo calibration.
+        boost::int64_t                  Date;           ///< The date of the stereo calibration, in seconds since the epoch.
+    };
+
+    typedef boost::shared_ptr<PcStereoCalibration const> PcStereoCalibrationPtr;  ///< A reference-counted pointer to an immutable PcStereoCalibration.
+
+    /// \brief The rectification of a stereo pair. Published as a whole and never modified afterwards.
+    struct PcStereoRectification
+    {
+        PcStereoCalibrationPtr          Calibration;        ///< The stereo calibration the maps were built from.
+        PcRemapMapPtr                   Left;               ///< The map that rectifies the frames of the left camera.
+        PcRemapMapPtr                   Right;              ///< The map that rectifies the frames of the right camera.
+        cv::Mat                         DisparityToDepth;   ///< The 4x4 disparity-to-depth matrix of the rectified pair.
+    };
+
+    typedef boost::shared_ptr<PcStereoRectification const> PcStereoRectificationPtr;  ///< A reference-counted pointer to an immutable PcStereoRectification.
+
     /// \ingroup PCCORE
     ///
     /// \brief Describes a stereo pair composed by two PcCameras.
@@ -26,8 +57,16 @@ namespace pcc
     ///
     /// Triggering of a stereo camera pair calibration is done via the callback system of the single camera
     /// calibration process. The OnCameraCalibrate function is registered as a callback on both cameras
-    /// of the stereo pair, so that once both cameras report back as calibrated, the calibration process of 
-    /// the stereo pair starts.
+    /// of the stereo pair, so that once both cameras report back as calibrated, the calibration of the
+    /// stereo pair is scheduled on the shared PcThreadPool. The cameras keep streaming meanwhile.
+    ///
+    /// The matrices are published as an immutable PcStereoCalibration, swapped in atomically once the solve
+    /// completes, so readers see either the previous calibration or the new one, never a mix of both. When
+    /// solves overlap, only the most recently scheduled one is published.
+    ///
+    /// Once enabled with SetRectification, the pair also rectifies the frames of both cameras as they arrive, with
+    /// fixed-point maps (see PcCreateRectifyMaps) rebuilt by UpdateRectification whenever the calibration changes,
+    /// and swapped in atomically like the calibration.
     class PcStereoCameraPair
     {
     public:
@@ -41,11 +80,50 @@ namespace pcc
             PcCameraPtr         iRight
         );
 
-        /// \brief Triggers actual calibration of the stereo pair.
-        /// 
-        /// Calculates the calibration matrices of the stereo pair and prints them using the Boost.Log module of the Boost library.
+        /// \brief Destructor. Waits for the scheduled calibrations to complete.
+        ~PcStereoCameraPair ();
+
+        /// \brief Schedules the calibration of the stereo pair on the PcThreadPool, without blocking.
+        ///
         /// Called automatically once both camera's report back as calibrated.
-        void Calibrate ();
+        void ScheduleCalibration ();
+
+        /// \brief Gets the current calibration of the stereo pair. Safe to call from any thread.
+        /// \return the calibration, null if the pair was never calibrated
+        inline PcStereoCalibrationPtr GetCalibration () const { return boost::atomic_load ( &m_calibration ); }
+
+        /// \brief Enables or disables the rectification of the frames of the pair.
+        ///
+        /// The maps are built, or dropped, by the next UpdateRectification.
+        ///
+        /// \param [in] iEnable     true to rectify the frames once the pair is calibrated
+        inline void SetRectification ( bool const& iEnable ) { m_isRectifying = iEnable; }
+
+        /// \brief Rebuilds the rectification maps if the stereo calibration changed since they were built.
+        ///
+        /// The previous maps keep being used until the new ones are built. Must be called from a single thread.
+        void UpdateRectification ();
+
+        /// \brief Gets the current rectification of the stereo pair. Safe to call from any thread.
+        /// \return the rectification, null if disabled or the pair was never calibrated
+        inline PcStereoRectificationPtr GetRectification () const { return boost::atomic_load ( &m_rectification ); }
+
+        /// \brief Rectifies a frame of either camera of the pair, if the rectification is enabled.
+        ///
+        /// Called from the frame observer thread of the camera, so that each camera of the pair only ever writes
+        /// its own rectified frame.
+        ///
+        /// \param [in] iCamera     the camera that took the frame
+        /// \param [in] iFrame      the frame
+        void PushFrame ( PcCameraPtr const& iCamera, PcFramePtr const& iFrame );
+
+        /// \brief Gets the latest rectified frame of the left camera.
+        /// \return the frame, black until the pair is rectifying
+        inline PcFramePtr const GetRectifiedLeft () const { return m_rectifiedLeft; }
+
+        /// \brief Gets the latest rectified frame of the right camera.
+        /// \return the frame, black until the pair is rectifying
+        inline PcFramePtr const GetRectifiedRight () const { return m_rectifiedRight; }
 
         /// \brief Callback to be called upon calibration of the component cameras.
         ///
@@ -53,6 +131,19 @@ namespace pcc
         /// class provides. It will check if both cameras in the pair are calibrated and, if so, launch the stereo calibration.
         void OnCameraCalibrated ( pcc::PcCamera* iCamera, pcc::CalibrationState iOldState, pcc::CalibrationState iNewState );
 
+        /// \brief Describes the current calibration of the stereo pair, for the calibration cache.
+        /// \param [out] oRecord    the record to be filled
+        void GetCacheRecord ( PcStereoRecord& oRecord );
+
+        /// \brief Restores a cached calibration of the stereo pair.
+        /// \param [in] iRecord     the cached calibration, which must be for this pair's left and right cameras
+        /// \return true if the calibration was restored, false if the record is for another pair
+        bool RestoreCalibration ( PcStereoRecord const& iRecord );
+
+        /// \brief Gets the date of the current stereo calibration.
+        /// \return the calibration date in seconds since the epoch, 0 if the pair was never calibrated
+        boost::int64_t GetCalibrationDate ();
+
         /// \brief Gets the left-eye camera of the stereo pair.
         /// \return a pointer to the left eye of the stereo pair
         inline PcCameraPtr const GetLeft () const { return m_left; }
@@ -108,14 +199,33 @@ namespace pcc
         /// \return this object, unchanged
         PcStereoCameraPair& operator= ( PcStereoCameraPair const& iOther ) { return (*this); }
 
+        /// \brief Runs a scheduled calibration and publishes it if no later one was scheduled meanwhile.
+        /// \param [in] iJob        the number of the scheduled calibration
+        void RunCalibration ( unsigned int const& iJob );
+
+        /// \brief Calculates the calibration matrices of the stereo pair from the views both cameras share.
+        ///
+        /// The shared views of both cameras are matched by synchronised frame set (see PcCalibrationCapture), so
+        /// every set where both cameras found the board is used, whether or not it was kept for the intrinsics.
+        ///
+        /// \return the calibration, null if the cameras share too few views or the solve failed
+        PcStereoCalibrationPtr Calibrate () const;
+
     private:
+        boost::mutex                    m_mutex;                ///< Locks the job counters.
+        boost::condition_variable       m_idle;                 ///< Signalled when a calibration task returns.
+        unsigned int                    m_taskCount;            ///< The number of calibration tasks scheduled or running.
+        unsigned int                    m_jobCount;             ///< The number of calibrations scheduled so far.
+
         PcCameraPtr                     m_left;                 ///< The left eye of the stereo pair.
         PcCameraPtr                     m_right;                ///< The right eye of the stereo pair.
-    
-        cv::Mat                         m_stereoRotation;       ///< The rotation matrix.
-        cv::Mat                         m_stereoTranslation;    ///< The translation matrix.
-        cv::Mat                         m_stereoEssential;      ///< The essential matrix.
-        cv::Mat                         m_stereoFundamental;    ///< The fundamental matrix.
+
+        PcStereoCalibrationPtr          m_calibration;          ///< The current calibration, null if none. Accessed atomically.
+
+        bool                            m_isRectifying;         ///< Whether the frames are to be rectified.
+        PcStereoRectificationPtr        m_rectification;        ///< The current rectification, null if none. Accessed atomically.
+        PcFramePtr                      m_rectifiedLeft;        ///< The latest rectified frame of the left camera.
+        PcFramePtr                      m_rectifiedRight;       ///< The latest rectified frame of the right camera.
     };
 
     typedef boost::shared_ptr<PcStereoCameraPair> PcStereoCameraPairPtr;    ///< A reference-counted pointer to a PcStereoCameraPair object.
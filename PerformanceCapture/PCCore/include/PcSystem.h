@@ -5,7 +5,13 @@
 #include "PcExport.h"
 #include "PcFrame.h"
 #include "PcCamera.h"
+#include "PcCalibrationCapture.h"
 #include "PcStereoCameraPair.h"
+#include "PcCalibrationCache.h"
+#include "PcRecorder.h"
+#include "PcRigCalibrator.h"
+#include "PcSharedFramePublisher.h"
+#include "PcWandCalibrator.h"
 
 #include <unordered_map>
 #include <map>
@@ -90,7 +96,7 @@ namespace pcc
         /// \brief Destroy the current singleton instance.
         /// 
         /// Unregisters the current CameraListObserver instance from the underlying VimbaSystem instance and
-        /// deletes the current PcSystem object instance.
+        /// deletes the current PcSystem object instance, then stops the shared PcThreadPool.
         PCCORE_EXPORT static void DestroyInstance ();
 
         /// \brief Updates the current camera list, based on two auxiliary input queues.
@@ -130,6 +136,35 @@ namespace pcc
         /// \return the frame that is currently registered on the frame-camera map for a given camera.
         PCCORE_EXPORT PcFramePtr const GetFrameFromCamera ( std::string const& iCameraId );
 
+        /// \brief Enables or disables the undistortion of the frames of a given camera.
+        ///
+        /// The undistortion map is built by the next UpdateCameras once the camera is calibrated, and rebuilt whenever
+        /// its calibration changes (see PcCamera::UpdateUndistortMap).
+        ///
+        /// \param [in] iCameraId    the GUID of the camera
+        /// \param [in] iEnable      true to undistort its frames
+        PCCORE_EXPORT void SetCameraUndistortion ( std::string const& iCameraId, bool const& iEnable );
+
+        /// \brief Reads the last undistorted frame of a given camera.
+        /// \param [in] iCameraId    the GUID of the camera whose frame is being requested
+        /// \return the undistorted frame, null if the camera isn't undistorting its frames
+        PCCORE_EXPORT PcFramePtr const GetUndistortedFrameFromCamera ( std::string const& iCameraId );
+
+        /// \brief Enables or disables the rectification of the frames of every stereo pair.
+        ///
+        /// The rectification maps are built by the next UpdateCameras once the pair is calibrated, and rebuilt
+        /// whenever its calibration changes (see PcStereoCameraPair::UpdateRectification).
+        ///
+        /// \param [in] iEnable      true to rectify the frames of the stereo pairs
+        PCCORE_EXPORT void SetStereoRectification ( bool const& iEnable );
+
+        /// \brief Reads the last rectified frames of a given stereo pair.
+        /// \param [in]  iPair       the index of the stereo pair
+        /// \param [out] oLeft       the rectified frame of the left camera
+        /// \param [out] oRight      the rectified frame of the right camera
+        /// \return true if the pair exists and is rectifying its frames, false otherwise
+        PCCORE_EXPORT bool GetRectifiedFrames ( size_t const& iPair, PcFramePtr& oLeft, PcFramePtr& oRight );
+
         /// \brief Reads the PTP synchronisation status for a given camera.
         /// \param [in] iCameraId   the GUID of the camera whose status is being queried
         /// \return a string containing the status of the PTP synchronisation (see PcCamera::GetPtpStatus for further information)
@@ -142,6 +177,51 @@ namespace pcc
         /// \param [in] iCameraId   the GUID of the camera whose calibration process is being queried
         /// \return the calibration progress for the camera
         PCCORE_EXPORT double GetCameraCalibrationProgress ( std::string const& iCameraId );
+
+        /// \brief Gets the reprojection error of the latest intrinsic solve for a given camera.
+        ///
+        /// Internally calls the PcCamera::GetCalibrationRms method and returns its value.
+        ///
+        /// \param [in] iCameraId   the GUID of the camera whose calibration process is being queried
+        /// \return the RMS reprojection error in pixels, negative if no solve completed yet
+        PCCORE_EXPORT double GetCameraCalibrationRms ( std::string const& iCameraId );
+
+        /// \brief Gets the sharpness of the latest candidate calibration frame of a given camera.
+        ///
+        /// Internally calls the PcCamera::GetCalibrationSharpness method and returns its value.
+        ///
+        /// \param [in] iCameraId   the GUID of the camera whose calibration process is being queried
+        /// \return the variance of the frame Laplacian, negative if unknown
+        PCCORE_EXPORT double GetCameraCalibrationSharpness ( std::string const& iCameraId );
+
+        /// \brief Gets the instruction guiding the operator toward the calibration views still missing for a given camera.
+        ///
+        /// Internally calls the PcCamera::GetCalibrationGuidance method and returns its value.
+        ///
+        /// \param [in] iCameraId   the GUID of the camera whose calibration process is being queried
+        /// \return a short instruction, empty if there is none
+        PCCORE_EXPORT std::string GetCameraCalibrationGuidance ( std::string const& iCameraId );
+
+        /// \brief Gets the cameras whose calibration drifted, as of the last UpdateCameras.
+        ///
+        /// The calibrations are only watched after PcCalibrationHelper::StartDriftMonitor. A drifted camera, e.g. a
+        /// camera whose tripod was bumped, should be recalibrated on its own.
+        ///
+        /// \return the GUIDs of the drifted cameras, empty if the calibrations aren't watched
+        PCCORE_EXPORT VEC(std::string) GetDriftedCameras ();
+
+        /// \brief Gets the wand calibration progress of a given camera, as of the last UpdateCameras.
+        ///
+        /// Only known while the wand calibration runs (see PcCalibrationHelper::StartWandCalibration).
+        ///
+        /// \param [in]  iCameraId  the GUID of the camera
+        /// \param [out] oStatus    the wand coverage of the camera and its error in the latest wand solution
+        /// \return true if the camera has a status, false if the wand calibration isn't running or the camera is unknown
+        PCCORE_EXPORT bool GetWandStatus ( std::string const& iCameraId, PcWandStatus& oStatus );
+
+        /// \brief Gets the capture that gathers the calibration frames of the cameras into synchronised frame sets.
+        /// \return a reference to the calibration capture, whose counters are thread-safe
+        inline PcCalibrationCapture& GetCalibrationCapture () { return m_calibrationCapture; }
         
         /// \brief Callback to notify the PcSystem of changes in the list of plugged cameras.
         ///
@@ -174,17 +254,81 @@ namespace pcc
         /// Iterates over the list of all available cameras and calls the PcCamera::Synchronise method.
         PCCORE_EXPORT void SynchroniseCameras ();
 
+        /// \brief Writes the calibrations completed since the last save to the calibration cache.
+        ///
+        /// Called by UpdateCameras, so calibrations are cached as soon as they complete. Does nothing if the cache
+        /// is disabled (see PcCalibrationHelper::CachePath).
+        PCCORE_EXPORT void SaveCalibrations ();
+
         /// \brief Launches the calibration process on all available cameras.
         ///
-        /// Iterates over the list of all available cameras and calls the PcCamera::StartCalibration method on each one of them.
+        /// Drops the frame sets gathered for a previous calibration, then iterates over the list of all available
+        /// cameras and calls the PcCamera::StartCalibration method on each one of them.
         PCCORE_EXPORT void CalibrateCameras ();
 
+        /// \brief Starts calibrating the poses of all calibrated cameras in a single rig frame, without blocking.
+        ///
+        /// Solves the chessboard observations collected since PcCalibrationHelper::StartRigCalibration with a
+        /// PcRigCalibrator on the PcThreadPool, using the current intrinsics of every calibrated camera. Cameras keep
+        /// streaming meanwhile. Once the solve completes, the next UpdateCameras sets the rig pose of every camera the
+        /// solution includes, and the poses are cached by the following SaveCalibrations.
+        ///
+        /// \return true if the solve was scheduled, false if the rig calibration wasn't started or is already solving
+        PCCORE_EXPORT bool CalibrateRig ();
+
+        /// \brief Starts solving the camera poses from the wand observations, without blocking.
+        ///
+        /// Solves the wand observations collected since PcCalibrationHelper::StartWandCalibration with the
+        /// PcWandCalibrator on the PcThreadPool, using the current intrinsics of every calibrated camera. UpdateCameras
+        /// calls it again every time enough new observations have been collected, so that the poses and their error
+        /// follow the coverage of the volume. Every new solution is applied to the cameras like a rig solution.
+        ///
+        /// \return true if the solve was scheduled, false if the wand calibration wasn't started or is already solving
+        PCCORE_EXPORT bool CalibrateWand ();
+
+        /// \brief Starts recording the frames of every camera.
+        ///
+        /// Creates a PcRecorder striping the take across the given target directories and starts it. Any
+        /// recording in progress is stopped first.
+        ///
+        /// \param [in] iTakeName   the name of the take, used to build the recorded file names
+        /// \param [in] iTargets    the target directories to stripe the take across
+        /// \return true if the recording started, false otherwise
+        PCCORE_EXPORT bool StartRecording ( std::string const& iTakeName, VEC(std::string) const& iTargets );
+
+        /// \brief Stops the recording in progress, if any.
+        ///
+        /// Blocks until every pending frame has been written.
+        PCCORE_EXPORT void StopRecording ();
+
+        /// \brief Tells whether a recording is in progress.
+        /// \return true if frames are being recorded, false otherwise
+        PCCORE_EXPORT bool IsRecording ();
+
+        /// \brief Starts publishing the frames of every camera to shared memory.
+        ///
+        /// Creates a PcSharedFramePublisher, so that other processes can follow the cameras with a
+        /// PcSharedFrameReader. Does nothing if frames are already being published.
+        ///
+        /// \param [in] iSlotCount  the number of frames kept in each camera's shared ring
+        PCCORE_EXPORT void StartFramePublishing ( unsigned int const& iSlotCount = 8u );
+
+        /// \brief Stops publishing frames to shared memory and removes the shared segments.
+        PCCORE_EXPORT void StopFramePublishing ();
+
+        /// \brief Tells whether frames are being published to shared memory.
+        /// \return true if frames are being published, false otherwise
+        PCCORE_EXPORT bool IsPublishingFrames ();
+
         /// \brief Sets the current frame for a given camera.
         ///
         /// Sets the current frame for a given camera. Reads frame's dimensions and raw data and calls
         /// PcFrame::Reset for the corresponding camera, passing the new frame as input data.
-        /// Also, if that camera is in the ACQUIRING phase of a calibration, pushes the newly read frame into its
-        /// calibration frame list, through the PcCamera::TryPushFrame method.
+        /// Also, if that camera is in the ACQUIRING phase of a calibration, offers the newly read frame to the
+        /// synchronised frame sets of the PcCalibrationCapture, and pushes it to the wand calibrator and the drift
+        /// monitor, if any (see PcCalibrationHelper::StartWandCalibration and StartDriftMonitor).
+        /// Finally, undistorts the frame if the camera has an undistortion map, and hands it to the stereo pairs for
+        /// rectification (see SetCameraUndistortion and SetStereoRectification).
         ///
         /// This method is called by a camera's PcFrameObserver's thread whenever a new frame is read from it.
         /// 
@@ -211,6 +355,24 @@ namespace pcc
         /// \param [in] iCameraId   the GUID of the camera to remove from the list
         void UnregisterCamera ( std::string const& iCameraId );
 
+        /// \brief Restores the cached calibrations of a newly registered camera and of its stereo pair.
+        /// \param [in] iCamera     the camera, already set up
+        void RestoreCalibrations ( PcCameraPtr const& iCamera );
+
+        /// \brief Sets the rig poses of the cameras from a rig solution, if it wasn't applied yet.
+        /// \param [in] iSolution  the solution, null if none
+        /// \return true if the solution was applied
+        bool ApplyRigSolution ( PcRigSolutionPtr const& iSolution );
+
+        /// \brief Applies the latest wand solution, and solves again once enough new wand observations were collected.
+        void UpdateWandCalibration ();
+
+        /// \brief Hands the calibration of every camera of the main rig to the drift monitor, and reports the cameras that drifted.
+        void UpdateDriftMonitor ();
+
+        /// \brief Rebuilds the undistortion and rectification maps, and the point undistorters, whose calibration changed.
+        void UpdateRemapStages ();
+
     private:
         static VmbAPI::ICameraListObserverPtr           sm_pInstance;       ///< The singleton instance of the PcSystem, stored as a reference-counted pointer to a CameraListObserver.
 
@@ -220,8 +382,20 @@ namespace pcc
 
         STRMAP(PcCameraPtr)                             m_activeCameras;    ///< The list of active cameras, represented as a string-indexed ordered map.
         STRMAP(PcFramePtr)                              m_frames;           ///< The list of frames, indexed by its camera's GUID.
+        STRMAP(PcFramePtr)                              m_undistortedFrames;    ///< The list of undistorted frames, indexed by its camera's GUID.
 
         VEC(PcStereoCameraPairPtr)                      m_stereo;           ///< The list of stereo pairs currently active in the system.
+        PcCalibrationCapture                            m_calibrationCapture;   ///< Gathers the calibration frames into synchronised sets. Destroyed before the cameras.
+
+        PcCalibrationCache                              m_calibrationCache; ///< The calibrations cached across sessions.
+        PcRigSolutionPtr                                m_rigSolution;      ///< The last rig solution applied to the cameras.
+        PcWandCalibratorPtr                             m_wandCalibrator;   ///< The wand calibrator m_wandSolveCount refers to.
+        size_t                                          m_wandSolveCount;   ///< The number of wand observations when the last wand solve was scheduled.
+        STRMAP(PcWandStatus)                            m_wandStatus;       ///< The wand calibration progress of every camera, as of the last UpdateCameras.
+        VEC(std::string)                                m_driftedCameras;   ///< The cameras reported as drifted by the last UpdateCameras.
+
+        PcRecorderPtr                                   m_recorder;         ///< The recorder of the take in progress. Accessed atomically, since frame observer threads read it.
+        PcSharedFramePublisherPtr                       m_publisher;        ///< The shared memory frame publisher, if enabled. Accessed atomically, like m_recorder.
     };
 }
 
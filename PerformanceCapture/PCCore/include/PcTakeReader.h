@@ -0,0 +1,142 @@
+#ifndef PCTAKEREADER_H
+#define PCTAKEREADER_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+#include "PcRecordingFormat.h"
+#include "PcRecordingIndex.h"
+
+#include <opencv2/opencv.hpp>
+
+#define BOOST_ALL_DYN_LINK
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+#include <vector>
+
+namespace pcc
+{
+    /// \ingroup PCCORE
+    ///
+    /// \brief Reads back a take recorded by PcRecorder.
+    ///
+    /// Opens the take manifest and every stripe it lists, and presents the frames of the take as a single sequence
+    /// in recording order, no matter how they were distributed across the recording targets.
+    ///
+    /// Stripe files are looked up at the path stored in the manifest first and then next to the manifest, so a take
+    /// can be read after its stripes have been gathered into a single directory.
+    ///
+    /// Frames are located through the take's PcRecordingIndex, so seeking to a given time, frame ID or frame set
+    /// is a binary search followed by a single read. Takes without an index (e.g. interrupted recordings) are indexed
+    /// from their stripe journals, or as a last resort by walking the chunk headers of every stripe.
+    ///
+    /// A take recorded with a proxy stream can be opened in proxy mode, in which case the reader presents the
+    /// downscaled frames of the proxy stripe, with the same API and the same frame-set structure.
+    class PcTakeReader
+    {
+    private:
+        typedef boost::mutex                    MutexType;  ///< The mutex used to serialise access to the stripe files.
+        typedef boost::lock_guard<MutexType>    GuardType;  ///< The RAII lock used together with MutexType.
+
+    public:
+        /// \brief Constructor.
+        ///
+        /// Opens the manifest and the stripes, and loads or rebuilds the take index.
+        /// \param [in] iManifestPath   the path of the take manifest
+        /// \param [in] iProxy          true to read the proxy stream of the take instead of the full-resolution frames
+        PCCORE_EXPORT explicit PcTakeReader ( std::string const& iManifestPath, bool const& iProxy = false );
+
+        /// \brief Destructor. Closes every stripe file.
+        PCCORE_EXPORT ~PcTakeReader ();
+
+        /// \brief Tells whether the take was successfully opened.
+        /// \return true if the manifest and all of the stripes could be read, false otherwise
+        inline bool IsOpen () const { return m_isOpen; }
+
+        /// \brief Gets the name of the take.
+        /// \return a constant reference to the take name
+        inline std::string const& GetTakeName () const { return m_takeName; }
+
+        /// \brief Gets the GUIDs of the recorded cameras, in the order used by PcChunkHeader::Camera.
+        /// \return a constant reference to the list of camera GUIDs
+        inline VEC(std::string) const& GetCameraList () const { return m_cameraIds; }
+
+        /// \brief Gets the number of frames in the take.
+        /// \return the number of recorded frames
+        inline size_t GetFrameCount () const { return m_entries.size (); }
+
+        /// \brief Gets the index entry of a recorded frame.
+        /// \param [in] iIndex      the position of the frame in recording order
+        /// \return a constant reference to the frame entry
+        inline PcIndexEntry const& GetEntry ( size_t const& iIndex ) const { return m_entries[iIndex]; }
+
+        /// \brief Gets the take index, to seek by camera, time, frame ID or frame set.
+        /// \return a constant reference to the take index
+        inline PcRecordingIndex const& GetIndex () const { return m_index; }
+
+        /// \brief Reads a recorded frame.
+        /// \param [in]  iIndex     the position of the frame in recording order
+        /// \param [out] oImage     the frame image. Reallocated only if its size or type don't match the frame
+        /// \return true upon success, false otherwise
+        PCCORE_EXPORT bool ReadFrame ( size_t const& iIndex, cv::Mat& oImage );
+
+        /// \brief Reads a recorded frame of a given camera.
+        /// \param [in]  iCamera    the index of the camera, as in GetCameraList
+        /// \param [in]  iPosition  the position of the frame in the camera's index entries (see GetIndex)
+        /// \param [out] oImage     the frame image. Reallocated only if its size or type don't match the frame
+        /// \return true upon success, false otherwise
+        PCCORE_EXPORT bool ReadCameraFrame ( unsigned int const& iCamera, size_t const& iPosition, cv::Mat& oImage );
+
+    private:
+        /// \brief Private copy constructor.
+        ///
+        /// Disables copy of PcTakeReader objects.
+        PcTakeReader ( PcTakeReader const& iOther ) {}
+
+        /// \brief Private assignment operator.
+        ///
+        /// Disables assignment of PcTakeReader objects.
+        /// \return this object, unchanged
+        PcTakeReader& operator= ( PcTakeReader const& iOther ) { return (*this); }
+
+        /// \brief Parses the take manifest and opens the stripe files it lists.
+        /// \param [in] iManifestPath   the path of the take manifest
+        /// \param [in] iProxy          true to open the proxy stripe and index instead of the full-resolution ones
+        /// \return true upon success, false otherwise
+        bool ReadManifest ( std::string const& iManifestPath, bool const& iProxy );
+
+        /// \brief Rebuilds the take index from the stripe journals.
+        /// \return true if every journal could be read, false otherwise
+        bool ReadJournals ();
+
+        /// \brief Rebuilds the take index by walking the chunk headers of every stripe.
+        ///
+        /// A truncated chunk at the end of a stripe (e.g. after a crash) ends the scan of that stripe.
+        void ScanStripes ();
+
+        /// \brief Reads the chunk located by an index entry.
+        /// \param [in]  iEntry     the index entry of the frame
+        /// \param [out] oImage     the frame image
+        /// \return true upon success, false otherwise
+        bool ReadEntry ( PcIndexEntry const& iEntry, cv::Mat& oImage );
+
+    private:
+        MutexType                       m_mutex;        ///< The mutex used to serialise access to the stripe files.
+
+        bool                            m_isOpen;       ///< Indicates whether the take was successfully opened.
+        std::string                     m_takeName;     ///< The name of the take.
+        VEC(std::string)                m_cameraIds;    ///< The recorded cameras' GUIDs.
+        std::string                     m_manifestDir;  ///< The directory holding the take manifest.
+        VEC(std::string)                m_stripePaths;  ///< The paths of the open stripe files.
+        VEC(FILE*)                      m_stripes;      ///< The open stripe files.
+        std::string                     m_indexPath;    ///< The path of the take index, empty if the manifest has none.
+        PcRecordingIndex                m_index;        ///< The take index.
+        VEC(PcIndexEntry)               m_entries;      ///< The recorded frames, in recording order.
+    };
+
+    typedef boost::shared_ptr<PcTakeReader> PcTakeReaderPtr;    ///< A reference-counted pointer to a PcTakeReader.
+}
+
+#endif // PCTAKEREADER_H
@@ -0,0 +1,51 @@
+#ifndef PCTARGETDETECTOR_H
+#define PCTARGETDETECTOR_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+
+#include "PcCalibrationTarget.h"
+#include "PcChessboardDetector.h"
+#include "PcCircleGridDetector.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+
+namespace pcc
+{
+    /// \ingroup PCCORE
+    ///
+    /// \brief Finds a calibration target in a frame, with the detector matching the target type.
+    ///
+    /// Chessboards are searched with a PcChessboardDetector and circle grids with a PcCircleGridDetector, both of
+    /// which search a downscaled copy of the frame first.
+    ///
+    /// A detector keeps its scratch images between calls, so each thread should use its own detector.
+    class PcTargetDetector
+    {
+    public:
+        /// \brief Constructor.
+        /// \param [in] iTarget         the calibration target
+        /// \param [in] iSearchWidth    the maximum width of the frame searched for the target, in pixels
+        PCCORE_EXPORT PcTargetDetector ( PcCalibrationTarget const& iTarget, unsigned int const& iSearchWidth = 640u );
+
+        /// \brief Looks for the target in a frame.
+        /// \param [in]  iFrame     the frame, 8-bit grayscale or BGR
+        /// \param [out] oPoints    the target points in full-resolution pixel coordinates, in the order of
+        ///                         PcCalibrationTarget::GetPoints
+        /// \return true if the whole target was found, false otherwise
+        PCCORE_EXPORT bool Detect ( cv::Mat const& iFrame, VEC(cv::Point2f)& oPoints );
+
+        /// \brief Gets the calibration target.
+        /// \return the target searched by the detector
+        inline PcCalibrationTarget const& GetTarget () const { return m_target; }
+
+    private:
+        PcCalibrationTarget             m_target;       ///< The calibration target.
+        PcChessboardDetector            m_chessboard;   ///< The chessboard detector, used for chessboard targets.
+        PcCircleGridDetector            m_circles;      ///< The circle grid detector, used for circle grid targets.
+    };
+}
+
+#endif // PCTARGETDETECTOR_H
@@ -0,0 +1,119 @@
+#ifndef PCTHREADPOOL_H
+#define PCTHREADPOOL_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+
+#define BOOST_ALL_DYN_LINK
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <deque>
+#include <vector>
+
+namespace pcc
+{
+    /// \ingroup PCCORE
+    ///
+    /// \brief A work-stealing thread pool shared by the whole library.
+    ///
+    /// The pool runs one worker per hardware thread. Each worker owns a task deque:
+    ///     - Tasks submitted from a worker go to the back of that worker's deque, and the worker runs its own tasks
+    ///       newest first, while their data is still in cache.
+    ///     - Tasks submitted from any other thread are dealt to the workers' deques in turn.
+    ///     - A worker whose deque is empty steals the oldest task of another worker before going to sleep.
+    ///
+    /// Tasks must not block waiting for other tasks, except through ParallelFor, which lets the waiting thread
+    /// run the work itself.
+    class PcThreadPool
+    {
+    public:
+        typedef boost::function0<void>              TaskType;       ///< The type of the tasks run by the pool.
+        typedef boost::function1<void, size_t>      LoopBodyType;   ///< The type of the loop bodies run by ParallelFor.
+
+        /// \brief  Gets a reference to the singleton PcThreadPool instance.
+        ///
+        /// Starts the pool upon first invocation. Safe to call from any thread.
+        ///
+        /// \return The singleton instance of PcThreadPool
+        PCCORE_EXPORT static PcThreadPool& GetInstance ();
+
+        /// \brief  Destroys the singleton instance of PcThreadPool.
+        ///
+        /// Runs the tasks still queued, then joins the workers. The tasks calling GetInstance meanwhile get the pool
+        /// being destroyed, while the other threads get a new one.
+        PCCORE_EXPORT static void DestroyInstance ();
+
+        /// \brief Queues a task to be run by a worker.
+        /// \param [in] iTask   the task
+        PCCORE_EXPORT void Submit ( TaskType const& iTask );
+
+        /// \brief Runs a loop body for every index of a range, in parallel, and waits for all of them to complete.
+        ///
+        /// The calling thread takes part in the loop, so ParallelFor may be called from within a task.
+        ///
+        /// \param [in] iBegin  the first index of the range
+        /// \param [in] iEnd    the index past the end of the range
+        /// \param [in] iBody   the loop body, called once per index
+        PCCORE_EXPORT void ParallelFor ( size_t const& iBegin, size_t const& iEnd, LoopBodyType const& iBody );
+
+        /// \brief Gets the number of workers of the pool.
+        /// \return the number of worker threads
+        inline unsigned int GetWorkerCount () const { return (unsigned int)m_workers.size (); }
+
+    private:
+        /// \brief The task deque of a worker.
+        struct Worker
+        {
+            boost::mutex            Mutex;      ///< The mutex protecting the deque.
+            std::deque<TaskType>    Tasks;      ///< The tasks queued on the worker.
+        };
+
+        /// \brief Constructor. Starts the workers.
+        /// \param [in] iWorkerCount    the number of workers
+        PcThreadPool ( unsigned int const& iWorkerCount );
+
+        /// \brief Destructor. Runs the remaining tasks and joins the workers.
+        ~PcThreadPool ();
+
+        /// \brief Private copy constructor.
+        ///
+        /// Disables copy of PcThreadPool objects.
+        PcThreadPool ( PcThreadPool const& iOther ) {}
+
+        /// \brief Private assignment operator.
+        ///
+        /// Disables assignment of PcThreadPool objects.
+        /// \return this object, unchanged
+        PcThreadPool& operator= ( PcThreadPool const& iOther ) { return (*this); }
+
+        /// \brief The loop of a worker thread.
+        /// \param [in] iWorker     the index of the worker
+        void Run ( unsigned int const& iWorker );
+
+        /// \brief Takes the next task of a worker, stealing from the other workers if it has none.
+        /// \param [in]  iWorker    the index of the worker
+        /// \param [out] oTask      the task
+        /// \return true if a task was taken, false if all of the deques are empty
+        bool TryTake ( unsigned int const& iWorker, TaskType& oTask );
+
+    private:
+        static PcThreadPool*                            sm_pInstance;       ///< The singleton instance of the pool.
+        static PcThreadPool*                            sm_pRetiring;       ///< The instance being destroyed, if any, still used by its own tasks.
+        static boost::mutex                             sm_instanceMutex;   ///< The mutex protecting the creation and destruction of the singleton instance.
+        static boost::thread_specific_ptr<unsigned int> sm_worker;          ///< The index of the worker running on the current thread, if any.
+
+        VEC(Worker*)                                m_workers;      ///< The task deques, one per worker.
+        boost::thread_group                         m_threads;      ///< The worker threads.
+        boost::atomic<unsigned int>                 m_next;         ///< The worker to receive the next task submitted from outside the pool.
+
+        boost::mutex                                m_sleepMutex;   ///< The mutex protecting the sleep of the workers.
+        boost::condition_variable                   m_wake;         ///< Wakes the workers when tasks are queued.
+        boost::atomic<size_t>                       m_pending;      ///< The number of queued tasks. Increased with m_sleepMutex held, before the task is queued.
+        bool                                        m_stop;         ///< Tells the workers to exit once the deques are empty.
+    };
+}
+
+#endif // PCTHREADPOOL_H
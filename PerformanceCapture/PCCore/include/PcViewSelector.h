@@ -0,0 +1,109 @@
+#ifndef PCVIEWSELECTOR_H
+#define PCVIEWSELECTOR_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+
+#include "PcCalibrationTarget.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <string>
+#include <vector>
+
+namespace pcc
+{
+    /// \brief The coarse pose of a chessboard view, as estimated by PcViewSelector::EstimatePose.
+    struct PcViewPose
+    {
+        cv::Point2f                     Center;         ///< The centre of the board, in image widths and heights.
+        float                           Size;           ///< The square root of the board area over the image area.
+        float                           Yaw;            ///< The rotation of the board about the vertical image axis, in degrees. Negative faces left.
+        float                           Pitch;          ///< The rotation of the board about the horizontal image axis, in degrees. Negative faces up.
+    };
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Accepts the calibration views that add information to the ones collected so far.
+    ///
+    /// Consecutive calibration frames mostly show the board in the same pose, and near-duplicate views make the
+    /// solve slower without making it better. The selector estimates the pose of each candidate view from the
+    /// homography of the board's outer corners, using a nominal camera matrix, and keeps a coverage map of:
+    ///     - The image regions, as a grid of cells, reached by the board corners.
+    ///     - The board tilts: facing the camera, and facing left, right, up or down, moderately or strongly.
+    ///     - The board distances, as the apparent board size: far, medium or near.
+    ///
+    /// A view is accepted if it brings a region, tilt or distance bin closer to its target number of views, or,
+    /// once every bin is full, if it isn't a near-duplicate of an accepted view. Near-duplicates are always rejected.
+    /// GetGuidance tells the operator which coverage is still missing.
+    ///
+    /// The selector is not thread-safe; its owner is expected to lock it.
+    class PcViewSelector
+    {
+    public:
+        /// \brief Constructor.
+        /// \param [in] iBoard          the calibration target
+        /// \param [in] iGridSize       the number of image region cells per image row and column
+        /// \param [in] iTarget         the number of views wanted in each coverage bin
+        PCCORE_EXPORT PcViewSelector ( PcCalibrationTarget const& iBoard, unsigned int const& iGridSize = 3u, unsigned int const& iTarget = 1u );
+
+        /// \brief Forgets every accepted view.
+        PCCORE_EXPORT void Reset ();
+
+        /// \brief Decides whether a view is worth keeping, and records it if so.
+        /// \param [in] iCorners    the chessboard corners of the view, in row-major order
+        /// \param [in] iImageSize  the size of the frame the corners were detected on
+        /// \return true if the view was accepted
+        PCCORE_EXPORT bool Accept ( VEC(cv::Point2f) const& iCorners, cv::Size const& iImageSize );
+
+        /// \brief Gets the filled fraction of the coverage map.
+        /// \return a double in the interval [0,1], 1 once every bin holds its target number of views
+        PCCORE_EXPORT double GetCoverage () const;
+
+        /// \brief Describes the most wanted coverage that is still missing, for the operator.
+        /// \return a short instruction, empty once every bin holds its target number of views
+        PCCORE_EXPORT std::string GetGuidance () const;
+
+        /// \brief Gets the number of views rejected since the last reset.
+        /// \return the number of rejected views
+        inline unsigned int const& GetRejectedViews () const { return m_rejected; }
+
+        /// \brief Estimates the coarse pose of a chessboard view.
+        ///
+        /// Assumes a camera with a focal length equal to the larger image dimension and the principal point in the
+        /// image centre, which is good enough to tell tilts apart before the camera is calibrated.
+        ///
+        /// \param [in]  iCorners       the chessboard corners of the view, in row-major order
+        /// \param [in]  iBoard         the calibration target
+        /// \param [in]  iImageSize     the size of the frame the corners were detected on
+        /// \param [out] oPose          the estimated pose
+        /// \return true upon success, false if the corners don't describe a board in front of the camera
+        PCCORE_EXPORT static bool EstimatePose ( VEC(cv::Point2f) const& iCorners, PcCalibrationTarget const& iBoard, cv::Size const& iImageSize, PcViewPose& oPose );
+
+    private:
+        /// \brief Gets the tilt bin of a pose.
+        /// \param [in] iPose       the view pose
+        /// \return 0 when facing the camera, 1 to 4 for moderate left, right, up and down tilts, 5 to 8 for strong ones
+        static unsigned int TiltBin ( PcViewPose const& iPose );
+
+        /// \brief Gets the distance bin of a pose.
+        /// \param [in] iPose       the view pose
+        /// \return 0 for far, 1 for medium and 2 for near boards
+        static unsigned int DistanceBin ( PcViewPose const& iPose );
+
+        /// \brief Tells whether every coverage bin holds its target number of views.
+        bool IsComplete () const;
+
+    private:
+        PcCalibrationTarget             m_board;        ///< The calibration target.
+        unsigned int                    m_gridSize;     ///< The number of region cells per image row and column.
+        unsigned int                    m_target;       ///< The number of views wanted in each bin.
+        VEC(unsigned int)               m_cells;        ///< The number of accepted views reaching each region cell, row-major.
+        VEC(unsigned int)               m_tilts;        ///< The number of accepted views in each tilt bin.
+        VEC(unsigned int)               m_distances;    ///< The number of accepted views in each distance bin.
+        VEC(PcViewPose)                 m_poses;        ///< The poses of the accepted views.
+        unsigned int                    m_rejected;     ///< The number of views rejected since the last reset.
+    };
+}
+
+#endif // PCVIEWSELECTOR_H
@@ -0,0 +1,224 @@
+#ifndef PCWANDCALIBRATOR_H
+#define PCWANDCALIBRATOR_H
+
+#include "PcExport.h"
+#include "PcCommon.h"
+#include "PcFrame.h"
+#include "PcPointUndistorter.h"
+#include "PcRecordingIndex.h"
+#include "PcRigCalibrator.h"
+
+#include <opencv2/opencv.hpp>
+
+#define BOOST_ALL_DYN_LINK
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace pcc
+{
+    /// \brief The outcome of a wand calibration solve. Published as a whole and never modified afterwards.
+    struct PcWandSolution
+    {
+        PcRigSolutionPtr                Poses;              ///< The camera poses, in wand units (see PcWandCalibrator).
+        STRMAP(double)                  CameraRms;          ///< The RMS reprojection error of each solved camera, in pixels.
+        size_t                          ViewCount;          ///< The number of wand views the poses were solved from.
+        size_t                          ObservationCount;   ///< The number of observations recorded when the solve started.
+    };
+
+    typedef boost::shared_ptr<PcWandSolution const> PcWandSolutionPtr;  ///< A reference-counted pointer to an immutable PcWandSolution.
+
+    /// \brief The wand calibration progress of a camera, as shown to the operator.
+    struct PcWandStatus
+    {
+        double                          Coverage;           ///< The fraction of the frame the wand markers covered so far, between 0 and 1.
+        double                          Rms;                ///< The RMS reprojection error of the camera in the latest solution, in pixels, negative until solved.
+        size_t                          ViewCount;          ///< The number of wand views of the latest solution, 0 until solved.
+    };
+
+    /// \ingroup PCCORE
+    ///
+    /// \brief Calibrates the poses of every camera of a capture volume from a wand waved through it.
+    ///
+    /// The wand is a rigid bar carrying three or more collinear markers, bright in the camera frames, at known and
+    /// unequal distances along the bar so that its two ends can be told apart. Unlike a chessboard, it is seen by
+    /// cameras facing each other across the volume.
+    ///
+    /// The calibrator finds the markers in the frames it is pushed, on the shared PcThreadPool, and groups the
+    /// observations taken at the same instant, within a timestamp tolerance, into wand views. Given the intrinsics of
+    /// every camera, Solve then:
+    ///     - Starts from the poses of the previous solve, if any. Otherwise, picks the pair of cameras sharing the most
+    ///       views, takes the first one as the world frame and gets the pose of the second from the essential matrix
+    ///       of their marker correspondences, scaled so that the triangulated wands have their known length.
+    ///     - Adds the other cameras one at a time, the one sharing the most views with the posed cameras first, by
+    ///       resection against the markers triangulated from the posed cameras.
+    ///     - Refines the poses of all cameras and wand views together with a sparse bundle adjustment
+    ///       (Levenberg-Marquardt). The wand of each view has 5 degrees of freedom, its first marker and its direction,
+    ///       and holds its markers at their known distances, so the scale of the volume is set by the wand. The wand
+    ///       poses are eliminated with a Schur complement and only the reduced camera system is solved densely.
+    ///     - Drops the observations whose error is far above the RMS error, and refines again.
+    ///
+    /// The poses are expressed in the units of the marker distances. The intrinsics are held fixed.
+    ///
+    /// Every method may be called from any thread. Observations keep being collected while Solve runs as a
+    /// background task, so the operator can follow the coverage of every camera and the error of the last solve, and
+    /// solve again as the volume gets covered.
+    class PcWandCalibrator
+    {
+    public:
+        /// \brief Constructor.
+        /// \param [in] iMarkerPositions    the distance of every marker from the first one along the wand, increasing,
+        ///                                 with unequal spacings
+        /// \param [in] iTolerance          the maximum difference between the timestamps of the observations of a wand view
+        PCCORE_EXPORT PcWandCalibrator ( VEC(double) const& iMarkerPositions, boost::uint64_t const& iTolerance = PCC_FRAME_SET_TOLERANCE );
+
+        /// \brief Destructor. Waits for the detections in flight.
+        PCCORE_EXPORT ~PcWandCalibrator ();
+
+        /// \brief Registers a camera and its intrinsics. Only the observations of registered cameras are used by Solve. Thread-safe.
+        /// \param [in] iCameraId       the camera GUID
+        /// \param [in] iCameraMatrix   the intrinsic camera matrix
+        /// \param [in] iDistCoeffs     the distortion coefficients
+        /// \param [in] iUndistorter    the undistorter of the marker centroids, built from the same intrinsics. Without
+        ///                             one, the centroids are undistorted with cv::undistortPoints
+        PCCORE_EXPORT void SetIntrinsics (
+            std::string const&              iCameraId,
+            cv::Mat const&                  iCameraMatrix,
+            cv::Mat const&                  iDistCoeffs,
+            PcPointUndistorterPtr const&    iUndistorter = PcPointUndistorterPtr ()
+        );
+
+        /// \brief Searches the wand in a camera frame, in the background. Thread-safe.
+        ///
+        /// The frame is copied, so the caller may reuse it at once. A camera has at most one frame being searched:
+        /// frames pushed meanwhile are dropped.
+        ///
+        /// \param [in] iCameraId       the GUID of the camera that took the frame
+        /// \param [in] iFrame          the frame, 8-bit single channel
+        PCCORE_EXPORT void PushFrame ( std::string const& iCameraId, PcFramePtr const& iFrame );
+
+        /// \brief Records a wand observation. Thread-safe.
+        /// \param [in] iCameraId       the GUID of the camera that observed the wand
+        /// \param [in] iTimestamp      the camera timestamp of the frame
+        /// \param [in] iFrameSize      the size of the frame, in pixels
+        /// \param [in] iMarkers        the marker centroids, in the order of the marker positions
+        PCCORE_EXPORT void AddObservation ( std::string const& iCameraId, boost::uint64_t const& iTimestamp, cv::Size const& iFrameSize, VEC(cv::Point2f) const& iMarkers );
+
+        /// \brief Searches the wand markers in an image.
+        ///
+        /// The markers are the blobs brighter than a fixed threshold. The wand is found if there are as many blobs
+        /// as markers and they are collinear; the markers are then ordered from their spacing.
+        ///
+        /// \param [in]  iImage         the image, 8-bit single channel
+        /// \param [out] oMarkers       the marker centroids, in the order of the marker positions
+        /// \return true if the wand was found, false otherwise
+        PCCORE_EXPORT bool DetectWand ( cv::Mat const& iImage, VEC(cv::Point2f)& oMarkers ) const;
+
+        /// \brief Calculates the camera poses from the observations recorded so far, and publishes them.
+        ///
+        /// Returns at once if another solve is running.
+        ///
+        /// \param [in] iMaxIterations  the maximum number of bundle adjustment iterations
+        /// \return true upon success, false if another solve is running or if no two registered cameras share
+        ///         enough wand views
+        PCCORE_EXPORT bool Solve ( unsigned int const& iMaxIterations = 50u );
+
+        /// \brief Gets the outcome of the last successful Solve. Thread-safe.
+        /// \return the solution, null if no solve succeeded
+        inline PcWandSolutionPtr GetSolution () const { return boost::atomic_load ( &m_solution ); }
+
+        /// \brief Tells whether a solve is running. Thread-safe.
+        /// \return true while Solve runs
+        inline bool IsSolving () const { return m_isSolving.load (); }
+
+        /// \brief Gets the number of observations recorded so far. Thread-safe.
+        /// \return the number of observations
+        PCCORE_EXPORT size_t GetObservationCount ();
+
+        /// \brief Gets how much of the frame of a camera the wand markers have covered so far. Thread-safe.
+        /// \param [in] iCameraId       the camera GUID
+        /// \return the fraction of the cells of a grid over the frame that held a marker, between 0 and 1
+        PCCORE_EXPORT double GetCoverage ( std::string const& iCameraId );
+
+        /// \brief Gets the number of frames dropped because the previous frame of their camera was still being searched. Thread-safe.
+        /// \return the number of dropped frames
+        PCCORE_EXPORT boost::uint64_t GetDroppedFrames ();
+
+    private:
+        /// \brief A wand observation.
+        struct Observation
+        {
+            std::string                 CameraId;       ///< The GUID of the observing camera.
+            boost::uint64_t             Timestamp;      ///< The camera timestamp of the frame.
+            VEC(cv::Point2f)            Markers;        ///< The marker centroids.
+        };
+
+        /// \brief The intrinsics of a registered camera.
+        struct Intrinsics
+        {
+            cv::Mat                     CameraMatrix;   ///< The intrinsic camera matrix.
+            cv::Mat                     DistCoeffs;     ///< The distortion coefficients.
+            PcPointUndistorterPtr       Undistorter;    ///< The undistorter of the marker centroids, null to use cv::undistortPoints.
+        };
+
+        /// \brief The detection state and coverage of a camera.
+        struct CameraState
+        {
+            cv::Mat                     Image;          ///< The copy of the frame being searched.
+            boost::uint64_t             Timestamp;      ///< The timestamp of the frame being searched.
+            bool                        IsDetecting;    ///< Whether a frame is being searched.
+            VEC(bool)                   Cells;          ///< Whether each cell of the coverage grid held a marker.
+            unsigned int                CoveredCells;   ///< The number of cells that held a marker.
+        };
+
+        /// \brief Private copy constructor.
+        ///
+        /// Disables copy of PcWandCalibrator objects.
+        /// \param [in] iOther      the object to be copied
+        PcWandCalibrator ( PcWandCalibrator const& iOther ) {}
+
+        /// \brief Private assignment operator.
+        ///
+        /// Disables assignment of PcWandCalibrator objects.
+        /// \param [in] iOther      the object to be assigned to this object.
+        /// \return this object, unchanged
+        PcWandCalibrator& operator= ( PcWandCalibrator const& iOther ) { return (*this); }
+
+        /// \brief Gets the detection state of a camera, creating it if needed, with m_mutex held.
+        /// \param [in] iCameraId       the camera GUID
+        /// \return the camera state
+        CameraState& GetCameraState ( std::string const& iCameraId );
+
+        /// \brief Searches the wand in the frame copied for a camera. Runs as a PcThreadPool task.
+        /// \param [in] iCameraId       the camera GUID
+        void Detect ( std::string const& iCameraId );
+
+        /// \brief Solves the camera poses, with m_solveMutex held.
+        /// \param [in] iMaxIterations  the maximum number of bundle adjustment iterations
+        /// \return true upon success
+        bool DoSolve ( unsigned int const& iMaxIterations );
+
+    private:
+        VEC(double)                     m_markerPositions;  ///< The marker distances from the first marker along the wand.
+        boost::uint64_t                 m_tolerance;        ///< The timestamp tolerance of a wand view.
+        boost::mutex                    m_mutex;            ///< Locks the observation list, the intrinsics and the camera states.
+        boost::condition_variable       m_idle;             ///< Signalled when a detection returns.
+        unsigned int                    m_taskCount;        ///< The number of detections scheduled or running.
+        boost::uint64_t                 m_droppedFrames;    ///< The number of frames dropped.
+        boost::mutex                    m_solveMutex;       ///< Held while solving, so that solves don't overlap.
+        boost::atomic<bool>             m_isSolving;        ///< Whether a solve is running.
+        VEC(Observation)                m_observations;     ///< The observations recorded so far.
+        STRMAP(Intrinsics)              m_intrinsics;       ///< The intrinsics of the registered cameras.
+        STRMAP(CameraState)             m_cameras;          ///< The detection state and coverage of every camera.
+        PcWandSolutionPtr               m_solution;         ///< The last successful solution, null if none. Accessed atomically.
+    };
+
+    typedef boost::shared_ptr<PcWandCalibrator> PcWandCalibratorPtr;  ///< A reference-counted pointer to a PcWandCalibrator object.
+}
+
+#endif // PCWANDCALIBRATOR_H
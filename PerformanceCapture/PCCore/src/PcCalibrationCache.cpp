@@ -0,0 +1,174 @@
+#include "PcCalibrationCache.h"
+
+#include "PcRecordingFormat.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+using namespace pcc;
+
+// "PCCA" in little-endian order.
+static boost::uint32_t const CACHE_MAGIC = 0x41434350u;
+static boost::uint32_t const CACHE_VERSION = 1u;
+
+/// \brief Writes an array to a file, returning false upon failure.
+template<typename T>
+static bool WriteArray ( FILE* iFile, T const* iData, size_t const& iCount )
+{
+    return ( iCount == 0 || fwrite ( iData, sizeof ( T ), iCount, iFile ) == iCount );
+}
+
+/// \brief Reads an array from a file, returning false upon failure.
+template<typename T>
+static bool ReadArray ( FILE* iFile, T* oData, size_t const& iCount )
+{
+    return ( iCount == 0 || fread ( oData, sizeof ( T ), iCount, iFile ) == iCount );
+}
+
+/// \brief Compares a record field with a GUID.
+static bool SameId ( char const* iField, std::string const& iId )
+{
+    return ( strncmp ( iField, iId.c_str (), PCC_CACHE_ID_LENGTH ) == 0 );
+}
+
+// ----------------------------------------------------------------------
+// PcCalibrationCache
+// ----------------------------------------------------------------------
+// Public
+PcCalibrationCache::PcCalibrationCache ()
+    :   m_cameras ()
+    ,   m_stereo ()
+{}
+bool PcCalibrationCache::Load ( std::string const& iPath )
+{
+    FILE* file = fopen ( iPath.c_str (), "rb" );
+    if ( !file ) {
+        return false;
+    }
+
+    boost::uint32_t header[4];
+    bool ok = ReadArray ( file, header, 4 ) && header[0] == CACHE_MAGIC && header[1] == CACHE_VERSION;
+
+    VEC(PcCameraRecord) cameras ( ok ? header[2] : 0u );
+    VEC(PcStereoRecord) stereo ( ok ? header[3] : 0u );
+    ok = ok && ( cameras.empty () || ReadArray ( file, &cameras[0], cameras.size () ) );
+    ok = ok && ( stereo.empty () || ReadArray ( file, &stereo[0], stereo.size () ) );
+    fclose ( file );
+
+    if ( !ok ) {
+        std::cout << "Invalid calibration cache " << iPath << std::endl;
+        return false;
+    }
+    m_cameras.swap ( cameras );
+    m_stereo.swap ( stereo );
+    return true;
+}
+bool PcCalibrationCache::Save ( std::string const& iPath ) const
+{
+    std::string const tempPath = iPath + ".tmp";
+    FILE* file = fopen ( tempPath.c_str (), "wb" );
+    if ( !file ) {
+        std::cout << "Error writing calibration cache " << tempPath << std::endl;
+        return false;
+    }
+
+    boost::uint32_t const header[] = {
+        CACHE_MAGIC, CACHE_VERSION, (boost::uint32_t)m_cameras.size (), (boost::uint32_t)m_stereo.size ()
+    };
+    bool ok = WriteArray ( file, header, 4 );
+    ok = ok && ( m_cameras.empty () || WriteArray ( file, &m_cameras[0], m_cameras.size () ) );
+    ok = ok && ( m_stereo.empty () || WriteArray ( file, &m_stereo[0], m_stereo.size () ) );
+    ok = ok && PcFileSync ( file );
+    fclose ( file );
+
+    // rename doesn't replace existing files on Windows.
+    if ( ok ) {
+        remove ( iPath.c_str () );
+        ok = ( rename ( tempPath.c_str (), iPath.c_str () ) == 0 );
+    }
+    if ( !ok ) {
+        std::cout << "Error writing calibration cache " << iPath << std::endl;
+        remove ( tempPath.c_str () );
+    }
+    return ok;
+}
+bool PcCalibrationCache::FindCamera ( std::string const& iCameraId, PcCameraRecord& oRecord ) const
+{
+    for ( auto record = m_cameras.begin (); record != m_cameras.end (); record++ ) {
+        if ( SameId ( record->CameraId, iCameraId ) ) {
+            oRecord = *record;
+            return true;
+        }
+    }
+    return false;
+}
+void PcCalibrationCache::StoreCamera ( PcCameraRecord const& iRecord )
+{
+    for ( auto record = m_cameras.begin (); record != m_cameras.end (); record++ ) {
+        if ( strncmp ( record->CameraId, iRecord.CameraId, PCC_CACHE_ID_LENGTH ) == 0 ) {
+            *record = iRecord;
+            return;
+        }
+    }
+    m_cameras.push_back ( iRecord );
+}
+bool PcCalibrationCache::FindStereo ( std::string const& iLeftId, std::string const& iRightId, PcStereoRecord& oRecord ) const
+{
+    for ( auto record = m_stereo.begin (); record != m_stereo.end (); record++ ) {
+        if ( SameId ( record->LeftId, iLeftId ) && SameId ( record->RightId, iRightId ) ) {
+            oRecord = *record;
+            return true;
+        }
+    }
+    return false;
+}
+void PcCalibrationCache::StoreStereo ( PcStereoRecord const& iRecord )
+{
+    for ( auto record = m_stereo.begin (); record != m_stereo.end (); record++ ) {
+        if (    strncmp ( record->LeftId, iRecord.LeftId, PCC_CACHE_ID_LENGTH ) == 0
+            &&  strncmp ( record->RightId, iRecord.RightId, PCC_CACHE_ID_LENGTH ) == 0 ) {
+            *record = iRecord;
+            return;
+        }
+    }
+    m_stereo.push_back ( iRecord );
+}
+boost::uint64_t PcCalibrationCache::RigKey ( VEC(std::string) const& iCameraIds )
+{
+    VEC(std::string) ids ( iCameraIds );
+    std::sort ( ids.begin (), ids.end () );
+
+    // 64-bit FNV-1a, with a separator after every GUID.
+    boost::uint64_t hash = 14695981039346656037ull;
+    for ( auto id = ids.begin (); id != ids.end (); id++ ) {
+        for ( auto c = id->begin (); c != id->end (); c++ ) {
+            hash = ( hash ^ (unsigned char)*c ) * 1099511628211ull;
+        }
+        hash = ( hash ^ (unsigned char)'\n' ) * 1099511628211ull;
+    }
+    return ( hash != 0u ) ? hash : 1u;
+}
+void PcCalibrationCache::WriteId ( std::string const& iId, char* oField )
+{
+    memset ( oField, 0, PCC_CACHE_ID_LENGTH );
+    iId.copy ( oField, PCC_CACHE_ID_LENGTH - 1u );
+}
+bool PcCalibrationCache::WriteMatrix ( cv::Mat const& iMatrix, size_t const& iCount, double* oField )
+{
+    std::fill ( oField, oField + iCount, 0.0 );
+    if ( iMatrix.total () != iCount || iMatrix.channels () != 1 ) {
+        return false;
+    }
+
+    cv::Mat values;
+    cv::Mat const continuous = iMatrix.isContinuous () ? iMatrix : iMatrix.clone ();
+    continuous.reshape ( 1, 1 ).convertTo ( values, CV_64F );
+    std::copy ( values.ptr<double> (), values.ptr<double> () + iCount, oField );
+    return true;
+}
+cv::Mat PcCalibrationCache::ReadMatrix ( double const* iField, int const& iRows, int const& iCols )
+{
+    return cv::Mat ( iRows, iCols, CV_64F, const_cast<double*> ( iField ) ).clone ();
+}
@@ -0,0 +1,225 @@
+#include "PcCalibrationCapture.h"
+
+#include "PcCalibrationHelper.h"
+#include "PcThreadPool.h"
+
+#include <boost/bind.hpp>
+
+using namespace pcc;
+
+// The number of cameras that must find the target in a set for it to count for the extrinsics.
+static size_t const MIN_SHARED_CAMERAS = 2u;
+
+// ----------------------------------------------------------------------
+// PcCalibrationCapture
+// ----------------------------------------------------------------------
+// Public
+PcCalibrationCapture::PcCalibrationCapture ( boost::uint64_t const& iTolerance )
+    :   m_tolerance ( iTolerance )
+    ,   m_mutex ()
+    ,   m_idle ()
+    ,   m_isDraining ( false )
+    ,   m_current ()
+    ,   m_pending ()
+    ,   m_free ()
+    ,   m_nextId ( 1u )
+    ,   m_setCount ( 0u )
+    ,   m_sharedSetCount ( 0u )
+    ,   m_droppedSets ( 0u )
+{}
+PcCalibrationCapture::~PcCalibrationCapture ()
+{
+    boost::unique_lock<boost::mutex> lock ( m_mutex );
+
+    m_pending.clear ();
+    while ( m_isDraining ) {
+        m_idle.wait ( lock );
+    }
+}
+void PcCalibrationCapture::PushFrame ( PcCameraPtr const& iCamera, PcFramePtr const& iFrame )
+{
+    boost::uint64_t const timestamp = iFrame->Timestamp ();
+    bool isDrainNeeded = false;
+    {
+        boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+        if ( m_current && timestamp > m_current->Timestamp + m_tolerance ) {
+            // This camera is past the instant of the open set, so the others are too.
+            isDrainNeeded = CloseSet ();
+        }
+
+        // Only a camera that wants a view opens a set; the others join it for the extrinsics.
+        if ( !m_current && iCamera->WantsCalibrationView ( timestamp ) ) {
+            if ( m_free.empty () ) {
+                m_current = FrameSetPtr ( new FrameSet () );
+            } else {
+                m_current = m_free.back ();
+                m_free.pop_back ();
+            }
+            m_current->Id = m_nextId++;
+            m_current->Timestamp = timestamp;
+            m_current->Size = 0u;
+        }
+
+        FrameSet* const set = m_current.get ();
+        if ( set != 0x0 && timestamp + m_tolerance >= set->Timestamp ) {
+            bool hasFrame = false;
+            for ( size_t f = 0; f < set->Size && !hasFrame; f++ ) {
+                hasFrame = ( set->Cameras[f] == iCamera );
+            }
+            if ( !hasFrame ) {
+                if ( set->Size == set->Images.size () ) {
+                    set->Cameras.push_back ( PcCameraPtr () );
+                    set->Images.push_back ( cv::Mat () );
+                    set->Timestamps.push_back ( 0u );
+                    set->FrameIds.push_back ( 0u );
+                }
+                // copyTo only reallocates the buffer if the frame size or type changed.
+                set->Cameras[set->Size] = iCamera;
+                iFrame->GetImagePoints ().copyTo ( set->Images[set->Size] );
+                set->Timestamps[set->Size] = timestamp;
+                set->FrameIds[set->Size] = iFrame->FrameId ();
+                set->Size++;
+            }
+        }
+    }
+
+    if ( isDrainNeeded ) {
+        PcThreadPool::GetInstance ().Submit ( boost::bind ( &PcCalibrationCapture::Drain, this ) );
+    }
+}
+void PcCalibrationCapture::Clear ()
+{
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    if ( m_current ) {
+        Recycle ( m_current );
+        m_current.reset ();
+    }
+    for ( auto set = m_pending.begin (); set != m_pending.end (); set++ ) {
+        Recycle ( *set );
+    }
+    m_pending.clear ();
+    m_setCount = 0u;
+    m_sharedSetCount = 0u;
+    m_droppedSets = 0u;
+}
+boost::uint64_t PcCalibrationCapture::GetSetCount ()
+{
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    return m_setCount;
+}
+boost::uint64_t PcCalibrationCapture::GetSharedSetCount ()
+{
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    return m_sharedSetCount;
+}
+boost::uint64_t PcCalibrationCapture::GetDroppedSets ()
+{
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    return m_droppedSets;
+}
+
+// Private
+bool PcCalibrationCapture::CloseSet ()
+{
+    PcCalibrationHelper& calib = PcCalibrationHelper::GetInstance ();
+
+    FrameSetPtr set;
+    set.swap ( m_current );
+    if ( m_pending.size () >= calib.FrameQueueCapacity () ) {
+        m_droppedSets++;
+        if ( calib.FrameDropPolicy () == PCC_DROP_NEWEST || m_pending.empty () ) {
+            Recycle ( set );
+            return false;
+        }
+        Recycle ( m_pending.front () );
+        m_pending.pop_front ();
+    }
+    m_pending.push_back ( set );
+
+    if ( m_isDraining ) {
+        return false;
+    }
+    m_isDraining = true;
+    return true;
+}
+void PcCalibrationCapture::Recycle ( FrameSetPtr const& iSet )
+{
+    // The cameras may be removed while their frames wait in the pool.
+    for ( size_t f = 0; f < iSet->Size; f++ ) {
+        iSet->Cameras[f].reset ();
+    }
+    iSet->Size = 0u;
+    m_free.push_back ( iSet );
+}
+void PcCalibrationCapture::Drain ()
+{
+    PcThreadPool& pool = PcThreadPool::GetInstance ();
+
+    VECOFVECS(cv::Point2f) corners;
+    VEC(unsigned char) isFound;
+    FrameSetPtr set;
+    for ( ;; ) {
+        {
+            boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+            if ( set ) {
+                Recycle ( set );
+                set.reset ();
+            }
+            if ( m_pending.empty () ) {
+                m_isDraining = false;
+                m_idle.notify_all ();
+                return;
+            }
+            set = m_pending.front ();
+            m_pending.pop_front ();
+        }
+
+        corners.resize ( set->Size );
+        isFound.assign ( set->Size, 0u );
+        pool.ParallelFor ( 0u, set->Size, boost::bind ( &PcCalibrationCapture::ProcessFrame, set.get (), &corners, &isFound, _1 ) );
+
+        size_t foundCount = 0u;
+        for ( size_t f = 0; f < set->Size; f++ ) {
+            foundCount += isFound[f];
+        }
+        bool const isShared = ( foundCount >= MIN_SHARED_CAMERAS );
+        if ( isShared ) {
+            // The rig calibrator groups its observations by timestamp, so the set shares a single one.
+            PcRigCalibratorPtr rig = PcCalibrationHelper::GetInstance ().GetRigCalibrator ();
+            for ( size_t f = 0; f < set->Size; f++ ) {
+                if ( !isFound[f] ) {
+                    continue;
+                }
+                PcCalibrationView view;
+                view.Timestamp = set->Timestamps[f];
+                view.FrameId = set->FrameIds[f];
+                view.SetId = set->Id;
+                set->Cameras[f]->AddSharedCalibrationView ( view, corners[f] );
+                if ( rig ) {
+                    rig->AddObservation ( set->Cameras[f]->GetID (), set->Timestamp, corners[f] );
+                }
+            }
+        }
+
+        boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+        m_setCount++;
+        if ( isShared ) {
+            m_sharedSetCount++;
+        }
+    }
+}
+void PcCalibrationCapture::ProcessFrame ( FrameSet const* iSet, VECOFVECS(cv::Point2f)* oCorners, VEC(unsigned char)* oIsFound, size_t const& iFrame )
+{
+    PcCalibrationView view;
+    view.Timestamp = iSet->Timestamps[iFrame];
+    view.FrameId = iSet->FrameIds[iFrame];
+    view.SetId = iSet->Id;
+    (*oIsFound)[iFrame] = iSet->Cameras[iFrame]->ProcessCalibrationFrame ( view, iSet->Images[iFrame], (*oCorners)[iFrame] ) ? 1u : 0u;
+}
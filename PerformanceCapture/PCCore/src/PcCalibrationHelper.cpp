@@ -1,6 +1,6 @@
 #include "PcCalibrationHelper.h"
 
-#include "PcChessboard.h"
+#include "PcCalibrationCache.h"
 #include "PcCamera.h"
 #include "PcSystem.h"
 
@@ -8,8 +8,6 @@
 
 using namespace pcc;
 
-/// \brief  Default calibration chessboard dimensions are 7x10 with 10x10 sized squares.
-PcChessboard PcCalibrationHelper::sm_chessboard ( 7u, 10u, 10u );
 PcCalibrationHelper* PcCalibrationHelper::sm_pInstance = 0x0;
 
 PcCalibrationHelper& PcCalibrationHelper::GetInstance ()
@@ -26,12 +24,66 @@ void PcCalibrationHelper::DestroyInstance ()
 
 PcCalibrationHelper::~PcCalibrationHelper ()
 {}
-VECOFVECS(cv::Point3f) PcCalibrationHelper::GetChessboardPoints ()
+VECOFVECS(cv::Point3f) PcCalibrationHelper::GetTargetPoints () const
 {
-    return sm_chessboard.CreateInputArray ( m_frameCount );
+    return GetTarget ()->CreateInputArray ( m_frameCount );
+}
+VECOFVECS(cv::Point3f) PcCalibrationHelper::GetTargetPoints ( unsigned int const& iViewCount ) const
+{
+    return GetTarget ()->CreateInputArray ( iViewCount );
+}
+void PcCalibrationHelper::StartImageExport ( std::string const& iDirectory, PcImageExportFormat const& iFormat )
+{
+    StopImageExport ();
+    boost::atomic_store ( &m_imageExporter, PcDebugImageExporterPtr ( new PcDebugImageExporter ( iDirectory, iFormat ) ) );
+}
+void PcCalibrationHelper::StopImageExport ()
+{
+    // The last owner joins the encoder threads when it releases the exporter.
+    boost::atomic_exchange ( &m_imageExporter, PcDebugImageExporterPtr () );
+}
+void PcCalibrationHelper::StartRigCalibration ()
+{
+    boost::atomic_store ( &m_rigCalibrator, PcRigCalibratorPtr ( new PcRigCalibrator ( GetTarget ()->GetPoints () ) ) );
+}
+void PcCalibrationHelper::StopRigCalibration ()
+{
+    boost::atomic_exchange ( &m_rigCalibrator, PcRigCalibratorPtr () );
+}
+void PcCalibrationHelper::StartWandCalibration ( VEC(double) const& iMarkerPositions )
+{
+    boost::atomic_store ( &m_wandCalibrator, PcWandCalibratorPtr ( new PcWandCalibrator ( iMarkerPositions ) ) );
+}
+void PcCalibrationHelper::StopWandCalibration ()
+{
+    // The last owner waits for the detections in flight when it releases the calibrator.
+    boost::atomic_exchange ( &m_wandCalibrator, PcWandCalibratorPtr () );
+}
+void PcCalibrationHelper::StartDriftMonitor ( double const& iBudget )
+{
+    boost::atomic_store ( &m_driftMonitor, PcDriftMonitorPtr ( new PcDriftMonitor ( *GetTarget (), iBudget ) ) );
+}
+void PcCalibrationHelper::StopDriftMonitor ()
+{
+    // The last owner waits for the check in flight when it releases the monitor.
+    boost::atomic_exchange ( &m_driftMonitor, PcDriftMonitorPtr () );
 }
 
 PcCalibrationHelper::PcCalibrationHelper ()
     :   m_frameDelay ( 1000 )
     ,   m_frameCount ( 15 )
+    ,   m_isIncremental ( true )
+    ,   m_minimumViews ( 4 )
+    ,   m_convergenceThreshold ( 1.0 )
+    ,   m_selectsViews ( true )
+    ,   m_minimumSharpness ( 50.0 )
+    ,   m_frameQueueCapacity ( 4 )
+    ,   m_frameDropPolicy ( PCC_DROP_OLDEST )
+    ,   m_thumbnailWidth ( 160 )
+    ,   m_cachePath ( std::string ( "calibration" ) + PCC_CALIBRATION_EXTENSION )
+    ,   m_imageExporter ()
+    ,   m_rigCalibrator ()
+    ,   m_wandCalibrator ()
+    ,   m_driftMonitor ()
+    ,   m_target ( new PcCalibrationTarget ( PCC_TARGET_CHESSBOARD, 7u, 10u, 10.0f ) )
 {}
@@ -0,0 +1,179 @@
+#include "PcCalibrationMath.h"
+
+#include "PcIntrinsicSolver.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace pcc;
+
+// The reprojection Jacobian of cv::projectPoints starts with the 3 rotation and 3 translation columns of the pose,
+// followed by fx, fy, cx, cy and the distortion coefficients.
+static int const POSE_PARAMETERS = 6;
+
+bool pcc::PcIntrinsicDeviations (
+    cv::InputArrayOfArrays      iObjectPoints,
+    cv::InputArrayOfArrays      iImagePoints,
+    VEC(cv::Mat) const&         iRvecs,
+    VEC(cv::Mat) const&         iTvecs,
+    cv::Mat const&              iCameraMatrix,
+    cv::Mat const&              iDistCoeffs,
+    int const&                  iFlags,
+    cv::Mat&                    oDeviations
+) {
+    int const distCount = (int)iDistCoeffs.total ();
+    int const paramCount = 4 + distCount;
+
+    // Parameters held fixed by the calibration don't take part in the covariance. A fixed aspect ratio couples fx
+    // and fy rather than fixing them, so both are kept, which slightly overestimates their deviations.
+    VEC(bool) isFree ( paramCount, true );
+    if ( iFlags & CV_CALIB_FIX_FOCAL_LENGTH ) {
+        isFree[0] = isFree[1] = false;
+    }
+    if ( iFlags & CV_CALIB_FIX_PRINCIPAL_POINT ) {
+        isFree[2] = isFree[3] = false;
+    }
+    int const distFlags[] = {
+        CV_CALIB_FIX_K1, CV_CALIB_FIX_K2, CV_CALIB_ZERO_TANGENT_DIST, CV_CALIB_ZERO_TANGENT_DIST,
+        CV_CALIB_FIX_K3, CV_CALIB_FIX_K4, CV_CALIB_FIX_K5, CV_CALIB_FIX_K6
+    };
+    for ( int d = 0; d < distCount && d < 8; d++ ) {
+        isFree[4 + d] = ( ( iFlags & distFlags[d] ) == 0 );
+    }
+    if ( distCount > 5 && !( iFlags & CV_CALIB_RATIONAL_MODEL ) ) {
+        // Without the rational model, cv::calibrateCamera holds k4, k5 and k6 at zero.
+        for ( int d = 5; d < distCount; d++ ) {
+            isFree[4 + d] = false;
+        }
+    }
+
+    VEC(int) columns;
+    for ( int p = 0; p < paramCount; p++ ) {
+        if ( isFree[p] ) {
+            columns.push_back ( p );
+        }
+    }
+    int const freeCount = (int)columns.size ();
+
+    cv::Mat information = cv::Mat::zeros ( freeCount, freeCount, CV_64F );
+    double squaredError = 0.0;
+    size_t observations = 0u;
+    size_t const viewCount = iRvecs.size ();
+    for ( size_t v = 0; v < viewCount; v++ ) {
+        cv::Mat const objectPoints = iObjectPoints.getMat ( (int)v );
+        cv::Mat imagePoints;
+        iImagePoints.getMat ( (int)v ).reshape ( 2, (int)iImagePoints.total ( (int)v ) ).convertTo ( imagePoints, CV_32FC2 );
+
+        VEC(cv::Point2f) projected;
+        cv::Mat jacobian;
+        cv::projectPoints ( objectPoints, iRvecs[v], iTvecs[v], iCameraMatrix, iDistCoeffs, projected, jacobian );
+
+        for ( int i = 0; i < imagePoints.rows; i++ ) {
+            cv::Point2f const d = imagePoints.at<cv::Point2f> ( i ) - projected[i];
+            squaredError += d.x * d.x + d.y * d.y;
+        }
+        observations += 2u * projected.size ();
+
+        cv::Mat intrinsic ( jacobian.rows, freeCount, CV_64F );
+        for ( int c = 0; c < freeCount; c++ ) {
+            cv::Mat column = intrinsic.col ( c );
+            jacobian.col ( POSE_PARAMETERS + columns[c] ).copyTo ( column );
+        }
+        cv::Mat const pose = jacobian.colRange ( 0, POSE_PARAMETERS );
+
+        // Schur complement of the pose block: A'A - A'B ( B'B )^-1 B'A.
+        cv::Mat AtA, AtB, BtB, BtBinv, AtBBtBinv, reduced;
+        cv::gemm ( intrinsic, intrinsic, 1.0, cv::noArray (), 0.0, AtA, cv::GEMM_1_T );
+        cv::gemm ( intrinsic, pose, 1.0, cv::noArray (), 0.0, AtB, cv::GEMM_1_T );
+        cv::gemm ( pose, pose, 1.0, cv::noArray (), 0.0, BtB, cv::GEMM_1_T );
+        if ( cv::invert ( BtB, BtBinv, cv::DECOMP_CHOLESKY ) == 0.0 ) {
+            return false;
+        }
+        cv::gemm ( AtB, BtBinv, 1.0, cv::noArray (), 0.0, AtBBtBinv );
+        cv::gemm ( AtBBtBinv, AtB, -1.0, AtA, 1.0, reduced, cv::GEMM_2_T );
+        information += reduced;
+    }
+
+    double const dof = (double)observations - freeCount - POSE_PARAMETERS * (double)viewCount;
+    if ( viewCount == 0u || dof <= 0.0 ) {
+        return false;
+    }
+
+    cv::Mat covariance;
+    if ( cv::invert ( information, covariance, cv::DECOMP_CHOLESKY ) == 0.0 ) {
+        return false;
+    }
+
+    double const variance = squaredError / dof;
+    oDeviations = cv::Mat::zeros ( 1, paramCount, CV_64F );
+    for ( int c = 0; c < freeCount; c++ ) {
+        oDeviations.at<double> ( columns[c] ) = std::sqrt ( variance * std::max ( 0.0, covariance.at<double> ( c, c ) ) );
+    }
+    return true;
+}
+double pcc::PcCalibrateIntrinsics (
+    cv::InputArrayOfArrays      iObjectPoints,
+    cv::InputArrayOfArrays      iImagePoints,
+    cv::Size const&             iImageSize,
+    cv::Mat&                    ioCameraMatrix,
+    cv::Mat&                    ioDistCoeffs,
+    bool const&                 iUseGuess,
+    cv::Mat&                    oDeviations
+) {
+    VEC(cv::Mat) rvecs, tvecs;
+
+    size_t const viewCount = iObjectPoints.total ();
+    VECOFVECS(cv::Point3f) objectPoints ( viewCount );
+    VECOFVECS(cv::Point2f) imagePoints ( viewCount );
+    for ( size_t v = 0; v < viewCount && v < iImagePoints.total (); v++ ) {
+        iObjectPoints.getMat ( (int)v ).copyTo ( objectPoints[v] );
+        iImagePoints.getMat ( (int)v ).copyTo ( imagePoints[v] );
+    }
+
+    // The native solver handles planar targets; anything it can't start from goes to OpenCV.
+    int const flags = CV_CALIB_FIX_K4|CV_CALIB_FIX_K5|CV_CALIB_FIX_K6|( iUseGuess ? CV_CALIB_USE_INTRINSIC_GUESS : 0 );
+    double rms = PcSolveIntrinsics ( objectPoints, imagePoints, iImageSize, ioCameraMatrix, ioDistCoeffs, rvecs, tvecs, iUseGuess );
+    if ( rms < 0.0 ) {
+        rms = cv::calibrateCamera (
+            iObjectPoints,
+            iImagePoints,
+            iImageSize,
+            ioCameraMatrix,
+            ioDistCoeffs,
+            rvecs,
+            tvecs,
+            flags
+        );
+    }
+
+    if ( !PcIntrinsicDeviations ( iObjectPoints, iImagePoints, rvecs, tvecs, ioCameraMatrix, ioDistCoeffs, flags, oDeviations ) ) {
+        oDeviations = cv::Mat ();
+    }
+    return rms;
+}
+
+bool pcc::PcTriangulate ( VEC(cv::Mat) const& iProjections, VEC(cv::Point2f) const& iPoints, cv::Point3d& oPoint )
+{
+    cv::Mat system ( 2 * (int)iPoints.size (), 4, CV_64F );
+    for ( size_t i = 0; i < iPoints.size (); i++ ) {
+        cv::Mat const& P = iProjections[i];
+        for ( int c = 0; c < 4; c++ ) {
+            system.at<double> ( 2 * (int)i, c ) = iPoints[i].x * P.at<double> ( 2, c ) - P.at<double> ( 0, c );
+            system.at<double> ( 2 * (int)i + 1, c ) = iPoints[i].y * P.at<double> ( 2, c ) - P.at<double> ( 1, c );
+        }
+    }
+    cv::Mat solution;
+    cv::SVD::solveZ ( system, solution );
+    double const w = solution.at<double> ( 3 );
+    if ( std::abs ( w ) < 1e-12 ) {
+        return false;
+    }
+    oPoint = cv::Point3d ( solution.at<double> ( 0 ) / w, solution.at<double> ( 1 ) / w, solution.at<double> ( 2 ) / w );
+    for ( size_t i = 0; i < iProjections.size (); i++ ) {
+        cv::Mat const& P = iProjections[i];
+        if ( P.at<double> ( 2, 0 ) * oPoint.x + P.at<double> ( 2, 1 ) * oPoint.y + P.at<double> ( 2, 2 ) * oPoint.z + P.at<double> ( 2, 3 ) <= 0.0 ) {
+            return false;
+        }
+    }
+    return true;
+}
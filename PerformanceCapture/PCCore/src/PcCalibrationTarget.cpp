@@ -0,0 +1,36 @@
+#include "PcCalibrationTarget.h"
+
+#include "PcChessboard.h"
+
+using namespace pcc;
+
+// ----------------------------------------------------------------------
+// PcCalibrationTarget
+// ----------------------------------------------------------------------
+// Public
+PcCalibrationTarget::PcCalibrationTarget (
+    PcTargetType const&     iType,
+    unsigned int const&     iRows,
+    unsigned int const&     iCols,
+    float const&            iSpacing
+)   :   m_type ( iType )
+    ,   m_size ( iCols, iRows )
+    ,   m_spacing ( iSpacing )
+    ,   m_points ()
+{
+    if ( m_type == PCC_TARGET_CHESSBOARD ) {
+        m_points = PcChessboard ( iRows, iCols, iSpacing ).GetPoints ();
+        return;
+    }
+
+    for ( int i = 0; i < m_size.height; i++ ) {
+        for ( int j = 0; j < m_size.width; j++ ) {
+            float const x = ( m_type == PCC_TARGET_ASYMMETRIC_CIRCLES ) ? (float)( 2 * j + i % 2 ) : (float)j;
+            m_points.push_back ( cv::Point3f ( x * m_spacing, i * m_spacing, 0.0f ) );
+        }
+    }
+}
+VECOFVECS(cv::Point3f) PcCalibrationTarget::CreateInputArray ( unsigned int const& iFrameCount ) const
+{
+    return VECOFVECS(cv::Point3f) ( iFrameCount, m_points );
+}
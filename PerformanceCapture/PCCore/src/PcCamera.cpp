@@ -6,15 +6,21 @@
 #include "PcFrame.h"
 #include "PcFrameObserver.h"
 #include "PcCalibrationHelper.h"
+#include "PcCalibrationMath.h"
 
 #define BOOST_ALL_DYN_LINK
 #include <boost/thread/thread.hpp>
 #include <boost/thread/locks.hpp>
 
+#include <algorithm>
+#include <ctime>
 #include <iostream>
 
 using namespace pcc;
 
+// The number of nanoseconds per second, and the default frequency of the camera timestamp clock.
+static boost::uint64_t const NANOSECONDS_PER_SECOND = 1000000000u;
+
 PcCamera::PcCamera (
     VmbAPI::CameraPtr const&        iCamera
 )   :   m_isSetup ( false )
@@ -24,10 +30,20 @@ PcCamera::PcCamera (
     ,   m_cameraId ()
     ,   m_ptpStatus ()
     ,   m_frameSize ()
+    ,   m_timestampFrequency ( NANOSECONDS_PER_SECOND )
     ,   m_cameraMatrix ( 3, 3, CV_64F )
     ,   m_distCoeffs ( 8, 1, CV_64F )
-    ,   m_frameCount ( 0u )
-    ,   m_lastFrameCount ( 0u )
+    ,   m_intrinsicDeviations ()
+    ,   m_calibrationDate ( 0 )
+    ,   m_calibrationVersion ( 0u )
+    ,   m_isUndistorting ( false )
+    ,   m_undistortVersion ( 0u )
+    ,   m_undistortMap ()
+    ,   m_pointUndistorterVersion ( 0u )
+    ,   m_pointUndistorter ()
+    ,   m_rigKey ( 0u )
+    ,   m_rigRotation ()
+    ,   m_rigTranslation ()
     ,   m_calibration ( (PcCameraCalibration*)0x0 )
 {
     m_calibration = new PcCameraCalibration ( this );
@@ -54,8 +70,6 @@ PcCamera::PcCamera (
 //    m_frameSize = iOther.m_frameSize;
 //    m_cameraMatrix = iOther.m_cameraMatrix;
 //    m_distCoeffs = iOther.m_distCoeffs;
-//    m_frameCount = iOther.m_frameCount;
-//    m_lastFrameCount = iOther.m_lastFrameCount;
 //    m_calibration = iOther.m_calibration;
 //}
 //
@@ -86,8 +100,6 @@ PcCamera::PcCamera (
 //        PCC_OBJ_FREE ( m_frameSize );
 //        PCC_OBJ_FREE ( m_cameraMatrix );
 //        PCC_OBJ_FREE ( m_distCoeffs );
-//        PCC_OBJ_FREE ( m_frameCount );
-//        PCC_OBJ_FREE ( m_lastFrameCount );
 //        PCC_OBJ_FREE ( m_calibration );
 //        PCC_OBJ_FREE ( m_calibration );
 //    }
@@ -266,6 +278,9 @@ void PcCamera::Setup () {
             m_frameSize.height = f;
             TryGetFeature ( "Width", f );
             m_frameSize.width = f;
+            if ( TryGetFeature ( "GevTimestampTickFrequency", f ) && f > 0 ) {
+                m_timestampFrequency = (boost::uint64_t)f;
+            }
 
             TrySetFeature ( "TriggerSelector", "FrameStart" );
             TrySetFeature ( "TriggerMode", "On" );
@@ -302,6 +317,16 @@ void PcCamera::StartAcquisition ()
     }
 }
 
+boost::uint64_t PcCamera::ToNanoseconds ( boost::uint64_t const& iTicks ) const
+{
+    if ( m_timestampFrequency == NANOSECONDS_PER_SECOND ) {
+        return iTicks;
+    }
+    // Split, since the product of a timestamp and a frequency overflows within seconds.
+    return  ( iTicks / m_timestampFrequency ) * NANOSECONDS_PER_SECOND
+        +   ( iTicks % m_timestampFrequency ) * NANOSECONDS_PER_SECOND / m_timestampFrequency;
+}
+
 void PcCamera::StopAcquisition ()
 {
     m_camera->StopContinuousImageAcquisition ();
@@ -337,23 +362,101 @@ void PcCamera::Synchronise ()
     while ( !m_isSynced );// { std::cout << m_ptpStatus << std::endl; }
 }
 
-double PcCamera::DoCalibration ( cv::InputArrayOfArrays iChessboardPoints, cv::InputArrayOfArrays iDetectedChessboardPoints, cv::Size iImageSize )
+double PcCamera::DoCalibration ( cv::InputArrayOfArrays iChessboardPoints, cv::InputArrayOfArrays iDetectedChessboardPoints, cv::Size iImageSize, bool const& iUseGuess )
 {
-    VEC(cv::Mat) rvecs, tvecs;
-
-    double rms = cv::calibrateCamera (
+    double const rms = PcCalibrateIntrinsics (
         iChessboardPoints,
         iDetectedChessboardPoints,
         iImageSize,
         m_cameraMatrix,
         m_distCoeffs,
-        rvecs,
-        tvecs,
-        CV_CALIB_FIX_K4|CV_CALIB_FIX_K5|CV_CALIB_FIX_K6
+        iUseGuess,
+        m_intrinsicDeviations
     );
+    m_calibrationDate = (boost::int64_t)time ( 0 );
+    m_calibrationVersion++;
 
     return rms;
 }
+void PcCamera::GetCacheRecord ( PcCameraRecord& oRecord )
+{
+    PcCalibrationCache::WriteId ( m_cameraId, oRecord.CameraId );
+    oRecord.Width = (boost::uint32_t)m_frameSize.width;
+    oRecord.Height = (boost::uint32_t)m_frameSize.height;
+    PcCalibrationCache::WriteMatrix ( m_cameraMatrix, 9u, oRecord.CameraMatrix );
+    oRecord.DistCount = (boost::uint32_t)std::min ( m_distCoeffs.total (), PCC_CACHE_DIST_COUNT );
+    PcCalibrationCache::WriteMatrix ( m_distCoeffs.reshape ( 1, 1 ).colRange ( 0, oRecord.DistCount ), oRecord.DistCount, oRecord.DistCoeffs );
+    std::fill ( oRecord.DistCoeffs + oRecord.DistCount, oRecord.DistCoeffs + PCC_CACHE_DIST_COUNT, 0.0 );
+    oRecord.Rms = m_calibration->GetCalibrationRms ();
+    oRecord.Date = m_calibrationDate;
+    oRecord.RigKey = m_rigKey;
+    if (    !PcCalibrationCache::WriteMatrix ( m_rigRotation, 9u, oRecord.Rotation )
+        ||  !PcCalibrationCache::WriteMatrix ( m_rigTranslation, 3u, oRecord.Translation ) ) {
+        oRecord.RigKey = 0u;
+    }
+}
+bool PcCamera::RestoreCalibration ( PcCameraRecord const& iRecord )
+{
+    if ( iRecord.Width != (boost::uint32_t)m_frameSize.width || iRecord.Height != (boost::uint32_t)m_frameSize.height ) {
+        std::cout << "Cached calibration of camera " << m_cameraId << " is for another resolution" << std::endl;
+        return false;
+    }
+
+    cv::Mat const cameraMatrix = PcCalibrationCache::ReadMatrix ( iRecord.CameraMatrix, 3, 3 );
+    if (    iRecord.DistCount == 0u || iRecord.DistCount > PCC_CACHE_DIST_COUNT
+        ||  !cv::checkRange ( cameraMatrix ) || cameraMatrix.at<double> ( 0, 0 ) <= 0.0 || cameraMatrix.at<double> ( 1, 1 ) <= 0.0 ) {
+        return false;
+    }
+    cv::Mat const distCoeffs = PcCalibrationCache::ReadMatrix ( iRecord.DistCoeffs, (int)iRecord.DistCount, 1 );
+    if ( !cv::checkRange ( distCoeffs ) || !m_calibration->RestoreCalibration ( iRecord.Rms ) ) {
+        return false;
+    }
+
+    m_cameraMatrix = cameraMatrix;
+    m_distCoeffs = distCoeffs;
+    m_intrinsicDeviations = cv::Mat ();
+    m_calibrationDate = iRecord.Date;
+    m_calibrationVersion++;
+    if ( iRecord.RigKey != 0u ) {
+        SetRigPose ( iRecord.RigKey, PcCalibrationCache::ReadMatrix ( iRecord.Rotation, 3, 3 ), PcCalibrationCache::ReadMatrix ( iRecord.Translation, 3, 1 ) );
+    }
+    return true;
+}
+void PcCamera::SetRigPose ( boost::uint64_t const& iRigKey, cv::Mat const& iRotation, cv::Mat const& iTranslation )
+{
+    m_rigKey = iRigKey;
+    m_rigRotation = iRotation.clone ();
+    m_rigTranslation = iTranslation.clone ();
+}
+
+void PcCamera::UpdateUndistortMap ()
+{
+    if ( !m_isUndistorting ) {
+        boost::atomic_store ( &m_undistortMap, PcRemapMapPtr () );
+        return;
+    }
+    // The intrinsics are only stable once calibrated, and the solve tasks don't touch them afterwards.
+    if (    m_calibration->GetCalibrationState () != CALIBRATED
+        ||  ( m_undistortVersion == m_calibrationVersion && GetUndistortMap () ) ) {
+        return;
+    }
+
+    PcRemapMapPtr const map = PcCreateUndistortMap ( m_cameraMatrix, m_distCoeffs, m_frameSize );
+    if ( map ) {
+        boost::atomic_store ( &m_undistortMap, map );
+        m_undistortVersion = m_calibrationVersion;
+    }
+}
+void PcCamera::UpdatePointUndistorter ()
+{
+    if (    m_calibration->GetCalibrationState () != CALIBRATED
+        ||  ( m_pointUndistorterVersion == m_calibrationVersion && GetPointUndistorter () ) ) {
+        return;
+    }
+
+    boost::atomic_store ( &m_pointUndistorter, PcPointUndistorterPtr ( new PcPointUndistorter ( m_cameraMatrix, m_distCoeffs, m_frameSize ) ) );
+    m_pointUndistorterVersion = m_calibrationVersion;
+}
 
 void PcCamera::StartCalibration ()
 {
@@ -363,17 +466,17 @@ void PcCamera::AbortCalibration ()
 {
     m_calibration->AbortCalibration ();
 }
-void PcCamera::TryPushFrame ( PcFramePtr const& iFrame )
+bool PcCamera::WantsCalibrationView ( boost::uint64_t const& iTimestamp )
 {
-    PcCalibrationHelper& calib = PcCalibrationHelper::GetInstance ();
-
-    unsigned int frameDelay = calib.FrameDelay () / 16;
-
-    m_frameCount++;
-    if ( m_frameCount >= m_lastFrameCount + frameDelay ) {
-        m_calibration->PushFrame ( iFrame );
-        m_lastFrameCount = m_frameCount;
-    }
+    return m_calibration->WantsView ( iTimestamp );
+}
+bool PcCamera::ProcessCalibrationFrame ( PcCalibrationView const& iView, cv::Mat const& iFrame, VEC(cv::Point2f)& oCorners )
+{
+    return m_calibration->ProcessFrame ( iView, iFrame, oCorners );
+}
+void PcCamera::AddSharedCalibrationView ( PcCalibrationView const& iView, VEC(cv::Point2f) const& iCorners )
+{
+    m_calibration->AddSharedView ( iView, iCorners );
 }
 CalibrationState PcCamera::GetCalibrationState ()
 {
@@ -383,7 +486,35 @@ double PcCamera::GetCalibrationProgress () const
 {
     return m_calibration->GetCalibrationProgress ();
 }
+double PcCamera::GetCalibrationRms () const
+{
+    return m_calibration->GetCalibrationRms ();
+}
+double PcCamera::GetCalibrationSharpness () const
+{
+    return m_calibration->GetSharpness ();
+}
+double PcCamera::GetCalibrationCoverage () const
+{
+    return m_calibration->GetCoverage ();
+}
+std::string PcCamera::GetCalibrationGuidance () const
+{
+    return m_calibration->GetGuidance ();
+}
 VECOFVECS(cv::Point2f) const& PcCamera::GetChessboardCorners () const
 {
     return m_calibration->GetChessboardCorners ();
+}
+VEC(PcCalibrationView) PcCamera::GetCalibrationViews () const
+{
+    return m_calibration->GetViews ();
+}
+void PcCamera::GetCalibrationObservations ( VEC(PcCalibrationView)& oViews, VECOFVECS(cv::Point2f)& oCorners ) const
+{
+    m_calibration->GetObservations ( oViews, oCorners );
+}
+void PcCamera::GetSharedCalibrationObservations ( VEC(PcCalibrationView)& oViews, VECOFVECS(cv::Point2f)& oCorners ) const
+{
+    m_calibration->GetSharedObservations ( oViews, oCorners );
 }
\ No newline at end of file
@@ -4,10 +4,17 @@
 
 #include "PcCamera.h"
 #include "PcCalibrationHelper.h"
+#include "PcImageFilters.h"
 #include "PcSystem.h"
+#include "PcThreadPool.h"
+
+#include <algorithm>
 
 using namespace pcc;
 
+// The frame timestamps count nanoseconds, whatever the clock of the camera (see PcCamera::ToNanoseconds).
+static boost::uint64_t const NANOSECONDS_PER_MS = 1000000u;
+
 // ----------------------------------------------------------------------
 // PcCameraCalibration
 // ----------------------------------------------------------------------
@@ -16,127 +23,328 @@ PcCameraCalibration::PcCameraCalibration ( PcCamera* iParent )
     :   m_mutex ()
     ,   m_stateMutex ()
     ,   m_calibState ( UNKNOWN )
-    ,   m_calibThread ( (ThreadType*) 0x0 )
-    ,   m_frameQueue ()
-    ,   m_frameList ()
+    ,   m_idle ()
+    ,   m_taskCount ( 0u )
+    ,   m_isSolving ( false )
+    ,   m_generation ( 0u )
+    ,   m_detector ( *PcCalibrationHelper::GetInstance ().GetTarget () )
+    ,   m_selector ( *PcCalibrationHelper::GetInstance ().GetTarget () )
+    ,   m_views ()
     ,   m_corners ()
+    ,   m_sharedViews ()
+    ,   m_sharedCorners ()
     ,   m_camera ( iParent )
     ,   m_count ( 0u )
+    ,   m_hasView ( false )
+    ,   m_lastViewTimestamp ( 0u )
+    ,   m_solvedViews ( 0u )
+    ,   m_rms ( -1.0 )
+    ,   m_sharpness ( -1.0 )
 {}
 PcCameraCalibration::~PcCameraCalibration ()
 {
-    UpgradeLockType upgradedLock ( m_mutex );
-    UniqueLockType lock ( upgradedLock );
+    LockType lock ( m_mutex );
 
-    if ( m_calibThread ) {
-        m_calibThread->interrupt ();
+    m_generation++;
+    while ( m_taskCount > 0u ) {
+        m_idle.wait ( lock );
     }
-    PCC_OBJ_FREE ( m_calibThread );
 }
 void PcCameraCalibration::StartCalibration ()
 {
-    UpgradeLockType upgradedLock ( m_mutex );
-    UniqueLockType lock ( upgradedLock );
+    LockType lock ( m_mutex );
 
-    DoStartCalibration ();
+    DoStartCalibration ( lock );
 }
 void PcCameraCalibration::AbortCalibration ()
 {
+    LockType lock ( m_mutex );
+
     if ( m_calibState == CALIBRATING || m_calibState == ACQUIRING ) {
-        DoAbortCalibration ();
+        DoAbortCalibration ( lock );
     }
 }
-void PcCameraCalibration::Process ()
+bool PcCameraCalibration::RestoreCalibration ( double const& iRms )
 {
-    PcSystem& cs = PcSystem::GetInstance ();
-    PcCalibrationHelper& calib = PcCalibrationHelper::GetInstance ();
+    LockType lock ( m_mutex );
 
-    cv::Size const& size = calib.GetChessboardSize ();
-    m_count = 0;
-    do {
-        boost::this_thread::sleep_for ( boost::chrono::milliseconds ( calib.FrameDelay () ) );
-        //boost::this_thread::interruption_point ();
+    if ( m_calibState == CALIBRATING || m_calibState == ACQUIRING ) {
+        return false;
+    }
+    m_rms = iRms;
+    m_calibState = CALIBRATED;
+    return true;
+}
+bool PcCameraCalibration::WantsView ( boost::uint64_t const& iTimestamp )
+{
+    LockType lock ( m_mutex );
 
-        cv::Mat frame;
-        {
-            UpgradeLockType upgradedLock ( m_mutex );
-            UniqueLockType lock ( upgradedLock );
-
-            if ( !m_frameQueue.empty () ) {
-                frame = m_frameQueue.front ();
-                m_frameQueue.pop ();
-            } else {
-                continue;
-            }
+    return m_calibState == ACQUIRING && IsDue ( iTimestamp );
+}
+bool PcCameraCalibration::ProcessFrame ( PcCalibrationView const& iView, cv::Mat const& iFrame, VEC(cv::Point2f)& oCorners )
+{
+    unsigned int generation;
+    {
+        LockType lock ( m_mutex );
+
+        if ( m_calibState != ACQUIRING ) {
+            return false;
         }
+        generation = m_generation;
+        m_taskCount++;
+    }
 
-        VEC(cv::Point2f) corners;
-        if ( cv::findChessboardCorners ( frame, size, corners, cv::CALIB_CB_FAST_CHECK ) ) {
-            m_frameList.push_back ( frame.clone () );
-            m_corners.push_back ( corners );
+    bool const isFound = DoProcessFrame ( generation, iView, iFrame, oCorners );
 
-            std::stringstream sFrame;
-            sFrame << ".\\Calibration\\" << m_camera->GetID () <<  "\\";
+    LockType lock ( m_mutex );
 
-            sFrame << m_count++ << ".png";
-            cv::drawChessboardCorners ( frame, size, corners, true );
-            cv::imwrite ( sFrame.str (), frame );
+    m_taskCount--;
+    m_idle.notify_all ();
+    return isFound;
+}
+void PcCameraCalibration::AddSharedView ( PcCalibrationView const& iView, VEC(cv::Point2f) const& iCorners )
+{
+    LockType lock ( m_mutex );
 
-            if ( calib.FrameCount () == m_count ) {
-                SetCalibrationState ( CALIBRATING );
-            }
-        }
-    } while ( m_calibState == ACQUIRING );
+    if ( m_calibState == ACQUIRING || m_calibState == CALIBRATING ) {
+        m_sharedViews.push_back ( iView );
+        m_sharedCorners.push_back ( iCorners );
+    }
+}
+CalibrationState PcCameraCalibration::GetCalibrationState ()
+{
+    //boost::shared_lock<boost::shared_mutex> lock ( m_stateMutex );
 
-    m_camera->DoCalibration ( calib.GetChessboardPoints (), m_corners, m_camera->GetFrameSize () );
-    {
-        UpgradeLockType upgradedLock ( m_mutex );
-        UniqueLockType lock ( upgradedLock );
+    return m_calibState;
+}
+VEC(PcCalibrationView) PcCameraCalibration::GetViews ()
+{
+    LockType lock ( m_mutex );
 
-        SetCalibrationState ( CALIBRATED );
-        m_listeners.clear ();
+    return m_views;
+}
+void PcCameraCalibration::GetObservations ( VEC(PcCalibrationView)& oViews, VECOFVECS(cv::Point2f)& oCorners )
+{
+    LockType lock ( m_mutex );
 
-        std::cout   << m_camera->CameraMatrix ()    << std::endl 
-                    << m_camera->DistCoeffs ()      << std::endl;
+    oViews = m_views;
+    oCorners = m_corners;
+}
+void PcCameraCalibration::GetSharedObservations ( VEC(PcCalibrationView)& oViews, VECOFVECS(cv::Point2f)& oCorners )
+{
+    LockType lock ( m_mutex );
+
+    oViews = m_sharedViews;
+    oCorners = m_sharedCorners;
+}
+double PcCameraCalibration::GetCoverage ()
+{
+    LockType lock ( m_mutex );
+
+    return m_selector.GetCoverage ();
+}
+std::string PcCameraCalibration::GetGuidance ()
+{
+    LockType lock ( m_mutex );
+
+    if ( m_calibState != ACQUIRING ) {
+        return std::string ();
     }
+    return m_selector.GetGuidance ();
 }
-void PcCameraCalibration::PushFrame ( PcFramePtr const& iFrame )
+double PcCameraCalibration::GetSharpness ()
 {
-    UpgradeLockType upgradedLock ( m_mutex );
-    UniqueLockType lock ( upgradedLock );
+    LockType lock ( m_mutex );
 
-    m_frameQueue.push ( iFrame->GetImagePoints ().clone () );
+    return m_sharpness;
 }
-CalibrationState PcCameraCalibration::GetCalibrationState ()
+double PcCameraCalibration::GetCalibrationRms ()
 {
-    //boost::shared_lock<boost::shared_mutex> lock ( m_stateMutex );
+    LockType lock ( m_mutex );
 
-    return m_calibState;
+    return m_rms;
 }
 double PcCameraCalibration::GetCalibrationProgress () const
 {
-    return ( (double)m_frameList.size () / (double)PcCalibrationHelper::GetInstance ().FrameCount () );
+    return ( (double)m_views.size () / (double)PcCalibrationHelper::GetInstance ().FrameCount () );
 }
 
 // Private
-void PcCameraCalibration::DoStartCalibration ()
+bool PcCameraCalibration::DoProcessFrame ( unsigned int const& iGeneration, PcCalibrationView iView, cv::Mat const& iFrame, VEC(cv::Point2f)& oCorners )
+{
+    PcCalibrationHelper& calib = PcCalibrationHelper::GetInstance ();
+
+    // Every processed frame is measured, so the operator sees the sharpness, but blurred ones never reach the detector.
+    double const sharpness = PcSharpness ( iFrame );
+    {
+        LockType lock ( m_mutex );
+
+        if ( iGeneration != m_generation ) {
+            return false;
+        }
+        m_sharpness = sharpness;
+    }
+    if ( sharpness < calib.MinimumSharpness () || !m_detector.Detect ( iFrame, oCorners ) ) {
+        return false;
+    }
+
+    // The frame may belong to a set opened by another camera, in which case it only counts for the extrinsics.
+    {
+        LockType lock ( m_mutex );
+
+        if (    iGeneration != m_generation || m_calibState != ACQUIRING || !IsDue ( iView.Timestamp )
+            ||  ( calib.SelectsViews () && !m_selector.Accept ( oCorners, iFrame.size () ) ) ) {
+            return true;
+        }
+    }
+
+    unsigned int const thumbnailWidth = calib.ThumbnailWidth ();
+    iView.Thumbnail = cv::Mat ();
+    if ( thumbnailWidth > 0u ) {
+        PcBoxDownscale ( iFrame, ( iFrame.cols + thumbnailWidth - 1u ) / thumbnailWidth, iView.Thumbnail );
+    }
+
+    unsigned int index;
+    {
+        LockType lock ( m_mutex );
+
+        // The incremental solver may have stopped the acquisition during the detection.
+        if ( iGeneration != m_generation || m_calibState != ACQUIRING || !IsDue ( iView.Timestamp ) ) {
+            return true;
+        }
+        m_hasView = true;
+        m_lastViewTimestamp = iView.Timestamp;
+        m_views.push_back ( iView );
+        m_corners.push_back ( oCorners );
+        index = m_count++;
+
+        bool const isComplete = ( calib.FrameCount () == m_count );
+        if ( isComplete ) {
+            SetCalibrationState ( CALIBRATING );
+        }
+        if ( isComplete || ( calib.IsIncremental () && m_count >= calib.MinimumViews () ) ) {
+            ScheduleSolve ();
+        }
+    }
+
+    // The frame buffer goes back to the capture, so the exporter gets its own copy to draw onto.
+    PcDebugImageExporterPtr exporter = calib.GetImageExporter ();
+    if ( exporter ) {
+        exporter->Export ( m_camera->GetID (), index, iFrame.clone (), oCorners, m_detector.GetTarget ().GetSize () );
+    }
+    return true;
+}
+void PcCameraCalibration::Solve ( unsigned int const& iGeneration )
+{
+    PcCalibrationHelper& calib = PcCalibrationHelper::GetInstance ();
+
+    // Views accepted during a solve are picked up by the next iteration, so a single solve task per camera runs at
+    // any time and each iteration uses every view collected so far.
+    for ( ;; ) {
+        VECOFVECS(cv::Point2f) corners;
+        bool useGuess;
+        {
+            LockType lock ( m_mutex );
+
+            if ( iGeneration != m_generation || m_corners.size () == m_solvedViews ) {
+                break;
+            }
+            // The corners are copied so that the queue isn't locked during the solve.
+            corners = m_corners;
+            useGuess = ( m_solvedViews > 0u );
+        }
+
+        double const rms = m_camera->DoCalibration (
+            m_detector.GetTarget ().CreateInputArray ( (unsigned int)corners.size () ),
+            corners,
+            m_camera->GetFrameSize (),
+            useGuess
+        );
+
+        LockType lock ( m_mutex );
+
+        if ( iGeneration != m_generation ) {
+            break;
+        }
+        m_solvedViews = (unsigned int)corners.size ();
+        m_rms = rms;
+
+        cv::Mat const& deviations = m_camera->IntrinsicDeviations ();
+        if (    m_calibState == ACQUIRING && calib.IsIncremental () && !deviations.empty ()
+            &&  std::max ( std::max ( deviations.at<double> ( 0 ), deviations.at<double> ( 1 ) ),
+                           std::max ( deviations.at<double> ( 2 ), deviations.at<double> ( 3 ) ) ) < calib.ConvergenceThreshold () ) {
+            SetCalibrationState ( CALIBRATING );
+        }
+
+        if ( m_calibState == CALIBRATING && m_solvedViews == m_corners.size () ) {
+            SetCalibrationState ( CALIBRATED );
+            m_listeners.clear ();
+            break;
+        }
+    }
+
+    LockType lock ( m_mutex );
+
+    m_isSolving = false;
+    m_taskCount--;
+    m_idle.notify_all ();
+}
+void PcCameraCalibration::ScheduleSolve ()
+{
+    if ( !m_isSolving ) {
+        m_isSolving = true;
+        m_taskCount++;
+        PcThreadPool::GetInstance ().Submit ( boost::bind ( &PcCameraCalibration::Solve, this, m_generation ) );
+    }
+}
+bool PcCameraCalibration::IsDue ( boost::uint64_t const& iTimestamp ) const
+{
+    if ( !m_hasView || iTimestamp < m_lastViewTimestamp ) {
+        return true;
+    }
+    boost::uint64_t const interval = (boost::uint64_t)PcCalibrationHelper::GetInstance ().FrameDelay () * NANOSECONDS_PER_MS;
+    return iTimestamp - m_lastViewTimestamp >= interval;
+}
+void PcCameraCalibration::DoStartCalibration ( LockType& ioLock )
 {
     if ( m_calibState == CALIBRATING || m_calibState == ACQUIRING ) {
-        DoAbortCalibration ();
+        DoAbortCalibration ( ioLock );
     }
 
+    // A frame of a completed calibration may still be in detection, without the lock.
+    m_generation++;
+    while ( m_taskCount > 0u ) {
+        m_idle.wait ( ioLock );
+    }
+
+    PcCalibrationHelper& calib = PcCalibrationHelper::GetInstance ();
+    PcCalibrationTargetPtr const target = calib.GetTarget ();
+
+    m_count = 0;
+    m_hasView = false;
+    m_lastViewTimestamp = 0u;
+    m_solvedViews = 0;
+    m_detector = PcTargetDetector ( *target );
+    m_selector = PcViewSelector ( *target );
+    m_rms = -1.0;
+    m_sharpness = -1.0;
+    VEC(PcCalibrationView)().swap ( m_sharedViews );
+    VECOFVECS(cv::Point2f)().swap ( m_sharedCorners );
     SetCalibrationState ( ACQUIRING );
-    m_calibThread = new ThreadType ( boost::bind ( &PcCameraCalibration::Process, this ) );
 }
-void PcCameraCalibration::DoAbortCalibration ()
+void PcCameraCalibration::DoAbortCalibration ( LockType& ioLock )
 {
     SetCalibrationState ( UNKNOWN );
 
-    PCC_OBJ_FREE ( m_calibThread );
+    m_generation++;
+    while ( m_taskCount > 0u ) {
+        m_idle.wait ( ioLock );
+    }
 
-    QUEUE(cv::Mat) ().swap ( m_frameQueue );
-    VEC(cv::Mat)().swap ( m_frameList );
+    VEC(PcCalibrationView)().swap ( m_views );
     VECOFVECS(cv::Point2f)().swap ( m_corners );
+    VEC(PcCalibrationView)().swap ( m_sharedViews );
+    VECOFVECS(cv::Point2f)().swap ( m_sharedCorners );
 }
 void PcCameraCalibration::SetCalibrationState ( CalibrationState const& iNewState )
 {
@@ -0,0 +1,116 @@
+#include "PcChessboardDetector.h"
+
+#include "PcImageFilters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace pcc;
+
+// Bounds of the half-size of the sub-pixel refinement window, in full-resolution pixels.
+static int const MIN_REFINE_RADIUS = 2;
+static int const MAX_REFINE_RADIUS = 11;
+
+// The margin added around the previous board on every side, relative to its larger dimension.
+static float const REGION_MARGIN = 0.5f;
+
+// Above this fraction of the frame area, the region costs about as much as the full frame and isn't searched first.
+static float const MAX_REGION_FRACTION = 0.6f;
+
+// ----------------------------------------------------------------------
+// PcChessboardDetector
+// ----------------------------------------------------------------------
+// Public
+PcChessboardDetector::PcChessboardDetector ( cv::Size const& iPatternSize, unsigned int const& iSearchWidth )
+    :   m_patternSize ( iPatternSize )
+    ,   m_searchWidth ( std::max ( 1u, iSearchWidth ) )
+    ,   m_gray ()
+    ,   m_level ()
+    ,   m_region ()
+{}
+bool PcChessboardDetector::Detect ( cv::Mat const& iFrame, VEC(cv::Point2f)& oCorners )
+{
+    oCorners.clear ();
+
+    cv::Mat gray = iFrame;
+    if ( iFrame.channels () == 3 ) {
+        cv::cvtColor ( iFrame, m_gray, CV_BGR2GRAY );
+        gray = m_gray;
+    }
+
+    unsigned int scale = 1u;
+    while ( (unsigned int)gray.cols / scale > m_searchWidth ) {
+        scale *= 2u;
+    }
+
+    cv::Rect const frame ( 0, 0, gray.cols, gray.rows );
+    bool found = false;
+    if ( m_region.area () > 0 && m_region.area () < MAX_REGION_FRACTION * frame.area () ) {
+        found = Search ( gray, m_region, scale, oCorners );
+    }
+    if ( !found && !Search ( gray, frame, scale, oCorners ) ) {
+        m_region = cv::Rect ();
+        return false;
+    }
+    UpdateRegion ( oCorners, gray.size () );
+
+    if ( scale == 1u ) {
+        cv::cornerSubPix ( gray, oCorners, cv::Size ( 5, 5 ), cv::Size ( -1, -1 ),
+            cv::TermCriteria ( cv::TermCriteria::EPS | cv::TermCriteria::COUNT, 30, 0.01 ) );
+        return true;
+    }
+
+    // The window has to absorb the downscaling error without reaching the neighbouring corners.
+    float spacing = std::numeric_limits<float>::max ();
+    for ( int r = 0; r < m_patternSize.height; r++ ) {
+        for ( int c = 0; c < m_patternSize.width; c++ ) {
+            cv::Point2f const& corner = oCorners[r * m_patternSize.width + c];
+            if ( c + 1 < m_patternSize.width ) {
+                cv::Point2f const d = oCorners[r * m_patternSize.width + c + 1] - corner;
+                spacing = std::min ( spacing, std::sqrt ( d.x * d.x + d.y * d.y ) );
+            }
+            if ( r + 1 < m_patternSize.height ) {
+                cv::Point2f const d = oCorners[( r + 1 ) * m_patternSize.width + c] - corner;
+                spacing = std::min ( spacing, std::sqrt ( d.x * d.x + d.y * d.y ) );
+            }
+        }
+    }
+    int const radius = std::max ( MIN_REFINE_RADIUS, std::min ( std::min ( 2 * (int)scale, MAX_REFINE_RADIUS ), (int)( spacing * 0.4f ) ) );
+
+    cv::cornerSubPix ( gray, oCorners, cv::Size ( radius, radius ), cv::Size ( -1, -1 ),
+        cv::TermCriteria ( cv::TermCriteria::EPS | cv::TermCriteria::COUNT, 30, 0.01 ) );
+    return true;
+}
+
+// Private
+bool PcChessboardDetector::Search ( cv::Mat const& iGray, cv::Rect const& iRegion, unsigned int const& iScale, VEC(cv::Point2f)& oCorners )
+{
+    cv::Mat level = iGray ( iRegion );
+    if ( iScale > 1u ) {
+        PcBoxDownscale ( level, iScale, m_level );
+        level = m_level;
+    }
+
+    int const flags = cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_NORMALIZE_IMAGE | cv::CALIB_CB_FAST_CHECK;
+    if ( !cv::findChessboardCorners ( level, m_patternSize, oCorners, flags ) ) {
+        oCorners.clear ();
+        return false;
+    }
+
+    // A downscaled pixel covers a scale x scale block, whose centre maps back to ( x + 0.5 ) * scale - 0.5.
+    float const s = (float)iScale;
+    for ( auto corner = oCorners.begin (); corner != oCorners.end (); corner++ ) {
+        corner->x = ( corner->x + 0.5f ) * s - 0.5f + iRegion.x;
+        corner->y = ( corner->y + 0.5f ) * s - 0.5f + iRegion.y;
+    }
+    return true;
+}
+void PcChessboardDetector::UpdateRegion ( VEC(cv::Point2f) const& iCorners, cv::Size const& iFrameSize )
+{
+    cv::Rect const board = cv::boundingRect ( iCorners );
+    int const margin = (int)( REGION_MARGIN * std::max ( board.width, board.height ) );
+
+    m_region = cv::Rect ( board.x - margin, board.y - margin, board.width + 2 * margin, board.height + 2 * margin );
+    m_region &= cv::Rect ( 0, 0, iFrameSize.width, iFrameSize.height );
+}
@@ -0,0 +1,144 @@
+#include "PcCircleGridDetector.h"
+
+#include "PcImageFilters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace pcc;
+
+// Blob detector thresholds. Fewer thresholds than the OpenCV defaults make the search cheaper.
+static float const MIN_THRESHOLD = 40.0f;
+static float const MAX_THRESHOLD = 200.0f;
+static float const THRESHOLD_STEP = 20.0f;
+
+// The smallest circle searched for, in downscaled pixels.
+static float const MIN_BLOB_AREA = 4.0f;
+
+// Motion blur stretches the circles, so elongated and slightly concave blobs are accepted.
+static float const MIN_INERTIA_RATIO = 0.05f;
+static float const MIN_CONVEXITY = 0.8f;
+
+// ----------------------------------------------------------------------
+// PcCircleGridDetector
+// ----------------------------------------------------------------------
+// Public
+PcCircleGridDetector::PcCircleGridDetector ( cv::Size const& iPatternSize, bool const& iIsAsymmetric, unsigned int const& iSearchWidth )
+    :   m_patternSize ( iPatternSize )
+    ,   m_isAsymmetric ( iIsAsymmetric )
+    ,   m_searchWidth ( std::max ( 1u, iSearchWidth ) )
+    ,   m_gray ()
+    ,   m_level ()
+{}
+bool PcCircleGridDetector::Detect ( cv::Mat const& iFrame, VEC(cv::Point2f)& oCenters )
+{
+    oCenters.clear ();
+
+    cv::Mat gray = iFrame;
+    if ( iFrame.channels () == 3 ) {
+        cv::cvtColor ( iFrame, m_gray, CV_BGR2GRAY );
+        gray = m_gray;
+    }
+
+    unsigned int scale = 1u;
+    while ( (unsigned int)gray.cols / scale > m_searchWidth ) {
+        scale *= 2u;
+    }
+
+    cv::Mat level = gray;
+    if ( scale > 1u ) {
+        PcBoxDownscale ( gray, scale, m_level );
+        level = m_level;
+    }
+
+    cv::SimpleBlobDetector::Params params;
+    params.minThreshold = MIN_THRESHOLD;
+    params.maxThreshold = MAX_THRESHOLD;
+    params.thresholdStep = THRESHOLD_STEP;
+    params.minRepeatability = 2;
+    params.filterByColor = true;
+    params.blobColor = 0;
+    params.filterByArea = true;
+    params.minArea = MIN_BLOB_AREA;
+    params.maxArea = (float)level.total () / (float)m_patternSize.area ();
+    params.filterByCircularity = false;
+    params.filterByInertia = true;
+    params.minInertiaRatio = MIN_INERTIA_RATIO;
+    params.filterByConvexity = true;
+    params.minConvexity = MIN_CONVEXITY;
+    cv::Ptr<cv::FeatureDetector> const blobDetector = new cv::SimpleBlobDetector ( params );
+
+    int const flags = m_isAsymmetric ? cv::CALIB_CB_ASYMMETRIC_GRID : cv::CALIB_CB_SYMMETRIC_GRID;
+    if ( !cv::findCirclesGrid ( level, m_patternSize, oCenters, flags, blobDetector ) ) {
+        oCenters.clear ();
+        return false;
+    }
+
+    // A downscaled pixel covers a scale x scale block, whose centre maps back to ( x + 0.5 ) * scale - 0.5.
+    if ( scale > 1u ) {
+        float const s = (float)scale;
+        for ( auto center = oCenters.begin (); center != oCenters.end (); center++ ) {
+            center->x = ( center->x + 0.5f ) * s - 0.5f;
+            center->y = ( center->y + 0.5f ) * s - 0.5f;
+        }
+    }
+
+    RefineCenters ( gray, oCenters );
+    return true;
+}
+
+// Private
+void PcCircleGridDetector::RefineCenters ( cv::Mat const& iGray, VEC(cv::Point2f)& ioCenters )
+{
+    // Halfway to the nearest circle, the window holds the whole circle but none of its neighbours.
+    float nearest = std::numeric_limits<float>::max ();
+    for ( size_t i = 0; i < ioCenters.size (); i++ ) {
+        for ( size_t j = i + 1; j < ioCenters.size (); j++ ) {
+            cv::Point2f const d = ioCenters[j] - ioCenters[i];
+            nearest = std::min ( nearest, d.x * d.x + d.y * d.y );
+        }
+    }
+    int const radius = (int)( 0.5f * std::sqrt ( nearest ) );
+    if ( radius < 2 ) {
+        return;
+    }
+
+    for ( auto center = ioCenters.begin (); center != ioCenters.end (); center++ ) {
+        int const x0 = std::max ( 0, (int)std::floor ( center->x + 0.5f ) - radius );
+        int const y0 = std::max ( 0, (int)std::floor ( center->y + 0.5f ) - radius );
+        int const x1 = std::min ( iGray.cols - 1, (int)std::floor ( center->x + 0.5f ) + radius );
+        int const y1 = std::min ( iGray.rows - 1, (int)std::floor ( center->y + 0.5f ) + radius );
+        if ( x0 >= x1 || y0 >= y1 ) {
+            continue;
+        }
+
+        int darkest = 255, brightest = 0;
+        for ( int y = y0; y <= y1; y++ ) {
+            unsigned char const* const row = iGray.ptr<unsigned char> ( y );
+            for ( int x = x0; x <= x1; x++ ) {
+                darkest = std::min ( darkest, (int)row[x] );
+                brightest = std::max ( brightest, (int)row[x] );
+            }
+        }
+
+        // Pixels darker than the mid-level weigh by how much darker they are, so blurred edges count partially.
+        int const threshold = ( darkest + brightest + 1 ) / 2;
+        double sum = 0.0, sumX = 0.0, sumY = 0.0;
+        for ( int y = y0; y <= y1; y++ ) {
+            unsigned char const* const row = iGray.ptr<unsigned char> ( y );
+            for ( int x = x0; x <= x1; x++ ) {
+                int const weight = threshold - (int)row[x];
+                if ( weight > 0 ) {
+                    sum += weight;
+                    sumX += (double)weight * x;
+                    sumY += (double)weight * y;
+                }
+            }
+        }
+        if ( sum > 0.0 ) {
+            center->x = (float)( sumX / sum );
+            center->y = (float)( sumY / sum );
+        }
+    }
+}
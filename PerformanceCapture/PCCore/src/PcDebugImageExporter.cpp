@@ -0,0 +1,124 @@
+#include "PcDebugImageExporter.h"
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+using namespace pcc;
+
+// ----------------------------------------------------------------------
+// PcDebugImageExporter
+// ----------------------------------------------------------------------
+// Public
+PcDebugImageExporter::PcDebugImageExporter (
+    std::string const&          iDirectory,
+    PcImageExportFormat const&  iFormat,
+    unsigned int const&         iCapacity,
+    unsigned int const&         iThreadCount
+)
+    :   m_mutex ()
+    ,   m_condition ()
+    ,   m_threads ()
+    ,   m_directory ( iDirectory )
+    ,   m_format ( iFormat )
+    ,   m_parameters ()
+    ,   m_queue ()
+    ,   m_capacity ( std::max ( 1u, iCapacity ) )
+    ,   m_dropped ( 0u )
+    ,   m_isOpen ( true )
+{
+    switch ( m_format ) {
+    case PCC_EXPORT_RAW:
+        m_parameters.push_back ( cv::IMWRITE_PXM_BINARY );
+        m_parameters.push_back ( 1 );
+        break;
+    case PCC_EXPORT_FAST_PNG:
+        m_parameters.push_back ( cv::IMWRITE_PNG_COMPRESSION );
+        m_parameters.push_back ( 1 );
+        break;
+    default:
+        break;
+    }
+
+    for ( unsigned int t = 0; t < std::max ( 1u, iThreadCount ); t++ ) {
+        m_threads.create_thread ( boost::bind ( &PcDebugImageExporter::Process, this ) );
+    }
+}
+PcDebugImageExporter::~PcDebugImageExporter ()
+{
+    {
+        GuardType lock ( m_mutex );
+        m_isOpen = false;
+    }
+    m_condition.notify_all ();
+    m_threads.join_all ();
+}
+bool PcDebugImageExporter::Export (
+    std::string const&          iCameraId,
+    unsigned int const&         iIndex,
+    cv::Mat const&              iImage,
+    VEC(cv::Point2f) const&     iCorners,
+    cv::Size const&             iPatternSize
+) {
+    {
+        GuardType lock ( m_mutex );
+
+        if ( !m_isOpen || m_queue.size () >= m_capacity ) {
+            m_dropped++;
+            return false;
+        }
+        m_queue.push_back ( PcDebugImage () );
+        PcDebugImage& image = m_queue.back ();
+        image.CameraId      = iCameraId;
+        image.Index         = iIndex;
+        image.Image         = iImage;
+        image.Corners       = iCorners;
+        image.PatternSize   = iPatternSize;
+    }
+    m_condition.notify_one ();
+    return true;
+}
+
+// Private
+void PcDebugImageExporter::Process ()
+{
+    for ( ;; ) {
+        PcDebugImage image;
+        {
+            LockType lock ( m_mutex );
+
+            while ( m_queue.empty () && m_isOpen ) {
+                m_condition.wait ( lock );
+            }
+            if ( m_queue.empty () ) {
+                return;
+            }
+            image = m_queue.front ();
+            m_queue.pop_front ();
+        }
+
+        Write ( image );
+    }
+}
+void PcDebugImageExporter::Write ( PcDebugImage& ioImage )
+{
+    boost::filesystem::path const directory = boost::filesystem::path ( m_directory ) / ioImage.CameraId;
+    boost::system::error_code err;
+    boost::filesystem::create_directories ( directory, err );
+
+    std::stringstream sFile;
+    sFile << ioImage.Index;
+    if ( m_format == PCC_EXPORT_RAW ) {
+        sFile << ( ( ioImage.Image.channels () == 1 ) ? ".pgm" : ".ppm" );
+    } else {
+        sFile << ".png";
+    }
+    std::string const path = ( directory / sFile.str () ).string ();
+
+    cv::drawChessboardCorners ( ioImage.Image, ioImage.PatternSize, ioImage.Corners, true );
+    if ( !cv::imwrite ( path, ioImage.Image, m_parameters ) ) {
+        std::cout << "Could not export calibration image " << path << std::endl;
+    }
+}
@@ -0,0 +1,458 @@
+#include "PcDriftMonitor.h"
+
+#include "PcCalibrationMath.h"
+#include "PcThreadPool.h"
+
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/chrono.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace pcc;
+
+typedef boost::chrono::steady_clock ClockType;
+
+// The frequency of the frame timestamps, which count nanoseconds (see PcCamera::ToNanoseconds).
+static double const TICKS_PER_SECOND = 1e9;
+
+// The number of cameras that must find the target for a check to run.
+static size_t const MIN_CHECK_CAMERAS = 3u;
+
+// The number of checks a camera takes part in to set its baseline.
+static size_t const BASELINE_CHECKS = 20u;
+
+// The number of recent checks the trend of the error is fitted to.
+static size_t const TREND_CHECKS = 30u;
+
+// The weight of a new error in the smoothed error.
+static double const SMOOTHING = 0.1;
+
+// A camera drifted once its smoothed error exceeds its baseline by this many deviations, and at least the floor in
+// pixels. It is cleared once the excess falls below the given fraction of that margin.
+static double const DRIFT_DEVIATIONS = 4.0;
+static double const MIN_DRIFT = 0.5;
+static double const CLEAR_FRACTION = 0.5;
+
+// A camera stands out in a check if its error exceeds the median error of the check this many times, and by the drift floor.
+static double const OUTLIER_RATIO = 2.0;
+
+/// \brief The points a camera saw in a check, with the calibration they're checked against.
+struct PcDriftView
+{
+    std::string                     CameraId;       ///< The camera GUID.
+    cv::Mat                         CameraMatrix;   ///< The intrinsic camera matrix.
+    cv::Mat                         DistCoeffs;     ///< The distortion coefficients.
+    cv::Mat                         Rvec;           ///< The rotation from the rig frame to the camera frame, as a rotation vector.
+    cv::Mat                         Translation;    ///< The translation from the rig frame to the camera frame.
+    cv::Mat                         Projection;     ///< The 3x4 matrix [ R | t ].
+    bool                            IsTrusted;      ///< Whether the camera isn't flagged as drifted.
+    VEC(cv::Point2f)                Points;         ///< The detected points.
+    VEC(cv::Point2f)                Normalized;     ///< The undistorted, normalised points.
+};
+
+/// \brief Tells whether two matrices hold the same values.
+static bool IsSame ( cv::Mat const& iFirst, cv::Mat const& iSecond )
+{
+    return iFirst.size () == iSecond.size () && iFirst.type () == iSecond.type () && ( iFirst.empty () || cv::norm ( iFirst, iSecond, cv::NORM_INF ) == 0.0 );
+}
+
+/// \brief Gets the RMS reprojection error of a camera, against the points triangulated from the other cameras.
+///
+/// The excluded cameras are left out of the triangulation, unless fewer than two other cameras would remain.
+///
+/// \return the error in pixels, negative if no point could be triangulated
+static double ReprojectionError ( VEC(PcDriftView) const& iViews, size_t const& iCamera, VEC(bool) const& iIsExcluded )
+{
+    VEC(size_t) sources, others;
+    for ( size_t s = 0; s < iViews.size (); s++ ) {
+        if ( s != iCamera ) {
+            others.push_back ( s );
+            if ( !iIsExcluded[s] ) {
+                sources.push_back ( s );
+            }
+        }
+    }
+    if ( sources.size () < 2u ) {
+        sources.swap ( others );
+    }
+    VEC(cv::Mat) projections;
+    for ( auto s = sources.begin (); s != sources.end (); s++ ) {
+        projections.push_back ( iViews[*s].Projection );
+    }
+
+    PcDriftView const& view = iViews[iCamera];
+    VEC(cv::Point3f) points;
+    VEC(cv::Point2f) detected;
+    VEC(cv::Point2f) observed ( sources.size () );
+    for ( size_t p = 0; p < view.Points.size (); p++ ) {
+        for ( size_t s = 0; s < sources.size (); s++ ) {
+            observed[s] = iViews[sources[s]].Normalized[p];
+        }
+        cv::Point3d point;
+        if ( PcTriangulate ( projections, observed, point ) ) {
+            points.push_back ( cv::Point3f ( (float)point.x, (float)point.y, (float)point.z ) );
+            detected.push_back ( view.Points[p] );
+        }
+    }
+    if ( points.empty () ) {
+        return -1.0;
+    }
+
+    VEC(cv::Point2f) projected;
+    cv::projectPoints ( points, view.Rvec, view.Translation, view.CameraMatrix, view.DistCoeffs, projected );
+    double sum = 0.0;
+    for ( size_t p = 0; p < projected.size (); p++ ) {
+        double const dx = projected[p].x - detected[p].x;
+        double const dy = projected[p].y - detected[p].y;
+        sum += dx * dx + dy * dy;
+    }
+    return std::sqrt ( sum / (double)projected.size () );
+}
+
+/// \brief Gets the reprojection error of every camera (see ReprojectionError), and the largest error of the included cameras.
+/// \return the largest error of the cameras that aren't excluded, negative if none has an error
+static double ReprojectionErrors ( VEC(PcDriftView) const& iViews, VEC(bool) const& iIsExcluded, VEC(double)& oErrors )
+{
+    double worst = -1.0;
+    oErrors.resize ( iViews.size () );
+    for ( size_t v = 0; v < iViews.size (); v++ ) {
+        oErrors[v] = ReprojectionError ( iViews, v, iIsExcluded );
+        worst = iIsExcluded[v] ? worst : std::max ( worst, oErrors[v] );
+    }
+    return worst;
+}
+
+// ----------------------------------------------------------------------
+// PcDriftMonitor
+// ----------------------------------------------------------------------
+// Public
+PcDriftMonitor::PcDriftMonitor ( PcCalibrationTarget const& iTarget, double const& iBudget, boost::uint64_t const& iTolerance )
+    :   m_budget ( std::min ( 1.0, std::max ( 1e-4, iBudget ) ) )
+    ,   m_tolerance ( iTolerance )
+    ,   m_detector ( iTarget )
+    ,   m_mutex ()
+    ,   m_idle ()
+    ,   m_isChecking ( false )
+    ,   m_nextCheck ( 0u )
+    ,   m_checkCount ( 0u )
+    ,   m_instant ( 0u )
+    ,   m_copyTime ( 0.0 )
+    ,   m_images ()
+    ,   m_calibrations ()
+    ,   m_histories ()
+    ,   m_generation ( 0u )
+{}
+PcDriftMonitor::~PcDriftMonitor ()
+{
+    boost::unique_lock<boost::mutex> lock ( m_mutex );
+
+    while ( m_isChecking.load () ) {
+        m_idle.wait ( lock );
+    }
+}
+void PcDriftMonitor::SetCalibration ( std::string const& iCameraId, cv::Mat const& iCameraMatrix, cv::Mat const& iDistCoeffs, cv::Mat const& iRotation, cv::Mat const& iTranslation )
+{
+    Calibration calibration;
+    iCameraMatrix.convertTo ( calibration.CameraMatrix, CV_64F );
+    iDistCoeffs.convertTo ( calibration.DistCoeffs, CV_64F );
+    iRotation.convertTo ( calibration.Rotation, CV_64F );
+    iTranslation.convertTo ( calibration.Translation, CV_64F );
+
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    auto const current = m_calibrations.find ( iCameraId );
+    if (    current != m_calibrations.end ()
+        &&  IsSame ( current->second.CameraMatrix, calibration.CameraMatrix ) && IsSame ( current->second.DistCoeffs, calibration.DistCoeffs )
+        &&  IsSame ( current->second.Rotation, calibration.Rotation ) && IsSame ( current->second.Translation, calibration.Translation ) ) {
+        return;
+    }
+    m_calibrations[iCameraId] = calibration;
+    ResetHistories ();
+}
+void PcDriftMonitor::RemoveCamera ( std::string const& iCameraId )
+{
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    if ( m_calibrations.erase ( iCameraId ) > 0u ) {
+        ResetHistories ();
+    }
+}
+void PcDriftMonitor::PushFrame ( std::string const& iCameraId, PcFramePtr const& iFrame )
+{
+    // Most frames fall between two checks, and are turned away without locking.
+    boost::uint64_t const timestamp = iFrame->Timestamp ();
+    if ( m_isChecking.load () || timestamp + m_tolerance < m_nextCheck.load () ) {
+        return;
+    }
+
+    {
+        boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+        if ( m_isChecking.load () || m_calibrations.find ( iCameraId ) == m_calibrations.end () ) {
+            return;
+        }
+
+        // The first camera to reach the next check sets its instant; the others must have a frame within tolerance.
+        if ( m_instant == 0u ) {
+            m_instant = timestamp;
+        }
+        bool isComplete = false;
+        if ( timestamp > m_instant + m_tolerance ) {
+            // This camera is past the instant, so the others are too.
+            isComplete = true;
+        } else if ( timestamp + m_tolerance >= m_instant && m_images.find ( iCameraId ) == m_images.end () ) {
+            ClockType::time_point const start = ClockType::now ();
+            iFrame->GetImagePoints ().copyTo ( m_images[iCameraId] );
+            m_copyTime += boost::chrono::duration<double> ( ClockType::now () - start ).count ();
+            isComplete = ( m_images.size () >= m_calibrations.size () );
+        }
+        if ( !isComplete ) {
+            return;
+        }
+
+        if ( m_images.size () < MIN_CHECK_CAMERAS ) {
+            // Too few cameras caught the instant. The copies still count against the budget.
+            m_nextCheck = timestamp + (boost::uint64_t)( m_copyTime / m_budget * TICKS_PER_SECOND );
+            m_images.clear ();
+            m_instant = 0u;
+            m_copyTime = 0.0;
+            return;
+        }
+        m_isChecking = true;
+    }
+    PcThreadPool::GetInstance ().Submit ( boost::bind ( &PcDriftMonitor::Check, this ) );
+}
+void PcDriftMonitor::AddCorrespondences ( boost::uint64_t const& iTimestamp, STRMAP(VEC(cv::Point2f)) const& iPoints )
+{
+    VEC(PcDriftView) views;
+    size_t generation = 0u;
+    {
+        boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+        for ( auto points = iPoints.begin (); points != iPoints.end (); points++ ) {
+            auto const calibration = m_calibrations.find ( points->first );
+            if (    calibration == m_calibrations.end () || points->second.empty ()
+                ||  ( !views.empty () && points->second.size () != views.front ().Points.size () ) ) {
+                continue;
+            }
+            auto const history = m_histories.find ( points->first );
+
+            PcDriftView view;
+            view.CameraId       = points->first;
+            view.CameraMatrix   = calibration->second.CameraMatrix;
+            view.DistCoeffs     = calibration->second.DistCoeffs;
+            view.Translation    = calibration->second.Translation;
+            view.IsTrusted      = ( history == m_histories.end () || !history->second.Status.HasDrifted );
+            view.Points         = points->second;
+            cv::Rodrigues ( calibration->second.Rotation, view.Rvec );
+            view.Projection.create ( 3, 4, CV_64F );
+            for ( int r = 0; r < 3; r++ ) {
+                for ( int c = 0; c < 3; c++ ) {
+                    view.Projection.at<double> ( r, c ) = calibration->second.Rotation.at<double> ( r, c );
+                }
+                view.Projection.at<double> ( r, 3 ) = calibration->second.Translation.at<double> ( r );
+            }
+            views.push_back ( view );
+        }
+        generation = m_generation;
+    }
+    if ( views.size () < MIN_CHECK_CAMERAS ) {
+        return;
+    }
+
+    for ( auto view = views.begin (); view != views.end (); view++ ) {
+        cv::undistortPoints ( view->Points, view->Normalized, view->CameraMatrix, view->DistCoeffs );
+    }
+
+    // Every camera is checked against the others. The drifted cameras are left out of the triangulations, so that they
+    // don't raise the error of the others, and so is the camera that explains best an error standing out in this check.
+    VEC(bool) isExcluded ( views.size () );
+    for ( size_t v = 0; v < views.size (); v++ ) {
+        isExcluded[v] = !views[v].IsTrusted;
+    }
+    VEC(double) errors;
+    ReprojectionErrors ( views, isExcluded, errors );
+    for (;;) {
+        VEC(double) included;
+        for ( size_t v = 0; v < views.size (); v++ ) {
+            if ( !isExcluded[v] && errors[v] >= 0.0 ) {
+                included.push_back ( errors[v] );
+            }
+        }
+        if ( included.size () <= MIN_CHECK_CAMERAS ) {
+            break;
+        }
+        std::sort ( included.begin (), included.end () );
+        double const median = included[( included.size () - 1u ) / 2u];
+        if ( included.back () <= std::max ( OUTLIER_RATIO * median, median + MIN_DRIFT ) ) {
+            break;
+        }
+
+        // The culprit isn't always the camera with the largest error, but leaving it out lowers the others' errors most.
+        size_t culprit = views.size ();
+        double lowest = 0.0;
+        VEC(double) trialErrors;
+        for ( size_t v = 0; v < views.size (); v++ ) {
+            if ( isExcluded[v] ) {
+                continue;
+            }
+            isExcluded[v] = true;
+            double const worst = ReprojectionErrors ( views, isExcluded, trialErrors );
+            isExcluded[v] = false;
+            if ( worst >= 0.0 && ( culprit == views.size () || worst < lowest ) ) {
+                culprit = v;
+                lowest = worst;
+            }
+        }
+        if ( culprit == views.size () ) {
+            break;
+        }
+        isExcluded[culprit] = true;
+        ReprojectionErrors ( views, isExcluded, errors );
+    }
+
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    // The calibrations changed meanwhile, so the errors are stale.
+    if ( generation != m_generation ) {
+        return;
+    }
+    double const time = (double)iTimestamp / TICKS_PER_SECOND;
+    for ( size_t v = 0; v < views.size (); v++ ) {
+        if ( errors[v] >= 0.0 ) {
+            AddError ( views[v].CameraId, time, errors[v] );
+        }
+    }
+    m_checkCount++;
+}
+bool PcDriftMonitor::GetStatus ( std::string const& iCameraId, PcDriftStatus& oStatus )
+{
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    auto const history = m_histories.find ( iCameraId );
+    if ( history == m_histories.end () ) {
+        return false;
+    }
+    oStatus = history->second.Status;
+    return true;
+}
+VEC(std::string) PcDriftMonitor::GetDriftedCameras ()
+{
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    VEC(std::string) cameras;
+    for ( auto history = m_histories.begin (); history != m_histories.end (); history++ ) {
+        if ( history->second.Status.HasDrifted ) {
+            cameras.push_back ( history->first );
+        }
+    }
+    return cameras;
+}
+
+// Private
+void PcDriftMonitor::ResetHistories ()
+{
+    History history;
+    history.Status.Baseline     = -1.0;
+    history.Status.Error        = -1.0;
+    history.Status.Trend        = 0.0;
+    history.Status.CheckCount   = 0u;
+    history.Status.HasDrifted   = false;
+    history.ErrorSum            = 0.0;
+    history.SquareSum           = 0.0;
+    history.Deviation           = 0.0;
+
+    m_histories.clear ();
+    for ( auto calibration = m_calibrations.begin (); calibration != m_calibrations.end (); calibration++ ) {
+        m_histories[calibration->first] = history;
+    }
+    m_generation++;
+}
+void PcDriftMonitor::AddError ( std::string const& iCameraId, double const& iTime, double const& iError )
+{
+    auto const found = m_histories.find ( iCameraId );
+    if ( found == m_histories.end () ) {
+        return;
+    }
+    History& history = found->second;
+    PcDriftStatus& status = history.Status;
+
+    status.CheckCount++;
+    status.Error = ( status.Error < 0.0 ) ? iError : status.Error + SMOOTHING * ( iError - status.Error );
+    if ( status.CheckCount <= BASELINE_CHECKS ) {
+        history.ErrorSum += iError;
+        history.SquareSum += iError * iError;
+        if ( status.CheckCount == BASELINE_CHECKS ) {
+            status.Baseline = history.ErrorSum / (double)BASELINE_CHECKS;
+            history.Deviation = std::sqrt ( std::max ( 0.0, history.SquareSum / (double)BASELINE_CHECKS - status.Baseline * status.Baseline ) );
+        }
+    }
+
+    // The trend is the least-squares slope of the recent errors over time.
+    history.Times.push_back ( iTime );
+    history.Errors.push_back ( iError );
+    if ( history.Times.size () > TREND_CHECKS ) {
+        history.Times.erase ( history.Times.begin () );
+        history.Errors.erase ( history.Errors.begin () );
+    }
+    size_t const count = history.Times.size ();
+    double meanTime = 0.0, meanError = 0.0;
+    for ( size_t i = 0; i < count; i++ ) {
+        meanTime += history.Times[i] / (double)count;
+        meanError += history.Errors[i] / (double)count;
+    }
+    double covariance = 0.0, variance = 0.0;
+    for ( size_t i = 0; i < count; i++ ) {
+        covariance += ( history.Times[i] - meanTime ) * ( history.Errors[i] - meanError );
+        variance += ( history.Times[i] - meanTime ) * ( history.Times[i] - meanTime );
+    }
+    status.Trend = ( variance > 0.0 ) ? covariance / variance : 0.0;
+
+    if ( status.Baseline < 0.0 ) {
+        return;
+    }
+    double const margin = std::max ( MIN_DRIFT, DRIFT_DEVIATIONS * history.Deviation );
+    if ( !status.HasDrifted && status.Error > status.Baseline + margin ) {
+        status.HasDrifted = true;
+    } else if ( status.HasDrifted && status.Error < status.Baseline + CLEAR_FRACTION * margin ) {
+        status.HasDrifted = false;
+    }
+}
+void PcDriftMonitor::Check ()
+{
+    ClockType::time_point const start = ClockType::now ();
+
+    STRMAP(cv::Mat) images;
+    boost::uint64_t instant = 0u;
+    double copyTime = 0.0;
+    {
+        boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+        images.swap ( m_images );
+        instant = m_instant;
+        copyTime = m_copyTime;
+        m_instant = 0u;
+        m_copyTime = 0.0;
+    }
+
+    STRMAP(VEC(cv::Point2f)) points;
+    for ( auto image = images.begin (); image != images.end (); image++ ) {
+        VEC(cv::Point2f) found;
+        if ( m_detector.Detect ( image->second, found ) ) {
+            points[image->first].swap ( found );
+        }
+    }
+    AddCorrespondences ( instant, points );
+
+    // The next check waits until this one is paid for within the budget.
+    double const cost = copyTime + boost::chrono::duration<double> ( ClockType::now () - start ).count ();
+
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    m_nextCheck = instant + (boost::uint64_t)( cost / m_budget * TICKS_PER_SECOND );
+    m_isChecking = false;
+    m_idle.notify_all ();
+}
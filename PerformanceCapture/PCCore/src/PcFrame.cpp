@@ -9,6 +9,8 @@ PcFrame::PcFrame ()
     :   m_gpuImage ()
     ,   m_cpuImage ( 1080, 1920, CV_8UC1, cv::Scalar(0) )
     ,   m_mutex ()
+    ,   m_timestamp ( 0u )
+    ,   m_frameId ( 0u )
 {}
 
 PcFrame::PcFrame (
@@ -19,6 +21,8 @@ PcFrame::PcFrame (
 )   :   m_gpuImage ()
     ,   m_cpuImage ( iHeight, iWidth, CV_8UC(iNumChannels) )
     ,   m_mutex ()
+    ,   m_timestamp ( 0u )
+    ,   m_frameId ( 0u )
 {
     memcpy ( m_cpuImage.data, iData, iWidth * iHeight * iNumChannels * sizeof ( unsigned char ) );
 
@@ -47,8 +51,13 @@ void PcFrame::Reset (
     unsigned int const&     iWidth,
     unsigned int const&     iHeight,
     unsigned int const&     iNumChannels,
-    unsigned char const*&   iData
+    unsigned char const*&   iData,
+    boost::uint64_t const&  iTimestamp,
+    boost::uint64_t const&  iFrameId
 ) {
+    m_timestamp = iTimestamp;
+    m_frameId = iFrameId;
+
     m_cpuImage.create ( iHeight, iWidth, CV_8UC(iNumChannels) );
 
     size_t size = m_cpuImage.dataend - m_cpuImage.datastart;
@@ -57,6 +66,17 @@ void PcFrame::Reset (
     m_gpuImage.upload ( m_cpuImage );
 }
 
+void PcFrame::Remap (
+    PcFrame const&          iSource,
+    PcRemapMap const&       iMap
+) {
+    m_timestamp = iSource.m_timestamp;
+    m_frameId = iSource.m_frameId;
+
+    PcRemap ( iSource.m_cpuImage, iMap, m_cpuImage );
+    m_gpuImage.upload ( m_cpuImage );
+}
+
 int const& PcFrame::Width () const
 {
     return m_cpuImage.cols;
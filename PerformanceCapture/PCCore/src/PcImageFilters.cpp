@@ -0,0 +1,155 @@
+#include "PcImageFilters.h"
+
+#include <algorithm>
+
+#if defined(PCC_USE_SSE2)
+#include <emmintrin.h>
+#endif
+
+using namespace pcc;
+
+/// \brief Averages 4x4 blocks of a single-channel 8-bit image, one output row at a time.
+static void BoxDownscale4 ( cv::Mat const& iSrc, cv::Mat& oDst )
+{
+    int const width = oDst.cols;
+    for ( int y = 0; y < oDst.rows; y++ ) {
+        unsigned char const* r0 = iSrc.ptr ( 4 * y );
+        unsigned char const* r1 = iSrc.ptr ( 4 * y + 1 );
+        unsigned char const* r2 = iSrc.ptr ( 4 * y + 2 );
+        unsigned char const* r3 = iSrc.ptr ( 4 * y + 3 );
+        unsigned char* out = oDst.ptr ( y );
+
+        int x = 0;
+#if defined(PCC_USE_SSE2)
+        // 32 input columns -> 8 output pixels. The four rows are summed as 16-bit lanes, then two multiply-adds
+        // against ones fold each group of four adjacent columns into a 32-bit sum.
+        __m128i const zero = _mm_setzero_si128 ();
+        __m128i const ones = _mm_set1_epi16 ( 1 );
+        __m128i const half = _mm_set1_epi32 ( 8 );
+        for ( ; x + 8 <= width; x += 8 ) {
+            __m128i quads[2];
+            for ( int h = 0; h < 2; h++ ) {
+                int const offset = 4 * x + 16 * h;
+                __m128i const a = _mm_loadu_si128 ( (__m128i const*)( r0 + offset ) );
+                __m128i const b = _mm_loadu_si128 ( (__m128i const*)( r1 + offset ) );
+                __m128i const c = _mm_loadu_si128 ( (__m128i const*)( r2 + offset ) );
+                __m128i const d = _mm_loadu_si128 ( (__m128i const*)( r3 + offset ) );
+
+                __m128i lo = _mm_add_epi16 ( _mm_unpacklo_epi8 ( a, zero ), _mm_unpacklo_epi8 ( b, zero ) );
+                lo = _mm_add_epi16 ( lo, _mm_add_epi16 ( _mm_unpacklo_epi8 ( c, zero ), _mm_unpacklo_epi8 ( d, zero ) ) );
+                __m128i hi = _mm_add_epi16 ( _mm_unpackhi_epi8 ( a, zero ), _mm_unpackhi_epi8 ( b, zero ) );
+                hi = _mm_add_epi16 ( hi, _mm_add_epi16 ( _mm_unpackhi_epi8 ( c, zero ), _mm_unpackhi_epi8 ( d, zero ) ) );
+
+                __m128i const pairs = _mm_packs_epi32 ( _mm_madd_epi16 ( lo, ones ), _mm_madd_epi16 ( hi, ones ) );
+                quads[h] = _mm_srli_epi32 ( _mm_add_epi32 ( _mm_madd_epi16 ( pairs, ones ), half ), 4 );
+            }
+            __m128i const packed = _mm_packs_epi32 ( quads[0], quads[1] );
+            _mm_storel_epi64 ( (__m128i*)( out + x ), _mm_packus_epi16 ( packed, packed ) );
+        }
+#endif
+        for ( ; x < width; x++ ) {
+            int const c = 4 * x;
+            unsigned int const sum =
+                    r0[c] + r0[c + 1] + r0[c + 2] + r0[c + 3]
+                +   r1[c] + r1[c + 1] + r1[c + 2] + r1[c + 3]
+                +   r2[c] + r2[c + 1] + r2[c + 2] + r2[c + 3]
+                +   r3[c] + r3[c + 1] + r3[c + 2] + r3[c + 3];
+            out[x] = (unsigned char)( ( sum + 8u ) >> 4 );
+        }
+    }
+}
+
+/// \brief Sums the 4-neighbour Laplacian and its square over every column of every iRowStep-th row, borders excluded.
+static void LaplacianMoments ( cv::Mat const& iSrc, int const& iRowStep, double& oSum, double& oSumSq, double& oCount )
+{
+    oSum = oSumSq = oCount = 0.0;
+    int const width = iSrc.cols - 1;
+    for ( int y = 1; y + 1 < iSrc.rows; y += iRowStep ) {
+        unsigned char const* up     = iSrc.ptr ( y - 1 );
+        unsigned char const* center = iSrc.ptr ( y );
+        unsigned char const* down   = iSrc.ptr ( y + 1 );
+
+        int x = 1;
+#if defined(PCC_USE_SSE2)
+        // 16 pixels per iteration. The Laplacian fits 16-bit lanes, and multiply-adds fold it and its square into
+        // 32-bit lanes, which are flushed to the double sums before they can overflow.
+        __m128i const zero = _mm_setzero_si128 ();
+        __m128i const ones = _mm_set1_epi16 ( 1 );
+        int const BLOCK = 256;
+        while ( x + 16 <= width ) {
+            __m128i sum = _mm_setzero_si128 ();
+            __m128i sumSq = _mm_setzero_si128 ();
+            for ( int n = 0; n < BLOCK && x + 16 <= width; n++, x += 16 ) {
+                __m128i const c = _mm_loadu_si128 ( (__m128i const*)( center + x ) );
+                __m128i const l = _mm_loadu_si128 ( (__m128i const*)( center + x - 1 ) );
+                __m128i const r = _mm_loadu_si128 ( (__m128i const*)( center + x + 1 ) );
+                __m128i const u = _mm_loadu_si128 ( (__m128i const*)( up + x ) );
+                __m128i const d = _mm_loadu_si128 ( (__m128i const*)( down + x ) );
+
+                __m128i lo = _mm_add_epi16 ( _mm_unpacklo_epi8 ( l, zero ), _mm_unpacklo_epi8 ( r, zero ) );
+                lo = _mm_add_epi16 ( lo, _mm_add_epi16 ( _mm_unpacklo_epi8 ( u, zero ), _mm_unpacklo_epi8 ( d, zero ) ) );
+                lo = _mm_sub_epi16 ( _mm_slli_epi16 ( _mm_unpacklo_epi8 ( c, zero ), 2 ), lo );
+                __m128i hi = _mm_add_epi16 ( _mm_unpackhi_epi8 ( l, zero ), _mm_unpackhi_epi8 ( r, zero ) );
+                hi = _mm_add_epi16 ( hi, _mm_add_epi16 ( _mm_unpackhi_epi8 ( u, zero ), _mm_unpackhi_epi8 ( d, zero ) ) );
+                hi = _mm_sub_epi16 ( _mm_slli_epi16 ( _mm_unpackhi_epi8 ( c, zero ), 2 ), hi );
+
+                sum = _mm_add_epi32 ( sum, _mm_add_epi32 ( _mm_madd_epi16 ( lo, ones ), _mm_madd_epi16 ( hi, ones ) ) );
+                sumSq = _mm_add_epi32 ( sumSq, _mm_add_epi32 ( _mm_madd_epi16 ( lo, lo ), _mm_madd_epi16 ( hi, hi ) ) );
+            }
+            int sums[4], sumsSq[4];
+            _mm_storeu_si128 ( (__m128i*)sums, sum );
+            _mm_storeu_si128 ( (__m128i*)sumsSq, sumSq );
+            for ( int i = 0; i < 4; i++ ) {
+                oSum += sums[i];
+                oSumSq += (unsigned int)sumsSq[i];
+            }
+        }
+#endif
+        for ( ; x < width; x++ ) {
+            int const laplacian = 4 * center[x] - center[x - 1] - center[x + 1] - up[x] - down[x];
+            oSum += laplacian;
+            oSumSq += (double)( laplacian * laplacian );
+        }
+        oCount += width - 1;
+    }
+}
+
+void pcc::PcBoxDownscale ( cv::Mat const& iSrc, unsigned int const& iFactor, cv::Mat& oDst )
+{
+    int const factor = std::max ( 1, (int)iFactor );
+    cv::Size const size ( iSrc.cols / factor, iSrc.rows / factor );
+
+    if ( factor == 4 && iSrc.type () == CV_8UC1 ) {
+        oDst.create ( size, CV_8UC1 );
+        BoxDownscale4 ( iSrc, oDst );
+    } else {
+        cv::resize ( iSrc ( cv::Rect ( 0, 0, size.width * factor, size.height * factor ) ), oDst, size, 0.0, 0.0, cv::INTER_AREA );
+    }
+}
+double pcc::PcSharpness ( cv::Mat const& iSrc, unsigned int const& iRowStep )
+{
+    if ( iSrc.cols < 3 || iSrc.rows < 3 ) {
+        return 0.0;
+    }
+
+    if ( iSrc.type () != CV_8UC1 ) {
+        cv::Mat gray, laplacian;
+        if ( iSrc.channels () == 3 ) {
+            cv::cvtColor ( iSrc, gray, CV_BGR2GRAY );
+        } else {
+            iSrc.convertTo ( gray, CV_8U );
+        }
+        cv::Laplacian ( gray, laplacian, CV_32F );
+        cv::Scalar mean, stdDev;
+        cv::meanStdDev ( laplacian, mean, stdDev );
+        return stdDev[0] * stdDev[0];
+    }
+
+    double sum, sumSq, count;
+    LaplacianMoments ( iSrc, std::max ( 1, (int)iRowStep ), sum, sumSq, count );
+    if ( count <= 0.0 ) {
+        return 0.0;
+    }
+    double const mean = sum / count;
+    return std::max ( 0.0, sumSq / count - mean * mean );
+}
@@ -0,0 +1,536 @@
+#include "PcIntrinsicSolver.h"
+
+#include "PcImageFilters.h"
+#include "PcThreadPool.h"
+
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(PCC_USE_SSE2)
+#include <emmintrin.h>
+#endif
+
+using namespace pcc;
+
+// The number of intrinsic parameters: fx, fy, cx, cy, k1, k2, p1, p2, k3.
+static int const INTRINSICS = 9;
+
+// The number of parameters of a view pose: the rotation vector, then the translation.
+static int const POSE = 6;
+
+// The number of parameters a point residual depends on.
+static int const PARAMETERS = INTRINSICS + POSE;
+
+// The number of entries of the upper triangle of the normal matrix of a view.
+static int const NORMAL_ENTRIES = PARAMETERS * ( PARAMETERS + 1 ) / 2;
+
+// The solver stops when an iteration changes the parameters by less than this fraction of their norm.
+static double const MIN_STEP = 1e-12;
+
+// The bounds of the Levenberg-Marquardt damping factor.
+static double const INITIAL_DAMPING = 1e-3;
+static double const MAX_DAMPING = 1e10;
+
+#if defined(PCC_USE_SSE2)
+/// \brief Two doubles processed together, so that the projection kernel is written once for one and two points.
+struct PcLane2
+{
+    __m128d     V;      ///< The two values.
+
+    PcLane2 () {}
+    PcLane2 ( double const& iValue ) : V ( _mm_set1_pd ( iValue ) ) {}
+    explicit PcLane2 ( __m128d const& iValue ) : V ( iValue ) {}
+};
+
+static inline PcLane2 operator+ ( PcLane2 const& a, PcLane2 const& b ) { return PcLane2 ( _mm_add_pd ( a.V, b.V ) ); }
+static inline PcLane2 operator- ( PcLane2 const& a, PcLane2 const& b ) { return PcLane2 ( _mm_sub_pd ( a.V, b.V ) ); }
+static inline PcLane2 operator* ( PcLane2 const& a, PcLane2 const& b ) { return PcLane2 ( _mm_mul_pd ( a.V, b.V ) ); }
+static inline PcLane2 operator/ ( PcLane2 const& a, PcLane2 const& b ) { return PcLane2 ( _mm_div_pd ( a.V, b.V ) ); }
+static inline PcLane2& operator+= ( PcLane2& a, PcLane2 const& b ) { a.V = _mm_add_pd ( a.V, b.V ); return a; }
+
+/// \brief Adds up the lanes of a PcLane2.
+static inline double SumLanes ( PcLane2 const& iValue )
+{
+    double lanes[2];
+    _mm_storeu_pd ( lanes, iValue.V );
+    return lanes[0] + lanes[1];
+}
+
+/// \brief Loads two consecutive doubles.
+static inline PcLane2 LoadPair ( double const* iValues ) { return PcLane2 ( _mm_loadu_pd ( iValues ) ); }
+#endif
+
+/// \brief Adds up the lanes of a scalar, i.e. returns it.
+static inline double SumLanes ( double const& iValue ) { return iValue; }
+
+/// \brief The points of one view, stored as separate coordinate arrays so that two points load at once.
+struct PcIntrinsicView
+{
+    VEC(double)             X;              ///< The x coordinates of the target points.
+    VEC(double)             Y;              ///< The y coordinates of the target points.
+    VEC(double)             U;              ///< The x coordinates of the detected points, in pixels.
+    VEC(double)             V;              ///< The y coordinates of the detected points, in pixels.
+};
+
+/// \brief The normal equation blocks of one view, for the intrinsics followed by the view pose.
+struct PcIntrinsicViewBlocks
+{
+    double                  H[PARAMETERS * PARAMETERS]; ///< J^T J, with U the intrinsic block, V the pose block and W the coupling.
+    double                  G[PARAMETERS];              ///< J^T r.
+    double                  Vinv[POSE * POSE];          ///< The inverse of the damped pose block.
+    double                  Y[INTRINSICS * POSE];       ///< W Vinv.
+    double                  Cost;                       ///< The sum of the squared residuals.
+    bool                    IsValid;                    ///< Whether the damped pose block could be inverted.
+};
+
+/// \brief Computes the rotation matrix of a rotation vector, and its derivative along each of the vector components.
+static void Rotate ( double const* iRvec, double* oR, double* oDR )
+{
+    cv::Mat rvec ( 3, 1, CV_64F, (void*)iRvec );
+    cv::Mat R ( 3, 3, CV_64F, oR );
+    cv::Mat jacobian ( 3, 9, CV_64F, oDR );
+    cv::Rodrigues ( rvec, R, jacobian );
+}
+
+/// \brief Accumulates the residuals and normal equation entries of one or two points.
+///
+/// T is double for one point, or PcLane2 for two. The normal entries are the upper triangle of J^T J, row after row.
+template<typename T>
+static inline void AccumulatePoints (
+    double const*           iK,
+    double const*           iR,
+    double const*           iDR,
+    double const*           iT,
+    T const&                iX,
+    T const&                iY,
+    T const&                iU,
+    T const&                iV,
+    T*                      ioNormal,
+    T*                      ioGradient,
+    T&                      ioCost
+) {
+    T const fx ( iK[0] ), fy ( iK[1] ), k1 ( iK[4] ), k2 ( iK[5] ), p1 ( iK[6] ), p2 ( iK[7] ), k3 ( iK[8] );
+    T const one ( 1.0 ), two ( 2.0 ), three ( 3.0 ), six ( 6.0 );
+
+    // The target lies on the z = 0 plane, so the third column of the rotation drops out.
+    T const Xc = T ( iR[0] ) * iX + T ( iR[1] ) * iY + T ( iT[0] );
+    T const Yc = T ( iR[3] ) * iX + T ( iR[4] ) * iY + T ( iT[1] );
+    T const Zc = T ( iR[6] ) * iX + T ( iR[7] ) * iY + T ( iT[2] );
+    T const iz = one / Zc;
+    T const x = Xc * iz, y = Yc * iz;
+    T const xx = x * x, yy = y * y, xy = x * y;
+    T const r2 = xx + yy, r4 = r2 * r2, r6 = r4 * r2;
+    T const radial = one + k1 * r2 + k2 * r4 + k3 * r6;
+    T const dRadial = k1 + two * k2 * r2 + three * k3 * r4;
+    T const xd = x * radial + two * p1 * xy + p2 * ( r2 + two * xx );
+    T const yd = y * radial + p1 * ( r2 + two * yy ) + two * p2 * xy;
+    T const eu = fx * xd + T ( iK[2] ) - iU;
+    T const ev = fy * yd + T ( iK[3] ) - iV;
+
+    T ju[PARAMETERS], jv[PARAMETERS];
+    T const zero ( 0.0 );
+    ju[0] = xd;             jv[0] = zero;
+    ju[1] = zero;           jv[1] = yd;
+    ju[2] = one;            jv[2] = zero;
+    ju[3] = zero;           jv[3] = one;
+    ju[4] = fx * x * r2;    jv[4] = fy * y * r2;
+    ju[5] = fx * x * r4;    jv[5] = fy * y * r4;
+    ju[6] = fx * two * xy;  jv[6] = fy * ( r2 + two * yy );
+    ju[7] = fx * ( r2 + two * xx );     jv[7] = fy * two * xy;
+    ju[8] = fx * x * r6;    jv[8] = fy * y * r6;
+
+    // Derivatives of the pixel with respect to the camera-frame point, through the normalised and distorted point.
+    T const cross = two * xy * dRadial + two * p1 * x + two * p2 * y;
+    T const a = fx * ( radial + two * xx * dRadial + two * p1 * y + six * p2 * x );
+    T const b = fx * cross;
+    T const c = fy * cross;
+    T const d = fy * ( radial + two * yy * dRadial + six * p1 * y + two * p2 * x );
+    T const duX = a * iz, duY = b * iz, duZ = zero - ( a * x + b * y ) * iz;
+    T const dvX = c * iz, dvY = d * iz, dvZ = zero - ( c * x + d * y ) * iz;
+    for ( int j = 0; j < 3; j++ ) {
+        double const* const dR = iDR + 9 * j;
+        T const dX = T ( dR[0] ) * iX + T ( dR[1] ) * iY;
+        T const dY = T ( dR[3] ) * iX + T ( dR[4] ) * iY;
+        T const dZ = T ( dR[6] ) * iX + T ( dR[7] ) * iY;
+        ju[INTRINSICS + j] = duX * dX + duY * dY + duZ * dZ;
+        jv[INTRINSICS + j] = dvX * dX + dvY * dY + dvZ * dZ;
+    }
+    ju[INTRINSICS + 3] = duX;   jv[INTRINSICS + 3] = dvX;
+    ju[INTRINSICS + 4] = duY;   jv[INTRINSICS + 4] = dvY;
+    ju[INTRINSICS + 5] = duZ;   jv[INTRINSICS + 5] = dvZ;
+
+    int n = 0;
+    for ( int r = 0; r < PARAMETERS; r++ ) {
+        for ( int c = r; c < PARAMETERS; c++ ) {
+            ioNormal[n++] += ju[r] * ju[c] + jv[r] * jv[c];
+        }
+        ioGradient[r] += ju[r] * eu + jv[r] * ev;
+    }
+    ioCost += eu * eu + ev * ev;
+}
+
+/// \brief Accumulates the squared residuals of one or two points. T is double for one point, or PcLane2 for two.
+template<typename T>
+static inline void AccumulateCost (
+    double const*           iK,
+    double const*           iR,
+    double const*           iT,
+    T const&                iX,
+    T const&                iY,
+    T const&                iU,
+    T const&                iV,
+    T&                      ioCost
+) {
+    T const one ( 1.0 ), two ( 2.0 );
+    T const Xc = T ( iR[0] ) * iX + T ( iR[1] ) * iY + T ( iT[0] );
+    T const Yc = T ( iR[3] ) * iX + T ( iR[4] ) * iY + T ( iT[1] );
+    T const iz = one / ( T ( iR[6] ) * iX + T ( iR[7] ) * iY + T ( iT[2] ) );
+    T const x = Xc * iz, y = Yc * iz;
+    T const xx = x * x, yy = y * y, xy = x * y;
+    T const r2 = xx + yy, r4 = r2 * r2;
+    T const radial = one + T ( iK[4] ) * r2 + T ( iK[5] ) * r4 + T ( iK[8] ) * r4 * r2;
+    T const eu = T ( iK[0] ) * ( x * radial + two * T ( iK[6] ) * xy + T ( iK[7] ) * ( r2 + two * xx ) ) + T ( iK[2] ) - iU;
+    T const ev = T ( iK[1] ) * ( y * radial + T ( iK[6] ) * ( r2 + two * yy ) + two * T ( iK[7] ) * xy ) + T ( iK[3] ) - iV;
+    ioCost += eu * eu + ev * ev;
+}
+
+/// \brief Evaluates the normal equation blocks of one view. Runs as a PcThreadPool::ParallelFor body.
+static void LinearizeView (
+    VEC(PcIntrinsicView) const*         iViews,
+    double const*                       iIntrinsics,
+    VEC(double) const*                  iPoses,
+    VEC(PcIntrinsicViewBlocks)*         oBlocks,
+    size_t                              iView
+) {
+    PcIntrinsicView const& view = (*iViews)[iView];
+    PcIntrinsicViewBlocks& blocks = (*oBlocks)[iView];
+    double const* const pose = &(*iPoses)[iView * POSE];
+
+    double R[9], dR[27];
+    Rotate ( pose, R, dR );
+
+    double normal[NORMAL_ENTRIES], gradient[PARAMETERS], cost = 0.0;
+    std::fill ( normal, normal + NORMAL_ENTRIES, 0.0 );
+    std::fill ( gradient, gradient + PARAMETERS, 0.0 );
+
+    size_t p = 0;
+    size_t const count = view.X.size ();
+#if defined(PCC_USE_SSE2)
+    PcLane2 normal2[NORMAL_ENTRIES], gradient2[PARAMETERS], cost2 ( 0.0 );
+    std::fill ( normal2, normal2 + NORMAL_ENTRIES, PcLane2 ( 0.0 ) );
+    std::fill ( gradient2, gradient2 + PARAMETERS, PcLane2 ( 0.0 ) );
+    for ( ; p + 2 <= count; p += 2 ) {
+        AccumulatePoints ( iIntrinsics, R, dR, pose + 3,
+            LoadPair ( &view.X[p] ), LoadPair ( &view.Y[p] ), LoadPair ( &view.U[p] ), LoadPair ( &view.V[p] ),
+            normal2, gradient2, cost2 );
+    }
+    for ( int n = 0; n < NORMAL_ENTRIES; n++ ) {
+        normal[n] = SumLanes ( normal2[n] );
+    }
+    for ( int r = 0; r < PARAMETERS; r++ ) {
+        gradient[r] = SumLanes ( gradient2[r] );
+    }
+    cost = SumLanes ( cost2 );
+#endif
+    for ( ; p < count; p++ ) {
+        AccumulatePoints ( iIntrinsics, R, dR, pose + 3,
+            view.X[p], view.Y[p], view.U[p], view.V[p],
+            normal, gradient, cost );
+    }
+
+    int n = 0;
+    for ( int r = 0; r < PARAMETERS; r++ ) {
+        for ( int c = r; c < PARAMETERS; c++, n++ ) {
+            blocks.H[r * PARAMETERS + c] = blocks.H[c * PARAMETERS + r] = normal[n];
+        }
+    }
+    std::copy ( gradient, gradient + PARAMETERS, blocks.G );
+    blocks.Cost = cost;
+}
+
+/// \brief Damps and inverts the pose block of one view, and computes W Vinv. Runs as a PcThreadPool::ParallelFor body.
+static void EliminateView (
+    double                              iDamping,
+    VEC(PcIntrinsicViewBlocks)*         ioBlocks,
+    size_t                              iView
+) {
+    PcIntrinsicViewBlocks& blocks = (*ioBlocks)[iView];
+
+    double damped[POSE * POSE];
+    for ( int r = 0; r < POSE; r++ ) {
+        for ( int c = 0; c < POSE; c++ ) {
+            damped[r * POSE + c] = blocks.H[( INTRINSICS + r ) * PARAMETERS + INTRINSICS + c] * ( r == c ? 1.0 + iDamping : 1.0 );
+        }
+    }
+    cv::Mat dampedMat ( POSE, POSE, CV_64F, damped );
+    cv::Mat inverse ( POSE, POSE, CV_64F, blocks.Vinv );
+    blocks.IsValid = ( cv::invert ( dampedMat, inverse, cv::DECOMP_CHOLESKY ) != 0.0 );
+    if ( !blocks.IsValid ) {
+        return;
+    }
+
+    for ( int r = 0; r < INTRINSICS; r++ ) {
+        for ( int c = 0; c < POSE; c++ ) {
+            double sum = 0.0;
+            for ( int k = 0; k < POSE; k++ ) {
+                sum += blocks.H[r * PARAMETERS + INTRINSICS + k] * blocks.Vinv[k * POSE + c];
+            }
+            blocks.Y[r * POSE + c] = sum;
+        }
+    }
+}
+
+/// \brief Computes the pose step of one view from the intrinsic step, and the cost of the resulting trial parameters.
+/// Runs as a PcThreadPool::ParallelFor body.
+static void EvaluateView (
+    VEC(PcIntrinsicView) const*         iViews,
+    VEC(PcIntrinsicViewBlocks) const*   iBlocks,
+    double const*                       iIntrinsicStep,
+    double const*                       iTrialIntrinsics,
+    VEC(double) const*                  iPoses,
+    VEC(double)*                        oTrialPoses,
+    VEC(double)*                        oCosts,
+    size_t                              iView
+) {
+    PcIntrinsicView const& view = (*iViews)[iView];
+    PcIntrinsicViewBlocks const& blocks = (*iBlocks)[iView];
+
+    // Back-substitution: dp = Vinv ( -gp - W^T dk ).
+    double b[POSE];
+    for ( int r = 0; r < POSE; r++ ) {
+        b[r] = -blocks.G[INTRINSICS + r];
+        for ( int k = 0; k < INTRINSICS; k++ ) {
+            b[r] -= blocks.H[k * PARAMETERS + INTRINSICS + r] * iIntrinsicStep[k];
+        }
+    }
+    double* const trial = &(*oTrialPoses)[iView * POSE];
+    for ( int r = 0; r < POSE; r++ ) {
+        trial[r] = (*iPoses)[iView * POSE + r];
+        for ( int k = 0; k < POSE; k++ ) {
+            trial[r] += blocks.Vinv[r * POSE + k] * b[k];
+        }
+    }
+
+    double R[9], dR[27];
+    Rotate ( trial, R, dR );
+
+    double cost = 0.0;
+    size_t p = 0;
+    size_t const count = view.X.size ();
+#if defined(PCC_USE_SSE2)
+    PcLane2 cost2 ( 0.0 );
+    for ( ; p + 2 <= count; p += 2 ) {
+        AccumulateCost ( iTrialIntrinsics, R, trial + 3,
+            LoadPair ( &view.X[p] ), LoadPair ( &view.Y[p] ), LoadPair ( &view.U[p] ), LoadPair ( &view.V[p] ), cost2 );
+    }
+    cost = SumLanes ( cost2 );
+#endif
+    for ( ; p < count; p++ ) {
+        AccumulateCost ( iTrialIntrinsics, R, trial + 3,
+            view.X[p], view.Y[p], view.U[p], view.V[p], cost );
+    }
+    (*oCosts)[iView] = cost;
+}
+
+/// \brief Estimates the initial pose of one view with cv::solvePnP. Runs as a PcThreadPool::ParallelFor body.
+static void InitialisePose (
+    VECOFVECS(cv::Point3f) const*       iObjectPoints,
+    VECOFVECS(cv::Point2f) const*       iImagePoints,
+    cv::Mat const*                      iCameraMatrix,
+    cv::Mat const*                      iDistCoeffs,
+    VEC(double)*                        oPoses,
+    size_t                              iView
+) {
+    cv::Mat rvec, tvec;
+    cv::solvePnP ( (*iObjectPoints)[iView], (*iImagePoints)[iView], *iCameraMatrix, *iDistCoeffs, rvec, tvec );
+    for ( int k = 0; k < 3; k++ ) {
+        (*oPoses)[iView * POSE + k] = rvec.at<double> ( k );
+        (*oPoses)[iView * POSE + 3 + k] = tvec.at<double> ( k );
+    }
+}
+
+/// \brief Minimises the reprojection error over the intrinsics and every view pose.
+/// \return the sum of the squared residuals at the solution
+static double Solve (
+    VEC(PcIntrinsicView) const&         iViews,
+    double*                             ioIntrinsics,
+    VEC(double)&                        ioPoses,
+    unsigned int const&                 iMaxIterations
+) {
+    PcThreadPool& pool = PcThreadPool::GetInstance ();
+    size_t const viewCount = iViews.size ();
+
+    VEC(PcIntrinsicViewBlocks) blocks ( viewCount );
+    VEC(double) trialPoses ( ioPoses.size () );
+    VEC(double) costs ( viewCount );
+
+    double damping = INITIAL_DAMPING;
+    double cost = 0.0;
+    bool isLinearized = false;
+    for ( unsigned int iteration = 0; iteration < iMaxIterations && damping < MAX_DAMPING; ) {
+        if ( !isLinearized ) {
+            pool.ParallelFor ( 0u, viewCount, boost::bind ( &LinearizeView, &iViews, ioIntrinsics, &ioPoses, &blocks, _1 ) );
+            cost = 0.0;
+            for ( size_t v = 0; v < viewCount; v++ ) {
+                cost += blocks[v].Cost;
+            }
+            isLinearized = true;
+        }
+
+        pool.ParallelFor ( 0u, viewCount, boost::bind ( &EliminateView, damping, &blocks, _1 ) );
+
+        // Reduced intrinsic system: ( U - W Vinv W^T ) dk = -( gk - W Vinv gp ).
+        cv::Mat reduced = cv::Mat::zeros ( INTRINSICS, INTRINSICS, CV_64F );
+        cv::Mat rhs = cv::Mat::zeros ( INTRINSICS, 1, CV_64F );
+        bool isValid = true;
+        for ( size_t v = 0; v < viewCount && isValid; v++ ) {
+            PcIntrinsicViewBlocks const& view = blocks[v];
+            isValid = view.IsValid;
+            for ( int r = 0; r < INTRINSICS && isValid; r++ ) {
+                double* const reducedRow = reduced.ptr<double> ( r );
+                for ( int c = 0; c < INTRINSICS; c++ ) {
+                    double sum = 0.0;
+                    for ( int k = 0; k < POSE; k++ ) {
+                        sum += view.Y[r * POSE + k] * view.H[c * PARAMETERS + INTRINSICS + k];
+                    }
+                    reducedRow[c] += view.H[r * PARAMETERS + c] - sum;
+                }
+                double y = 0.0;
+                for ( int k = 0; k < POSE; k++ ) {
+                    y += view.Y[r * POSE + k] * view.G[INTRINSICS + k];
+                }
+                rhs.at<double> ( r ) += y - view.G[r];
+            }
+        }
+        // The damping of U applies to the sum over the views, as if the full system were damped.
+        for ( size_t v = 0; v < viewCount && isValid; v++ ) {
+            for ( int d = 0; d < INTRINSICS; d++ ) {
+                reduced.at<double> ( d, d ) += damping * blocks[v].H[d * PARAMETERS + d];
+            }
+        }
+
+        cv::Mat step;
+        if ( !isValid || !cv::solve ( reduced, rhs, step, cv::DECOMP_CHOLESKY ) ) {
+            damping *= 10.0;
+            continue;
+        }
+
+        double trialIntrinsics[INTRINSICS];
+        double stepNorm = 0.0, norm = 0.0;
+        for ( int k = 0; k < INTRINSICS; k++ ) {
+            trialIntrinsics[k] = ioIntrinsics[k] + step.at<double> ( k );
+            stepNorm += step.at<double> ( k ) * step.at<double> ( k );
+            norm += ioIntrinsics[k] * ioIntrinsics[k];
+        }
+        pool.ParallelFor ( 0u, viewCount, boost::bind ( &EvaluateView, &iViews, &blocks, step.ptr<double> (), trialIntrinsics,
+            &ioPoses, &trialPoses, &costs, _1 ) );
+        double trialCost = 0.0;
+        for ( size_t v = 0; v < viewCount; v++ ) {
+            trialCost += costs[v];
+        }
+        for ( size_t k = 0; k < ioPoses.size (); k++ ) {
+            stepNorm += ( trialPoses[k] - ioPoses[k] ) * ( trialPoses[k] - ioPoses[k] );
+            norm += ioPoses[k] * ioPoses[k];
+        }
+
+        if ( trialCost < cost ) {
+            std::copy ( trialIntrinsics, trialIntrinsics + INTRINSICS, ioIntrinsics );
+            ioPoses.swap ( trialPoses );
+            cost = trialCost;
+            damping = std::max ( damping * 0.1, 1e-12 );
+            isLinearized = false;
+            iteration++;
+            if ( stepNorm <= MIN_STEP * MIN_STEP * norm ) {
+                break;
+            }
+        } else {
+            damping *= 10.0;
+        }
+    }
+    return cost;
+}
+
+double pcc::PcSolveIntrinsics (
+    VECOFVECS(cv::Point3f) const&   iObjectPoints,
+    VECOFVECS(cv::Point2f) const&   iImagePoints,
+    cv::Size const&                 iImageSize,
+    cv::Mat&                        ioCameraMatrix,
+    cv::Mat&                        ioDistCoeffs,
+    VEC(cv::Mat)&                   oRvecs,
+    VEC(cv::Mat)&                   oTvecs,
+    bool const&                     iUseGuess,
+    unsigned int const&             iMaxIterations
+) {
+    size_t const viewCount = iObjectPoints.size ();
+    if ( viewCount == 0u || iImagePoints.size () != viewCount ) {
+        return -1.0;
+    }
+
+    VEC(PcIntrinsicView) views ( viewCount );
+    size_t pointCount = 0u;
+    for ( size_t v = 0; v < viewCount; v++ ) {
+        VEC(cv::Point3f) const& objectPoints = iObjectPoints[v];
+        VEC(cv::Point2f) const& imagePoints = iImagePoints[v];
+        if ( objectPoints.size () != imagePoints.size () || objectPoints.size () < 4u ) {
+            return -1.0;
+        }
+        PcIntrinsicView& view = views[v];
+        for ( size_t p = 0; p < objectPoints.size (); p++ ) {
+            if ( objectPoints[p].z != 0.0f ) {
+                return -1.0;
+            }
+            view.X.push_back ( objectPoints[p].x );
+            view.Y.push_back ( objectPoints[p].y );
+            view.U.push_back ( imagePoints[p].x );
+            view.V.push_back ( imagePoints[p].y );
+        }
+        pointCount += objectPoints.size ();
+    }
+
+    cv::Mat cameraMatrix, distCoeffs = cv::Mat::zeros ( 5, 1, CV_64F );
+    if ( iUseGuess && ioCameraMatrix.total () == 9u ) {
+        ioCameraMatrix.convertTo ( cameraMatrix, CV_64F );
+        cameraMatrix = cameraMatrix.reshape ( 1, 3 );
+        cv::Mat guess;
+        ioDistCoeffs.convertTo ( guess, CV_64F );
+        for ( int k = 0; k < 5 && k < (int)guess.total (); k++ ) {
+            distCoeffs.at<double> ( k ) = guess.ptr<double> ()[k];
+        }
+    } else {
+        cameraMatrix = cv::initCameraMatrix2D ( iObjectPoints, iImagePoints, iImageSize, 0.0 );
+    }
+
+    double intrinsics[INTRINSICS] = {
+        cameraMatrix.at<double> ( 0, 0 ), cameraMatrix.at<double> ( 1, 1 ),
+        cameraMatrix.at<double> ( 0, 2 ), cameraMatrix.at<double> ( 1, 2 ),
+        distCoeffs.at<double> ( 0 ), distCoeffs.at<double> ( 1 ), distCoeffs.at<double> ( 2 ),
+        distCoeffs.at<double> ( 3 ), distCoeffs.at<double> ( 4 )
+    };
+    if ( !( intrinsics[0] > 0.0 ) || !( intrinsics[1] > 0.0 ) ) {
+        return -1.0;
+    }
+
+    VEC(double) poses ( viewCount * POSE );
+    PcThreadPool::GetInstance ().ParallelFor ( 0u, viewCount,
+        boost::bind ( &InitialisePose, &iObjectPoints, &iImagePoints, &cameraMatrix, &distCoeffs, &poses, _1 ) );
+
+    double const cost = Solve ( views, intrinsics, poses, iMaxIterations );
+
+    ioCameraMatrix = cv::Mat::eye ( 3, 3, CV_64F );
+    ioCameraMatrix.at<double> ( 0, 0 ) = intrinsics[0];
+    ioCameraMatrix.at<double> ( 1, 1 ) = intrinsics[1];
+    ioCameraMatrix.at<double> ( 0, 2 ) = intrinsics[2];
+    ioCameraMatrix.at<double> ( 1, 2 ) = intrinsics[3];
+    cv::Mat ( 5, 1, CV_64F, intrinsics + 4 ).copyTo ( ioDistCoeffs );
+    oRvecs.resize ( viewCount );
+    oTvecs.resize ( viewCount );
+    for ( size_t v = 0; v < viewCount; v++ ) {
+        cv::Mat ( 3, 1, CV_64F, &poses[v * POSE] ).copyTo ( oRvecs[v] );
+        cv::Mat ( 3, 1, CV_64F, &poses[v * POSE + 3] ).copyTo ( oTvecs[v] );
+    }
+    return std::sqrt ( cost / pointCount );
+}
@@ -0,0 +1,299 @@
+#include "PcOfflineCalibrator.h"
+
+#include "PcCalibrationHelper.h"
+#include "PcCalibrationMath.h"
+#include "PcImageFilters.h"
+#include "PcTargetDetector.h"
+#include "PcThreadPool.h"
+#include "PcViewSelector.h"
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <ctime>
+#include <iostream>
+
+using namespace pcc;
+
+// The recorded frame timestamps count nanoseconds (see PcCamera::ToNanoseconds).
+static boost::uint64_t const NANOSECONDS_PER_MS = 1000000u;
+
+// The timestamp step between consecutive images of a directory: one second, well above the frame-set tolerance.
+static boost::uint64_t const IMAGE_INTERVAL = 1000u * NANOSECONDS_PER_MS;
+
+// The number of consecutive frames searched by a single detector.
+static size_t const CHUNK_SIZE = 32u;
+
+// ----------------------------------------------------------------------
+// PcOfflineCalibrator
+// ----------------------------------------------------------------------
+// Public
+PcOfflineCalibrator::PcOfflineCalibrator ( PcCalibrationTarget const& iTarget )
+    :   m_target ( iTarget )
+    ,   m_sources ()
+    ,   m_chunks ()
+    ,   m_candidates ()
+    ,   m_views ()
+    ,   m_results ()
+    ,   m_rigSolution ()
+{}
+bool PcOfflineCalibrator::AddTake ( std::string const& iManifestPath )
+{
+    PcTakeReaderPtr take ( new PcTakeReader ( iManifestPath ) );
+    if ( !take->IsOpen () ) {
+        std::cout << "Couldn't open the take " << iManifestPath << std::endl;
+        return false;
+    }
+
+    VEC(std::string) const& cameraIds = take->GetCameraList ();
+    for ( unsigned int c = 0; c < cameraIds.size (); c++ ) {
+        if ( HasCamera ( cameraIds[c] ) ) {
+            std::cout << "Skipping camera " << cameraIds[c] << " of take " << take->GetTakeName () << ", already added" << std::endl;
+            continue;
+        }
+
+        Source source;
+        source.CameraId = cameraIds[c];
+        source.Take = take;
+        source.TakeCamera = c;
+        VEC(PcIndexEntry) const& entries = take->GetIndex ().GetCameraEntries ( c );
+        for ( auto entry = entries.begin (); entry != entries.end (); entry++ ) {
+            source.Timestamps.push_back ( entry->Timestamp );
+        }
+        m_sources.push_back ( source );
+    }
+    return true;
+}
+bool PcOfflineCalibrator::AddImageDirectory ( std::string const& iCameraId, std::string const& iDirectory )
+{
+    if ( HasCamera ( iCameraId ) ) {
+        std::cout << "Camera " << iCameraId << " was already added" << std::endl;
+        return false;
+    }
+
+    Source source;
+    source.CameraId = iCameraId;
+    source.TakeCamera = 0u;
+
+    boost::system::error_code err;
+    for ( boost::filesystem::directory_iterator file ( iDirectory, err ), end; !err && file != end; file.increment ( err ) ) {
+        std::string extension = file->path ().extension ().string ();
+        std::transform ( extension.begin (), extension.end (), extension.begin (), ::tolower );
+        if (    boost::filesystem::is_regular_file ( file->status () )
+            &&  ( extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".bmp"
+              ||  extension == ".tif" || extension == ".tiff" || extension == ".pgm" ) ) {
+            source.Paths.push_back ( file->path ().string () );
+        }
+    }
+    if ( source.Paths.empty () ) {
+        std::cout << "No image found in " << iDirectory << std::endl;
+        return false;
+    }
+
+    std::sort ( source.Paths.begin (), source.Paths.end () );
+    for ( size_t i = 0; i < source.Paths.size (); i++ ) {
+        source.Timestamps.push_back ( ( i + 1 ) * IMAGE_INTERVAL );
+    }
+    m_sources.push_back ( source );
+    return true;
+}
+bool PcOfflineCalibrator::Calibrate ( bool const& iSolveRig )
+{
+    PcThreadPool& pool = PcThreadPool::GetInstance ();
+
+    m_chunks.clear ();
+    m_candidates.assign ( m_sources.size (), VEC(Candidate) () );
+    for ( size_t s = 0; s < m_sources.size (); s++ ) {
+        size_t const frameCount = m_sources[s].Timestamps.size ();
+        m_candidates[s].resize ( frameCount );
+        for ( size_t begin = 0; begin < frameCount; begin += CHUNK_SIZE ) {
+            Chunk chunk;
+            chunk.Source = s;
+            chunk.Begin = begin;
+            chunk.End = std::min ( frameCount, begin + CHUNK_SIZE );
+            m_chunks.push_back ( chunk );
+        }
+    }
+    pool.ParallelFor ( 0u, m_chunks.size (), boost::bind ( &PcOfflineCalibrator::DetectChunk, this, _1 ) );
+
+    // The acceptance policy depends on the views accepted before, so the replay is sequential within a camera.
+    PcRigCalibrator rig ( m_target.GetPoints () );
+    m_views.assign ( m_sources.size (), VECOFVECS(cv::Point2f) () );
+    m_results.assign ( m_sources.size (), PcOfflineCameraResult () );
+    for ( size_t s = 0; s < m_sources.size (); s++ ) {
+        SelectViews ( s, rig, m_views[s] );
+    }
+    pool.ParallelFor ( 0u, m_sources.size (), boost::bind ( &PcOfflineCalibrator::SolveCamera, this, _1 ) );
+
+    unsigned int calibrated = 0u;
+    for ( auto result = m_results.begin (); result != m_results.end (); result++ ) {
+        std::cout   << "Camera " << result->CameraId << ": " << result->DetectionCount << " detections in "
+                    << result->FrameCount << " frames, " << result->ViewCount << " views";
+        if ( result->Rms < 0.0 ) {
+            std::cout << ", not calibrated" << std::endl;
+            continue;
+        }
+        std::cout << ", RMS: " << result->Rms << std::endl;
+        rig.SetIntrinsics ( result->CameraId, result->CameraMatrix, result->DistCoeffs );
+        calibrated++;
+    }
+
+    m_rigSolution = PcRigSolutionPtr ();
+    if ( iSolveRig && calibrated >= 2u ) {
+        std::cout << "Solving the rig calibration from " << rig.GetObservationCount () << " observations" << std::endl;
+        if ( rig.Solve () ) {
+            m_rigSolution = rig.GetSolution ();
+            std::cout   << "Calibrated a rig of " << m_rigSolution->Rotations.size () << " cameras around camera "
+                        << m_rigSolution->WorldCamera << ", RMS: " << m_rigSolution->Rms << std::endl;
+        }
+    }
+
+    // Only the accepted views are kept.
+    VEC(Chunk) ().swap ( m_chunks );
+    VECOFVECS(Candidate) ().swap ( m_candidates );
+    return calibrated > 0u;
+}
+void PcOfflineCalibrator::StoreResults ( PcCalibrationCache& ioCache ) const
+{
+    boost::int64_t const date = (boost::int64_t)time ( 0 );
+
+    VEC(std::string) rigIds;
+    if ( m_rigSolution ) {
+        for ( auto rotation = m_rigSolution->Rotations.begin (); rotation != m_rigSolution->Rotations.end (); rotation++ ) {
+            rigIds.push_back ( rotation->first );
+        }
+    }
+    boost::uint64_t const rigKey = rigIds.empty () ? 0u : PcCalibrationCache::RigKey ( rigIds );
+
+    for ( auto result = m_results.begin (); result != m_results.end (); result++ ) {
+        if ( result->Rms < 0.0 ) {
+            continue;
+        }
+
+        PcCameraRecord record;
+        PcCalibrationCache::WriteId ( result->CameraId, record.CameraId );
+        record.Width = (boost::uint32_t)result->FrameSize.width;
+        record.Height = (boost::uint32_t)result->FrameSize.height;
+        PcCalibrationCache::WriteMatrix ( result->CameraMatrix, 9u, record.CameraMatrix );
+        record.DistCount = (boost::uint32_t)std::min ( result->DistCoeffs.total (), PCC_CACHE_DIST_COUNT );
+        PcCalibrationCache::WriteMatrix ( result->DistCoeffs.reshape ( 1, 1 ).colRange ( 0, record.DistCount ), record.DistCount, record.DistCoeffs );
+        std::fill ( record.DistCoeffs + record.DistCount, record.DistCoeffs + PCC_CACHE_DIST_COUNT, 0.0 );
+        record.Rms = result->Rms;
+        record.Date = date;
+
+        record.RigKey = 0u;
+        std::fill ( record.Rotation, record.Rotation + 9, 0.0 );
+        std::fill ( record.Translation, record.Translation + 3, 0.0 );
+        if ( m_rigSolution && m_rigSolution->Rotations.count ( result->CameraId ) ) {
+            record.RigKey = rigKey;
+            if (    !PcCalibrationCache::WriteMatrix ( m_rigSolution->Rotations.at ( result->CameraId ), 9u, record.Rotation )
+                ||  !PcCalibrationCache::WriteMatrix ( m_rigSolution->Translations.at ( result->CameraId ), 3u, record.Translation ) ) {
+                record.RigKey = 0u;
+            }
+        }
+        ioCache.StoreCamera ( record );
+    }
+}
+
+// Private
+bool PcOfflineCalibrator::HasCamera ( std::string const& iCameraId ) const
+{
+    for ( auto source = m_sources.begin (); source != m_sources.end (); source++ ) {
+        if ( source->CameraId == iCameraId ) {
+            return true;
+        }
+    }
+    return false;
+}
+bool PcOfflineCalibrator::ReadFrame ( Source const& iSource, size_t const& iPosition, cv::Mat& oImage ) const
+{
+    if ( iSource.Take ) {
+        return iSource.Take->ReadCameraFrame ( iSource.TakeCamera, iPosition, oImage );
+    }
+    oImage = cv::imread ( iSource.Paths[iPosition], cv::IMREAD_GRAYSCALE );
+    return !oImage.empty ();
+}
+void PcOfflineCalibrator::DetectChunk ( size_t const& iChunk )
+{
+    PcCalibrationHelper& calib = PcCalibrationHelper::GetInstance ();
+    Chunk const& chunk = m_chunks[iChunk];
+    Source const& source = m_sources[chunk.Source];
+
+    PcTargetDetector detector ( m_target );
+    cv::Mat frame;
+    for ( size_t f = chunk.Begin; f < chunk.End; f++ ) {
+        Candidate& candidate = m_candidates[chunk.Source][f];
+        candidate.IsSharp = false;
+        candidate.IsFound = false;
+        if ( !ReadFrame ( source, f, frame ) ) {
+            continue;
+        }
+        candidate.FrameSize = frame.size ();
+        candidate.IsSharp = ( PcSharpness ( frame ) >= calib.MinimumSharpness () );
+        candidate.IsFound = candidate.IsSharp && detector.Detect ( frame, candidate.Corners );
+    }
+}
+void PcOfflineCalibrator::SelectViews ( size_t const& iSource, PcRigCalibrator& ioRig, VECOFVECS(cv::Point2f)& oViews )
+{
+    PcCalibrationHelper& calib = PcCalibrationHelper::GetInstance ();
+    Source const& source = m_sources[iSource];
+    VEC(Candidate) const& candidates = m_candidates[iSource];
+    PcOfflineCameraResult& result = m_results[iSource];
+
+    result.CameraId = source.CameraId;
+    result.Rms = -1.0;
+    result.FrameCount = (unsigned int)candidates.size ();
+    result.DetectionCount = 0u;
+    result.ViewCount = 0u;
+
+    // Images of a directory are all far enough apart, only the frames of a take are rate-limited.
+    boost::uint64_t const interval = source.Take ? (boost::uint64_t)calib.FrameDelay () * NANOSECONDS_PER_MS : 0u;
+    PcViewSelector selector ( m_target );
+    bool hasView = false;
+    boost::uint64_t lastView = 0u;
+    for ( size_t f = 0; f < candidates.size (); f++ ) {
+        Candidate const& candidate = candidates[f];
+        boost::uint64_t const timestamp = source.Timestamps[f];
+        if ( candidate.IsFound ) {
+            result.DetectionCount++;
+        }
+        if (    !candidate.IsFound || oViews.size () >= calib.FrameCount ()
+            ||  ( hasView && timestamp >= lastView && timestamp - lastView < interval ) ) {
+            continue;
+        }
+
+        ioRig.AddObservation ( source.CameraId, timestamp, candidate.Corners );
+        if ( calib.SelectsViews () && !selector.Accept ( candidate.Corners, candidate.FrameSize ) ) {
+            continue;
+        }
+        hasView = true;
+        lastView = timestamp;
+        result.FrameSize = candidate.FrameSize;
+        oViews.push_back ( candidate.Corners );
+    }
+    result.ViewCount = (unsigned int)oViews.size ();
+}
+void PcOfflineCalibrator::SolveCamera ( size_t const& iSource )
+{
+    PcOfflineCameraResult& result = m_results[iSource];
+    VECOFVECS(cv::Point2f) const& views = m_views[iSource];
+    if ( views.size () < PcCalibrationHelper::GetInstance ().MinimumViews () ) {
+        return;
+    }
+
+    try {
+        result.Rms = PcCalibrateIntrinsics (
+            m_target.CreateInputArray ( (unsigned int)views.size () ),
+            views,
+            result.FrameSize,
+            result.CameraMatrix,
+            result.DistCoeffs,
+            false,
+            result.Deviations
+        );
+    } catch ( cv::Exception const& e ) {
+        std::cout << "Calibration of camera " << result.CameraId << " failed: " << e.what () << std::endl;
+        result.Rms = -1.0;
+    }
+}
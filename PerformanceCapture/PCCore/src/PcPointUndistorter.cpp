@@ -0,0 +1,275 @@
+#include "PcPointUndistorter.h"
+
+#include "PcImageFilters.h"
+
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(PCC_USE_SSE2)
+#include <emmintrin.h>
+#endif
+
+using namespace pcc;
+
+// The spacing of the grid nodes, in pixels. The interpolation error grows with its square, and stays well within the
+// convergence basin of the Newton step for any realistic lens.
+static float const GRID_SPACING = 32.0f;
+
+// The number of grid cells past each border of the frame, for the points detected right on the border.
+static int const GRID_MARGIN = 1;
+
+// The Newton iterations allowed to solve a grid node, and the squared step at which it converged.
+static int const MAX_SOLVE_ITERATIONS = 20;
+static double const SOLVE_EPSILON = 1e-24;
+
+/// \brief Moves an undistorted estimate by one Newton step towards the inverse of the distortion model.
+///
+/// The model is the rational model of cv::calibrateCamera, without the thin prism and tilt terms.
+///
+/// \param [in]    iCoeffs      the distortion coefficients, k1, k2, p1, p2, k3, k4, k5, k6
+/// \param [in]    iTargetX     the distorted point, in normalized coordinates
+/// \param [in]    iTargetY     the distorted point, in normalized coordinates
+/// \param [inout] ioX          the undistorted estimate, in normalized coordinates
+/// \param [inout] ioY          the undistorted estimate, in normalized coordinates
+template <typename T>
+static inline void NewtonStep ( T const* iCoeffs, T const& iTargetX, T const& iTargetY, T& ioX, T& ioY )
+{
+    T const x = ioX, y = ioY;
+    T const xx = x * x, yy = y * y, xy = x * y;
+    T const r2 = xx + yy;
+    T const a = T ( 1 ) + r2 * ( iCoeffs[0] + r2 * ( iCoeffs[1] + r2 * iCoeffs[4] ) );
+    T const b = T ( 1 ) + r2 * ( iCoeffs[5] + r2 * ( iCoeffs[6] + r2 * iCoeffs[7] ) );
+    T const da = iCoeffs[0] + r2 * ( T ( 2 ) * iCoeffs[1] + r2 * T ( 3 ) * iCoeffs[4] );
+    T const db = iCoeffs[5] + r2 * ( T ( 2 ) * iCoeffs[6] + r2 * T ( 3 ) * iCoeffs[7] );
+    T const invB = T ( 1 ) / b;
+    T const c = a * invB;
+    T const dc = T ( 2 ) * ( da - c * db ) * invB;     // The derivative of c along r2, times 2.
+    T const p1 = iCoeffs[2], p2 = iCoeffs[3];
+
+    T const ex = x * c + T ( 2 ) * p1 * xy + p2 * ( r2 + T ( 2 ) * xx ) - iTargetX;
+    T const ey = y * c + p1 * ( r2 + T ( 2 ) * yy ) + T ( 2 ) * p2 * xy - iTargetY;
+    T const jxx = c + xx * dc + T ( 2 ) * p1 * y + T ( 6 ) * p2 * x;
+    T const jxy = xy * dc + T ( 2 ) * ( p1 * x + p2 * y );
+    T const jyy = c + yy * dc + T ( 6 ) * p1 * y + T ( 2 ) * p2 * x;
+    T const invDet = T ( 1 ) / ( jxx * jyy - jxy * jxy );
+
+    ioX = x - ( jyy * ex - jxy * ey ) * invDet;
+    ioY = y - ( jxx * ey - jxy * ex ) * invDet;
+}
+
+// ----------------------------------------------------------------------
+// PcPointUndistorter
+// ----------------------------------------------------------------------
+// Public
+PcPointUndistorter::PcPointUndistorter ( cv::Mat const& iCameraMatrix, cv::Mat const& iDistCoeffs, cv::Size const& iFrameSize )
+    :   m_cameraMatrix ()
+    ,   m_distCoeffs ()
+    ,   m_hasGrid ( true )
+    ,   m_skew ( 0.0f )
+    ,   m_invSpacing ( 1.0f / GRID_SPACING )
+    ,   m_cols ( 0 )
+    ,   m_rows ( 0 )
+    ,   m_grid ()
+{
+    iCameraMatrix.convertTo ( m_cameraMatrix, CV_64F );
+    if ( !iDistCoeffs.empty () ) {
+        iDistCoeffs.reshape ( 1, (int)iDistCoeffs.total () ).convertTo ( m_distCoeffs, CV_64F );
+    }
+
+    for ( int k = 0; k < 8; k++ ) {
+        m_model[k] = ( k < m_distCoeffs.rows ) ? m_distCoeffs.at<double> ( k ) : 0.0;
+        m_coeffs[k] = (float)m_model[k];
+    }
+    for ( int k = 8; k < m_distCoeffs.rows; k++ ) {
+        m_hasGrid = m_hasGrid && ( m_distCoeffs.at<double> ( k ) == 0.0 );
+    }
+
+    double const fx = m_cameraMatrix.at<double> ( 0, 0 );
+    double const fy = m_cameraMatrix.at<double> ( 1, 1 );
+    double const cx = m_cameraMatrix.at<double> ( 0, 2 );
+    double const cy = m_cameraMatrix.at<double> ( 1, 2 );
+    double const skew = m_cameraMatrix.at<double> ( 0, 1 );
+    m_focal[0] = (float)fx;
+    m_focal[1] = (float)fy;
+    m_center[0] = (float)cx;
+    m_center[1] = (float)cy;
+    m_skew = (float)skew;
+    if ( !m_hasGrid || iFrameSize.width <= 0 || iFrameSize.height <= 0 ) {
+        m_hasGrid = false;
+        return;
+    }
+
+    m_origin[0] = -GRID_MARGIN * GRID_SPACING;
+    m_origin[1] = -GRID_MARGIN * GRID_SPACING;
+    m_cols = (int)std::ceil ( iFrameSize.width / GRID_SPACING ) + 2 * GRID_MARGIN + 1;
+    m_rows = (int)std::ceil ( iFrameSize.height / GRID_SPACING ) + 2 * GRID_MARGIN + 1;
+    m_grid.resize ( 2u * m_cols * m_rows );
+    for ( int r = 0; r < m_rows; r++ ) {
+        double const y = ( m_origin[1] + r * GRID_SPACING - cy ) / fy;
+        for ( int c = 0; c < m_cols; c++ ) {
+            double const x = ( m_origin[0] + c * GRID_SPACING - cx - skew * y ) / fx;
+            double ux, uy;
+            Solve ( x, y, ux, uy );
+            m_grid[2 * ( r * m_cols + c )] = (float)ux;
+            m_grid[2 * ( r * m_cols + c ) + 1] = (float)uy;
+        }
+    }
+}
+void PcPointUndistorter::Undistort ( VEC(cv::Point2f) const& iPoints, VEC(cv::Point2f)& oPoints, bool const& iIsPixels ) const
+{
+    if ( !m_hasGrid ) {
+        VEC(cv::Point2f) points;
+        if ( iIsPixels ) {
+            cv::undistortPoints ( iPoints, points, m_cameraMatrix, m_distCoeffs, cv::noArray (), m_cameraMatrix );
+        } else {
+            cv::undistortPoints ( iPoints, points, m_cameraMatrix, m_distCoeffs );
+        }
+        oPoints.swap ( points );
+        return;
+    }
+
+    oPoints.resize ( iPoints.size () );
+    if ( !iPoints.empty () ) {
+        UndistortRange ( &iPoints[0], &oPoints[0], iPoints.size (), iIsPixels );
+    }
+}
+
+// Private
+void PcPointUndistorter::Solve ( double const& iX, double const& iY, double& oX, double& oY ) const
+{
+    oX = iX;
+    oY = iY;
+    for ( int i = 0; i < MAX_SOLVE_ITERATIONS; i++ ) {
+        double const x = oX, y = oY;
+        NewtonStep ( m_model, iX, iY, oX, oY );
+        if ( ( oX - x ) * ( oX - x ) + ( oY - y ) * ( oY - y ) < SOLVE_EPSILON ) {
+            break;
+        }
+    }
+}
+void PcPointUndistorter::UndistortRange ( cv::Point2f const* iPoints, cv::Point2f* oPoints, size_t const& iCount, bool const& iIsPixels ) const
+{
+    // The distorted points are normalized as ( u - cx - skew * y ) / fx and ( v - cy ) / fy.
+    float const invFx = 1.0f / m_focal[0];
+    float const invFy = 1.0f / m_focal[1];
+    float const skewX = m_skew * invFx;
+    float const maxCol = (float)( m_cols - 2 );
+    float const maxRow = (float)( m_rows - 2 );
+    float const* grid = &m_grid[0];
+
+    size_t p = 0u;
+#if defined(PCC_USE_SSE2)
+    // 4 points per iteration. The two rows of the grid cell of a point are loaded as two pairs of nodes, and
+    // transposed across the 4 points into a register per coordinate of each node.
+    __m128 const originX = _mm_set1_ps ( m_origin[0] ), originY = _mm_set1_ps ( m_origin[1] );
+    __m128 const invSpacing = _mm_set1_ps ( m_invSpacing );
+    __m128 const zero = _mm_setzero_ps ();
+    __m128 const colLimit = _mm_set1_ps ( maxCol ), rowLimit = _mm_set1_ps ( maxRow );
+    __m128 const one = _mm_set1_ps ( 1.0f ), two = _mm_set1_ps ( 2.0f ), three = _mm_set1_ps ( 3.0f ), six = _mm_set1_ps ( 6.0f );
+    __m128 const k1 = _mm_set1_ps ( m_coeffs[0] ), k2 = _mm_set1_ps ( m_coeffs[1] ), k3 = _mm_set1_ps ( m_coeffs[4] );
+    __m128 const k4 = _mm_set1_ps ( m_coeffs[5] ), k5 = _mm_set1_ps ( m_coeffs[6] ), k6 = _mm_set1_ps ( m_coeffs[7] );
+    __m128 const p1 = _mm_set1_ps ( m_coeffs[2] ), p2 = _mm_set1_ps ( m_coeffs[3] );
+    __m128 const fx = _mm_set1_ps ( m_focal[0] ), fy = _mm_set1_ps ( m_focal[1] );
+    __m128 const cx = _mm_set1_ps ( m_center[0] ), cy = _mm_set1_ps ( m_center[1] );
+    __m128 const skew = _mm_set1_ps ( m_skew );
+    __m128 const normX = _mm_set1_ps ( invFx ), normY = _mm_set1_ps ( invFy ), normSkew = _mm_set1_ps ( skewX );
+    for ( ; p + 4 <= iCount; p += 4 ) {
+        __m128 const lo = _mm_loadu_ps ( &iPoints[p].x );
+        __m128 const hi = _mm_loadu_ps ( &iPoints[p + 2].x );
+        __m128 const u = _mm_shuffle_ps ( lo, hi, _MM_SHUFFLE ( 2, 0, 2, 0 ) );
+        __m128 const v = _mm_shuffle_ps ( lo, hi, _MM_SHUFFLE ( 3, 1, 3, 1 ) );
+
+        // The grid cell, clamped to the grid, and the position within it, extrapolated past the border cells.
+        __m128 const gx = _mm_mul_ps ( _mm_sub_ps ( u, originX ), invSpacing );
+        __m128 const gy = _mm_mul_ps ( _mm_sub_ps ( v, originY ), invSpacing );
+        __m128i const col = _mm_cvttps_epi32 ( _mm_min_ps ( _mm_max_ps ( gx, zero ), colLimit ) );
+        __m128i const row = _mm_cvttps_epi32 ( _mm_min_ps ( _mm_max_ps ( gy, zero ), rowLimit ) );
+        __m128 const wx = _mm_sub_ps ( gx, _mm_cvtepi32_ps ( col ) );
+        __m128 const wy = _mm_sub_ps ( gy, _mm_cvtepi32_ps ( row ) );
+
+        int cols[4], rows[4];
+        _mm_storeu_si128 ( (__m128i*)cols, col );
+        _mm_storeu_si128 ( (__m128i*)rows, row );
+        __m128 top[4], bottom[4];
+        for ( int i = 0; i < 4; i++ ) {
+            float const* node = grid + 2 * ( rows[i] * m_cols + cols[i] );
+            top[i] = _mm_loadu_ps ( node );
+            bottom[i] = _mm_loadu_ps ( node + 2 * m_cols );
+        }
+        _MM_TRANSPOSE4_PS ( top[0], top[1], top[2], top[3] );
+        _MM_TRANSPOSE4_PS ( bottom[0], bottom[1], bottom[2], bottom[3] );
+
+        __m128 const tx = _mm_add_ps ( top[0], _mm_mul_ps ( wx, _mm_sub_ps ( top[2], top[0] ) ) );
+        __m128 const ty = _mm_add_ps ( top[1], _mm_mul_ps ( wx, _mm_sub_ps ( top[3], top[1] ) ) );
+        __m128 const bx = _mm_add_ps ( bottom[0], _mm_mul_ps ( wx, _mm_sub_ps ( bottom[2], bottom[0] ) ) );
+        __m128 const by = _mm_add_ps ( bottom[1], _mm_mul_ps ( wx, _mm_sub_ps ( bottom[3], bottom[1] ) ) );
+        __m128 const x = _mm_add_ps ( tx, _mm_mul_ps ( wy, _mm_sub_ps ( bx, tx ) ) );
+        __m128 const y = _mm_add_ps ( ty, _mm_mul_ps ( wy, _mm_sub_ps ( by, ty ) ) );
+
+        // The Newton step, as in NewtonStep.
+        __m128 const targetY = _mm_mul_ps ( _mm_sub_ps ( v, cy ), normY );
+        __m128 const targetX = _mm_sub_ps ( _mm_mul_ps ( _mm_sub_ps ( u, cx ), normX ), _mm_mul_ps ( normSkew, targetY ) );
+        __m128 const xx = _mm_mul_ps ( x, x ), yy = _mm_mul_ps ( y, y ), xy = _mm_mul_ps ( x, y );
+        __m128 const r2 = _mm_add_ps ( xx, yy );
+        __m128 const a = _mm_add_ps ( one, _mm_mul_ps ( r2, _mm_add_ps ( k1, _mm_mul_ps ( r2, _mm_add_ps ( k2, _mm_mul_ps ( r2, k3 ) ) ) ) ) );
+        __m128 const b = _mm_add_ps ( one, _mm_mul_ps ( r2, _mm_add_ps ( k4, _mm_mul_ps ( r2, _mm_add_ps ( k5, _mm_mul_ps ( r2, k6 ) ) ) ) ) );
+        __m128 const da = _mm_add_ps ( k1, _mm_mul_ps ( r2, _mm_add_ps ( _mm_mul_ps ( two, k2 ), _mm_mul_ps ( _mm_mul_ps ( r2, three ), k3 ) ) ) );
+        __m128 const db = _mm_add_ps ( k4, _mm_mul_ps ( r2, _mm_add_ps ( _mm_mul_ps ( two, k5 ), _mm_mul_ps ( _mm_mul_ps ( r2, three ), k6 ) ) ) );
+        __m128 const invB = _mm_div_ps ( one, b );
+        __m128 const c = _mm_mul_ps ( a, invB );
+        __m128 const dc = _mm_mul_ps ( _mm_mul_ps ( two, _mm_sub_ps ( da, _mm_mul_ps ( c, db ) ) ), invB );
+
+        __m128 const ex = _mm_sub_ps ( _mm_add_ps ( _mm_add_ps ( _mm_mul_ps ( x, c ), _mm_mul_ps ( _mm_mul_ps ( two, p1 ), xy ) ),
+                                                    _mm_mul_ps ( p2, _mm_add_ps ( r2, _mm_mul_ps ( two, xx ) ) ) ), targetX );
+        __m128 const ey = _mm_sub_ps ( _mm_add_ps ( _mm_add_ps ( _mm_mul_ps ( y, c ), _mm_mul_ps ( p1, _mm_add_ps ( r2, _mm_mul_ps ( two, yy ) ) ) ),
+                                                    _mm_mul_ps ( _mm_mul_ps ( two, p2 ), xy ) ), targetY );
+        __m128 const jxx = _mm_add_ps ( _mm_add_ps ( c, _mm_mul_ps ( xx, dc ) ),
+                                        _mm_add_ps ( _mm_mul_ps ( _mm_mul_ps ( two, p1 ), y ), _mm_mul_ps ( _mm_mul_ps ( six, p2 ), x ) ) );
+        __m128 const jxy = _mm_add_ps ( _mm_mul_ps ( xy, dc ), _mm_mul_ps ( two, _mm_add_ps ( _mm_mul_ps ( p1, x ), _mm_mul_ps ( p2, y ) ) ) );
+        __m128 const jyy = _mm_add_ps ( _mm_add_ps ( c, _mm_mul_ps ( yy, dc ) ),
+                                        _mm_add_ps ( _mm_mul_ps ( _mm_mul_ps ( six, p1 ), y ), _mm_mul_ps ( _mm_mul_ps ( two, p2 ), x ) ) );
+        __m128 const invDet = _mm_div_ps ( one, _mm_sub_ps ( _mm_mul_ps ( jxx, jyy ), _mm_mul_ps ( jxy, jxy ) ) );
+        __m128 ox = _mm_sub_ps ( x, _mm_mul_ps ( _mm_sub_ps ( _mm_mul_ps ( jyy, ex ), _mm_mul_ps ( jxy, ey ) ), invDet ) );
+        __m128 oy = _mm_sub_ps ( y, _mm_mul_ps ( _mm_sub_ps ( _mm_mul_ps ( jxx, ey ), _mm_mul_ps ( jxy, ex ) ), invDet ) );
+
+        if ( iIsPixels ) {
+            ox = _mm_add_ps ( _mm_add_ps ( _mm_mul_ps ( fx, ox ), _mm_mul_ps ( skew, oy ) ), cx );
+            oy = _mm_add_ps ( _mm_mul_ps ( fy, oy ), cy );
+        }
+        _mm_storeu_ps ( &oPoints[p].x, _mm_unpacklo_ps ( ox, oy ) );
+        _mm_storeu_ps ( &oPoints[p + 2].x, _mm_unpackhi_ps ( ox, oy ) );
+    }
+#endif
+    for ( ; p < iCount; p++ ) {
+        float const u = iPoints[p].x, v = iPoints[p].y;
+        float const gx = ( u - m_origin[0] ) * m_invSpacing;
+        float const gy = ( v - m_origin[1] ) * m_invSpacing;
+        int const col = (int)std::min ( std::max ( gx, 0.0f ), maxCol );
+        int const row = (int)std::min ( std::max ( gy, 0.0f ), maxRow );
+        float const wx = gx - col;
+        float const wy = gy - row;
+
+        float const* top = grid + 2 * ( row * m_cols + col );
+        float const* bottom = top + 2 * m_cols;
+        float const tx = top[0] + wx * ( top[2] - top[0] );
+        float const ty = top[1] + wx * ( top[3] - top[1] );
+        float const bx = bottom[0] + wx * ( bottom[2] - bottom[0] );
+        float const by = bottom[1] + wx * ( bottom[3] - bottom[1] );
+        float x = tx + wy * ( bx - tx );
+        float y = ty + wy * ( by - ty );
+
+        float const targetY = ( v - m_center[1] ) * invFy;
+        float const targetX = ( u - m_center[0] ) * invFx - skewX * targetY;
+        NewtonStep ( m_coeffs, targetX, targetY, x, y );
+
+        if ( iIsPixels ) {
+            oPoints[p].x = m_focal[0] * x + m_skew * y + m_center[0];
+            oPoints[p].y = m_focal[1] * y + m_center[1];
+        } else {
+            oPoints[p].x = x;
+            oPoints[p].y = y;
+        }
+    }
+}
@@ -0,0 +1,455 @@
+#include "PcRecorder.h"
+
+#include "PcCommon.h"
+#include "PcImageFilters.h"
+
+#define BOOST_ALL_DYN_LINK
+#include <boost/chrono.hpp>
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace pcc;
+
+// Weight of the latest measurement in the throughput moving average.
+static double const THROUGHPUT_SMOOTHING = 0.2;
+
+// Throughput assumed for a target before anything has been written to it, in bytes per second.
+static double const INITIAL_THROUGHPUT = 500.0 * 1024.0 * 1024.0;
+
+// Number of journal entries buffered before the journal is flushed.
+static unsigned int const JOURNAL_FLUSH_INTERVAL = 32u;
+
+// ----------------------------------------------------------------------
+// PcRecordingStripe
+// ----------------------------------------------------------------------
+// Public
+PcRecordingStripe::PcRecordingStripe (
+    std::string const&      iDirectory,
+    std::string const&      iTakeName,
+    unsigned int const&     iIndex,
+    unsigned int const&     iCapacity,
+    unsigned int const&     iScale
+)   :   m_mutex ()
+    ,   m_condition ()
+    ,   m_thread ( (boost::thread*)0x0 )
+    ,   m_directory ( iDirectory )
+    ,   m_path ()
+    ,   m_index ( iIndex )
+    ,   m_scale ( iScale )
+    ,   m_scaled ()
+    ,   m_file ( (FILE*)0x0 )
+    ,   m_journal ( (FILE*)0x0 )
+    ,   m_offset ( 0u )
+    ,   m_queue ()
+    ,   m_capacity ( iCapacity )
+    ,   m_throughput ( INITIAL_THROUGHPUT )
+    ,   m_isOpen ( false )
+    ,   m_hasFailed ( false )
+{
+    std::stringstream sFile;
+    if ( m_scale > 1 ) {
+        sFile << iTakeName << PCC_PROXY_SUFFIX << PCC_STRIPE_EXTENSION;
+    } else {
+        sFile << iTakeName << "." << iIndex << PCC_STRIPE_EXTENSION;
+    }
+    m_path = ( boost::filesystem::path ( iDirectory ) / sFile.str () ).string ();
+}
+PcRecordingStripe::~PcRecordingStripe ()
+{
+    Close ();
+}
+bool PcRecordingStripe::Open ()
+{
+    boost::system::error_code err;
+    boost::filesystem::create_directories ( m_directory, err );
+
+    m_file = fopen ( m_path.c_str (), "wb" );
+    if ( !m_file ) {
+        std::cout << "Error opening recording stripe " << m_path << std::endl;
+        return false;
+    }
+    m_journal = fopen ( GetJournalPath ().c_str (), "wb" );
+    if ( !m_journal ) {
+        std::cout << "Error opening recording journal " << GetJournalPath () << std::endl;
+        fclose ( m_file );
+        m_file = (FILE*)0x0;
+        return false;
+    }
+
+    m_offset = 0u;
+    m_isOpen = true;
+    m_thread = new boost::thread ( boost::bind ( &PcRecordingStripe::Process, this ) );
+    return true;
+}
+void PcRecordingStripe::Close ()
+{
+    {
+        GuardType lock ( m_mutex );
+        m_isOpen = false;
+    }
+    m_condition.notify_all ();
+
+    if ( m_thread ) {
+        m_thread->join ();
+    }
+    PCC_OBJ_FREE ( m_thread );
+
+    if ( m_file ) {
+        PcFileSync ( m_file );
+        fclose ( m_file );
+        m_file = (FILE*)0x0;
+    }
+    if ( m_journal ) {
+        PcFileSync ( m_journal );
+        fclose ( m_journal );
+        m_journal = (FILE*)0x0;
+    }
+}
+bool PcRecordingStripe::TryPush ( PcRecordingChunkPtr const& iChunk )
+{
+    {
+        GuardType lock ( m_mutex );
+
+        if ( !m_isOpen || m_hasFailed || m_queue.size () >= m_capacity ) {
+            return false;
+        }
+        m_queue.push_back ( iChunk );
+    }
+    m_condition.notify_one ();
+    return true;
+}
+double PcRecordingStripe::GetWeight ()
+{
+    GuardType lock ( m_mutex );
+
+    if ( !m_isOpen || m_hasFailed ) {
+        return 0.0;
+    }
+    double const fill = (double)m_queue.size () / (double)m_capacity;
+    return m_throughput * ( 1.0 - fill );
+}
+
+// Private
+void PcRecordingStripe::Process ()
+{
+    typedef boost::chrono::steady_clock ClockType;
+
+    PcIndexEntry entry;
+    entry.Stripe    = (boost::uint16_t)m_index;
+    entry.Reserved  = 0u;
+
+    unsigned int pending = 0u;
+    for (;;) {
+        PcRecordingChunkPtr chunk;
+        {
+            LockType lock ( m_mutex );
+            while ( m_isOpen && m_queue.empty () ) {
+                m_condition.wait ( lock );
+            }
+            if ( m_queue.empty () ) {
+                return;
+            }
+            chunk = m_queue.front ();
+            m_queue.pop_front ();
+        }
+
+        ClockType::time_point const start = ClockType::now ();
+
+        // The chunk may be shared with another stripe, so a proxy writes a downscaled copy of it.
+        PcChunkHeader header = chunk->Header;
+        unsigned char const* data = chunk->Data.empty () ? (unsigned char const*)0x0 : &chunk->Data[0];
+        if ( m_scale > 1 && data ) {
+            cv::Mat const full ( header.Height, header.Width, CV_8UC(header.Channels), (void*)data );
+            PcBoxDownscale ( full, m_scale, m_scaled );
+            header.Width        = m_scaled.cols;
+            header.Height       = m_scaled.rows;
+            header.PayloadSize  = (boost::uint32_t)( m_scaled.total () * m_scaled.elemSize () );
+            data = m_scaled.data;
+        }
+
+        size_t const size = header.PayloadSize;
+        bool ok = ( fwrite ( &header, sizeof ( PcChunkHeader ), 1, m_file ) == 1 );
+        ok = ok && ( size == 0 || fwrite ( data, size, 1, m_file ) == 1 );
+        ok = ok && ( fflush ( m_file ) == 0 );
+
+        // The journal entry goes out after its chunk, so a journal never points past the end of its stripe.
+        entry.Timestamp = header.Timestamp;
+        entry.FrameId   = header.FrameId;
+        entry.Sequence  = header.Sequence;
+        entry.Offset    = m_offset;
+        entry.Camera    = header.Camera;
+        ok = ok && ( fwrite ( &entry, sizeof ( PcIndexEntry ), 1, m_journal ) == 1 );
+        if ( ok && ++pending >= JOURNAL_FLUSH_INTERVAL ) {
+            ok = ( fflush ( m_journal ) == 0 );
+            pending = 0u;
+        }
+        m_offset += sizeof ( PcChunkHeader ) + size;
+
+        double const seconds = boost::chrono::duration<double> ( ClockType::now () - start ).count ();
+
+        GuardType lock ( m_mutex );
+        if ( !ok ) {
+            std::cout << "Error writing recording stripe " << m_path << ", target disabled." << std::endl;
+            m_hasFailed = true;
+            m_queue.clear ();
+            return;
+        }
+        if ( seconds > 0.0 ) {
+            double const rate = (double)( sizeof ( PcChunkHeader ) + size ) / seconds;
+            m_throughput = THROUGHPUT_SMOOTHING * rate + ( 1.0 - THROUGHPUT_SMOOTHING ) * m_throughput;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------
+// PcRecorder
+// ----------------------------------------------------------------------
+// Public
+PcRecorder::PcRecorder (
+    std::string const&          iTakeName,
+    VEC(std::string) const&     iTargets,
+    unsigned int const&         iQueueCapacity,
+    unsigned int const&         iProxyScale
+)   :   m_mutex ()
+    ,   m_takeName ( iTakeName )
+    ,   m_targets ( iTargets )
+    ,   m_queueCapacity ( iQueueCapacity )
+    ,   m_proxyScale ( iProxyScale )
+    ,   m_manifestPath ()
+    ,   m_indexPath ()
+    ,   m_proxyIndexPath ()
+    ,   m_stripes ()
+    ,   m_proxy ()
+    ,   m_currentWeights ()
+    ,   m_cameraIndices ()
+    ,   m_cameraIds ()
+    ,   m_isRecording ( false )
+    ,   m_sequence ( 0u )
+    ,   m_spilled ( 0u )
+    ,   m_dropped ( 0u )
+    ,   m_proxyDropped ( 0u )
+{
+    if ( !m_targets.empty () ) {
+        m_manifestPath = ( boost::filesystem::path ( m_targets.front () ) / ( m_takeName + PCC_TAKE_EXTENSION ) ).string ();
+    }
+}
+PcRecorder::~PcRecorder ()
+{
+    Stop ();
+}
+bool PcRecorder::Start ()
+{
+    GuardType lock ( m_mutex );
+
+    if ( m_isRecording ) {
+        return true;
+    }
+
+    for ( unsigned int i = 0; i < m_targets.size (); i++ ) {
+        // Stripes are numbered among the opened ones, so that the journals match the manifest order.
+        PcRecordingStripePtr stripe ( new PcRecordingStripe ( m_targets[i], m_takeName, m_stripes.size (), m_queueCapacity ) );
+        if ( stripe->Open () ) {
+            m_stripes.push_back ( stripe );
+        }
+    }
+    m_currentWeights.assign ( m_stripes.size (), 0.0 );
+
+    if ( m_proxyScale > 1 && !m_stripes.empty () ) {
+        m_proxy.reset ( new PcRecordingStripe ( m_targets.front (), m_takeName, 0u, m_queueCapacity, m_proxyScale ) );
+        if ( !m_proxy->Open () ) {
+            std::cout << "Take " << m_takeName << ": recording without proxy stream." << std::endl;
+            m_proxy.reset ();
+        }
+    }
+
+    m_isRecording = !m_stripes.empty () && WriteManifest ();
+    return m_isRecording;
+}
+void PcRecorder::Stop ()
+{
+    VEC(PcRecordingStripePtr) stripes;
+    {
+        GuardType lock ( m_mutex );
+
+        if ( !m_isRecording ) {
+            return;
+        }
+        m_isRecording = false;
+        stripes = m_stripes;
+        if ( m_proxy ) {
+            stripes.push_back ( m_proxy );
+        }
+    }
+
+    // Closing drains every queue, so it happens outside of the routing lock.
+    for ( auto stripe = stripes.begin (); stripe != stripes.end (); stripe++ ) {
+        (*stripe)->Close ();
+    }
+
+    GuardType lock ( m_mutex );
+
+    boost::filesystem::path const directory = boost::filesystem::path ( m_manifestPath ).parent_path ();
+    std::string const indexPath = ( directory / ( m_takeName + PCC_INDEX_EXTENSION ) ).string ();
+    if ( WriteIndex ( m_stripes, indexPath ) ) {
+        m_indexPath = indexPath;
+    }
+    if ( m_proxy ) {
+        std::string const proxyIndexPath = ( directory / ( m_takeName + PCC_PROXY_SUFFIX + PCC_INDEX_EXTENSION ) ).string ();
+        if ( WriteIndex ( VEC(PcRecordingStripePtr) ( 1, m_proxy ), proxyIndexPath ) ) {
+            m_proxyIndexPath = proxyIndexPath;
+        }
+    }
+    WriteManifest ();
+
+    std::cout   << "Take " << m_takeName << ": " << m_sequence << " frames recorded, "
+                << m_spilled << " spilled, " << m_dropped << " dropped, "
+                << m_proxyDropped << " missing from the proxy stream." << std::endl;
+}
+bool PcRecorder::Record ( std::string const& iCameraId, PcFramePtr const& iFrame )
+{
+    cv::Mat const& image = iFrame->GetImagePoints ();
+
+    // The copy happens before taking the routing lock, so cameras don't wait on each other's memcpy.
+    PcRecordingChunkPtr chunk ( new PcRecordingChunk () );
+    PcChunkHeader& header = chunk->Header;
+    header.Magic        = PcChunkHeader::MAGIC;
+    header.Version      = PcChunkHeader::VERSION;
+    header.FrameId      = iFrame->FrameId ();
+    header.Timestamp    = iFrame->Timestamp ();
+    header.Width        = image.cols;
+    header.Height       = image.rows;
+    header.Channels     = image.channels ();
+    header.PayloadSize  = (boost::uint32_t)( image.total () * image.elemSize () );
+
+    chunk->Data.resize ( header.PayloadSize );
+    if ( image.isContinuous () ) {
+        memcpy ( &chunk->Data[0], image.data, header.PayloadSize );
+    } else {
+        size_t const rowSize = image.cols * image.elemSize ();
+        for ( int r = 0; r < image.rows; r++ ) {
+            memcpy ( &chunk->Data[r * rowSize], image.ptr ( r ), rowSize );
+        }
+    }
+
+    GuardType lock ( m_mutex );
+
+    if ( !m_isRecording ) {
+        return false;
+    }
+    header.Camera   = (boost::uint16_t)GetCameraIndex ( iCameraId );
+    header.Sequence = m_sequence;
+
+    // Smooth weighted round-robin: every stripe earns its weight, the richest one gets the chunk and pays
+    // back the total. Stripes are tried from richest to poorest, so a full queue spills to the next best target.
+    double total = 0.0;
+    for ( unsigned int i = 0; i < m_stripes.size (); i++ ) {
+        double const weight = m_stripes[i]->GetWeight ();
+        m_currentWeights[i] += weight;
+        total += weight;
+    }
+
+    VEC(bool) tried ( m_stripes.size (), false );
+    for ( unsigned int attempt = 0; attempt < m_stripes.size (); attempt++ ) {
+        int best = -1;
+        for ( unsigned int i = 0; i < m_stripes.size (); i++ ) {
+            if ( !tried[i] && ( best < 0 || m_currentWeights[i] > m_currentWeights[best] ) ) {
+                best = i;
+            }
+        }
+        tried[best] = true;
+
+        if ( m_stripes[best]->TryPush ( chunk ) ) {
+            m_currentWeights[best] -= total;
+            if ( attempt > 0 ) {
+                m_spilled++;
+            }
+            if ( m_proxy && !m_proxy->TryPush ( chunk ) ) {
+                m_proxyDropped++;
+            }
+            m_sequence++;
+            return true;
+        }
+    }
+
+    m_dropped++;
+    return false;
+}
+boost::uint64_t PcRecorder::GetRecordedFrames ()
+{
+    GuardType lock ( m_mutex );
+    return m_sequence;
+}
+boost::uint64_t PcRecorder::GetSpilledFrames ()
+{
+    GuardType lock ( m_mutex );
+    return m_spilled;
+}
+boost::uint64_t PcRecorder::GetDroppedFrames ()
+{
+    GuardType lock ( m_mutex );
+    return m_dropped;
+}
+boost::uint64_t PcRecorder::GetDroppedProxyFrames ()
+{
+    GuardType lock ( m_mutex );
+    return m_proxyDropped;
+}
+
+// Private
+unsigned int PcRecorder::GetCameraIndex ( std::string const& iCameraId )
+{
+    auto index = m_cameraIndices.find ( iCameraId );
+    if ( index != m_cameraIndices.end () ) {
+        return index->second;
+    }
+
+    unsigned int const newIndex = m_cameraIds.size ();
+    m_cameraIndices.insert ( std::make_pair ( iCameraId, newIndex ) );
+    m_cameraIds.push_back ( iCameraId );
+    return newIndex;
+}
+bool PcRecorder::WriteManifest ()
+{
+    std::ofstream manifest ( m_manifestPath.c_str (), std::ios::out | std::ios::trunc );
+    if ( !manifest.is_open () ) {
+        std::cout << "Error writing take manifest " << m_manifestPath << std::endl;
+        return false;
+    }
+
+    manifest << "PCTAKE 1" << std::endl;
+    manifest << "take " << m_takeName << std::endl;
+    for ( auto stripe = m_stripes.begin (); stripe != m_stripes.end (); stripe++ ) {
+        manifest << "stripe " << (*stripe)->GetPath () << std::endl;
+    }
+    for ( auto camera = m_cameraIds.begin (); camera != m_cameraIds.end (); camera++ ) {
+        manifest << "camera " << *camera << std::endl;
+    }
+    if ( m_proxy ) {
+        manifest << "proxy " << m_proxy->GetPath () << std::endl;
+    }
+    if ( !m_indexPath.empty () ) {
+        manifest << "index " << m_indexPath << std::endl;
+    }
+    if ( !m_proxyIndexPath.empty () ) {
+        manifest << "proxyindex " << m_proxyIndexPath << std::endl;
+    }
+    return manifest.good ();
+}
+bool PcRecorder::WriteIndex ( VEC(PcRecordingStripePtr) const& iStripes, std::string const& iPath )
+{
+    VEC(PcIndexEntry) entries;
+    entries.reserve ( (size_t)m_sequence );
+    for ( auto stripe = iStripes.begin (); stripe != iStripes.end (); stripe++ ) {
+        if ( !PcRecordingIndex::ReadJournal ( (*stripe)->GetJournalPath (), entries ) ) {
+            std::cout << "Error reading recording journal " << (*stripe)->GetJournalPath () << std::endl;
+            return false;
+        }
+    }
+
+    PcRecordingIndex index;
+    index.Build ( entries, m_cameraIds.size (), PCC_FRAME_SET_TOLERANCE );
+    return index.Save ( iPath );
+}
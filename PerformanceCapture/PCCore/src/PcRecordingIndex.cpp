@@ -0,0 +1,199 @@
+#include "PcRecordingIndex.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+using namespace pcc;
+
+// "PCX1" in little-endian order.
+static boost::uint32_t const INDEX_MAGIC = 0x31584350u;
+
+/// \brief Orders index entries by timestamp, then by sequence number.
+static bool CompareTimestamp ( PcIndexEntry const& iLeft, PcIndexEntry const& iRight )
+{
+    if ( iLeft.Timestamp != iRight.Timestamp ) {
+        return iLeft.Timestamp < iRight.Timestamp;
+    }
+    return iLeft.Sequence < iRight.Sequence;
+}
+
+/// \brief Orders index entries by frame ID, for binary searches only.
+static bool CompareFrameId ( PcIndexEntry const& iLeft, PcIndexEntry const& iRight )
+{
+    return iLeft.FrameId < iRight.FrameId;
+}
+
+/// \brief Writes an array to a file, returning false upon failure.
+template<typename T>
+static bool WriteArray ( FILE* iFile, T const* iData, size_t const& iCount )
+{
+    return ( iCount == 0 || fwrite ( iData, sizeof ( T ), iCount, iFile ) == iCount );
+}
+
+/// \brief Reads an array from a file, returning false upon failure.
+template<typename T>
+static bool ReadArray ( FILE* iFile, T* oData, size_t const& iCount )
+{
+    return ( iCount == 0 || fread ( oData, sizeof ( T ), iCount, iFile ) == iCount );
+}
+
+// ----------------------------------------------------------------------
+// PcRecordingIndex
+// ----------------------------------------------------------------------
+// Public
+boost::uint32_t const PcRecordingIndex::NO_FRAME;
+
+PcRecordingIndex::PcRecordingIndex ()
+    :   m_cameras ()
+    ,   m_setTimestamps ()
+    ,   m_setFrames ()
+{}
+void PcRecordingIndex::Build (
+    VEC(PcIndexEntry) const&    iEntries,
+    unsigned int const&         iCameraCount,
+    boost::uint64_t const&      iSetTolerance
+) {
+    VECOFVECS(PcIndexEntry) ( iCameraCount ).swap ( m_cameras );
+    VEC(boost::uint64_t) ().swap ( m_setTimestamps );
+    VEC(boost::uint32_t) ().swap ( m_setFrames );
+
+    for ( auto entry = iEntries.begin (); entry != iEntries.end (); entry++ ) {
+        if ( entry->Camera < iCameraCount ) {
+            m_cameras[entry->Camera].push_back ( *entry );
+        }
+    }
+    for ( auto camera = m_cameras.begin (); camera != m_cameras.end (); camera++ ) {
+        std::sort ( camera->begin (), camera->end (), CompareTimestamp );
+    }
+
+    // Merge the cameras in timestamp order. A frame joins the open set if it is close enough to the set's first
+    // frame and its camera isn't in the set yet, otherwise it opens a new set.
+    VEC(size_t) next ( iCameraCount, 0u );
+    for (;;) {
+        int camera = -1;
+        for ( unsigned int c = 0; c < iCameraCount; c++ ) {
+            if ( next[c] < m_cameras[c].size () && ( camera < 0 ||
+                m_cameras[c][next[c]].Timestamp < m_cameras[camera][next[camera]].Timestamp ) ) {
+                camera = c;
+            }
+        }
+        if ( camera < 0 ) {
+            break;
+        }
+
+        boost::uint64_t const timestamp = m_cameras[camera][next[camera]].Timestamp;
+        bool const isOpen = !m_setTimestamps.empty ();
+        size_t const row = ( m_setTimestamps.size () - 1 ) * iCameraCount;
+        if (    !isOpen
+            ||  timestamp - m_setTimestamps.back () > iSetTolerance
+            ||  m_setFrames[row + camera] != NO_FRAME ) {
+            m_setTimestamps.push_back ( timestamp );
+            m_setFrames.resize ( m_setFrames.size () + iCameraCount, NO_FRAME );
+        }
+        m_setFrames[( m_setTimestamps.size () - 1 ) * iCameraCount + camera] = (boost::uint32_t)next[camera];
+        next[camera]++;
+    }
+}
+bool PcRecordingIndex::Save ( std::string const& iPath ) const
+{
+    FILE* file = fopen ( iPath.c_str (), "wb" );
+    if ( !file ) {
+        std::cout << "Error writing recording index " << iPath << std::endl;
+        return false;
+    }
+
+    boost::uint32_t const header[] = { INDEX_MAGIC, (boost::uint32_t)m_cameras.size () };
+    bool ok = WriteArray ( file, header, 2 );
+
+    for ( auto camera = m_cameras.begin (); camera != m_cameras.end (); camera++ ) {
+        boost::uint64_t const count = camera->size ();
+        ok = ok && WriteArray ( file, &count, 1 );
+    }
+    for ( auto camera = m_cameras.begin (); camera != m_cameras.end (); camera++ ) {
+        ok = ok && ( camera->empty () || WriteArray ( file, &camera->front (), camera->size () ) );
+    }
+
+    boost::uint64_t const setCount = m_setTimestamps.size ();
+    ok = ok && WriteArray ( file, &setCount, 1 );
+    if ( setCount ) {
+        ok = ok && WriteArray ( file, &m_setTimestamps[0], m_setTimestamps.size () );
+        ok = ok && ( m_setFrames.empty () || WriteArray ( file, &m_setFrames[0], m_setFrames.size () ) );
+    }
+
+    ok = ok && PcFileSync ( file );
+    fclose ( file );
+    return ok;
+}
+bool PcRecordingIndex::Load ( std::string const& iPath )
+{
+    FILE* file = fopen ( iPath.c_str (), "rb" );
+    if ( !file ) {
+        return false;
+    }
+
+    boost::uint32_t header[2];
+    bool ok = ReadArray ( file, header, 2 ) && header[0] == INDEX_MAGIC;
+
+    unsigned int const cameraCount = ok ? header[1] : 0u;
+    VEC(boost::uint64_t) counts ( cameraCount );
+    ok = ok && ( cameraCount == 0 || ReadArray ( file, &counts[0], cameraCount ) );
+
+    VECOFVECS(PcIndexEntry) cameras ( cameraCount );
+    for ( unsigned int c = 0; ok && c < cameraCount; c++ ) {
+        cameras[c].resize ( (size_t)counts[c] );
+        ok = ( cameras[c].empty () || ReadArray ( file, &cameras[c][0], cameras[c].size () ) );
+    }
+
+    boost::uint64_t setCount = 0u;
+    ok = ok && ReadArray ( file, &setCount, 1 );
+
+    VEC(boost::uint64_t) setTimestamps ( ok ? (size_t)setCount : 0u );
+    VEC(boost::uint32_t) setFrames ( ok ? (size_t)setCount * cameraCount : 0u );
+    ok = ok && ( setTimestamps.empty () || ReadArray ( file, &setTimestamps[0], setTimestamps.size () ) );
+    ok = ok && ( setFrames.empty () || ReadArray ( file, &setFrames[0], setFrames.size () ) );
+    fclose ( file );
+
+    if ( ok ) {
+        m_cameras.swap ( cameras );
+        m_setTimestamps.swap ( setTimestamps );
+        m_setFrames.swap ( setFrames );
+    }
+    return ok;
+}
+bool PcRecordingIndex::ReadJournal ( std::string const& iPath, VEC(PcIndexEntry)& oEntries )
+{
+    FILE* file = fopen ( iPath.c_str (), "rb" );
+    if ( !file ) {
+        return false;
+    }
+
+    PcIndexEntry entry;
+    while ( fread ( &entry, sizeof ( PcIndexEntry ), 1, file ) == 1 ) {
+        oEntries.push_back ( entry );
+    }
+    fclose ( file );
+    return true;
+}
+size_t PcRecordingIndex::FindByTimestamp ( unsigned int const& iCamera, boost::uint64_t const& iTimestamp ) const
+{
+    VEC(PcIndexEntry) const& entries = m_cameras[iCamera];
+
+    PcIndexEntry key;
+    key.Timestamp = iTimestamp;
+    key.Sequence = 0u;
+    return std::lower_bound ( entries.begin (), entries.end (), key, CompareTimestamp ) - entries.begin ();
+}
+size_t PcRecordingIndex::FindByFrameId ( unsigned int const& iCamera, boost::uint64_t const& iFrameId ) const
+{
+    // Frame IDs grow with time on each camera, so the timestamp order is also the frame ID order.
+    VEC(PcIndexEntry) const& entries = m_cameras[iCamera];
+
+    PcIndexEntry key;
+    key.FrameId = iFrameId;
+    return std::lower_bound ( entries.begin (), entries.end (), key, CompareFrameId ) - entries.begin ();
+}
+size_t PcRecordingIndex::FindFrameSet ( boost::uint64_t const& iTimestamp ) const
+{
+    return std::lower_bound ( m_setTimestamps.begin (), m_setTimestamps.end (), iTimestamp ) - m_setTimestamps.begin ();
+}
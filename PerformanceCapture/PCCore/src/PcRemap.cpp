@@ -0,0 +1,173 @@
+#include "PcRemap.h"
+
+#include "PcImageFilters.h"
+#include "PcThreadPool.h"
+
+#include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+#if defined(PCC_USE_SSE2)
+#include <emmintrin.h>
+#endif
+
+using namespace pcc;
+
+// The output tile size, small enough for the source rows a tile reads to stay in cache.
+static int const TILE_WIDTH = 256;
+static int const TILE_HEIGHT = 32;
+
+// The fixed-point resolution of the source positions, in bits per axis, as used by cv::convertMaps.
+static int const WEIGHT_BITS = 5;
+static int const WEIGHT_ONE = 1 << WEIGHT_BITS;
+
+/// \brief Reads a source pixel, 0 outside of the image.
+static inline int SamplePixel ( cv::Mat const& iSrc, int const& iX, int const& iY )
+{
+    if ( (unsigned int)iX >= (unsigned int)iSrc.cols || (unsigned int)iY >= (unsigned int)iSrc.rows ) {
+        return 0;
+    }
+    return iSrc.ptr ( iY )[iX];
+}
+
+/// \brief Reads the 2x2 source neighbourhood of an output pixel, top row in oTop and bottom row in oBottom.
+static inline void GatherPixels ( cv::Mat const& iSrc, int const& iX, int const& iY, short* oTop, short* oBottom )
+{
+    if ( (unsigned int)iX < (unsigned int)( iSrc.cols - 1 ) && (unsigned int)iY < (unsigned int)( iSrc.rows - 1 ) ) {
+        unsigned char const* top = iSrc.ptr ( iY ) + iX;
+        unsigned char const* bottom = iSrc.ptr ( iY + 1 ) + iX;
+        oTop[0] = top[0];
+        oTop[1] = top[1];
+        oBottom[0] = bottom[0];
+        oBottom[1] = bottom[1];
+    } else {
+        oTop[0] = (short)SamplePixel ( iSrc, iX, iY );
+        oTop[1] = (short)SamplePixel ( iSrc, iX + 1, iY );
+        oBottom[0] = (short)SamplePixel ( iSrc, iX, iY + 1 );
+        oBottom[1] = (short)SamplePixel ( iSrc, iX + 1, iY + 1 );
+    }
+}
+
+/// \brief Resamples one output tile of a single-channel 8-bit image. Runs as a PcThreadPool::ParallelFor body.
+static void RemapTile ( cv::Mat const* iSrc, PcRemapMap const* iMap, cv::Mat* oDst, int const& iTilesPerRow, size_t const& iTile )
+{
+    int const x0 = (int)( iTile % iTilesPerRow ) * TILE_WIDTH;
+    int const y0 = (int)( iTile / iTilesPerRow ) * TILE_HEIGHT;
+    int const x1 = std::min ( oDst->cols, x0 + TILE_WIDTH );
+    int const y1 = std::min ( oDst->rows, y0 + TILE_HEIGHT );
+
+    for ( int y = y0; y < y1; y++ ) {
+        short const* coordinates = iMap->Coordinates.ptr<short> ( y );
+        unsigned short const* weights = iMap->Weights.ptr<unsigned short> ( y );
+        unsigned char* out = oDst->ptr ( y );
+
+        int x = x0;
+#if defined(PCC_USE_SSE2)
+        // 8 pixels per iteration. The neighbourhoods are gathered as interleaved left/right pairs, so that a
+        // multiply-add against the interleaved horizontal weights blends each row into a 32-bit lane. The two rows
+        // still fit 16-bit lanes, and are interleaved and blended the same way with the vertical weights.
+        __m128i const mask = _mm_set1_epi16 ( WEIGHT_ONE - 1 );
+        __m128i const one = _mm_set1_epi16 ( WEIGHT_ONE );
+        __m128i const half = _mm_set1_epi32 ( 1 << ( 2 * WEIGHT_BITS - 1 ) );
+        for ( ; x + 8 <= x1; x += 8 ) {
+            short top[16], bottom[16];
+            for ( int i = 0; i < 8; i++ ) {
+                GatherPixels ( *iSrc, coordinates[2 * ( x + i )], coordinates[2 * ( x + i ) + 1], top + 2 * i, bottom + 2 * i );
+            }
+
+            __m128i const fractions = _mm_loadu_si128 ( (__m128i const*)( weights + x ) );
+            __m128i const wx = _mm_and_si128 ( fractions, mask );
+            __m128i const wy = _mm_srli_epi16 ( fractions, WEIGHT_BITS );
+            __m128i const wxLo = _mm_unpacklo_epi16 ( _mm_sub_epi16 ( one, wx ), wx );
+            __m128i const wxHi = _mm_unpackhi_epi16 ( _mm_sub_epi16 ( one, wx ), wx );
+            __m128i const wyLo = _mm_unpacklo_epi16 ( _mm_sub_epi16 ( one, wy ), wy );
+            __m128i const wyHi = _mm_unpackhi_epi16 ( _mm_sub_epi16 ( one, wy ), wy );
+
+            __m128i const t = _mm_packs_epi32 ( _mm_madd_epi16 ( _mm_loadu_si128 ( (__m128i const*)top ), wxLo ),
+                                                _mm_madd_epi16 ( _mm_loadu_si128 ( (__m128i const*)( top + 8 ) ), wxHi ) );
+            __m128i const b = _mm_packs_epi32 ( _mm_madd_epi16 ( _mm_loadu_si128 ( (__m128i const*)bottom ), wxLo ),
+                                                _mm_madd_epi16 ( _mm_loadu_si128 ( (__m128i const*)( bottom + 8 ) ), wxHi ) );
+
+            __m128i const lo = _mm_srli_epi32 ( _mm_add_epi32 ( _mm_madd_epi16 ( _mm_unpacklo_epi16 ( t, b ), wyLo ), half ), 2 * WEIGHT_BITS );
+            __m128i const hi = _mm_srli_epi32 ( _mm_add_epi32 ( _mm_madd_epi16 ( _mm_unpackhi_epi16 ( t, b ), wyHi ), half ), 2 * WEIGHT_BITS );
+            __m128i const packed = _mm_packs_epi32 ( lo, hi );
+            _mm_storel_epi64 ( (__m128i*)( out + x ), _mm_packus_epi16 ( packed, packed ) );
+        }
+#endif
+        for ( ; x < x1; x++ ) {
+            short top[2], bottom[2];
+            GatherPixels ( *iSrc, coordinates[2 * x], coordinates[2 * x + 1], top, bottom );
+            int const wx = weights[x] & ( WEIGHT_ONE - 1 );
+            int const wy = weights[x] >> WEIGHT_BITS;
+            int const t = top[0] * ( WEIGHT_ONE - wx ) + top[1] * wx;
+            int const b = bottom[0] * ( WEIGHT_ONE - wx ) + bottom[1] * wx;
+            out[x] = (unsigned char)( ( t * ( WEIGHT_ONE - wy ) + b * wy + ( 1 << ( 2 * WEIGHT_BITS - 1 ) ) ) >> ( 2 * WEIGHT_BITS ) );
+        }
+    }
+}
+
+/// \brief Builds a fixed-point map with cv::initUndistortRectifyMap.
+static PcRemapMapPtr CreateMap ( cv::Mat const& iCameraMatrix, cv::Mat const& iDistCoeffs, cv::Mat const& iRotation, cv::Mat const& iNewCameraMatrix, cv::Size const& iFrameSize )
+{
+    boost::shared_ptr<PcRemapMap> map ( new PcRemapMap () );
+    cv::initUndistortRectifyMap ( iCameraMatrix, iDistCoeffs, iRotation, iNewCameraMatrix, iFrameSize, CV_16SC2, map->Coordinates, map->Weights );
+    iNewCameraMatrix.colRange ( 0, 3 ).convertTo ( map->CameraMatrix, CV_64F );
+    return map;
+}
+
+PcRemapMapPtr pcc::PcCreateUndistortMap ( cv::Mat const& iCameraMatrix, cv::Mat const& iDistCoeffs, cv::Size const& iFrameSize )
+{
+    if ( iFrameSize.width <= 0 || iFrameSize.height <= 0 ) {
+        return PcRemapMapPtr ();
+    }
+    return CreateMap ( iCameraMatrix, iDistCoeffs, cv::Mat (), iCameraMatrix, iFrameSize );
+}
+bool pcc::PcCreateRectifyMaps (
+    cv::Mat const&          iLeftCameraMatrix,
+    cv::Mat const&          iLeftDistCoeffs,
+    cv::Mat const&          iRightCameraMatrix,
+    cv::Mat const&          iRightDistCoeffs,
+    cv::Size const&         iFrameSize,
+    cv::Mat const&          iRotation,
+    cv::Mat const&          iTranslation,
+    PcRemapMapPtr&          oLeft,
+    PcRemapMapPtr&          oRight,
+    cv::Mat&                oDisparityToDepth
+) {
+    if ( iFrameSize.width <= 0 || iFrameSize.height <= 0 ) {
+        return false;
+    }
+
+    cv::Mat leftRotation, rightRotation, leftProjection, rightProjection;
+    try {
+        cv::stereoRectify (
+            iLeftCameraMatrix, iLeftDistCoeffs,
+            iRightCameraMatrix, iRightDistCoeffs,
+            iFrameSize, iRotation, iTranslation,
+            leftRotation, rightRotation, leftProjection, rightProjection, oDisparityToDepth
+        );
+        oLeft = CreateMap ( iLeftCameraMatrix, iLeftDistCoeffs, leftRotation, leftProjection, iFrameSize );
+        oRight = CreateMap ( iRightCameraMatrix, iRightDistCoeffs, rightRotation, rightProjection, iFrameSize );
+    } catch ( cv::Exception const& e ) {
+        std::cout << "Stereo rectification failed: " << e.what () << std::endl;
+        return false;
+    }
+    return true;
+}
+void pcc::PcRemap ( cv::Mat const& iSrc, PcRemapMap const& iMap, cv::Mat& oDst )
+{
+    if ( iSrc.type () != CV_8UC1 ) {
+        cv::remap ( iSrc, oDst, iMap.Coordinates, iMap.Weights, cv::INTER_LINEAR, cv::BORDER_CONSTANT );
+        return;
+    }
+
+    oDst.create ( iMap.Coordinates.size (), CV_8UC1 );
+    int const tilesPerRow = ( oDst.cols + TILE_WIDTH - 1 ) / TILE_WIDTH;
+    int const tilesPerColumn = ( oDst.rows + TILE_HEIGHT - 1 ) / TILE_HEIGHT;
+    PcThreadPool::GetInstance ().ParallelFor ( 0u, (size_t)( tilesPerRow * tilesPerColumn ),
+        boost::bind ( &RemapTile, &iSrc, &iMap, &oDst, tilesPerRow, _1 ) );
+}
@@ -0,0 +1,674 @@
+#include "PcRigCalibrator.h"
+
+#include "PcThreadPool.h"
+
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <utility>
+
+using namespace pcc;
+
+// The bundle adjustment stops when an iteration improves the cost by less than this fraction.
+static double const MIN_IMPROVEMENT = 1e-9;
+
+// The bounds of the Levenberg-Marquardt damping factor.
+static double const INITIAL_DAMPING = 1e-3;
+static double const MAX_DAMPING = 1e10;
+
+/// \brief A rigid transform x -> R x + t, with R stored row-major.
+struct PcRigidPose
+{
+    double R[9];
+    double t[3];
+};
+
+/// \brief Composes two poses: oPose ( x ) = iFirst ( iSecond ( x ) ).
+static void Compose ( PcRigidPose const& iFirst, PcRigidPose const& iSecond, PcRigidPose& oPose )
+{
+    PcRigidPose pose;
+    for ( int r = 0; r < 3; r++ ) {
+        for ( int c = 0; c < 3; c++ ) {
+            pose.R[r * 3 + c] = iFirst.R[r * 3] * iSecond.R[c] + iFirst.R[r * 3 + 1] * iSecond.R[3 + c] + iFirst.R[r * 3 + 2] * iSecond.R[6 + c];
+        }
+        pose.t[r] = iFirst.R[r * 3] * iSecond.t[0] + iFirst.R[r * 3 + 1] * iSecond.t[1] + iFirst.R[r * 3 + 2] * iSecond.t[2] + iFirst.t[r];
+    }
+    oPose = pose;
+}
+
+/// \brief Inverts a pose.
+static void Invert ( PcRigidPose const& iPose, PcRigidPose& oPose )
+{
+    PcRigidPose pose;
+    for ( int r = 0; r < 3; r++ ) {
+        for ( int c = 0; c < 3; c++ ) {
+            pose.R[r * 3 + c] = iPose.R[c * 3 + r];
+        }
+    }
+    for ( int r = 0; r < 3; r++ ) {
+        pose.t[r] = -( pose.R[r * 3] * iPose.t[0] + pose.R[r * 3 + 1] * iPose.t[1] + pose.R[r * 3 + 2] * iPose.t[2] );
+    }
+    oPose = pose;
+}
+
+/// \brief Converts 6 pose parameters, a rotation vector followed by a translation, to a pose.
+static void ToPose ( double const* iParams, PcRigidPose& oPose )
+{
+    cv::Mat rvec ( 3, 1, CV_64F, const_cast<double*> ( iParams ) );
+    cv::Mat rotation ( 3, 3, CV_64F, oPose.R );
+    cv::Rodrigues ( rvec, rotation );
+    std::copy ( iParams + 3, iParams + 6, oPose.t );
+}
+
+/// \brief Converts a pose to 6 pose parameters, a rotation vector followed by a translation.
+static void ToParams ( PcRigidPose const& iPose, double* oParams )
+{
+    cv::Mat rotation ( 3, 3, CV_64F, const_cast<double*> ( iPose.R ) );
+    cv::Mat rvec ( 3, 1, CV_64F, oParams );
+    cv::Rodrigues ( rotation, rvec );
+    std::copy ( iPose.t, iPose.t + 3, oParams + 3 );
+}
+
+/// \brief Gets the angle of the rotation between two poses, in radians.
+static double RotationDistance ( PcRigidPose const& iFirst, PcRigidPose const& iSecond )
+{
+    // trace ( R1 R2^T ) = 1 + 2 cos ( angle )
+    double trace = 0.0;
+    for ( int i = 0; i < 9; i++ ) {
+        trace += iFirst.R[i] * iSecond.R[i];
+    }
+    return std::acos ( std::max ( -1.0, std::min ( 1.0, 0.5 * ( trace - 1.0 ) ) ) );
+}
+
+/// \brief The observation of a board view by one camera, as used by the bundle adjustment.
+struct PcRigObservation
+{
+    unsigned int    Camera;         ///< The index of the observing camera.
+    size_t          Source;         ///< The index of the observation in the snapshot.
+    PcRigidPose     BoardToCamera;  ///< The board pose in the camera frame, from cv::solvePnP.
+};
+
+/// \brief The bundle adjustment problem.
+struct PcRigProblem
+{
+    VEC(cv::Point3f) const*         BoardPoints;    ///< The chessboard points.
+    VECOFVECS(cv::Point2f)          Corners;        ///< The corners of every snapshot observation.
+    VEC(cv::Mat)                    CameraMatrices; ///< The intrinsic matrix of every camera.
+    VEC(cv::Mat)                    DistCoeffs;     ///< The distortion coefficients of every camera.
+    VECOFVECS(PcRigObservation)     Views;          ///< The observations of every board view.
+    VEC(int)                        FreeIndex;      ///< The index of every camera among the optimised ones, -1 for the world camera.
+};
+
+/// \brief The normal equation blocks of one board view.
+struct PcRigViewBlocks
+{
+    double          V[36];          ///< The board pose block, J_b^T J_b.
+    double          Vinv[36];       ///< The inverse of the damped board pose block.
+    double          Gb[6];          ///< The board pose gradient, J_b^T r.
+    double          Cost;           ///< The sum of the squared residuals of the view.
+    VEC(double)     U;              ///< The camera blocks J_c^T J_c, 36 per observation.
+    VEC(double)     W;              ///< The camera-board blocks J_c^T J_b, 36 per observation.
+    VEC(double)     Y;              ///< The products W Vinv, 36 per observation.
+    VEC(double)     Gc;             ///< The camera gradients J_c^T r, 6 per observation.
+    bool            IsValid;        ///< Whether the damped board pose block could be inverted.
+};
+
+/// \brief Projects the board of one observation, optionally accumulating the normal equation blocks.
+/// \return the sum of the squared residuals
+static double Project (
+    PcRigProblem const&         iProblem,
+    PcRigObservation const&     iObservation,
+    double const*               iCamera,
+    double const*               iBoard,
+    PcRigViewBlocks*            ioBlocks,
+    size_t const&               iIndex
+) {
+    cv::Mat rb ( 3, 1, CV_64F, const_cast<double*> ( iBoard ) );
+    cv::Mat tb ( 3, 1, CV_64F, const_cast<double*> ( iBoard + 3 ) );
+    cv::Mat rc ( 3, 1, CV_64F, const_cast<double*> ( iCamera ) );
+    cv::Mat tc ( 3, 1, CV_64F, const_cast<double*> ( iCamera + 3 ) );
+
+    // The board goes to the world frame first, then to the camera frame.
+    cv::Mat r3, t3, dr3dr1, dr3dt1, dr3dr2, dr3dt2, dt3dr1, dt3dt1, dt3dr2, dt3dt2;
+    cv::composeRT ( rb, tb, rc, tc, r3, t3, dr3dr1, dr3dt1, dr3dr2, dr3dt2, dt3dr1, dt3dt1, dt3dr2, dt3dt2 );
+
+    VEC(cv::Point2f) projected;
+    cv::Mat jacobian;
+    cv::Mat const& cameraMatrix = iProblem.CameraMatrices[iObservation.Camera];
+    cv::Mat const& distCoeffs = iProblem.DistCoeffs[iObservation.Camera];
+    if ( ioBlocks ) {
+        cv::projectPoints ( *iProblem.BoardPoints, r3, t3, cameraMatrix, distCoeffs, projected, jacobian );
+    } else {
+        cv::projectPoints ( *iProblem.BoardPoints, r3, t3, cameraMatrix, distCoeffs, projected );
+    }
+
+    VEC(cv::Point2f) const& corners = iProblem.Corners[iObservation.Source];
+    double cost = 0.0;
+    for ( size_t p = 0; p < projected.size (); p++ ) {
+        double const dx = projected[p].x - corners[p].x;
+        double const dy = projected[p].y - corners[p].y;
+        cost += dx * dx + dy * dy;
+    }
+    if ( !ioBlocks ) {
+        return cost;
+    }
+
+    // d ( r3, t3 ) / d ( board ) and d ( r3, t3 ) / d ( camera ), as 6x6 row-major blocks.
+    double dBoard[36], dCamera[36];
+    cv::Mat const* const boardParts[] = { &dr3dr1, &dr3dt1, &dt3dr1, &dt3dt1 };
+    cv::Mat const* const cameraParts[] = { &dr3dr2, &dr3dt2, &dt3dr2, &dt3dt2 };
+    for ( int part = 0; part < 4; part++ ) {
+        int const row0 = ( part / 2 ) * 3;
+        int const col0 = ( part % 2 ) * 3;
+        for ( int r = 0; r < 3; r++ ) {
+            for ( int c = 0; c < 3; c++ ) {
+                dBoard[( row0 + r ) * 6 + col0 + c] = boardParts[part]->at<double> ( r, c );
+                dCamera[( row0 + r ) * 6 + col0 + c] = cameraParts[part]->at<double> ( r, c );
+            }
+        }
+    }
+
+    bool const isFree = ( iProblem.FreeIndex[iObservation.Camera] >= 0 );
+    double* const U = &ioBlocks->U[iIndex * 36];
+    double* const W = &ioBlocks->W[iIndex * 36];
+    double* const Gc = &ioBlocks->Gc[iIndex * 6];
+    for ( int row = 0; row < jacobian.rows; row++ ) {
+        // The first 6 columns of the projection Jacobian are d ( u, v ) / d ( r3, t3 ).
+        double const* const j3 = jacobian.ptr<double> ( row );
+        double const residual = ( row % 2 == 0 )
+            ? projected[row / 2].x - corners[row / 2].x
+            : projected[row / 2].y - corners[row / 2].y;
+
+        double jb[6], jc[6];
+        for ( int c = 0; c < 6; c++ ) {
+            jb[c] = 0.0;
+            jc[c] = 0.0;
+            for ( int k = 0; k < 6; k++ ) {
+                jb[c] += j3[k] * dBoard[k * 6 + c];
+                jc[c] += j3[k] * dCamera[k * 6 + c];
+            }
+        }
+
+        for ( int r = 0; r < 6; r++ ) {
+            ioBlocks->Gb[r] += jb[r] * residual;
+            for ( int c = 0; c < 6; c++ ) {
+                ioBlocks->V[r * 6 + c] += jb[r] * jb[c];
+            }
+        }
+        if ( isFree ) {
+            for ( int r = 0; r < 6; r++ ) {
+                Gc[r] += jc[r] * residual;
+                for ( int c = 0; c < 6; c++ ) {
+                    U[r * 6 + c] += jc[r] * jc[c];
+                    W[r * 6 + c] += jc[r] * jb[c];
+                }
+            }
+        }
+    }
+    return cost;
+}
+
+/// \brief Evaluates the normal equation blocks of one board view. Runs as a PcThreadPool::ParallelFor body.
+static void LinearizeView (
+    PcRigProblem const*         iProblem,
+    VEC(double) const*          iCameras,
+    VEC(double) const*          iBoards,
+    VEC(PcRigViewBlocks)*       oBlocks,
+    size_t                      iView
+) {
+    VEC(PcRigObservation) const& view = iProblem->Views[iView];
+    PcRigViewBlocks& blocks = (*oBlocks)[iView];
+
+    std::fill ( blocks.V, blocks.V + 36, 0.0 );
+    std::fill ( blocks.Gb, blocks.Gb + 6, 0.0 );
+    blocks.U.assign ( view.size () * 36, 0.0 );
+    blocks.W.assign ( view.size () * 36, 0.0 );
+    blocks.Gc.assign ( view.size () * 6, 0.0 );
+    blocks.Y.assign ( view.size () * 36, 0.0 );
+    blocks.Cost = 0.0;
+    for ( size_t o = 0; o < view.size (); o++ ) {
+        blocks.Cost += Project ( *iProblem, view[o], &(*iCameras)[view[o].Camera * 6], &(*iBoards)[iView * 6], &blocks, o );
+    }
+}
+
+/// \brief Damps and inverts the board pose block of one view, and computes W Vinv. Runs as a PcThreadPool::ParallelFor body.
+static void EliminateView (
+    PcRigProblem const*         iProblem,
+    double                      iDamping,
+    VEC(PcRigViewBlocks)*       ioBlocks,
+    size_t                      iView
+) {
+    PcRigViewBlocks& blocks = (*ioBlocks)[iView];
+
+    double damped[36];
+    std::copy ( blocks.V, blocks.V + 36, damped );
+    for ( int d = 0; d < 6; d++ ) {
+        damped[d * 7] *= ( 1.0 + iDamping );
+    }
+    cv::Mat dampedMat ( 6, 6, CV_64F, damped );
+    cv::Mat inverse ( 6, 6, CV_64F, blocks.Vinv );
+    blocks.IsValid = ( cv::invert ( dampedMat, inverse, cv::DECOMP_CHOLESKY ) != 0.0 );
+    if ( !blocks.IsValid ) {
+        return;
+    }
+
+    VEC(PcRigObservation) const& view = iProblem->Views[iView];
+    for ( size_t o = 0; o < view.size (); o++ ) {
+        double const* const W = &blocks.W[o * 36];
+        double* const Y = &blocks.Y[o * 36];
+        for ( int r = 0; r < 6; r++ ) {
+            for ( int c = 0; c < 6; c++ ) {
+                double sum = 0.0;
+                for ( int k = 0; k < 6; k++ ) {
+                    sum += W[r * 6 + k] * blocks.Vinv[k * 6 + c];
+                }
+                Y[r * 6 + c] = sum;
+            }
+        }
+    }
+}
+
+/// \brief Evaluates the cost of one board view. Runs as a PcThreadPool::ParallelFor body.
+static void EvaluateView (
+    PcRigProblem const*         iProblem,
+    VEC(double) const*          iCameras,
+    VEC(double) const*          iBoards,
+    VEC(double)*                oCosts,
+    size_t                      iView
+) {
+    VEC(PcRigObservation) const& view = iProblem->Views[iView];
+    double cost = 0.0;
+    for ( size_t o = 0; o < view.size (); o++ ) {
+        cost += Project ( *iProblem, view[o], &(*iCameras)[view[o].Camera * 6], &(*iBoards)[iView * 6], 0x0, o );
+    }
+    (*oCosts)[iView] = cost;
+}
+
+// ----------------------------------------------------------------------
+// PcRigCalibrator
+// ----------------------------------------------------------------------
+// Public
+PcRigCalibrator::PcRigCalibrator ( VEC(cv::Point3f) const& iBoardPoints, boost::uint64_t const& iTolerance )
+    :   m_boardPoints ( iBoardPoints )
+    ,   m_tolerance ( iTolerance )
+    ,   m_mutex ()
+    ,   m_solveMutex ()
+    ,   m_isSolving ( false )
+    ,   m_observations ()
+    ,   m_intrinsics ()
+    ,   m_solution ()
+{}
+void PcRigCalibrator::SetIntrinsics ( std::string const& iCameraId, cv::Mat const& iCameraMatrix, cv::Mat const& iDistCoeffs )
+{
+    Intrinsics intrinsics;
+    iCameraMatrix.convertTo ( intrinsics.CameraMatrix, CV_64F );
+    iDistCoeffs.convertTo ( intrinsics.DistCoeffs, CV_64F );
+
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    m_intrinsics[iCameraId] = intrinsics;
+}
+void PcRigCalibrator::AddObservation ( std::string const& iCameraId, boost::uint64_t const& iTimestamp, VEC(cv::Point2f) const& iCorners )
+{
+    if ( iCorners.size () != m_boardPoints.size () ) {
+        return;
+    }
+
+    Observation observation;
+    observation.CameraId = iCameraId;
+    observation.Timestamp = iTimestamp;
+    observation.Corners = iCorners;
+
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    m_observations.push_back ( observation );
+}
+bool PcRigCalibrator::Solve ( unsigned int const& iMaxIterations )
+{
+    boost::unique_lock<boost::mutex> solveLock ( m_solveMutex, boost::try_to_lock );
+    if ( !solveLock.owns_lock () ) {
+        return false;
+    }
+    m_isSolving = true;
+    bool const isSolved = DoSolve ( iMaxIterations );
+    m_isSolving = false;
+    return isSolved;
+}
+size_t PcRigCalibrator::GetObservationCount ()
+{
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    return m_observations.size ();
+}
+
+// Private
+bool PcRigCalibrator::DoSolve ( unsigned int const& iMaxIterations )
+{
+    VEC(Observation) observations;
+    STRMAP(Intrinsics) allIntrinsics;
+    {
+        boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+        observations = m_observations;
+        allIntrinsics = m_intrinsics;
+    }
+
+    // Cameras are indexed in GUID order.
+    VEC(std::string) cameraIds;
+    STRMAP(unsigned int) cameraIndex;
+    PcRigProblem problem;
+    problem.BoardPoints = &m_boardPoints;
+    for ( auto intrinsics = allIntrinsics.begin (); intrinsics != allIntrinsics.end (); intrinsics++ ) {
+        cameraIndex[intrinsics->first] = (unsigned int)cameraIds.size ();
+        cameraIds.push_back ( intrinsics->first );
+        problem.CameraMatrices.push_back ( intrinsics->second.CameraMatrix );
+        problem.DistCoeffs.push_back ( intrinsics->second.DistCoeffs );
+    }
+    unsigned int const cameraCount = (unsigned int)cameraIds.size ();
+
+    // Group the observations taken within the tolerance of each other into board views, with at most one
+    // observation per camera.
+    std::vector<std::pair<boost::uint64_t, size_t> > order;
+    for ( size_t o = 0; o < observations.size (); o++ ) {
+        if ( cameraIndex.find ( observations[o].CameraId ) != cameraIndex.end () ) {
+            order.push_back ( std::make_pair ( observations[o].Timestamp, o ) );
+        }
+    }
+    std::sort ( order.begin (), order.end () );
+
+    VECOFVECS(PcRigObservation) views;
+    boost::uint64_t viewStart = 0u;
+    VEC(bool) hasCamera ( cameraCount, false );
+    for ( auto o = order.begin (); o != order.end (); o++ ) {
+        Observation const& observation = observations[o->second];
+        unsigned int const camera = cameraIndex[observation.CameraId];
+        if ( views.empty () || observation.Timestamp - viewStart > m_tolerance || hasCamera[camera] ) {
+            views.push_back ( VEC(PcRigObservation) () );
+            viewStart = observation.Timestamp;
+            std::fill ( hasCamera.begin (), hasCamera.end (), false );
+        }
+
+        PcRigObservation rigObservation;
+        rigObservation.Camera = camera;
+        rigObservation.Source = problem.Corners.size ();
+        cv::Mat rvec, tvec;
+        if ( !cv::solvePnP ( m_boardPoints, observation.Corners, problem.CameraMatrices[camera], problem.DistCoeffs[camera], rvec, tvec ) ) {
+            continue;
+        }
+        double params[6] = {
+            rvec.at<double> ( 0 ), rvec.at<double> ( 1 ), rvec.at<double> ( 2 ),
+            tvec.at<double> ( 0 ), tvec.at<double> ( 1 ), tvec.at<double> ( 2 )
+        };
+        ToPose ( params, rigObservation.BoardToCamera );
+        problem.Corners.push_back ( observation.Corners );
+        views.back ().push_back ( rigObservation );
+        hasCamera[camera] = true;
+    }
+
+    // Co-visibility graph.
+    VEC(unsigned int) covisibility ( cameraCount * cameraCount, 0u );
+    VEC(unsigned int) observationCount ( cameraCount, 0u );
+    for ( auto view = views.begin (); view != views.end (); view++ ) {
+        if ( view->size () < 2u ) {
+            continue;
+        }
+        for ( auto first = view->begin (); first != view->end (); first++ ) {
+            observationCount[first->Camera]++;
+            for ( auto second = view->begin (); second != view->end (); second++ ) {
+                if ( first->Camera != second->Camera ) {
+                    covisibility[first->Camera * cameraCount + second->Camera]++;
+                }
+            }
+        }
+    }
+    if ( cameraCount < 2u ) {
+        return false;
+    }
+    unsigned int const world = (unsigned int)( std::max_element ( observationCount.begin (), observationCount.end () ) - observationCount.begin () );
+
+    // Maximum spanning tree from the world camera. Every camera pose maps the world frame to the camera frame.
+    VEC(PcRigidPose) cameraPoses ( cameraCount );
+    VEC(bool) inTree ( cameraCount, false );
+    PcRigidPose identity = { { 1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0 }, { 0.0, 0.0, 0.0 } };
+    cameraPoses[world] = identity;
+    inTree[world] = true;
+    unsigned int treeSize = 1u;
+    for ( ;; ) {
+        unsigned int bestWeight = 0u, parent = 0u, child = 0u;
+        for ( unsigned int i = 0; i < cameraCount; i++ ) {
+            for ( unsigned int j = 0; inTree[i] && j < cameraCount; j++ ) {
+                if ( !inTree[j] && covisibility[i * cameraCount + j] > bestWeight ) {
+                    bestWeight = covisibility[i * cameraCount + j];
+                    parent = i;
+                    child = j;
+                }
+            }
+        }
+        if ( bestWeight == 0u ) {
+            break;
+        }
+
+        // The candidate relative poses, one per shared view; the one closest to all others in rotation wins.
+        VEC(PcRigidPose) candidates;
+        for ( auto view = views.begin (); view != views.end (); view++ ) {
+            PcRigObservation const* parentObservation = 0x0;
+            PcRigObservation const* childObservation = 0x0;
+            for ( auto o = view->begin (); o != view->end (); o++ ) {
+                if ( o->Camera == parent ) {
+                    parentObservation = &(*o);
+                } else if ( o->Camera == child ) {
+                    childObservation = &(*o);
+                }
+            }
+            if ( parentObservation && childObservation ) {
+                PcRigidPose cameraToBoard, relative;
+                Invert ( parentObservation->BoardToCamera, cameraToBoard );
+                Compose ( childObservation->BoardToCamera, cameraToBoard, relative );
+                candidates.push_back ( relative );
+            }
+        }
+        size_t best = 0u;
+        double bestSpread = std::numeric_limits<double>::max ();
+        for ( size_t c = 0; c < candidates.size (); c++ ) {
+            double spread = 0.0;
+            for ( size_t d = 0; d < candidates.size (); d++ ) {
+                spread += RotationDistance ( candidates[c], candidates[d] );
+            }
+            if ( spread < bestSpread ) {
+                bestSpread = spread;
+                best = c;
+            }
+        }
+
+        Compose ( candidates[best], cameraPoses[parent], cameraPoses[child] );
+        inTree[child] = true;
+        treeSize++;
+    }
+    if ( treeSize < 2u ) {
+        std::cout << "No two cameras of the rig share a board view" << std::endl;
+        return false;
+    }
+
+    // Keep the views seen by at least two cameras of the tree, and initialise their board poses in the world frame.
+    problem.FreeIndex.assign ( cameraCount, -1 );
+    int freeCount = 0;
+    for ( unsigned int c = 0; c < cameraCount; c++ ) {
+        if ( inTree[c] && c != world ) {
+            problem.FreeIndex[c] = freeCount++;
+        }
+    }
+    VEC(double) boards;
+    size_t pointCount = 0u;
+    for ( auto view = views.begin (); view != views.end (); view++ ) {
+        VEC(PcRigObservation) kept;
+        for ( auto o = view->begin (); o != view->end (); o++ ) {
+            if ( inTree[o->Camera] ) {
+                kept.push_back ( *o );
+            }
+        }
+        if ( kept.size () < 2u ) {
+            continue;
+        }
+
+        PcRigidPose cameraToWorld, boardToWorld;
+        Invert ( cameraPoses[kept[0].Camera], cameraToWorld );
+        Compose ( cameraToWorld, kept[0].BoardToCamera, boardToWorld );
+        boards.resize ( boards.size () + 6u );
+        ToParams ( boardToWorld, &boards[boards.size () - 6u] );
+
+        pointCount += kept.size () * m_boardPoints.size ();
+        problem.Views.push_back ( kept );
+    }
+    size_t const viewCount = problem.Views.size ();
+
+    VEC(double) cameras ( cameraCount * 6u, 0.0 );
+    for ( unsigned int c = 0; c < cameraCount; c++ ) {
+        if ( inTree[c] ) {
+            ToParams ( cameraPoses[c], &cameras[c * 6u] );
+        }
+    }
+
+    // Levenberg-Marquardt over the camera and board poses, with the board poses eliminated by a Schur complement.
+    PcThreadPool& pool = PcThreadPool::GetInstance ();
+    VEC(PcRigViewBlocks) blocks ( viewCount );
+    VEC(double) costs ( viewCount, 0.0 );
+    double damping = INITIAL_DAMPING;
+    double cost = 0.0;
+    bool isLinearized = false;
+    int const reducedSize = freeCount * 6;
+    for ( unsigned int iteration = 0; iteration < iMaxIterations && damping < MAX_DAMPING; ) {
+        if ( !isLinearized ) {
+            pool.ParallelFor ( 0u, viewCount, boost::bind ( &LinearizeView, &problem, &cameras, &boards, &blocks, _1 ) );
+            cost = 0.0;
+            for ( size_t v = 0; v < viewCount; v++ ) {
+                cost += blocks[v].Cost;
+            }
+            isLinearized = true;
+        }
+
+        pool.ParallelFor ( 0u, viewCount, boost::bind ( &EliminateView, &problem, damping, &blocks, _1 ) );
+
+        // Reduced camera system: ( U - W Vinv W^T ) dc = -( gc - W Vinv gb ).
+        cv::Mat reduced = cv::Mat::zeros ( reducedSize, reducedSize, CV_64F );
+        cv::Mat rhs = cv::Mat::zeros ( reducedSize, 1, CV_64F );
+        bool isValid = true;
+        for ( size_t v = 0; v < viewCount && isValid; v++ ) {
+            PcRigViewBlocks const& view = blocks[v];
+            VEC(PcRigObservation) const& observations = problem.Views[v];
+            isValid = view.IsValid;
+            for ( size_t i = 0; i < observations.size () && isValid; i++ ) {
+                int const ci = problem.FreeIndex[observations[i].Camera];
+                if ( ci < 0 ) {
+                    continue;
+                }
+                double const* const Yi = &view.Y[i * 36];
+                for ( int r = 0; r < 6; r++ ) {
+                    double* const reducedRow = reduced.ptr<double> ( ci * 6 + r );
+                    for ( int c = 0; c < 6; c++ ) {
+                        reducedRow[ci * 6 + c] += view.U[i * 36 + r * 6 + c] * ( r == c ? 1.0 + damping : 1.0 );
+                    }
+                    double y = 0.0;
+                    for ( int k = 0; k < 6; k++ ) {
+                        y += Yi[r * 6 + k] * view.Gb[k];
+                    }
+                    rhs.at<double> ( ci * 6 + r ) += y - view.Gc[i * 6 + r];
+                }
+                for ( size_t j = 0; j < observations.size (); j++ ) {
+                    int const cj = problem.FreeIndex[observations[j].Camera];
+                    if ( cj < 0 ) {
+                        continue;
+                    }
+                    double const* const Wj = &view.W[j * 36];
+                    for ( int r = 0; r < 6; r++ ) {
+                        double* const reducedRow = reduced.ptr<double> ( ci * 6 + r );
+                        for ( int c = 0; c < 6; c++ ) {
+                            double sum = 0.0;
+                            for ( int k = 0; k < 6; k++ ) {
+                                sum += Yi[r * 6 + k] * Wj[c * 6 + k];
+                            }
+                            reducedRow[cj * 6 + c] -= sum;
+                        }
+                    }
+                }
+            }
+        }
+
+        cv::Mat cameraStep;
+        if ( !isValid || !cv::solve ( reduced, rhs, cameraStep, cv::DECOMP_CHOLESKY ) ) {
+            damping *= 10.0;
+            continue;
+        }
+
+        // Back-substitution: db = Vinv ( -gb - W^T dc ).
+        VEC(double) trialCameras ( cameras );
+        for ( unsigned int c = 0; c < cameraCount; c++ ) {
+            for ( int k = 0; problem.FreeIndex[c] >= 0 && k < 6; k++ ) {
+                trialCameras[c * 6 + k] += cameraStep.at<double> ( problem.FreeIndex[c] * 6 + k );
+            }
+        }
+        VEC(double) trialBoards ( boards );
+        for ( size_t v = 0; v < viewCount; v++ ) {
+            PcRigViewBlocks const& view = blocks[v];
+            VEC(PcRigObservation) const& observations = problem.Views[v];
+            double b[6];
+            for ( int r = 0; r < 6; r++ ) {
+                b[r] = -view.Gb[r];
+            }
+            for ( size_t i = 0; i < observations.size (); i++ ) {
+                int const ci = problem.FreeIndex[observations[i].Camera];
+                for ( int r = 0; ci >= 0 && r < 6; r++ ) {
+                    for ( int k = 0; k < 6; k++ ) {
+                        b[r] -= view.W[i * 36 + k * 6 + r] * cameraStep.at<double> ( ci * 6 + k );
+                    }
+                }
+            }
+            for ( int r = 0; r < 6; r++ ) {
+                for ( int k = 0; k < 6; k++ ) {
+                    trialBoards[v * 6 + r] += view.Vinv[r * 6 + k] * b[k];
+                }
+            }
+        }
+
+        pool.ParallelFor ( 0u, viewCount, boost::bind ( &EvaluateView, &problem, &trialCameras, &trialBoards, &costs, _1 ) );
+        double trialCost = 0.0;
+        for ( size_t v = 0; v < viewCount; v++ ) {
+            trialCost += costs[v];
+        }
+
+        if ( trialCost < cost ) {
+            bool const hasConverged = ( cost - trialCost < MIN_IMPROVEMENT * cost );
+            cameras.swap ( trialCameras );
+            boards.swap ( trialBoards );
+            cost = trialCost;
+            damping = std::max ( damping * 0.1, 1e-12 );
+            isLinearized = false;
+            iteration++;
+            if ( hasConverged ) {
+                break;
+            }
+        } else {
+            damping *= 10.0;
+        }
+    }
+
+    boost::shared_ptr<PcRigSolution> solution ( new PcRigSolution () );
+    for ( unsigned int c = 0; c < cameraCount; c++ ) {
+        if ( !inTree[c] ) {
+            std::cout << "Camera " << cameraIds[c] << " shares no board view with the rig" << std::endl;
+            continue;
+        }
+        PcRigidPose pose;
+        ToPose ( &cameras[c * 6u], pose );
+        solution->Rotations[cameraIds[c]] = cv::Mat ( 3, 3, CV_64F, pose.R ).clone ();
+        solution->Translations[cameraIds[c]] = cv::Mat ( 3, 1, CV_64F, pose.t ).clone ();
+    }
+    solution->WorldCamera = cameraIds[world];
+    solution->Rms = ( pointCount > 0u ) ? std::sqrt ( cost / (double)pointCount ) : 0.0;
+    boost::atomic_store ( &m_solution, PcRigSolutionPtr ( solution ) );
+    return true;
+}
@@ -0,0 +1,213 @@
+#include "PcSharedFramePublisher.h"
+
+#include <boost/static_assert.hpp>
+#include <boost/interprocess/exceptions.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+using namespace pcc;
+namespace bip = boost::interprocess;
+
+BOOST_STATIC_ASSERT ( sizeof ( PcSharedSegmentHeader ) <= PCC_SHARED_ALIGNMENT );
+BOOST_STATIC_ASSERT ( sizeof ( PcSharedSlotHeader ) <= PCC_SHARED_ALIGNMENT );
+
+/// \brief Creates a shared memory object of a given size and maps it, replacing any stale object with the same name.
+static bool CreateSharedMemory (
+    std::string const&      iName,
+    boost::uint64_t const&  iSize,
+    PcSharedMemoryType&     oMemory,
+    bip::mapped_region&     oRegion
+) {
+    try {
+#if defined(WIN32)
+        PcSharedMemoryType memory ( bip::create_only, iName.c_str (), bip::read_write, (size_t)iSize );
+#else
+        PcSharedMemoryType::remove ( iName.c_str () );
+        PcSharedMemoryType memory ( bip::create_only, iName.c_str (), bip::read_write );
+        memory.truncate ( (bip::offset_t)iSize );
+#endif
+        bip::mapped_region region ( memory, bip::read_write, 0, (size_t)iSize );
+        oMemory.swap ( memory );
+        oRegion.swap ( region );
+        return true;
+    } catch ( bip::interprocess_exception const& e ) {
+        std::cout << "Error creating shared memory " << iName << ": " << e.what () << std::endl;
+        return false;
+    }
+}
+
+/// \brief Removes a shared memory object. Windows shared memory goes away with its last handle instead.
+static void RemoveSharedMemory ( std::string const& iName )
+{
+#if !defined(WIN32)
+    PcSharedMemoryType::remove ( iName.c_str () );
+#endif
+}
+
+// ----------------------------------------------------------------------
+// PcSharedFrameSegment
+// ----------------------------------------------------------------------
+// Public
+PcSharedFrameSegment::PcSharedFrameSegment (
+    std::string const&      iCameraId,
+    unsigned int const&     iSlotCount,
+    boost::uint64_t const&  iPayloadCapacity
+)   :   m_name ( PcSharedSegmentName ( iCameraId ) )
+    ,   m_memory ()
+    ,   m_region ()
+    ,   m_header ( (PcSharedSegmentHeader*)0x0 )
+{
+    boost::uint64_t const stride = PcSharedAlign ( PCC_SHARED_ALIGNMENT + iPayloadCapacity );
+    if ( !CreateSharedMemory ( m_name, PCC_SHARED_ALIGNMENT + iSlotCount * stride, m_memory, m_region ) ) {
+        return;
+    }
+
+    unsigned char* const base = (unsigned char*)m_region.get_address ();
+    for ( unsigned int s = 0; s < iSlotCount; s++ ) {
+        PcSharedSlotHeader* slot = new ( base + PCC_SHARED_ALIGNMENT + s * stride ) PcSharedSlotHeader ();
+        slot->Lock.store ( 0u, boost::memory_order_relaxed );
+        slot->PayloadSize = 0u;
+    }
+
+    // The magic number goes last, so a consumer never sees a half-initialised segment as valid.
+    PcSharedSegmentHeader* header = new ( base ) PcSharedSegmentHeader ();
+    header->Version         = PcSharedSegmentHeader::VERSION;
+    header->SlotCount       = iSlotCount;
+    header->Reserved        = 0u;
+    header->SlotStride      = stride;
+    header->PayloadCapacity = iPayloadCapacity;
+    header->Published.store ( 0u, boost::memory_order_relaxed );
+    boost::atomic_thread_fence ( boost::memory_order_release );
+    header->Magic           = PcSharedSegmentHeader::MAGIC;
+
+    m_header = header;
+}
+PcSharedFrameSegment::~PcSharedFrameSegment ()
+{
+    if ( m_header ) {
+        // Tells the consumers still mapping the segment that it is gone for good.
+        m_header->Magic = 0u;
+        boost::atomic_thread_fence ( boost::memory_order_release );
+        RemoveSharedMemory ( m_name );
+    }
+}
+bool PcSharedFrameSegment::Publish (
+    unsigned int const&     iWidth,
+    unsigned int const&     iHeight,
+    unsigned int const&     iChannels,
+    unsigned char const*    iData,
+    boost::uint64_t const&  iTimestamp,
+    boost::uint64_t const&  iFrameId
+) {
+    boost::uint64_t const size = (boost::uint64_t)iWidth * iHeight * iChannels;
+    if ( !m_header || size > m_header->PayloadCapacity ) {
+        return false;
+    }
+
+    boost::uint64_t const sequence = m_header->Published.load ( boost::memory_order_relaxed );
+    unsigned char* const slotBase = (unsigned char*)m_header + PCC_SHARED_ALIGNMENT
+                                  + ( sequence % m_header->SlotCount ) * m_header->SlotStride;
+    PcSharedSlotHeader* slot = (PcSharedSlotHeader*)slotBase;
+
+    // Sequence lock: odd while the slot is being written.
+    boost::uint64_t const lock = slot->Lock.load ( boost::memory_order_relaxed );
+    slot->Lock.store ( lock + 1u, boost::memory_order_relaxed );
+    boost::atomic_thread_fence ( boost::memory_order_release );
+
+    slot->Sequence      = sequence;
+    slot->Timestamp     = iTimestamp;
+    slot->FrameId       = iFrameId;
+    slot->Width         = iWidth;
+    slot->Height        = iHeight;
+    slot->Channels      = iChannels;
+    slot->PayloadSize   = (boost::uint32_t)size;
+    memcpy ( slotBase + PCC_SHARED_ALIGNMENT, iData, (size_t)size );
+
+    slot->Lock.store ( lock + 2u, boost::memory_order_release );
+    m_header->Published.store ( sequence + 1u, boost::memory_order_release );
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// PcSharedFramePublisher
+// ----------------------------------------------------------------------
+// Public
+PcSharedFramePublisher::PcSharedFramePublisher ( unsigned int const& iSlotCount )
+    :   m_mutex ()
+    ,   m_slotCount ( std::max ( 2u, iSlotCount ) )
+    ,   m_memory ()
+    ,   m_region ()
+    ,   m_directory ( (PcSharedDirectory*)0x0 )
+    ,   m_segments ()
+{
+    if ( CreateSharedMemory ( PCC_SHARED_DIRECTORY_NAME, sizeof ( PcSharedDirectory ), m_memory, m_region ) ) {
+        PcSharedDirectory* directory = new ( m_region.get_address () ) PcSharedDirectory ();
+        directory->Count.store ( 0u, boost::memory_order_relaxed );
+        boost::atomic_thread_fence ( boost::memory_order_release );
+        directory->Magic = PcSharedSegmentHeader::MAGIC;
+        m_directory = directory;
+    }
+}
+PcSharedFramePublisher::~PcSharedFramePublisher ()
+{
+    GuardType lock ( m_mutex );
+
+    m_segments.clear ();
+    if ( m_directory ) {
+        m_directory->Magic = 0u;
+        RemoveSharedMemory ( PCC_SHARED_DIRECTORY_NAME );
+    }
+}
+bool PcSharedFramePublisher::Publish (
+    std::string const&      iCameraId,
+    unsigned int const&     iWidth,
+    unsigned int const&     iHeight,
+    unsigned int const&     iChannels,
+    unsigned char const*    iData,
+    boost::uint64_t const&  iTimestamp,
+    boost::uint64_t const&  iFrameId
+) {
+    PcSharedFrameSegmentPtr segment;
+    {
+        GuardType lock ( m_mutex );
+        segment = GetSegment ( iCameraId, (boost::uint64_t)iWidth * iHeight * iChannels );
+    }
+
+    // The copy happens outside of the lock, so cameras publish in parallel.
+    return segment && segment->Publish ( iWidth, iHeight, iChannels, iData, iTimestamp, iFrameId );
+}
+
+// Private
+PcSharedFrameSegmentPtr PcSharedFramePublisher::GetSegment ( std::string const& iCameraId, boost::uint64_t const& iPayloadCapacity )
+{
+    auto found = m_segments.find ( iCameraId );
+    if ( found != m_segments.end () ) {
+        if ( found->second->GetPayloadCapacity () >= iPayloadCapacity ) {
+            return found->second;
+        }
+        // The frame format grew: the old segment is invalidated and consumers have to reopen the camera.
+        m_segments.erase ( found );
+    }
+
+    PcSharedFrameSegmentPtr segment ( new PcSharedFrameSegment ( iCameraId, m_slotCount, iPayloadCapacity ) );
+    if ( !segment->IsOpen () ) {
+        return PcSharedFrameSegmentPtr ();
+    }
+    m_segments.insert ( std::make_pair ( iCameraId, segment ) );
+
+    if ( m_directory ) {
+        bool isListed = false;
+        unsigned int const count = m_directory->Count.load ( boost::memory_order_relaxed );
+        for ( unsigned int c = 0; c < count && !isListed; c++ ) {
+            isListed = ( iCameraId.compare ( m_directory->Cameras[c] ) == 0 );
+        }
+        if ( !isListed && count < PCC_SHARED_MAX_CAMERAS && iCameraId.size () < PCC_SHARED_MAX_ID_LENGTH ) {
+            strncpy ( m_directory->Cameras[count], iCameraId.c_str (), PCC_SHARED_MAX_ID_LENGTH );
+            m_directory->Count.store ( count + 1u, boost::memory_order_release );
+        }
+    }
+    return segment;
+}
@@ -0,0 +1,177 @@
+#include "PcSharedFrameReader.h"
+
+#include <boost/interprocess/exceptions.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace pcc;
+namespace bip = boost::interprocess;
+
+/// \brief Opens and maps an existing shared memory object, returning false if it doesn't exist.
+static bool OpenSharedMemory ( std::string const& iName, PcSharedMemoryType& oMemory, bip::mapped_region& oRegion )
+{
+    try {
+        PcSharedMemoryType memory ( bip::open_only, iName.c_str (), bip::read_write );
+        bip::mapped_region region ( memory, bip::read_write );
+        oMemory.swap ( memory );
+        oRegion.swap ( region );
+        return true;
+    } catch ( bip::interprocess_exception const& ) {
+        return false;
+    }
+}
+
+// ----------------------------------------------------------------------
+// PcSharedFrameReader
+// ----------------------------------------------------------------------
+// Public
+PcSharedFrameReader::PcSharedFrameReader ( std::string const& iCameraId )
+    :   m_name ( PcSharedSegmentName ( iCameraId ) )
+    ,   m_memory ()
+    ,   m_region ()
+    ,   m_header ( (PcSharedSegmentHeader const*)0x0 )
+    ,   m_next ( 0u )
+    ,   m_lost ( 0u )
+{}
+bool PcSharedFrameReader::Open ()
+{
+    Close ();
+    if ( !OpenSharedMemory ( m_name, m_memory, m_region ) ) {
+        return false;
+    }
+
+    PcSharedSegmentHeader const* header = (PcSharedSegmentHeader const*)m_region.get_address ();
+    if (    m_region.get_size () < PCC_SHARED_ALIGNMENT
+        ||  header->Magic != PcSharedSegmentHeader::MAGIC
+        ||  header->Version != PcSharedSegmentHeader::VERSION ) {
+        Close ();
+        return false;
+    }
+    boost::atomic_thread_fence ( boost::memory_order_acquire );
+    if ( m_region.get_size () < PCC_SHARED_ALIGNMENT + header->SlotCount * header->SlotStride ) {
+        Close ();
+        return false;
+    }
+
+    m_header = header;
+    boost::uint64_t const published = m_header->Published.load ( boost::memory_order_acquire );
+    m_next = ( published > 0u ) ? published - 1u : 0u;
+    return true;
+}
+void PcSharedFrameReader::Close ()
+{
+    m_header = (PcSharedSegmentHeader const*)0x0;
+    bip::mapped_region ().swap ( m_region );
+    PcSharedMemoryType ().swap ( m_memory );
+}
+bool PcSharedFrameReader::IsOpen ()
+{
+    if ( m_header && m_header->Magic != PcSharedSegmentHeader::MAGIC ) {
+        Close ();
+    }
+    return ( m_header != 0x0 );
+}
+bool PcSharedFrameReader::ReadNext ( PcSharedFrameView& oView )
+{
+    if ( !IsOpen () ) {
+        return false;
+    }
+
+    // The oldest slot of the ring is the next one to be overwritten, so a reader that fell behind restarts one
+    // slot ahead of it.
+    boost::uint64_t const published = m_header->Published.load ( boost::memory_order_acquire );
+    boost::uint64_t const oldest = ( published > m_header->SlotCount ) ? published - m_header->SlotCount + 1u : 0u;
+    if ( m_next < oldest ) {
+        m_lost += oldest - m_next;
+        m_next = oldest;
+    }
+
+    while ( m_next < published ) {
+        if ( ReadFrame ( m_next++, oView ) ) {
+            return true;
+        }
+        m_lost++;
+    }
+    return false;
+}
+bool PcSharedFrameReader::ReadLatest ( PcSharedFrameView& oView )
+{
+    if ( !IsOpen () ) {
+        return false;
+    }
+
+    boost::uint64_t const published = m_header->Published.load ( boost::memory_order_acquire );
+    if ( m_next >= published ) {
+        return false;
+    }
+    m_next = published;
+    return ReadFrame ( published - 1u, oView );
+}
+bool PcSharedFrameReader::IsValid ( PcSharedFrameView const& iView ) const
+{
+    if ( !m_header ) {
+        return false;
+    }
+
+    // Every read of the slot made so far must complete before the lock is checked again.
+    boost::atomic_thread_fence ( boost::memory_order_acquire );
+    PcSharedSlotHeader const* slot = (PcSharedSlotHeader const*)(
+        (unsigned char const*)m_header + PCC_SHARED_ALIGNMENT + iView.Slot * m_header->SlotStride
+    );
+    return ( slot->Lock.load ( boost::memory_order_relaxed ) == iView.Lock );
+}
+bool PcSharedFrameReader::CopyFrame ( PcSharedFrameView const& iView, cv::Mat& oImage ) const
+{
+    iView.Image.copyTo ( oImage );
+    return IsValid ( iView );
+}
+VEC(std::string) PcSharedFrameReader::ListCameras ()
+{
+    VEC(std::string) cameras;
+
+    PcSharedMemoryType memory;
+    bip::mapped_region region;
+    if ( !OpenSharedMemory ( PCC_SHARED_DIRECTORY_NAME, memory, region ) || region.get_size () < sizeof ( PcSharedDirectory ) ) {
+        return cameras;
+    }
+
+    PcSharedDirectory const* directory = (PcSharedDirectory const*)region.get_address ();
+    if ( directory->Magic != PcSharedSegmentHeader::MAGIC ) {
+        return cameras;
+    }
+    unsigned int const count = std::min ( directory->Count.load ( boost::memory_order_acquire ), PCC_SHARED_MAX_CAMERAS );
+    for ( unsigned int c = 0; c < count; c++ ) {
+        char const* id = directory->Cameras[c];
+        cameras.push_back ( std::string ( id, strnlen ( id, PCC_SHARED_MAX_ID_LENGTH ) ) );
+    }
+    return cameras;
+}
+
+// Private
+bool PcSharedFrameReader::ReadFrame ( boost::uint64_t const& iSequence, PcSharedFrameView& oView )
+{
+    unsigned int const slotIndex = (unsigned int)( iSequence % m_header->SlotCount );
+    unsigned char const* slotBase = (unsigned char const*)m_header + PCC_SHARED_ALIGNMENT + slotIndex * m_header->SlotStride;
+    PcSharedSlotHeader const* slot = (PcSharedSlotHeader const*)slotBase;
+
+    boost::uint64_t const lock = slot->Lock.load ( boost::memory_order_acquire );
+    if ( ( lock & 1u ) != 0u || slot->Sequence != iSequence ) {
+        return false;
+    }
+
+    boost::uint64_t const size = (boost::uint64_t)slot->Width * slot->Height * slot->Channels;
+    if ( slot->Channels == 0u || slot->Channels > 4u || size != slot->PayloadSize || size > m_header->PayloadCapacity ) {
+        return false;
+    }
+
+    oView.Image     = cv::Mat ( slot->Height, slot->Width, CV_8UC(slot->Channels), (void*)( slotBase + PCC_SHARED_ALIGNMENT ) );
+    oView.Sequence  = iSequence;
+    oView.Timestamp = slot->Timestamp;
+    oView.FrameId   = slot->FrameId;
+    oView.Slot      = slotIndex;
+    oView.Lock      = lock;
+
+    // The metadata read above is only trustworthy if the slot didn't change meanwhile.
+    return IsValid ( oView );
+}
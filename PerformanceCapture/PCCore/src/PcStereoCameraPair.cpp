@@ -6,66 +6,212 @@
 #include "PcCamera.h"
 #include "PcSystem.h"
 #include "PcCalibrationHelper.h"
+#include "PcThreadPool.h"
 
+#include <boost/bind.hpp>
 #include <boost/log/trivial.hpp>
 
 #include <opencv2/calib3d/calib3d.hpp>
 
+#include <cstring>
+#include <ctime>
+
 using namespace pcc;
 
+// The minimum number of views both cameras must share for a stereo calibration.
+static size_t const MIN_SHARED_VIEWS = 3u;
+
 PcStereoCameraPair::PcStereoCameraPair (
     PcCameraPtr         iLeft,
     PcCameraPtr         iRight
-)   :   m_left ()
+)   :   m_mutex ()
+    ,   m_idle ()
+    ,   m_taskCount ( 0u )
+    ,   m_jobCount ( 0u )
+    ,   m_left ()
     ,   m_right ()
-    ,   m_stereoRotation ()
-    ,   m_stereoTranslation ()
-    ,   m_stereoEssential ()
-    ,   m_stereoFundamental ()
+    ,   m_calibration ()
+    ,   m_isRectifying ( false )
+    ,   m_rectification ()
+    ,   m_rectifiedLeft ( new PcFrame () )
+    ,   m_rectifiedRight ( new PcFrame () )
 {
     SetLeft ( iLeft );
     SetRight ( iRight );
 }
+PcStereoCameraPair::~PcStereoCameraPair ()
+{
+    boost::unique_lock<boost::mutex> lock ( m_mutex );
+
+    while ( m_taskCount > 0u ) {
+        m_idle.wait ( lock );
+    }
+}
 
 void PcStereoCameraPair::OnCameraCalibrated ( PcCamera* iCamera, CalibrationState iOldState, CalibrationState iNewState )
 {
+    // Runs with the camera calibration locked, so the solve itself is left to a task.
     std::string const& camId = iCamera->GetID ();
     if ( iNewState == CALIBRATED && camId.compare ( m_left->GetID () ) == 0 ) {
         if ( m_right.get () != 0x0 && m_right->GetCalibrationState () == CALIBRATED ) {
-            Calibrate ();
+            ScheduleCalibration ();
         }
     } else if ( iNewState == CALIBRATED && camId.compare ( m_right->GetID () ) == 0 ) {
         if ( m_left.get () != 0x0 && m_left->GetCalibrationState () == CALIBRATED ) {
-            Calibrate ();
+            ScheduleCalibration ();
         }
     }
 }
 
-void PcStereoCameraPair::Calibrate ()
+void PcStereoCameraPair::ScheduleCalibration ()
+{
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    m_taskCount++;
+    m_jobCount++;
+    PcThreadPool::GetInstance ().Submit ( boost::bind ( &PcStereoCameraPair::RunCalibration, this, m_jobCount ) );
+}
+void PcStereoCameraPair::GetCacheRecord ( PcStereoRecord& oRecord )
+{
+    PcStereoCalibrationPtr const calibration = GetCalibration ();
+
+    PcCalibrationCache::WriteId ( m_left->GetID (), oRecord.LeftId );
+    PcCalibrationCache::WriteId ( m_right->GetID (), oRecord.RightId );
+    PcCalibrationCache::WriteMatrix ( calibration ? calibration->Rotation : cv::Mat (), 9u, oRecord.Rotation );
+    PcCalibrationCache::WriteMatrix ( calibration ? calibration->Translation : cv::Mat (), 3u, oRecord.Translation );
+    PcCalibrationCache::WriteMatrix ( calibration ? calibration->Essential : cv::Mat (), 9u, oRecord.Essential );
+    PcCalibrationCache::WriteMatrix ( calibration ? calibration->Fundamental : cv::Mat (), 9u, oRecord.Fundamental );
+    oRecord.Rms = calibration ? calibration->Rms : -1.0;
+    oRecord.Date = calibration ? calibration->Date : 0;
+}
+bool PcStereoCameraPair::RestoreCalibration ( PcStereoRecord const& iRecord )
+{
+    PcStereoRecord expected;
+    PcCalibrationCache::WriteId ( m_left->GetID (), expected.LeftId );
+    PcCalibrationCache::WriteId ( m_right->GetID (), expected.RightId );
+    if (    strncmp ( expected.LeftId, iRecord.LeftId, PCC_CACHE_ID_LENGTH ) != 0
+        ||  strncmp ( expected.RightId, iRecord.RightId, PCC_CACHE_ID_LENGTH ) != 0 ) {
+        return false;
+    }
+
+    boost::shared_ptr<PcStereoCalibration> calibration ( new PcStereoCalibration () );
+    calibration->Rotation = PcCalibrationCache::ReadMatrix ( iRecord.Rotation, 3, 3 );
+    calibration->Translation = PcCalibrationCache::ReadMatrix ( iRecord.Translation, 3, 1 );
+    calibration->Essential = PcCalibrationCache::ReadMatrix ( iRecord.Essential, 3, 3 );
+    calibration->Fundamental = PcCalibrationCache::ReadMatrix ( iRecord.Fundamental, 3, 3 );
+    calibration->Rms = iRecord.Rms;
+    calibration->Date = iRecord.Date;
+    boost::atomic_store ( &m_calibration, PcStereoCalibrationPtr ( calibration ) );
+    return true;
+}
+boost::int64_t PcStereoCameraPair::GetCalibrationDate ()
 {
-    cv::stereoCalibrate (
-        PcCalibrationHelper::GetInstance ().GetChessboardPoints (),
-        m_left->GetChessboardCorners (),
-        m_right->GetChessboardCorners (),
-        m_left->CameraMatrix (),
-        m_left->DistCoeffs (),
-        m_right->CameraMatrix (),
-        m_right->DistCoeffs (),
-        m_left->GetFrameSize (),
-        m_stereoRotation,
-        m_stereoTranslation,
-        m_stereoEssential,
-        m_stereoFundamental
-    );
-
-    BOOST_LOG_TRIVIAL (trace) << std::endl << "Rstereo: " << std::endl << m_stereoRotation << std::endl;
-    BOOST_LOG_TRIVIAL (trace) << std::endl << "Tstereo: " << std::endl << m_stereoTranslation << std::endl;
-    BOOST_LOG_TRIVIAL (trace) << std::endl << "Estereo: " << std::endl << m_stereoEssential << std::endl;
-    BOOST_LOG_TRIVIAL (trace) << std::endl << "Fstereo: " << std::endl << m_stereoFundamental << std::endl;
-
-    m_left->StopAcquisition ();
-    m_left->StartAcquisition ();
-
-    m_right->StopAcquisition ();
-    m_right->StartAcquisition ();
-}
\ No newline at end of file
+    PcStereoCalibrationPtr const calibration = GetCalibration ();
+    return calibration ? calibration->Date : 0;
+}
+void PcStereoCameraPair::UpdateRectification ()
+{
+    PcStereoCalibrationPtr const calibration = GetCalibration ();
+    if ( !m_isRectifying ) {
+        boost::atomic_store ( &m_rectification, PcStereoRectificationPtr () );
+        return;
+    }
+    PcStereoRectificationPtr const current = GetRectification ();
+    if (    !calibration || ( current && current->Calibration == calibration )
+        ||  m_left->GetCalibrationState () != CALIBRATED || m_right->GetCalibrationState () != CALIBRATED ) {
+        return;
+    }
+
+    boost::shared_ptr<PcStereoRectification> rectification ( new PcStereoRectification () );
+    rectification->Calibration = calibration;
+    if ( PcCreateRectifyMaps (
+            m_left->CameraMatrix (), m_left->DistCoeffs (),
+            m_right->CameraMatrix (), m_right->DistCoeffs (),
+            m_left->GetFrameSize (), calibration->Rotation, calibration->Translation,
+            rectification->Left, rectification->Right, rectification->DisparityToDepth ) ) {
+        boost::atomic_store ( &m_rectification, PcStereoRectificationPtr ( rectification ) );
+    }
+}
+void PcStereoCameraPair::PushFrame ( PcCameraPtr const& iCamera, PcFramePtr const& iFrame )
+{
+    PcStereoRectificationPtr const rectification = GetRectification ();
+    if ( !rectification ) {
+        return;
+    }
+    if ( iCamera == m_left ) {
+        m_rectifiedLeft->Remap ( *iFrame, *rectification->Left );
+    } else if ( iCamera == m_right ) {
+        m_rectifiedRight->Remap ( *iFrame, *rectification->Right );
+    }
+}
+
+// Private
+void PcStereoCameraPair::RunCalibration ( unsigned int const& iJob )
+{
+    PcStereoCalibrationPtr const calibration = Calibrate ();
+
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    // A calibration scheduled later uses more recent views, and wins even if it completes first.
+    if ( calibration && iJob == m_jobCount ) {
+        boost::atomic_store ( &m_calibration, calibration );
+    }
+    m_taskCount--;
+    m_idle.notify_all ();
+}
+PcStereoCalibrationPtr PcStereoCameraPair::Calibrate () const
+{
+    VEC(PcCalibrationView) leftViews, rightViews;
+    VECOFVECS(cv::Point2f) leftCorners, rightCorners;
+    m_left->GetSharedCalibrationObservations ( leftViews, leftCorners );
+    m_right->GetSharedCalibrationObservations ( rightViews, rightCorners );
+
+    // Both lists are in increasing set order, and only the sets both cameras found the board in can be used.
+    VECOFVECS(cv::Point2f) leftMatched, rightMatched;
+    size_t l = 0, r = 0;
+    while ( l < leftViews.size () && r < rightViews.size () ) {
+        if ( leftViews[l].SetId < rightViews[r].SetId ) {
+            l++;
+        } else if ( rightViews[r].SetId < leftViews[l].SetId ) {
+            r++;
+        } else {
+            leftMatched.push_back ( leftCorners[l++] );
+            rightMatched.push_back ( rightCorners[r++] );
+        }
+    }
+
+    // A camera restored from the calibration cache has no views to match.
+    if ( leftMatched.size () < MIN_SHARED_VIEWS ) {
+        BOOST_LOG_TRIVIAL (trace) << "Stereo pair " << m_left->GetID () << " / " << m_right->GetID () << " shares "
+                                  << leftMatched.size () << " views, too few to calibrate from";
+        return PcStereoCalibrationPtr ();
+    }
+
+    boost::shared_ptr<PcStereoCalibration> calibration ( new PcStereoCalibration () );
+    try {
+        calibration->Rms = cv::stereoCalibrate (
+            PcCalibrationHelper::GetInstance ().GetTargetPoints ( (unsigned int)leftMatched.size () ),
+            leftMatched,
+            rightMatched,
+            m_left->CameraMatrix ().clone (),
+            m_left->DistCoeffs ().clone (),
+            m_right->CameraMatrix ().clone (),
+            m_right->DistCoeffs ().clone (),
+            m_left->GetFrameSize (),
+            calibration->Rotation,
+            calibration->Translation,
+            calibration->Essential,
+            calibration->Fundamental
+        );
+    } catch ( cv::Exception const& e ) {
+        BOOST_LOG_TRIVIAL (trace) << "Stereo calibration of " << m_left->GetID () << " / " << m_right->GetID () << " failed: " << e.what ();
+        return PcStereoCalibrationPtr ();
+    }
+    calibration->Date = (boost::int64_t)time ( 0 );
+
+    BOOST_LOG_TRIVIAL (trace) << std::endl << "Rstereo: " << std::endl << calibration->Rotation << std::endl;
+    BOOST_LOG_TRIVIAL (trace) << std::endl << "Tstereo: " << std::endl << calibration->Translation << std::endl;
+    BOOST_LOG_TRIVIAL (trace) << std::endl << "Estereo: " << std::endl << calibration->Essential << std::endl;
+    BOOST_LOG_TRIVIAL (trace) << std::endl << "Fstereo: " << std::endl << calibration->Fundamental << std::endl;
+    return calibration;
+}
@@ -5,11 +5,15 @@
 #include "PcFrameObserver.h"
 #include "PcErrChk.h"
 #include "PcCalibrationHelper.h"
+#include "PcThreadPool.h"
 
 #define BOOST_ALL_DYN_LINK
 #include <boost/thread/thread.hpp>
 #include <boost/thread/locks.hpp>
 
+#include <algorithm>
+#include <cstring>
+
 #include <opencv2/gpu/gpu.hpp>
 #include <opencv2/gpu/gpumat.hpp>
 
@@ -19,6 +23,9 @@ using namespace pcc;
 // Total available bandwidth in bytes
 static unsigned int const MAX_BW = 124000000;
 
+// The number of new wand observations after which the wand calibration is solved again.
+static size_t const WAND_SOLVE_INTERVAL = 500u;
+
 VmbAPI::ICameraListObserverPtr PcSystem::sm_pInstance ( (PcSystem*)0x0 );
 
 PcSystem::PcSystem()
@@ -26,7 +33,17 @@ PcSystem::PcSystem()
     ,   m_activeCameras ()
     ,   m_mutex ( new MutexType () )
     ,   m_frames ()
+    ,   m_undistortedFrames ()
     ,   m_stereo ()
+    ,   m_calibrationCapture ()
+    ,   m_calibrationCache ()
+    ,   m_rigSolution ()
+    ,   m_wandCalibrator ()
+    ,   m_wandSolveCount ( 0u )
+    ,   m_wandStatus ()
+    ,   m_driftedCameras ()
+    ,   m_recorder ()
+    ,   m_publisher ()
 {}
 
 void PcSystem::Setup ()
@@ -101,12 +118,19 @@ void PcSystem::Setup ()
         //    frameList[j] = newFrame;
         //}
     }
+    std::string const& cachePath = PcCalibrationHelper::GetInstance ().CachePath ();
+    if ( !cachePath.empty () ) {
+        m_calibrationCache.Load ( cachePath );
+    }
+
     std::cout << cameras.size () << " cameras found" << std::endl;
     std::cout << "Maximum per-camera bandwidth: " << GetMaxPerCameraBandwidth () << std::endl;
 }
 
 PcSystem::~PcSystem ()
 {
+    StopRecording ();
+    StopFramePublishing ();
     PCC_OBJ_FREE ( m_mutex );
 
     //PcCalibrationHelper& calib = PcCalibrationHelper::GetInstance ();
@@ -138,6 +162,9 @@ void PcSystem::DestroyInstance ()
     VmbAPI::VimbaSystem& vmbs = VmbAPI::VimbaSystem::GetInstance ();
     vmbs.UnregisterCameraListObserver ( sm_pInstance );
     sm_pInstance.reset ( (PcSystem*)0x0 );
+
+    // The cameras wait for their calibration tasks on destruction, so the pool goes last.
+    PcThreadPool::DestroyInstance ();
 }
 
 void PcSystem::StartCapture ()
@@ -208,6 +235,32 @@ PcFramePtr const PcSystem::GetFrameFromCamera ( std::string const& iCameraId )
 {
     return m_frames.at ( iCameraId );
 }
+void PcSystem::SetCameraUndistortion ( std::string const& iCameraId, bool const& iEnable )
+{
+    m_activeCameras.at ( iCameraId )->SetUndistortion ( iEnable );
+}
+PcFramePtr const PcSystem::GetUndistortedFrameFromCamera ( std::string const& iCameraId )
+{
+    if ( !m_activeCameras.at ( iCameraId )->IsUndistorting () ) {
+        return PcFramePtr ();
+    }
+    return m_undistortedFrames.at ( iCameraId );
+}
+void PcSystem::SetStereoRectification ( bool const& iEnable )
+{
+    for ( auto pair = m_stereo.begin (); pair != m_stereo.end (); pair++ ) {
+        (*pair)->SetRectification ( iEnable );
+    }
+}
+bool PcSystem::GetRectifiedFrames ( size_t const& iPair, PcFramePtr& oLeft, PcFramePtr& oRight )
+{
+    if ( iPair >= m_stereo.size () || !m_stereo[iPair]->GetRectification () ) {
+        return false;
+    }
+    oLeft = m_stereo[iPair]->GetRectifiedLeft ();
+    oRight = m_stereo[iPair]->GetRectifiedRight ();
+    return true;
+}
 std::string PcSystem::GetCameraStatus ( std::string const& iCameraId )
 {
     return m_activeCameras.at ( iCameraId )->GetPtpStatus ();
@@ -218,6 +271,21 @@ double PcSystem::GetCameraCalibrationProgress ( std::string const& iCameraId )
     return m_activeCameras.at ( iCameraId )->GetCalibrationProgress ();
 }
 
+double PcSystem::GetCameraCalibrationRms ( std::string const& iCameraId )
+{
+    return m_activeCameras.at ( iCameraId )->GetCalibrationRms ();
+}
+
+double PcSystem::GetCameraCalibrationSharpness ( std::string const& iCameraId )
+{
+    return m_activeCameras.at ( iCameraId )->GetCalibrationSharpness ();
+}
+
+std::string PcSystem::GetCameraCalibrationGuidance ( std::string const& iCameraId )
+{
+    return m_activeCameras.at ( iCameraId )->GetCalibrationGuidance ();
+}
+
 void PcSystem::SetFrame ( VmbAPI::CameraPtr const& iCamera, VmbAPI::FramePtr const& iFrame )
 {
     VmbErrorType err;
@@ -234,14 +302,52 @@ void PcSystem::SetFrame ( VmbAPI::CameraPtr const& iCamera, VmbAPI::FramePtr con
     err = iFrame->GetImage(frameData);
     ERR_CHK ( err, VmbErrorSuccess, "Error reading frame image data." );
 
+    VmbUint64_t timestamp = 0u;
+    err = iFrame->GetTimestamp ( timestamp );
+    ERR_CHK ( err, VmbErrorSuccess, "Error reading frame timestamp." );
+
+    VmbUint64_t frameId = 0u;
+    err = iFrame->GetFrameID ( frameId );
+    ERR_CHK ( err, VmbErrorSuccess, "Error reading frame ID." );
+
     std::string sCamId;
     iCamera->GetID ( sCamId );
     
-    m_frames[sCamId]->Reset ( width, height, 1, frameData );
+    // Cameras may tick at different rates, so the frames are timestamped in nanoseconds from here on.
+    timestamp = m_activeCameras.at ( sCamId )->ToNanoseconds ( timestamp );
+    m_frames[sCamId]->Reset ( width, height, 1, frameData, timestamp, frameId );
+
+    PcRecorderPtr recorder = boost::atomic_load ( &m_recorder );
+    if ( recorder ) {
+        recorder->Record ( sCamId, m_frames.at ( sCamId ) );
+    }
+
+    PcSharedFramePublisherPtr publisher = boost::atomic_load ( &m_publisher );
+    if ( publisher ) {
+        publisher->Publish ( sCamId, width, height, 1, frameData, timestamp, frameId );
+    }
     
+    PcWandCalibratorPtr wand = PcCalibrationHelper::GetInstance ().GetWandCalibrator ();
+    if ( wand ) {
+        wand->PushFrame ( sCamId, m_frames.at ( sCamId ) );
+    }
+
+    PcDriftMonitorPtr monitor = PcCalibrationHelper::GetInstance ().GetDriftMonitor ();
+    if ( monitor ) {
+        monitor->PushFrame ( sCamId, m_frames.at ( sCamId ) );
+    }
+
     //PcCalibrationHelper& calib = PcCalibrationHelper::GetInstance ();
     if ( m_activeCameras.at ( sCamId )->GetCalibrationState () == ACQUIRING ) {
-        m_activeCameras.at ( sCamId )->TryPushFrame ( m_frames.at ( sCamId ) );
+        m_calibrationCapture.PushFrame ( m_activeCameras.at ( sCamId ), m_frames.at ( sCamId ) );
+    }
+
+    PcRemapMapPtr const undistortMap = m_activeCameras.at ( sCamId )->GetUndistortMap ();
+    if ( undistortMap ) {
+        m_undistortedFrames.at ( sCamId )->Remap ( *m_frames.at ( sCamId ), *undistortMap );
+    }
+    for ( auto pair = m_stereo.begin (); pair != m_stereo.end (); pair++ ) {
+        (*pair)->PushFrame ( m_activeCameras.at ( sCamId ), m_frames.at ( sCamId ) );
     }
     //memcpy ( m_data[uiCamId].data, frameData, width * height * sizeof ( unsigned char ) );
 
@@ -276,6 +382,12 @@ void PcSystem::UnregisterCamera ( std::string const& iCameraId )
 
     m_activeCameras.erase ( iCameraId );
     m_frames.erase ( iCameraId );
+    m_undistortedFrames.erase ( iCameraId );
+
+    PcDriftMonitorPtr monitor = PcCalibrationHelper::GetInstance ().GetDriftMonitor ();
+    if ( monitor ) {
+        monitor->RemoveCamera ( iCameraId );
+    }
     for ( auto cam = m_activeCameras.begin (); cam != m_activeCameras.end (); cam++ ) {
         cam->second->AdjustBandwidth ( GetMaxPerCameraBandwidth () );
     }
@@ -290,18 +402,161 @@ void PcSystem::RegisterCamera ( std::string const& iCameraId, VmbAPI::CameraPtr
 
     m_activeCameras.insert ( newCam );
     m_frames.insert ( std::make_pair ( iCameraId, PcFramePtr ( new PcFrame () ) ) );
+    m_undistortedFrames.insert ( std::make_pair ( iCameraId, PcFramePtr ( new PcFrame () ) ) );
 
     if ( m_activeCameras.size () && !(m_activeCameras.size () % 2) ) {
         m_stereo.push_back ( PcStereoCameraPairPtr ( new PcStereoCameraPair ( lastCam->second, newCam.second ) ) );
     }
 
     newCam.second->Setup ();
+    RestoreCalibrations ( newCam.second );
     for ( auto cam = m_activeCameras.begin (); cam != m_activeCameras.end (); cam++ ) {
         cam->second->AdjustBandwidth ( GetMaxPerCameraBandwidth () );
     }
     newCam.second->StartAcquisition ();
 }
 
+void PcSystem::RestoreCalibrations ( PcCameraPtr const& iCamera )
+{
+    PcCameraRecord record;
+    if ( !m_calibrationCache.FindCamera ( iCamera->GetID (), record ) || !iCamera->RestoreCalibration ( record ) ) {
+        return;
+    }
+    std::cout << "Restored the calibration of camera " << iCamera->GetID () << ", RMS: " << record.Rms << std::endl;
+
+    for ( auto pair = m_stereo.begin (); pair != m_stereo.end (); pair++ ) {
+        PcCameraPtr const left = (*pair)->GetLeft ();
+        PcCameraPtr const right = (*pair)->GetRight ();
+        PcStereoRecord stereo;
+        if (    ( left == iCamera || right == iCamera )
+            &&  left->GetCalibrationState () == CALIBRATED && right->GetCalibrationState () == CALIBRATED
+            &&  m_calibrationCache.FindStereo ( left->GetID (), right->GetID (), stereo ) ) {
+            (*pair)->RestoreCalibration ( stereo );
+        }
+    }
+}
+
+bool PcSystem::ApplyRigSolution ( PcRigSolutionPtr const& iSolution )
+{
+    if ( !iSolution || iSolution == m_rigSolution ) {
+        return false;
+    }
+    m_rigSolution = iSolution;
+
+    VEC(std::string) cameraIds;
+    for ( auto rotation = iSolution->Rotations.begin (); rotation != iSolution->Rotations.end (); rotation++ ) {
+        if ( m_activeCameras.find ( rotation->first ) != m_activeCameras.end () ) {
+            cameraIds.push_back ( rotation->first );
+        }
+    }
+    boost::uint64_t const rigKey = PcCalibrationCache::RigKey ( cameraIds );
+    for ( auto id = cameraIds.begin (); id != cameraIds.end (); id++ ) {
+        m_activeCameras[*id]->SetRigPose ( rigKey, iSolution->Rotations.at ( *id ), iSolution->Translations.at ( *id ) );
+    }
+    std::cout << "Calibrated a rig of " << cameraIds.size () << " cameras around camera " << iSolution->WorldCamera
+              << ", RMS: " << iSolution->Rms << std::endl;
+    return true;
+}
+
+void PcSystem::UpdateWandCalibration ()
+{
+    PcWandCalibratorPtr const wand = PcCalibrationHelper::GetInstance ().GetWandCalibrator ();
+    if ( wand != m_wandCalibrator ) {
+        // A new calibrator starts counting from zero again.
+        m_wandCalibrator = wand;
+        m_wandSolveCount = 0u;
+    }
+    if ( !wand ) {
+        m_wandStatus.clear ();
+        return;
+    }
+
+    PcWandSolutionPtr const solution = wand->GetSolution ();
+    if ( solution && ApplyRigSolution ( solution->Poses ) ) {
+        std::cout << "Wand calibration from " << solution->ViewCount << " views:";
+        for ( auto rms = solution->CameraRms.begin (); rms != solution->CameraRms.end (); rms++ ) {
+            std::cout << " " << rms->first << " " << rms->second << " px (" << 100.0 * wand->GetCoverage ( rms->first ) << "% covered)";
+        }
+        std::cout << std::endl;
+    }
+
+    STRMAP(PcWandStatus) statuses;
+    for ( auto camera = m_activeCameras.begin (); camera != m_activeCameras.end (); camera++ ) {
+        PcWandStatus& status = statuses[camera->first];
+        status.Coverage = wand->GetCoverage ( camera->first );
+        status.Rms = -1.0;
+        status.ViewCount = 0u;
+        if ( solution && solution->CameraRms.find ( camera->first ) != solution->CameraRms.end () ) {
+            status.Rms = solution->CameraRms.at ( camera->first );
+            status.ViewCount = solution->ViewCount;
+        }
+    }
+    m_wandStatus.swap ( statuses );
+
+    size_t const observationCount = wand->GetObservationCount ();
+    if ( !wand->IsSolving () && observationCount >= m_wandSolveCount + WAND_SOLVE_INTERVAL ) {
+        CalibrateWand ();
+    }
+}
+
+void PcSystem::UpdateDriftMonitor ()
+{
+    PcDriftMonitorPtr const monitor = PcCalibrationHelper::GetInstance ().GetDriftMonitor ();
+    if ( !monitor ) {
+        m_driftedCameras.clear ();
+        return;
+    }
+
+    // Poses are only comparable within a rig, so the rig most cameras belong to is monitored.
+    std::map<boost::uint64_t, size_t> rigSizes;
+    boost::uint64_t rigKey = 0u;
+    for ( auto camera = m_activeCameras.begin (); camera != m_activeCameras.end (); camera++ ) {
+        boost::uint64_t const key = camera->second->RigKey ();
+        if ( camera->second->GetCalibrationState () != CALIBRATED || key == 0u ) {
+            continue;
+        }
+        size_t const size = ++rigSizes[key];
+        if ( size > rigSizes[rigKey] ) {
+            rigKey = key;
+        }
+    }
+    for ( auto camera = m_activeCameras.begin (); camera != m_activeCameras.end (); camera++ ) {
+        PcCameraPtr const& cam = camera->second;
+        if ( rigKey != 0u && cam->RigKey () == rigKey && cam->GetCalibrationState () == CALIBRATED ) {
+            monitor->SetCalibration ( camera->first, cam->CameraMatrix (), cam->DistCoeffs (), cam->RigRotation (), cam->RigTranslation () );
+        } else {
+            monitor->RemoveCamera ( camera->first );
+        }
+    }
+
+    VEC(std::string) const drifted = monitor->GetDriftedCameras ();
+    for ( auto id = drifted.begin (); id != drifted.end (); id++ ) {
+        PcDriftStatus status;
+        if ( std::find ( m_driftedCameras.begin (), m_driftedCameras.end (), *id ) == m_driftedCameras.end () && monitor->GetStatus ( *id, status ) ) {
+            std::cout << "Camera " << *id << " drifted from its calibration, error: " << status.Error << " px, baseline: "
+                      << status.Baseline << " px. It should be recalibrated." << std::endl;
+        }
+    }
+    for ( auto id = m_driftedCameras.begin (); id != m_driftedCameras.end (); id++ ) {
+        if ( std::find ( drifted.begin (), drifted.end (), *id ) == drifted.end () ) {
+            std::cout << "Camera " << *id << " is back within its calibration" << std::endl;
+        }
+    }
+    m_driftedCameras = drifted;
+}
+
+void PcSystem::UpdateRemapStages ()
+{
+    // The maps take a few tens of milliseconds to build, so the frames keep the previous ones meanwhile.
+    for ( auto camera = m_activeCameras.begin (); camera != m_activeCameras.end (); camera++ ) {
+        camera->second->UpdateUndistortMap ();
+        camera->second->UpdatePointUndistorter ();
+    }
+    for ( auto pair = m_stereo.begin (); pair != m_stereo.end (); pair++ ) {
+        (*pair)->UpdateRectification ();
+    }
+}
+
 void PcSystem::CameraListChanged ( VmbAPI::CameraPtr iCamera, VmbAPI::UpdateTriggerType iUpdateReason )
 {
     GuardType lock (*m_mutex);
@@ -334,6 +589,25 @@ int PcSystem::GetMaxPerCameraBandwidth ()
     }
 }
 
+VEC(std::string) PcSystem::GetDriftedCameras ()
+{
+    GuardType lock (*m_mutex);
+
+    return m_driftedCameras;
+}
+
+bool PcSystem::GetWandStatus ( std::string const& iCameraId, PcWandStatus& oStatus )
+{
+    GuardType lock (*m_mutex);
+
+    auto const status = m_wandStatus.find ( iCameraId );
+    if ( status == m_wandStatus.end () ) {
+        return false;
+    }
+    oStatus = status->second;
+    return true;
+}
+
 VEC(std::string) PcSystem::GetCameraList ()
 {
     VEC(std::string) list;
@@ -392,6 +666,13 @@ void PcSystem::UpdateCameras ()
     if ( hasChanged ) {
         //SynchroniseCameras ();
     }
+
+    PcRigCalibratorPtr const rig = PcCalibrationHelper::GetInstance ().GetRigCalibrator ();
+    ApplyRigSolution ( rig ? rig->GetSolution () : PcRigSolutionPtr () );
+    UpdateWandCalibration ();
+    UpdateDriftMonitor ();
+    UpdateRemapStages ();
+    SaveCalibrations ();
 }
 
 void PcSystem::SynchroniseCameras ()
@@ -411,11 +692,147 @@ void PcSystem::SynchroniseCameras ()
     }
 }
 
+void PcSystem::SaveCalibrations ()
+{
+    std::string const& cachePath = PcCalibrationHelper::GetInstance ().CachePath ();
+    if ( cachePath.empty () ) {
+        return;
+    }
+
+    bool hasChanged = false;
+    for ( auto camera = m_activeCameras.begin (); camera != m_activeCameras.end (); camera++ ) {
+        if ( camera->second->GetCalibrationState () != CALIBRATED ) {
+            continue;
+        }
+        PcCameraRecord record, cached;
+        camera->second->GetCacheRecord ( record );
+        if (    m_calibrationCache.FindCamera ( camera->first, cached )
+            &&  cached.Date == record.Date && cached.RigKey == record.RigKey
+            &&  memcmp ( cached.Rotation, record.Rotation, sizeof ( record.Rotation ) ) == 0
+            &&  memcmp ( cached.Translation, record.Translation, sizeof ( record.Translation ) ) == 0 ) {
+            continue;
+        }
+        m_calibrationCache.StoreCamera ( record );
+        hasChanged = true;
+    }
+    for ( auto pair = m_stereo.begin (); pair != m_stereo.end (); pair++ ) {
+        boost::int64_t const date = (*pair)->GetCalibrationDate ();
+        PcStereoRecord cached;
+        if (    date == 0
+            ||  ( m_calibrationCache.FindStereo ( (*pair)->GetLeft ()->GetID (), (*pair)->GetRight ()->GetID (), cached ) && cached.Date == date ) ) {
+            continue;
+        }
+        PcStereoRecord record;
+        (*pair)->GetCacheRecord ( record );
+        m_calibrationCache.StoreStereo ( record );
+        hasChanged = true;
+    }
+
+    if ( hasChanged ) {
+        m_calibrationCache.Save ( cachePath );
+    }
+}
+
 void PcSystem::CalibrateCameras ()
 {
     //PcCalibrationHelper& calib = PcCalibrationHelper::GetInstance ();
     //calib.StartCalibration ();
+    m_calibrationCapture.Clear ();
     for ( auto camera = m_activeCameras.begin (); camera != m_activeCameras.end (); camera++ ) {
         camera->second->StartCalibration ();
     }
-}
\ No newline at end of file
+}
+
+bool PcSystem::CalibrateRig ()
+{
+    PcRigCalibratorPtr rig = PcCalibrationHelper::GetInstance ().GetRigCalibrator ();
+    if ( !rig ) {
+        std::cout << "The rig calibration wasn't started" << std::endl;
+        return false;
+    }
+    if ( rig->IsSolving () ) {
+        std::cout << "The rig calibration is already solving" << std::endl;
+        return false;
+    }
+
+    for ( auto camera = m_activeCameras.begin (); camera != m_activeCameras.end (); camera++ ) {
+        if ( camera->second->GetCalibrationState () == CALIBRATED ) {
+            rig->SetIntrinsics ( camera->first, camera->second->CameraMatrix (), camera->second->DistCoeffs () );
+        }
+    }
+
+    // The task holds the calibrator, which outlives a StopRigCalibration until the solve completes.
+    std::cout << "Solving the rig calibration from " << rig->GetObservationCount () << " observations" << std::endl;
+    PcThreadPool::GetInstance ().Submit ( boost::bind ( &PcRigCalibrator::Solve, rig, 50u ) );
+    return true;
+}
+
+bool PcSystem::CalibrateWand ()
+{
+    PcWandCalibratorPtr wand = PcCalibrationHelper::GetInstance ().GetWandCalibrator ();
+    if ( !wand ) {
+        std::cout << "The wand calibration wasn't started" << std::endl;
+        return false;
+    }
+    if ( wand->IsSolving () ) {
+        std::cout << "The wand calibration is already solving" << std::endl;
+        return false;
+    }
+
+    for ( auto camera = m_activeCameras.begin (); camera != m_activeCameras.end (); camera++ ) {
+        if ( camera->second->GetCalibrationState () == CALIBRATED ) {
+            // The marker centroids are undistorted on every solve, so they go through the grid rather than the
+            // iterative cv::undistortPoints.
+            camera->second->UpdatePointUndistorter ();
+            wand->SetIntrinsics ( camera->first, camera->second->CameraMatrix (), camera->second->DistCoeffs (), camera->second->GetPointUndistorter () );
+        }
+    }
+
+    // The task holds the calibrator, which outlives a StopWandCalibration until the solve completes.
+    m_wandCalibrator = wand;
+    m_wandSolveCount = wand->GetObservationCount ();
+    PcThreadPool::GetInstance ().Submit ( boost::bind ( &PcWandCalibrator::Solve, wand, 50u ) );
+    return true;
+}
+
+bool PcSystem::StartRecording ( std::string const& iTakeName, VEC(std::string) const& iTargets )
+{
+    StopRecording ();
+
+    PcRecorderPtr recorder ( new PcRecorder ( iTakeName, iTargets ) );
+    if ( !recorder->Start () ) {
+        return false;
+    }
+    boost::atomic_store ( &m_recorder, recorder );
+    return true;
+}
+
+void PcSystem::StopRecording ()
+{
+    PcRecorderPtr recorder = boost::atomic_exchange ( &m_recorder, PcRecorderPtr () );
+    if ( recorder ) {
+        recorder->Stop ();
+    }
+}
+
+bool PcSystem::IsRecording ()
+{
+    return ( boost::atomic_load ( &m_recorder ).get () != 0x0 );
+}
+
+void PcSystem::StartFramePublishing ( unsigned int const& iSlotCount )
+{
+    if ( !IsPublishingFrames () ) {
+        boost::atomic_store ( &m_publisher, PcSharedFramePublisherPtr ( new PcSharedFramePublisher ( iSlotCount ) ) );
+    }
+}
+
+void PcSystem::StopFramePublishing ()
+{
+    boost::atomic_exchange ( &m_publisher, PcSharedFramePublisherPtr () );
+}
+
+bool PcSystem::IsPublishingFrames ()
+{
+    return ( boost::atomic_load ( &m_publisher ).get () != 0x0 );
+}
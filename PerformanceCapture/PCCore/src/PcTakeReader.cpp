@@ -0,0 +1,209 @@
+#include "PcTakeReader.h"
+
+#define BOOST_ALL_DYN_LINK
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace pcc;
+
+/// \brief Orders take entries by their take-wide sequence number.
+static bool CompareSequence ( PcIndexEntry const& iLeft, PcIndexEntry const& iRight )
+{
+    return iLeft.Sequence < iRight.Sequence;
+}
+
+/// \brief Counts the cameras referenced by a list of entries. An interrupted take may not list its cameras yet.
+static unsigned int CountCameras ( VEC(PcIndexEntry) const& iEntries, unsigned int const& iListed )
+{
+    unsigned int count = iListed;
+    for ( auto entry = iEntries.begin (); entry != iEntries.end (); entry++ ) {
+        count = std::max ( count, (unsigned int)entry->Camera + 1u );
+    }
+    return count;
+}
+
+// ----------------------------------------------------------------------
+// PcTakeReader
+// ----------------------------------------------------------------------
+// Public
+PcTakeReader::PcTakeReader ( std::string const& iManifestPath, bool const& iProxy )
+    :   m_mutex ()
+    ,   m_isOpen ( false )
+    ,   m_takeName ()
+    ,   m_cameraIds ()
+    ,   m_manifestDir ()
+    ,   m_stripePaths ()
+    ,   m_stripes ()
+    ,   m_indexPath ()
+    ,   m_index ()
+    ,   m_entries ()
+{
+    m_isOpen = ReadManifest ( iManifestPath, iProxy );
+    if ( !m_isOpen ) {
+        return;
+    }
+
+    bool hasIndex = !m_indexPath.empty () && m_index.Load ( m_indexPath ) && m_index.GetCameraCount () == m_cameraIds.size ();
+    if ( !hasIndex ) {
+        std::cout << "Take " << m_takeName << " has no index, rebuilding it." << std::endl;
+        if ( !ReadJournals () ) {
+            ScanStripes ();
+        }
+    }
+
+    for ( unsigned int c = 0; c < m_index.GetCameraCount (); c++ ) {
+        VEC(PcIndexEntry) const& entries = m_index.GetCameraEntries ( c );
+        m_entries.insert ( m_entries.end (), entries.begin (), entries.end () );
+    }
+    std::sort ( m_entries.begin (), m_entries.end (), CompareSequence );
+}
+PcTakeReader::~PcTakeReader ()
+{
+    for ( auto stripe = m_stripes.begin (); stripe != m_stripes.end (); stripe++ ) {
+        if ( *stripe ) {
+            fclose ( *stripe );
+        }
+    }
+}
+bool PcTakeReader::ReadFrame ( size_t const& iIndex, cv::Mat& oImage )
+{
+    if ( iIndex >= m_entries.size () ) {
+        return false;
+    }
+    return ReadEntry ( m_entries[iIndex], oImage );
+}
+bool PcTakeReader::ReadCameraFrame ( unsigned int const& iCamera, size_t const& iPosition, cv::Mat& oImage )
+{
+    if ( iCamera >= m_index.GetCameraCount () || iPosition >= m_index.GetCameraEntries ( iCamera ).size () ) {
+        return false;
+    }
+    return ReadEntry ( m_index.GetCameraEntries ( iCamera )[iPosition], oImage );
+}
+
+// Private
+bool PcTakeReader::ReadManifest ( std::string const& iManifestPath, bool const& iProxy )
+{
+    std::ifstream manifest ( iManifestPath.c_str () );
+    if ( !manifest.is_open () ) {
+        std::cout << "Error opening take manifest " << iManifestPath << std::endl;
+        return false;
+    }
+
+    std::string line;
+    std::getline ( manifest, line );
+    if ( line.compare ( "PCTAKE 1" ) != 0 ) {
+        std::cout << "Unsupported take manifest " << iManifestPath << std::endl;
+        return false;
+    }
+
+    boost::filesystem::path const manifestDir = boost::filesystem::path ( iManifestPath ).parent_path ();
+    m_manifestDir = manifestDir.string ();
+
+    char const* const stripeKey = iProxy ? "proxy" : "stripe";
+    char const* const indexKey  = iProxy ? "proxyindex" : "index";
+    while ( std::getline ( manifest, line ) ) {
+        size_t const split = line.find ( ' ' );
+        if ( split == std::string::npos ) {
+            continue;
+        }
+        std::string const key = line.substr ( 0, split );
+        std::string const value = line.substr ( split + 1 );
+
+        if ( key.compare ( "take" ) == 0 ) {
+            m_takeName = value;
+        } else if ( key.compare ( "camera" ) == 0 ) {
+            m_cameraIds.push_back ( value );
+        } else if ( key.compare ( stripeKey ) == 0 ) {
+            FILE* stripe = fopen ( value.c_str (), "rb" );
+            if ( !stripe ) {
+                std::string const local = ( manifestDir / boost::filesystem::path ( value ).filename () ).string ();
+                stripe = fopen ( local.c_str (), "rb" );
+            }
+            if ( !stripe ) {
+                std::cout << "Error opening recording stripe " << value << std::endl;
+                return false;
+            }
+            m_stripePaths.push_back ( value );
+            m_stripes.push_back ( stripe );
+        } else if ( key.compare ( indexKey ) == 0 ) {
+            m_indexPath = value;
+            if ( !boost::filesystem::exists ( m_indexPath ) ) {
+                m_indexPath = ( manifestDir / boost::filesystem::path ( value ).filename () ).string ();
+            }
+        }
+    }
+    return !m_stripes.empty ();
+}
+bool PcTakeReader::ReadJournals ()
+{
+    VEC(PcIndexEntry) entries;
+    for ( auto path = m_stripePaths.begin (); path != m_stripePaths.end (); path++ ) {
+        std::string journal = *path + PCC_JOURNAL_EXTENSION;
+        if ( !boost::filesystem::exists ( journal ) ) {
+            journal = ( boost::filesystem::path ( m_manifestDir ) / boost::filesystem::path ( journal ).filename () ).string ();
+        }
+        if ( !PcRecordingIndex::ReadJournal ( journal, entries ) ) {
+            return false;
+        }
+    }
+    m_index.Build ( entries, CountCameras ( entries, m_cameraIds.size () ), PCC_FRAME_SET_TOLERANCE );
+    return true;
+}
+void PcTakeReader::ScanStripes ()
+{
+    VEC(PcIndexEntry) entries;
+    for ( unsigned int s = 0; s < m_stripes.size (); s++ ) {
+        FILE* stripe = m_stripes[s];
+        boost::uint64_t offset = 0u;
+
+        PcChunkHeader header;
+        while ( PcFileSeek ( stripe, offset ) && fread ( &header, sizeof ( PcChunkHeader ), 1, stripe ) == 1 ) {
+            if ( header.Magic != PcChunkHeader::MAGIC ) {
+                std::cout << "Corrupted chunk in stripe " << s << " at offset " << offset << std::endl;
+                break;
+            }
+            boost::uint64_t const next = offset + sizeof ( PcChunkHeader ) + header.PayloadSize;
+            if ( !PcFileSeek ( stripe, next - 1 ) || fgetc ( stripe ) == EOF ) {
+                break;
+            }
+
+            PcIndexEntry entry;
+            entry.Timestamp = header.Timestamp;
+            entry.FrameId   = header.FrameId;
+            entry.Sequence  = header.Sequence;
+            entry.Offset    = offset;
+            entry.Camera    = header.Camera;
+            entry.Stripe    = (boost::uint16_t)s;
+            entry.Reserved  = 0u;
+            entries.push_back ( entry );
+            offset = next;
+        }
+    }
+    m_index.Build ( entries, CountCameras ( entries, m_cameraIds.size () ), PCC_FRAME_SET_TOLERANCE );
+}
+bool PcTakeReader::ReadEntry ( PcIndexEntry const& iEntry, cv::Mat& oImage )
+{
+    if ( iEntry.Stripe >= m_stripes.size () ) {
+        return false;
+    }
+
+    GuardType lock ( m_mutex );
+
+    FILE* stripe = m_stripes[iEntry.Stripe];
+    PcChunkHeader header;
+    if (    !PcFileSeek ( stripe, iEntry.Offset )
+        ||  fread ( &header, sizeof ( PcChunkHeader ), 1, stripe ) != 1
+        ||  header.Magic != PcChunkHeader::MAGIC ) {
+        return false;
+    }
+
+    oImage.create ( header.Height, header.Width, CV_8UC(header.Channels) );
+    if ( oImage.total () * oImage.elemSize () != header.PayloadSize ) {
+        return false;
+    }
+    return ( header.PayloadSize == 0 || fread ( oImage.data, header.PayloadSize, 1, stripe ) == 1 );
+}
@@ -0,0 +1,20 @@
+#include "PcTargetDetector.h"
+
+using namespace pcc;
+
+// ----------------------------------------------------------------------
+// PcTargetDetector
+// ----------------------------------------------------------------------
+// Public
+PcTargetDetector::PcTargetDetector ( PcCalibrationTarget const& iTarget, unsigned int const& iSearchWidth )
+    :   m_target ( iTarget )
+    ,   m_chessboard ( iTarget.GetSize (), iSearchWidth )
+    ,   m_circles ( iTarget.GetSize (), iTarget.GetType () == PCC_TARGET_ASYMMETRIC_CIRCLES, iSearchWidth )
+{}
+bool PcTargetDetector::Detect ( cv::Mat const& iFrame, VEC(cv::Point2f)& oPoints )
+{
+    if ( m_target.GetType () == PCC_TARGET_CHESSBOARD ) {
+        return m_chessboard.Detect ( iFrame, oPoints );
+    }
+    return m_circles.Detect ( iFrame, oPoints );
+}
@@ -0,0 +1,186 @@
+#include "PcThreadPool.h"
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+
+using namespace pcc;
+
+/// \brief The state shared by the threads running one ParallelFor loop.
+struct PcParallelLoop
+{
+    PcParallelLoop ( size_t const& iBegin, size_t const& iEnd, PcThreadPool::LoopBodyType const& iBody )
+        :   Next ( iBegin ), End ( iEnd ), Remaining ( iEnd - iBegin ), Body ( iBody )
+    {}
+
+    /// \brief Runs loop iterations until none is left to claim.
+    void Run ()
+    {
+        size_t done = 0u;
+        for ( size_t i = Next++; i < End; i = Next++ ) {
+            Body ( i );
+            done++;
+        }
+        if ( done > 0u && Remaining.fetch_sub ( done ) == done ) {
+            boost::lock_guard<boost::mutex> lock ( Mutex );
+            Done.notify_all ();
+        }
+    }
+
+    boost::atomic<size_t>           Next;       ///< The next index to claim.
+    size_t                          End;        ///< The index past the end of the range.
+    boost::atomic<size_t>           Remaining;  ///< The number of iterations not completed yet.
+    PcThreadPool::LoopBodyType      Body;       ///< The loop body.
+    boost::mutex                    Mutex;      ///< The mutex protecting the wait for completion.
+    boost::condition_variable       Done;       ///< Signalled when the last iteration completes.
+};
+
+PcThreadPool* PcThreadPool::sm_pInstance = 0x0;
+PcThreadPool* PcThreadPool::sm_pRetiring = 0x0;
+boost::mutex PcThreadPool::sm_instanceMutex;
+boost::thread_specific_ptr<unsigned int> PcThreadPool::sm_worker;
+
+// ----------------------------------------------------------------------
+// PcThreadPool
+// ----------------------------------------------------------------------
+// Public
+PcThreadPool& PcThreadPool::GetInstance ()
+{
+    boost::lock_guard<boost::mutex> lock ( sm_instanceMutex );
+    if ( !sm_pInstance && sm_pRetiring && sm_worker.get () ) {
+        // A task still running on the pool being destroyed keeps using it, since its workers drain the queues.
+        return (*sm_pRetiring);
+    }
+    if ( !sm_pInstance ) {
+        // Tasks may wait on each other through ParallelFor, which needs at least one other worker to make progress
+        // while a thread waits.
+        sm_pInstance = new PcThreadPool ( std::max ( 2u, boost::thread::hardware_concurrency () ) );
+    }
+    return (*sm_pInstance);
+}
+void PcThreadPool::DestroyInstance ()
+{
+    PcThreadPool* pool = 0x0;
+    {
+        boost::lock_guard<boost::mutex> lock ( sm_instanceMutex );
+        std::swap ( pool, sm_pInstance );
+        sm_pRetiring = pool;
+    }
+
+    // The workers are joined without the lock, since the tasks they still run may call GetInstance.
+    PCC_OBJ_FREE ( pool );
+
+    boost::lock_guard<boost::mutex> lock ( sm_instanceMutex );
+    sm_pRetiring = 0x0;
+}
+void PcThreadPool::Submit ( TaskType const& iTask )
+{
+    unsigned int const* current = sm_worker.get ();
+    unsigned int const worker = current ? *current : m_next++ % m_workers.size ();
+    {
+        boost::lock_guard<boost::mutex> lock ( m_sleepMutex );
+        m_pending++;
+    }
+    {
+        boost::lock_guard<boost::mutex> lock ( m_workers[worker]->Mutex );
+        m_workers[worker]->Tasks.push_back ( iTask );
+    }
+    m_wake.notify_one ();
+}
+void PcThreadPool::ParallelFor ( size_t const& iBegin, size_t const& iEnd, LoopBodyType const& iBody )
+{
+    if ( iEnd <= iBegin ) {
+        return;
+    }
+
+    boost::shared_ptr<PcParallelLoop> loop = boost::make_shared<PcParallelLoop> ( iBegin, iEnd, iBody );
+    size_t const helpers = std::min ( iEnd - iBegin - 1u, m_workers.size () );
+    for ( size_t h = 0; h < helpers; h++ ) {
+        // The helpers hold the loop state, since they may start after the loop is over.
+        Submit ( boost::bind ( &PcParallelLoop::Run, loop ) );
+    }
+    loop->Run ();
+
+    boost::unique_lock<boost::mutex> lock ( loop->Mutex );
+    while ( loop->Remaining > 0u ) {
+        loop->Done.wait ( lock );
+    }
+}
+
+// Private
+PcThreadPool::PcThreadPool ( unsigned int const& iWorkerCount )
+    :   m_workers ()
+    ,   m_threads ()
+    ,   m_next ( 0u )
+    ,   m_sleepMutex ()
+    ,   m_wake ()
+    ,   m_pending ( 0u )
+    ,   m_stop ( false )
+{
+    for ( unsigned int w = 0; w < iWorkerCount; w++ ) {
+        m_workers.push_back ( new Worker () );
+    }
+    for ( unsigned int w = 0; w < iWorkerCount; w++ ) {
+        m_threads.create_thread ( boost::bind ( &PcThreadPool::Run, this, w ) );
+    }
+}
+PcThreadPool::~PcThreadPool ()
+{
+    {
+        boost::lock_guard<boost::mutex> lock ( m_sleepMutex );
+        m_stop = true;
+    }
+    m_wake.notify_all ();
+    m_threads.join_all ();
+
+    for ( auto worker = m_workers.begin (); worker != m_workers.end (); worker++ ) {
+        PCC_OBJ_FREE ( *worker );
+    }
+}
+void PcThreadPool::Run ( unsigned int const& iWorker )
+{
+    sm_worker.reset ( new unsigned int ( iWorker ) );
+
+    TaskType task;
+    for ( ;; ) {
+        if ( TryTake ( iWorker, task ) ) {
+            task ();
+            task.clear ();
+            continue;
+        }
+
+        // Submit counts a task with m_sleepMutex held before queuing it, so no task can be missed here.
+        boost::unique_lock<boost::mutex> lock ( m_sleepMutex );
+        while ( m_pending == 0u && !m_stop ) {
+            m_wake.wait ( lock );
+        }
+        if ( m_pending == 0u && m_stop ) {
+            return;
+        }
+    }
+}
+bool PcThreadPool::TryTake ( unsigned int const& iWorker, TaskType& oTask )
+{
+    {
+        Worker& own = *m_workers[iWorker];
+        boost::lock_guard<boost::mutex> lock ( own.Mutex );
+        if ( !own.Tasks.empty () ) {
+            oTask.swap ( own.Tasks.back () );
+            own.Tasks.pop_back ();
+            m_pending--;
+            return true;
+        }
+    }
+    for ( size_t i = 1; i < m_workers.size (); i++ ) {
+        Worker& victim = *m_workers[( iWorker + i ) % m_workers.size ()];
+        boost::lock_guard<boost::mutex> lock ( victim.Mutex );
+        if ( !victim.Tasks.empty () ) {
+            oTask.swap ( victim.Tasks.front () );
+            victim.Tasks.pop_front ();
+            m_pending--;
+            return true;
+        }
+    }
+    return false;
+}
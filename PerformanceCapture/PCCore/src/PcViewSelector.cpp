@@ -0,0 +1,255 @@
+#include "PcViewSelector.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace pcc;
+
+// Tilt bin bounds, in degrees.
+static float const MODERATE_TILT = 15.0f;
+static float const STRONG_TILT = 30.0f;
+static unsigned int const TILT_BINS = 9u;
+
+// Distance bin bounds, as apparent board sizes.
+static float const FAR_SIZE = 0.35f;
+static float const NEAR_SIZE = 0.6f;
+static unsigned int const DISTANCE_BINS = 3u;
+
+// Two views closer than this in every respect are near-duplicates.
+static float const DUPLICATE_OFFSET = 0.05f;
+static float const DUPLICATE_SIZE = 0.05f;
+static float const DUPLICATE_ANGLE = 5.0f;
+
+static double const RADIANS_TO_DEGREES = 57.295779513082321;
+
+// ----------------------------------------------------------------------
+// PcViewSelector
+// ----------------------------------------------------------------------
+// Public
+PcViewSelector::PcViewSelector ( PcCalibrationTarget const& iBoard, unsigned int const& iGridSize, unsigned int const& iTarget )
+    :   m_board ( iBoard )
+    ,   m_gridSize ( std::max ( 1u, iGridSize ) )
+    ,   m_target ( std::max ( 1u, iTarget ) )
+    ,   m_cells ( m_gridSize * m_gridSize, 0u )
+    ,   m_tilts ( TILT_BINS, 0u )
+    ,   m_distances ( DISTANCE_BINS, 0u )
+    ,   m_poses ()
+    ,   m_rejected ( 0u )
+{}
+void PcViewSelector::Reset ()
+{
+    std::fill ( m_cells.begin (), m_cells.end (), 0u );
+    std::fill ( m_tilts.begin (), m_tilts.end (), 0u );
+    std::fill ( m_distances.begin (), m_distances.end (), 0u );
+    m_poses.clear ();
+    m_rejected = 0u;
+}
+bool PcViewSelector::Accept ( VEC(cv::Point2f) const& iCorners, cv::Size const& iImageSize )
+{
+    PcViewPose pose;
+    if ( !EstimatePose ( iCorners, m_board, iImageSize, pose ) ) {
+        m_rejected++;
+        return false;
+    }
+
+    for ( auto other = m_poses.begin (); other != m_poses.end (); other++ ) {
+        if (    std::abs ( other->Center.x - pose.Center.x ) < DUPLICATE_OFFSET
+            &&  std::abs ( other->Center.y - pose.Center.y ) < DUPLICATE_OFFSET
+            &&  std::abs ( other->Size - pose.Size ) < DUPLICATE_SIZE
+            &&  std::abs ( other->Yaw - pose.Yaw ) < DUPLICATE_ANGLE
+            &&  std::abs ( other->Pitch - pose.Pitch ) < DUPLICATE_ANGLE ) {
+            m_rejected++;
+            return false;
+        }
+    }
+
+    VEC(bool) reached ( m_cells.size (), false );
+    for ( auto corner = iCorners.begin (); corner != iCorners.end (); corner++ ) {
+        int const col = std::min ( (int)m_gridSize - 1, std::max ( 0, (int)( corner->x * m_gridSize / iImageSize.width ) ) );
+        int const row = std::min ( (int)m_gridSize - 1, std::max ( 0, (int)( corner->y * m_gridSize / iImageSize.height ) ) );
+        reached[row * m_gridSize + col] = true;
+    }
+
+    unsigned int const tilt = TiltBin ( pose );
+    unsigned int const distance = DistanceBin ( pose );
+
+    unsigned int gain = 0u;
+    for ( size_t c = 0; c < m_cells.size (); c++ ) {
+        if ( reached[c] && m_cells[c] < m_target ) {
+            gain++;
+        }
+    }
+    if ( m_tilts[tilt] < m_target ) {
+        gain++;
+    }
+    if ( m_distances[distance] < m_target ) {
+        gain++;
+    }
+    if ( gain == 0u && !IsComplete () ) {
+        m_rejected++;
+        return false;
+    }
+
+    for ( size_t c = 0; c < m_cells.size (); c++ ) {
+        if ( reached[c] ) {
+            m_cells[c]++;
+        }
+    }
+    m_tilts[tilt]++;
+    m_distances[distance]++;
+    m_poses.push_back ( pose );
+    return true;
+}
+double PcViewSelector::GetCoverage () const
+{
+    unsigned int filled = 0u;
+    for ( auto c = m_cells.begin (); c != m_cells.end (); c++ ) {
+        filled += std::min ( *c, m_target );
+    }
+    for ( auto t = m_tilts.begin (); t != m_tilts.end (); t++ ) {
+        filled += std::min ( *t, m_target );
+    }
+    for ( auto d = m_distances.begin (); d != m_distances.end (); d++ ) {
+        filled += std::min ( *d, m_target );
+    }
+    size_t const bins = m_cells.size () + m_tilts.size () + m_distances.size ();
+    return ( (double)filled / (double)( bins * m_target ) );
+}
+std::string PcViewSelector::GetGuidance () const
+{
+    static char const* const ROWS[] = { "top", "middle", "bottom" };
+    static char const* const COLS[] = { "left", "centre", "right" };
+    static char const* const DIRECTIONS[] = { "left", "right", "up", "down" };
+    static char const* const DISTANCES[] = { "farther away", "to a medium distance", "closer" };
+
+    for ( size_t c = 0; c < m_cells.size (); c++ ) {
+        if ( m_cells[c] < m_target ) {
+            unsigned int const row = (unsigned int)c / m_gridSize;
+            unsigned int const col = (unsigned int)c % m_gridSize;
+            std::string where = ROWS[row * 3u / m_gridSize];
+            where += "-";
+            where += COLS[col * 3u / m_gridSize];
+            return ( "Move the board to the " + where + " of the image" );
+        }
+    }
+    for ( unsigned int t = 0; t < TILT_BINS; t++ ) {
+        if ( m_tilts[t] < m_target ) {
+            if ( t == 0u ) {
+                return "Hold the board facing the camera";
+            }
+            std::string const direction = DIRECTIONS[( t - 1u ) % 4u];
+            return ( ( t < 5u ? "Turn the board slightly to face " : "Turn the board strongly to face " ) + direction );
+        }
+    }
+    for ( unsigned int d = 0; d < DISTANCE_BINS; d++ ) {
+        if ( m_distances[d] < m_target ) {
+            return ( std::string ( "Move the board " ) + DISTANCES[d] );
+        }
+    }
+    return std::string ();
+}
+bool PcViewSelector::EstimatePose ( VEC(cv::Point2f) const& iCorners, PcCalibrationTarget const& iBoard, cv::Size const& iImageSize, PcViewPose& oPose )
+{
+    int const cols = iBoard.GetSize ().width;
+    int const rows = iBoard.GetSize ().height;
+    if ( cols < 2 || rows < 2 || (int)iCorners.size () != cols * rows || iImageSize.area () <= 0 ) {
+        return false;
+    }
+
+    // The outer points, going round the board.
+    int const outer[] = { 0, cols - 1, rows * cols - 1, ( rows - 1 ) * cols };
+    cv::Point2f image[4], board[4];
+    for ( int i = 0; i < 4; i++ ) {
+        cv::Point3f const& point = iBoard.GetPoints ()[outer[i]];
+        image[i] = iCorners[outer[i]];
+        board[i] = cv::Point2f ( point.x, point.y );
+    }
+
+    VEC(cv::Point2f) const outline ( image, image + 4 );
+    double const area = cv::contourArea ( outline );
+    if ( area <= 0.0 ) {
+        return false;
+    }
+
+    cv::Point2f center ( 0.0f, 0.0f );
+    for ( auto corner = iCorners.begin (); corner != iCorners.end (); corner++ ) {
+        center += *corner;
+    }
+    oPose.Center = cv::Point2f (
+        center.x / (float)iCorners.size () / (float)iImageSize.width,
+        center.y / (float)iCorners.size () / (float)iImageSize.height
+    );
+    oPose.Size = (float)std::sqrt ( area / (double)iImageSize.area () );
+
+    // H = K [r1 r2 t] up to scale, with a nominal K.
+    cv::Mat const H = cv::getPerspectiveTransform ( board, image );
+    double const f = (double)std::max ( iImageSize.width, iImageSize.height );
+    double const cx = 0.5 * iImageSize.width;
+    double const cy = 0.5 * iImageSize.height;
+
+    // Columns of K^-1 H.
+    double m[3][3];
+    for ( int c = 0; c < 3; c++ ) {
+        double const h2 = H.at<double> ( 2, c );
+        m[c][0] = ( H.at<double> ( 0, c ) - cx * h2 ) / f;
+        m[c][1] = ( H.at<double> ( 1, c ) - cy * h2 ) / f;
+        m[c][2] = h2;
+    }
+    double const norm = std::sqrt ( m[0][0] * m[0][0] + m[0][1] * m[0][1] + m[0][2] * m[0][2] );
+    if ( norm <= 0.0 ) {
+        return false;
+    }
+    // The board lies in front of the camera.
+    double const scale = ( m[2][2] < 0.0 ? -1.0 : 1.0 ) / norm;
+
+    // The board normal, r1 x r2, up to the common scale.
+    double normal[3] = {
+        m[0][1] * m[1][2] - m[0][2] * m[1][1],
+        m[0][2] * m[1][0] - m[0][0] * m[1][2],
+        m[0][0] * m[1][1] - m[0][1] * m[1][0]
+    };
+    double const normalNorm = std::sqrt ( normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2] );
+    if ( normalNorm <= 0.0 ) {
+        return false;
+    }
+    double const t[3] = { m[2][0] * scale, m[2][1] * scale, m[2][2] * scale };
+    double const sign = ( normal[0] * t[0] + normal[1] * t[1] + normal[2] * t[2] > 0.0 ) ? -1.0 : 1.0;
+    for ( int i = 0; i < 3; i++ ) {
+        normal[i] *= sign / normalNorm;
+    }
+
+    // The normal points back to the camera, so a board facing the camera has a normal along -z.
+    oPose.Yaw = (float)( std::atan2 ( normal[0], -normal[2] ) * RADIANS_TO_DEGREES );
+    oPose.Pitch = (float)( std::atan2 ( normal[1], -normal[2] ) * RADIANS_TO_DEGREES );
+    return true;
+}
+
+// Private
+unsigned int PcViewSelector::TiltBin ( PcViewPose const& iPose )
+{
+    float const yaw = std::abs ( iPose.Yaw );
+    float const pitch = std::abs ( iPose.Pitch );
+    float const tilt = std::max ( yaw, pitch );
+    if ( tilt < MODERATE_TILT ) {
+        return 0u;
+    }
+
+    unsigned int direction;
+    if ( yaw >= pitch ) {
+        direction = ( iPose.Yaw < 0.0f ) ? 0u : 1u;
+    } else {
+        direction = ( iPose.Pitch < 0.0f ) ? 2u : 3u;
+    }
+    return ( ( tilt < STRONG_TILT ? 1u : 5u ) + direction );
+}
+unsigned int PcViewSelector::DistanceBin ( PcViewPose const& iPose )
+{
+    if ( iPose.Size < FAR_SIZE ) {
+        return 0u;
+    }
+    return ( iPose.Size < NEAR_SIZE ) ? 1u : 2u;
+}
+bool PcViewSelector::IsComplete () const
+{
+    return ( GetCoverage () >= 1.0 );
+}
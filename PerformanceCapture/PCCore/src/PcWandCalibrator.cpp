@@ -0,0 +1,1117 @@
+#include "PcWandCalibrator.h"
+
+#include "PcCalibrationMath.h"
+#include "PcThreadPool.h"
+
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <utility>
+
+using namespace pcc;
+
+// The intensity above which a pixel belongs to a marker.
+static double const MARKER_THRESHOLD = 200.0;
+
+// The largest marker searched for, in pixels along either axis.
+static int const MAX_MARKER_SIZE = 64;
+
+// The largest distance of a marker from the wand line, as a fraction of the wand length in the image, and in pixels.
+static float const MAX_LINE_DISTANCE = 0.03f;
+static float const MIN_LINE_DISTANCE = 2.0f;
+
+// The wand ends are told apart if the spacing fits one order at most half as badly as the other.
+static float const MAX_ORDER_AMBIGUITY = 0.5f;
+
+// The size of the coverage grid over the frames.
+static int const COVERAGE_COLUMNS = 8;
+static int const COVERAGE_ROWS = 6;
+
+// The number of views two cameras must share to start the solve, and a camera must share with the posed ones to join.
+static size_t const MIN_PAIR_VIEWS = 10u;
+static size_t const MIN_RESECTION_VIEWS = 6u;
+
+// The RANSAC threshold of the essential matrix, in pixels.
+static double const ESSENTIAL_THRESHOLD = 2.0;
+
+// Observations whose RMS error exceeds this many times the overall RMS error, and at least the floor in pixels, are dropped.
+static double const OUTLIER_FACTOR = 3.0;
+static double const MIN_OUTLIER_ERROR = 1.0;
+
+// The bundle adjustment stops when an iteration improves the cost by less than this fraction.
+static double const MIN_IMPROVEMENT = 1e-9;
+
+// The bounds of the Levenberg-Marquardt damping factor.
+static double const INITIAL_DAMPING = 1e-3;
+static double const MAX_DAMPING = 1e10;
+
+// The number of parameters of a wand view: its first marker, then two offsets of its direction.
+static int const WAND = 5;
+
+/// \brief The observation of a wand view by one camera, as used by the bundle adjustment.
+struct PcWandObservation
+{
+    unsigned int            Camera;         ///< The index of the observing camera.
+    size_t                  Source;         ///< The index of the observation in the snapshot.
+};
+
+/// \brief The bundle adjustment problem.
+struct PcWandProblem
+{
+    VEC(double)                     Positions;      ///< The marker distances from the first marker.
+    VECOFVECS(cv::Point2f)          Markers;        ///< The markers of every snapshot observation.
+    VECOFVECS(cv::Point2f)          Normalized;     ///< The undistorted, normalised markers of every snapshot observation.
+    VEC(cv::Mat)                    CameraMatrices; ///< The intrinsic matrix of every camera.
+    VEC(cv::Mat)                    DistCoeffs;     ///< The distortion coefficients of every camera.
+    VECOFVECS(PcWandObservation)    Views;          ///< The observations of every wand view.
+    VEC(double)                     Frames;         ///< The initial direction of every wand, then two unit vectors orthogonal to it.
+    VEC(int)                        FreeIndex;      ///< The index of every camera among the optimised ones, -1 if fixed or unused.
+};
+
+/// \brief The normal equation blocks of one wand view.
+struct PcWandViewBlocks
+{
+    double          V[WAND * WAND];     ///< The wand block, J_w^T J_w.
+    double          Vinv[WAND * WAND];  ///< The inverse of the damped wand block.
+    double          Gw[WAND];           ///< The wand gradient, J_w^T r.
+    double          Cost;               ///< The sum of the squared residuals of the view.
+    VEC(double)     U;                  ///< The camera blocks J_c^T J_c, 36 per observation.
+    VEC(double)     W;                  ///< The camera-wand blocks J_c^T J_w, 30 per observation.
+    VEC(double)     Y;                  ///< The products W Vinv, 30 per observation.
+    VEC(double)     Gc;                 ///< The camera gradients J_c^T r, 6 per observation.
+    bool            IsValid;            ///< Whether the damped wand block could be inverted.
+};
+
+/// \brief Gets the 3x4 matrix [ R | t ] of 6 pose parameters, a rotation vector followed by a translation.
+static cv::Mat ProjectionMatrix ( double const* iParams )
+{
+    cv::Mat rotation;
+    cv::Rodrigues ( cv::Mat ( 3, 1, CV_64F, const_cast<double*> ( iParams ) ), rotation );
+    cv::Mat projection ( 3, 4, CV_64F );
+    for ( int r = 0; r < 3; r++ ) {
+        for ( int c = 0; c < 3; c++ ) {
+            projection.at<double> ( r, c ) = rotation.at<double> ( r, c );
+        }
+        projection.at<double> ( r, 3 ) = iParams[3 + r];
+    }
+    return projection;
+}
+
+/// \brief Triangulates the markers of a wand view from the posed cameras that observed it.
+/// \return true if at least two posed cameras observed the view and every marker lies in front of them
+static bool TriangulateView (
+    PcWandProblem const&                iProblem,
+    VEC(PcWandObservation) const&       iView,
+    VEC(double) const&                  iCameras,
+    VEC(bool) const&                    iIsPosed,
+    VEC(cv::Point3d)&                   oMarkers
+) {
+    VEC(cv::Mat) projections;
+    VEC(size_t) sources;
+    for ( auto o = iView.begin (); o != iView.end (); o++ ) {
+        if ( iIsPosed[o->Camera] ) {
+            projections.push_back ( ProjectionMatrix ( &iCameras[o->Camera * 6u] ) );
+            sources.push_back ( o->Source );
+        }
+    }
+    if ( projections.size () < 2u ) {
+        return false;
+    }
+
+    oMarkers.resize ( iProblem.Positions.size () );
+    VEC(cv::Point2f) points ( projections.size () );
+    for ( size_t m = 0; m < oMarkers.size (); m++ ) {
+        for ( size_t s = 0; s < sources.size (); s++ ) {
+            points[s] = iProblem.Normalized[sources[s]][m];
+        }
+        if ( !PcTriangulate ( projections, points, oMarkers[m] ) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// \brief Gets the markers of a wand, and optionally their derivatives along the two direction offsets.
+static void WandMarkers ( PcWandProblem const& iProblem, size_t const& iView, double const* iWand, VEC(cv::Point3d)& oMarkers, double* oDerivatives )
+{
+    double const* const frame = &iProblem.Frames[iView * 9u];
+    double v[3], norm = 0.0;
+    for ( int k = 0; k < 3; k++ ) {
+        v[k] = frame[k] + iWand[3] * frame[3 + k] + iWand[4] * frame[6 + k];
+        norm += v[k] * v[k];
+    }
+    norm = std::sqrt ( norm );
+    double direction[3] = { v[0] / norm, v[1] / norm, v[2] / norm };
+
+    // d ( v / |v| ) / da = ( e - d ( d . e ) ) / |v|, for the unit vectors e of the frame.
+    double dDirection[2][3];
+    for ( int a = 0; a < 2; a++ ) {
+        double const* const e = frame + 3 * ( a + 1 );
+        double const dot = direction[0] * e[0] + direction[1] * e[1] + direction[2] * e[2];
+        for ( int k = 0; k < 3; k++ ) {
+            dDirection[a][k] = ( e[k] - direction[k] * dot ) / norm;
+        }
+    }
+
+    size_t const markerCount = iProblem.Positions.size ();
+    oMarkers.resize ( markerCount );
+    for ( size_t m = 0; m < markerCount; m++ ) {
+        double const s = iProblem.Positions[m] - iProblem.Positions[0];
+        oMarkers[m] = cv::Point3d ( iWand[0] + s * direction[0], iWand[1] + s * direction[1], iWand[2] + s * direction[2] );
+        if ( oDerivatives ) {
+            for ( int a = 0; a < 2; a++ ) {
+                for ( int k = 0; k < 3; k++ ) {
+                    oDerivatives[m * 6 + a * 3 + k] = s * dDirection[a][k];
+                }
+            }
+        }
+    }
+}
+
+/// \brief Projects the wand of one observation, optionally accumulating the normal equation blocks.
+/// \return the sum of the squared residuals
+static double Project (
+    PcWandProblem const&        iProblem,
+    size_t const&               iView,
+    PcWandObservation const&    iObservation,
+    double const*               iCamera,
+    double const*               iWand,
+    PcWandViewBlocks*           ioBlocks,
+    size_t const&               iIndex
+) {
+    VEC(cv::Point3d) markers;
+    VEC(double) dMarkers ( iProblem.Positions.size () * 6u );
+    WandMarkers ( iProblem, iView, iWand, markers, ioBlocks ? &dMarkers[0] : 0x0 );
+
+    cv::Mat rvec ( 3, 1, CV_64F, const_cast<double*> ( iCamera ) );
+    cv::Mat tvec ( 3, 1, CV_64F, const_cast<double*> ( iCamera + 3 ) );
+    VEC(cv::Point2d) projected;
+    cv::Mat jacobian;
+    cv::Mat const& cameraMatrix = iProblem.CameraMatrices[iObservation.Camera];
+    cv::Mat const& distCoeffs = iProblem.DistCoeffs[iObservation.Camera];
+    if ( ioBlocks ) {
+        cv::projectPoints ( markers, rvec, tvec, cameraMatrix, distCoeffs, projected, jacobian );
+    } else {
+        cv::projectPoints ( markers, rvec, tvec, cameraMatrix, distCoeffs, projected );
+    }
+
+    VEC(cv::Point2f) const& observed = iProblem.Markers[iObservation.Source];
+    double cost = 0.0;
+    for ( size_t p = 0; p < projected.size (); p++ ) {
+        double const dx = projected[p].x - observed[p].x;
+        double const dy = projected[p].y - observed[p].y;
+        cost += dx * dx + dy * dy;
+    }
+    if ( !ioBlocks ) {
+        return cost;
+    }
+
+    cv::Mat rotation;
+    cv::Rodrigues ( rvec, rotation );
+
+    bool const isFree = ( iProblem.FreeIndex[iObservation.Camera] >= 0 );
+    double* const U = &ioBlocks->U[iIndex * 36];
+    double* const W = &ioBlocks->W[iIndex * 30];
+    double* const Gc = &ioBlocks->Gc[iIndex * 6];
+    for ( int row = 0; row < jacobian.rows; row++ ) {
+        // The first 6 columns of the projection Jacobian are d ( u, v ) / d ( rvec, tvec ), and d ( u, v ) / dX = d ( u, v ) / dt R.
+        double const* const jc = jacobian.ptr<double> ( row );
+        int const marker = row / 2;
+        double const residual = ( row % 2 == 0 )
+            ? projected[marker].x - observed[marker].x
+            : projected[marker].y - observed[marker].y;
+
+        double jw[WAND];
+        for ( int c = 0; c < 3; c++ ) {
+            jw[c] = jc[3] * rotation.at<double> ( 0, c ) + jc[4] * rotation.at<double> ( 1, c ) + jc[5] * rotation.at<double> ( 2, c );
+        }
+        double const* const dMarker = &dMarkers[marker * 6];
+        jw[3] = jw[0] * dMarker[0] + jw[1] * dMarker[1] + jw[2] * dMarker[2];
+        jw[4] = jw[0] * dMarker[3] + jw[1] * dMarker[4] + jw[2] * dMarker[5];
+
+        for ( int r = 0; r < WAND; r++ ) {
+            ioBlocks->Gw[r] += jw[r] * residual;
+            for ( int c = 0; c < WAND; c++ ) {
+                ioBlocks->V[r * WAND + c] += jw[r] * jw[c];
+            }
+        }
+        if ( isFree ) {
+            for ( int r = 0; r < 6; r++ ) {
+                Gc[r] += jc[r] * residual;
+                for ( int c = 0; c < 6; c++ ) {
+                    U[r * 6 + c] += jc[r] * jc[c];
+                }
+                for ( int c = 0; c < WAND; c++ ) {
+                    W[r * WAND + c] += jc[r] * jw[c];
+                }
+            }
+        }
+    }
+    return cost;
+}
+
+/// \brief Evaluates the normal equation blocks of one wand view. Runs as a PcThreadPool::ParallelFor body.
+static void LinearizeView (
+    PcWandProblem const*        iProblem,
+    VEC(double) const*          iCameras,
+    VEC(double) const*          iWands,
+    VEC(PcWandViewBlocks)*      oBlocks,
+    size_t                      iView
+) {
+    VEC(PcWandObservation) const& view = iProblem->Views[iView];
+    PcWandViewBlocks& blocks = (*oBlocks)[iView];
+
+    std::fill ( blocks.V, blocks.V + WAND * WAND, 0.0 );
+    std::fill ( blocks.Gw, blocks.Gw + WAND, 0.0 );
+    blocks.U.assign ( view.size () * 36, 0.0 );
+    blocks.W.assign ( view.size () * 30, 0.0 );
+    blocks.Gc.assign ( view.size () * 6, 0.0 );
+    blocks.Y.assign ( view.size () * 30, 0.0 );
+    blocks.Cost = 0.0;
+    for ( size_t o = 0; o < view.size (); o++ ) {
+        blocks.Cost += Project ( *iProblem, iView, view[o], &(*iCameras)[view[o].Camera * 6], &(*iWands)[iView * WAND], &blocks, o );
+    }
+}
+
+/// \brief Damps and inverts the wand block of one view, and computes W Vinv. Runs as a PcThreadPool::ParallelFor body.
+static void EliminateView (
+    PcWandProblem const*        iProblem,
+    double                      iDamping,
+    VEC(PcWandViewBlocks)*      ioBlocks,
+    size_t                      iView
+) {
+    PcWandViewBlocks& blocks = (*ioBlocks)[iView];
+
+    double damped[WAND * WAND];
+    std::copy ( blocks.V, blocks.V + WAND * WAND, damped );
+    for ( int d = 0; d < WAND; d++ ) {
+        damped[d * ( WAND + 1 )] *= ( 1.0 + iDamping );
+    }
+    cv::Mat dampedMat ( WAND, WAND, CV_64F, damped );
+    cv::Mat inverse ( WAND, WAND, CV_64F, blocks.Vinv );
+    blocks.IsValid = ( cv::invert ( dampedMat, inverse, cv::DECOMP_CHOLESKY ) != 0.0 );
+    if ( !blocks.IsValid ) {
+        return;
+    }
+
+    VEC(PcWandObservation) const& view = iProblem->Views[iView];
+    for ( size_t o = 0; o < view.size (); o++ ) {
+        double const* const W = &blocks.W[o * 30];
+        double* const Y = &blocks.Y[o * 30];
+        for ( int r = 0; r < 6; r++ ) {
+            for ( int c = 0; c < WAND; c++ ) {
+                double sum = 0.0;
+                for ( int k = 0; k < WAND; k++ ) {
+                    sum += W[r * WAND + k] * blocks.Vinv[k * WAND + c];
+                }
+                Y[r * WAND + c] = sum;
+            }
+        }
+    }
+}
+
+/// \brief Evaluates the cost of every observation of one wand view. Runs as a PcThreadPool::ParallelFor body.
+static void EvaluateView (
+    PcWandProblem const*        iProblem,
+    VEC(double) const*          iCameras,
+    VEC(double) const*          iWands,
+    VECOFVECS(double)*          oCosts,
+    size_t                      iView
+) {
+    VEC(PcWandObservation) const& view = iProblem->Views[iView];
+    VEC(double)& costs = (*oCosts)[iView];
+    costs.resize ( view.size () );
+    for ( size_t o = 0; o < view.size (); o++ ) {
+        costs[o] = Project ( *iProblem, iView, view[o], &(*iCameras)[view[o].Camera * 6], &(*iWands)[iView * WAND], 0x0, o );
+    }
+}
+
+/// \brief Sets the index of every posed camera observed in the problem among the optimised ones.
+/// \return the number of optimised cameras
+static int IndexCameras ( PcWandProblem& ioProblem, unsigned int const& iWorld, VEC(bool)& ioIsPosed )
+{
+    VEC(bool) isObserved ( ioIsPosed.size (), false );
+    for ( auto view = ioProblem.Views.begin (); view != ioProblem.Views.end (); view++ ) {
+        for ( auto o = view->begin (); o != view->end (); o++ ) {
+            isObserved[o->Camera] = true;
+        }
+    }
+    ioProblem.FreeIndex.assign ( ioIsPosed.size (), -1 );
+    int freeCount = 0;
+    for ( size_t c = 0; c < ioIsPosed.size (); c++ ) {
+        ioIsPosed[c] = ioIsPosed[c] && ( isObserved[c] || c == iWorld );
+        if ( ioIsPosed[c] && c != iWorld ) {
+            ioProblem.FreeIndex[c] = freeCount++;
+        }
+    }
+    return freeCount;
+}
+
+/// \brief Refines the camera and wand poses with Levenberg-Marquardt, the wand poses eliminated by a Schur complement.
+/// \return the sum of the squared residuals at the solution
+static double Refine (
+    PcWandProblem const&        iProblem,
+    int const&                  iFreeCount,
+    VEC(double)&                ioCameras,
+    VEC(double)&                ioWands,
+    unsigned int const&         iMaxIterations
+) {
+    PcThreadPool& pool = PcThreadPool::GetInstance ();
+    size_t const viewCount = iProblem.Views.size ();
+    unsigned int const cameraCount = (unsigned int)iProblem.FreeIndex.size ();
+    VEC(PcWandViewBlocks) blocks ( viewCount );
+    VECOFVECS(double) costs ( viewCount );
+    double damping = INITIAL_DAMPING;
+    double cost = 0.0;
+    bool isLinearized = false;
+    int const reducedSize = iFreeCount * 6;
+    for ( unsigned int iteration = 0; iteration < iMaxIterations && damping < MAX_DAMPING; ) {
+        if ( !isLinearized ) {
+            pool.ParallelFor ( 0u, viewCount, boost::bind ( &LinearizeView, &iProblem, &ioCameras, &ioWands, &blocks, _1 ) );
+            cost = 0.0;
+            for ( size_t v = 0; v < viewCount; v++ ) {
+                cost += blocks[v].Cost;
+            }
+            isLinearized = true;
+        }
+
+        pool.ParallelFor ( 0u, viewCount, boost::bind ( &EliminateView, &iProblem, damping, &blocks, _1 ) );
+
+        // Reduced camera system: ( U - W Vinv W^T ) dc = -( gc - W Vinv gw ).
+        cv::Mat reduced = cv::Mat::zeros ( reducedSize, reducedSize, CV_64F );
+        cv::Mat rhs = cv::Mat::zeros ( reducedSize, 1, CV_64F );
+        bool isValid = true;
+        for ( size_t v = 0; v < viewCount && isValid; v++ ) {
+            PcWandViewBlocks const& view = blocks[v];
+            VEC(PcWandObservation) const& observations = iProblem.Views[v];
+            isValid = view.IsValid;
+            for ( size_t i = 0; i < observations.size () && isValid; i++ ) {
+                int const ci = iProblem.FreeIndex[observations[i].Camera];
+                if ( ci < 0 ) {
+                    continue;
+                }
+                double const* const Yi = &view.Y[i * 30];
+                for ( int r = 0; r < 6; r++ ) {
+                    double* const reducedRow = reduced.ptr<double> ( ci * 6 + r );
+                    for ( int c = 0; c < 6; c++ ) {
+                        reducedRow[ci * 6 + c] += view.U[i * 36 + r * 6 + c] * ( r == c ? 1.0 + damping : 1.0 );
+                    }
+                    double y = 0.0;
+                    for ( int k = 0; k < WAND; k++ ) {
+                        y += Yi[r * WAND + k] * view.Gw[k];
+                    }
+                    rhs.at<double> ( ci * 6 + r ) += y - view.Gc[i * 6 + r];
+                }
+                for ( size_t j = 0; j < observations.size (); j++ ) {
+                    int const cj = iProblem.FreeIndex[observations[j].Camera];
+                    if ( cj < 0 ) {
+                        continue;
+                    }
+                    double const* const Wj = &view.W[j * 30];
+                    for ( int r = 0; r < 6; r++ ) {
+                        double* const reducedRow = reduced.ptr<double> ( ci * 6 + r );
+                        for ( int c = 0; c < 6; c++ ) {
+                            double sum = 0.0;
+                            for ( int k = 0; k < WAND; k++ ) {
+                                sum += Yi[r * WAND + k] * Wj[c * WAND + k];
+                            }
+                            reducedRow[cj * 6 + c] -= sum;
+                        }
+                    }
+                }
+            }
+        }
+
+        cv::Mat cameraStep;
+        if ( !isValid || !cv::solve ( reduced, rhs, cameraStep, cv::DECOMP_CHOLESKY ) ) {
+            damping *= 10.0;
+            continue;
+        }
+
+        // Back-substitution: dw = Vinv ( -gw - W^T dc ).
+        VEC(double) trialCameras ( ioCameras );
+        for ( unsigned int c = 0; c < cameraCount; c++ ) {
+            for ( int k = 0; iProblem.FreeIndex[c] >= 0 && k < 6; k++ ) {
+                trialCameras[c * 6 + k] += cameraStep.at<double> ( iProblem.FreeIndex[c] * 6 + k );
+            }
+        }
+        VEC(double) trialWands ( ioWands );
+        for ( size_t v = 0; v < viewCount; v++ ) {
+            PcWandViewBlocks const& view = blocks[v];
+            VEC(PcWandObservation) const& observations = iProblem.Views[v];
+            double b[WAND];
+            for ( int r = 0; r < WAND; r++ ) {
+                b[r] = -view.Gw[r];
+            }
+            for ( size_t i = 0; i < observations.size (); i++ ) {
+                int const ci = iProblem.FreeIndex[observations[i].Camera];
+                for ( int r = 0; ci >= 0 && r < WAND; r++ ) {
+                    for ( int k = 0; k < 6; k++ ) {
+                        b[r] -= view.W[i * 30 + k * WAND + r] * cameraStep.at<double> ( ci * 6 + k );
+                    }
+                }
+            }
+            for ( int r = 0; r < WAND; r++ ) {
+                for ( int k = 0; k < WAND; k++ ) {
+                    trialWands[v * WAND + r] += view.Vinv[r * WAND + k] * b[k];
+                }
+            }
+        }
+
+        pool.ParallelFor ( 0u, viewCount, boost::bind ( &EvaluateView, &iProblem, &trialCameras, &trialWands, &costs, _1 ) );
+        double trialCost = 0.0;
+        for ( size_t v = 0; v < viewCount; v++ ) {
+            for ( auto c = costs[v].begin (); c != costs[v].end (); c++ ) {
+                trialCost += *c;
+            }
+        }
+
+        if ( trialCost < cost ) {
+            bool const hasConverged = ( cost - trialCost < MIN_IMPROVEMENT * cost );
+            ioCameras.swap ( trialCameras );
+            ioWands.swap ( trialWands );
+            cost = trialCost;
+            damping = std::max ( damping * 0.1, 1e-12 );
+            isLinearized = false;
+            iteration++;
+            if ( hasConverged ) {
+                break;
+            }
+        } else {
+            damping *= 10.0;
+        }
+    }
+    return cost;
+}
+
+// ----------------------------------------------------------------------
+// PcWandCalibrator
+// ----------------------------------------------------------------------
+// Public
+PcWandCalibrator::PcWandCalibrator ( VEC(double) const& iMarkerPositions, boost::uint64_t const& iTolerance )
+    :   m_markerPositions ( iMarkerPositions )
+    ,   m_tolerance ( iTolerance )
+    ,   m_mutex ()
+    ,   m_idle ()
+    ,   m_taskCount ( 0u )
+    ,   m_droppedFrames ( 0u )
+    ,   m_solveMutex ()
+    ,   m_isSolving ( false )
+    ,   m_observations ()
+    ,   m_intrinsics ()
+    ,   m_cameras ()
+    ,   m_solution ()
+{}
+PcWandCalibrator::~PcWandCalibrator ()
+{
+    boost::unique_lock<boost::mutex> lock ( m_mutex );
+
+    while ( m_taskCount > 0u ) {
+        m_idle.wait ( lock );
+    }
+}
+void PcWandCalibrator::SetIntrinsics (
+    std::string const&              iCameraId,
+    cv::Mat const&                  iCameraMatrix,
+    cv::Mat const&                  iDistCoeffs,
+    PcPointUndistorterPtr const&    iUndistorter
+) {
+    Intrinsics intrinsics;
+    iCameraMatrix.convertTo ( intrinsics.CameraMatrix, CV_64F );
+    iDistCoeffs.convertTo ( intrinsics.DistCoeffs, CV_64F );
+    intrinsics.Undistorter = iUndistorter;
+
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    m_intrinsics[iCameraId] = intrinsics;
+}
+void PcWandCalibrator::PushFrame ( std::string const& iCameraId, PcFramePtr const& iFrame )
+{
+    CameraState* state = 0x0;
+    {
+        boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+        state = &GetCameraState ( iCameraId );
+        if ( state->IsDetecting ) {
+            m_droppedFrames++;
+            return;
+        }
+        state->IsDetecting = true;
+        m_taskCount++;
+    }
+
+    // Only the caller that set IsDetecting writes the image, until the detection returns.
+    iFrame->GetImagePoints ().copyTo ( state->Image );
+    state->Timestamp = iFrame->Timestamp ();
+    PcThreadPool::GetInstance ().Submit ( boost::bind ( &PcWandCalibrator::Detect, this, iCameraId ) );
+}
+void PcWandCalibrator::AddObservation ( std::string const& iCameraId, boost::uint64_t const& iTimestamp, cv::Size const& iFrameSize, VEC(cv::Point2f) const& iMarkers )
+{
+    if ( iMarkers.size () != m_markerPositions.size () ) {
+        return;
+    }
+
+    Observation observation;
+    observation.CameraId = iCameraId;
+    observation.Timestamp = iTimestamp;
+    observation.Markers = iMarkers;
+
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    m_observations.push_back ( observation );
+
+    CameraState& state = GetCameraState ( iCameraId );
+    for ( auto marker = iMarkers.begin (); marker != iMarkers.end () && iFrameSize.area () > 0; marker++ ) {
+        int const column = std::min ( COVERAGE_COLUMNS - 1, std::max ( 0, (int)( marker->x * COVERAGE_COLUMNS / iFrameSize.width ) ) );
+        int const row = std::min ( COVERAGE_ROWS - 1, std::max ( 0, (int)( marker->y * COVERAGE_ROWS / iFrameSize.height ) ) );
+        if ( !state.Cells[row * COVERAGE_COLUMNS + column] ) {
+            state.Cells[row * COVERAGE_COLUMNS + column] = true;
+            state.CoveredCells++;
+        }
+    }
+}
+bool PcWandCalibrator::DetectWand ( cv::Mat const& iImage, VEC(cv::Point2f)& oMarkers ) const
+{
+    oMarkers.clear ();
+    size_t const markerCount = m_markerPositions.size ();
+    if ( iImage.type () != CV_8UC1 || markerCount < 3u ) {
+        return false;
+    }
+
+    cv::Mat binary;
+    cv::threshold ( iImage, binary, MARKER_THRESHOLD, 255.0, CV_THRESH_BINARY );
+    VECOFVECS(cv::Point) contours;
+    cv::findContours ( binary, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE );
+    if ( contours.size () != markerCount ) {
+        return false;
+    }
+
+    // Pixels above the threshold weigh by how much brighter they are, so the marker edges count partially.
+    VEC(cv::Point2f) centroids;
+    for ( auto contour = contours.begin (); contour != contours.end (); contour++ ) {
+        cv::Rect const box = cv::boundingRect ( *contour );
+        if ( box.width > MAX_MARKER_SIZE || box.height > MAX_MARKER_SIZE ) {
+            return false;
+        }
+        double sum = 0.0, sumX = 0.0, sumY = 0.0;
+        for ( int y = box.y; y < box.y + box.height; y++ ) {
+            unsigned char const* const row = iImage.ptr<unsigned char> ( y );
+            for ( int x = box.x; x < box.x + box.width; x++ ) {
+                double const weight = (double)row[x] - MARKER_THRESHOLD;
+                if ( weight > 0.0 ) {
+                    sum += weight;
+                    sumX += weight * x;
+                    sumY += weight * y;
+                }
+            }
+        }
+        if ( sum <= 0.0 ) {
+            return false;
+        }
+        centroids.push_back ( cv::Point2f ( (float)( sumX / sum ), (float)( sumY / sum ) ) );
+    }
+
+    // The two markers furthest apart are the wand ends.
+    size_t first = 0u, last = 1u;
+    float longest = 0.0f;
+    for ( size_t i = 0; i < markerCount; i++ ) {
+        for ( size_t j = i + 1; j < markerCount; j++ ) {
+            cv::Point2f const d = centroids[j] - centroids[i];
+            if ( d.x * d.x + d.y * d.y > longest ) {
+                longest = d.x * d.x + d.y * d.y;
+                first = i;
+                last = j;
+            }
+        }
+    }
+    longest = std::sqrt ( longest );
+    if ( longest <= 0.0f ) {
+        return false;
+    }
+
+    // Every marker must lie on the line between the ends. They are then sorted along it.
+    cv::Point2f const direction = ( centroids[last] - centroids[first] ) * ( 1.0 / longest );
+    float const maxDistance = std::max ( MIN_LINE_DISTANCE, MAX_LINE_DISTANCE * longest );
+    std::vector<std::pair<float, size_t> > order;
+    for ( size_t i = 0; i < markerCount; i++ ) {
+        cv::Point2f const d = centroids[i] - centroids[first];
+        if ( std::abs ( d.x * direction.y - d.y * direction.x ) > maxDistance ) {
+            return false;
+        }
+        order.push_back ( std::make_pair ( ( d.x * direction.x + d.y * direction.y ) / longest, i ) );
+    }
+    std::sort ( order.begin (), order.end () );
+
+    // Compare the relative marker positions with those of the wand, read from either end.
+    double const length = m_markerPositions.back () - m_markerPositions.front ();
+    float forward = 0.0f, backward = 0.0f;
+    for ( size_t i = 0; i < markerCount; i++ ) {
+        float const expected = (float)( ( m_markerPositions[i] - m_markerPositions.front () ) / length );
+        float const reversed = (float)( ( m_markerPositions.back () - m_markerPositions[markerCount - 1 - i] ) / length );
+        forward += ( order[i].first - expected ) * ( order[i].first - expected );
+        backward += ( order[i].first - reversed ) * ( order[i].first - reversed );
+    }
+    if ( std::min ( forward, backward ) > MAX_ORDER_AMBIGUITY * std::max ( forward, backward ) ) {
+        return false;
+    }
+    bool const isReversed = ( backward < forward );
+    for ( size_t i = 0; i < markerCount; i++ ) {
+        oMarkers.push_back ( centroids[order[isReversed ? markerCount - 1 - i : i].second] );
+    }
+    return true;
+}
+bool PcWandCalibrator::Solve ( unsigned int const& iMaxIterations )
+{
+    boost::unique_lock<boost::mutex> solveLock ( m_solveMutex, boost::try_to_lock );
+    if ( !solveLock.owns_lock () ) {
+        return false;
+    }
+    m_isSolving = true;
+    bool const isSolved = DoSolve ( iMaxIterations );
+    m_isSolving = false;
+    return isSolved;
+}
+size_t PcWandCalibrator::GetObservationCount ()
+{
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    return m_observations.size ();
+}
+double PcWandCalibrator::GetCoverage ( std::string const& iCameraId )
+{
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    auto const state = m_cameras.find ( iCameraId );
+    if ( state == m_cameras.end () ) {
+        return 0.0;
+    }
+    return (double)state->second.CoveredCells / (double)( COVERAGE_COLUMNS * COVERAGE_ROWS );
+}
+boost::uint64_t PcWandCalibrator::GetDroppedFrames ()
+{
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    return m_droppedFrames;
+}
+
+// Private
+PcWandCalibrator::CameraState& PcWandCalibrator::GetCameraState ( std::string const& iCameraId )
+{
+    auto state = m_cameras.find ( iCameraId );
+    if ( state == m_cameras.end () ) {
+        CameraState newState;
+        newState.Timestamp = 0u;
+        newState.IsDetecting = false;
+        newState.Cells.assign ( COVERAGE_COLUMNS * COVERAGE_ROWS, false );
+        newState.CoveredCells = 0u;
+        state = m_cameras.insert ( std::make_pair ( iCameraId, newState ) ).first;
+    }
+    return state->second;
+}
+void PcWandCalibrator::Detect ( std::string const& iCameraId )
+{
+    cv::Mat image;
+    boost::uint64_t timestamp = 0u;
+    {
+        boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+        CameraState const& state = GetCameraState ( iCameraId );
+        image = state.Image;
+        timestamp = state.Timestamp;
+    }
+
+    VEC(cv::Point2f) markers;
+    if ( DetectWand ( image, markers ) ) {
+        AddObservation ( iCameraId, timestamp, image.size (), markers );
+    }
+
+    boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+    GetCameraState ( iCameraId ).IsDetecting = false;
+    m_taskCount--;
+    m_idle.notify_all ();
+}
+bool PcWandCalibrator::DoSolve ( unsigned int const& iMaxIterations )
+{
+    VEC(Observation) observations;
+    STRMAP(Intrinsics) allIntrinsics;
+    {
+        boost::lock_guard<boost::mutex> lock ( m_mutex );
+
+        observations = m_observations;
+        allIntrinsics = m_intrinsics;
+    }
+    PcWandSolutionPtr const previous = GetSolution ();
+
+    // Cameras are indexed in GUID order.
+    VEC(std::string) cameraIds;
+    STRMAP(unsigned int) cameraIndex;
+    VEC(PcPointUndistorterPtr) undistorters;
+    PcWandProblem problem;
+    problem.Positions = m_markerPositions;
+    for ( auto intrinsics = allIntrinsics.begin (); intrinsics != allIntrinsics.end (); intrinsics++ ) {
+        cameraIndex[intrinsics->first] = (unsigned int)cameraIds.size ();
+        cameraIds.push_back ( intrinsics->first );
+        undistorters.push_back ( intrinsics->second.Undistorter );
+        problem.CameraMatrices.push_back ( intrinsics->second.CameraMatrix );
+        problem.DistCoeffs.push_back ( intrinsics->second.DistCoeffs );
+    }
+    unsigned int const cameraCount = (unsigned int)cameraIds.size ();
+    if ( cameraCount < 2u ) {
+        return false;
+    }
+
+    // Group the observations taken within the tolerance of each other into wand views, with at most one
+    // observation per camera.
+    std::vector<std::pair<boost::uint64_t, size_t> > order;
+    for ( size_t o = 0; o < observations.size (); o++ ) {
+        if ( cameraIndex.find ( observations[o].CameraId ) != cameraIndex.end () ) {
+            order.push_back ( std::make_pair ( observations[o].Timestamp, o ) );
+        }
+    }
+    std::sort ( order.begin (), order.end () );
+
+    VECOFVECS(PcWandObservation) views;
+    boost::uint64_t viewStart = 0u;
+    VEC(bool) hasCamera ( cameraCount, false );
+    for ( auto o = order.begin (); o != order.end (); o++ ) {
+        Observation const& observation = observations[o->second];
+        unsigned int const camera = cameraIndex[observation.CameraId];
+        if ( views.empty () || observation.Timestamp - viewStart > m_tolerance || hasCamera[camera] ) {
+            views.push_back ( VEC(PcWandObservation) () );
+            viewStart = observation.Timestamp;
+            std::fill ( hasCamera.begin (), hasCamera.end (), false );
+        }
+
+        PcWandObservation wandObservation;
+        wandObservation.Camera = camera;
+        wandObservation.Source = problem.Markers.size ();
+        VEC(cv::Point2f) normalized;
+        if ( undistorters[camera] ) {
+            undistorters[camera]->Undistort ( observation.Markers, normalized );
+        } else {
+            cv::undistortPoints ( observation.Markers, normalized, problem.CameraMatrices[camera], problem.DistCoeffs[camera] );
+        }
+        problem.Markers.push_back ( observation.Markers );
+        problem.Normalized.push_back ( normalized );
+        views.back ().push_back ( wandObservation );
+        hasCamera[camera] = true;
+    }
+
+    VEC(double) cameras ( cameraCount * 6u, 0.0 );
+    VEC(bool) isPosed ( cameraCount, false );
+    unsigned int world = cameraCount;
+
+    // Start from the previous solution, if its world camera is still registered.
+    if ( previous && cameraIndex.find ( previous->Poses->WorldCamera ) != cameraIndex.end () ) {
+        world = cameraIndex[previous->Poses->WorldCamera];
+        for ( auto rotation = previous->Poses->Rotations.begin (); rotation != previous->Poses->Rotations.end (); rotation++ ) {
+            auto const camera = cameraIndex.find ( rotation->first );
+            if ( camera == cameraIndex.end () ) {
+                continue;
+            }
+            cv::Mat rvec ( 3, 1, CV_64F, &cameras[camera->second * 6u] );
+            cv::Rodrigues ( rotation->second, rvec );
+            cv::Mat const& translation = previous->Poses->Translations.at ( rotation->first );
+            for ( int k = 0; k < 3; k++ ) {
+                cameras[camera->second * 6u + 3u + k] = translation.at<double> ( k );
+            }
+            isPosed[camera->second] = true;
+        }
+    } else {
+        // The pair of cameras sharing the most views.
+        VEC(size_t) covisibility ( cameraCount * cameraCount, 0u );
+        for ( auto view = views.begin (); view != views.end (); view++ ) {
+            for ( auto first = view->begin (); first != view->end (); first++ ) {
+                for ( auto second = view->begin (); second != view->end (); second++ ) {
+                    if ( first->Camera != second->Camera ) {
+                        covisibility[first->Camera * cameraCount + second->Camera]++;
+                    }
+                }
+            }
+        }
+        size_t const best = std::max_element ( covisibility.begin (), covisibility.end () ) - covisibility.begin ();
+        if ( covisibility[best] < MIN_PAIR_VIEWS ) {
+            std::cout << "No two cameras share " << MIN_PAIR_VIEWS << " wand views" << std::endl;
+            return false;
+        }
+        world = (unsigned int)( best / cameraCount );
+        unsigned int const second = (unsigned int)( best % cameraCount );
+
+        VEC(cv::Point2f) worldPoints, secondPoints;
+        VEC(size_t) worldSources, secondSources;
+        for ( auto view = views.begin (); view != views.end (); view++ ) {
+            size_t worldSource = problem.Markers.size (), secondSource = problem.Markers.size ();
+            for ( auto o = view->begin (); o != view->end (); o++ ) {
+                if ( o->Camera == world ) {
+                    worldSource = o->Source;
+                } else if ( o->Camera == second ) {
+                    secondSource = o->Source;
+                }
+            }
+            if ( worldSource < problem.Markers.size () && secondSource < problem.Markers.size () ) {
+                worldSources.push_back ( worldSource );
+                secondSources.push_back ( secondSource );
+                worldPoints.insert ( worldPoints.end (), problem.Normalized[worldSource].begin (), problem.Normalized[worldSource].end () );
+                secondPoints.insert ( secondPoints.end (), problem.Normalized[secondSource].begin (), problem.Normalized[secondSource].end () );
+            }
+        }
+
+        // On normalised points, the fundamental matrix is the essential matrix.
+        double const threshold = ESSENTIAL_THRESHOLD / problem.CameraMatrices[world].at<double> ( 0, 0 );
+        cv::Mat const essential = cv::findFundamentalMat ( worldPoints, secondPoints, CV_FM_RANSAC, threshold, 0.99 );
+        if ( essential.rows != 3 || essential.cols != 3 ) {
+            std::cout << "The wand views of cameras " << cameraIds[world] << " and " << cameraIds[second] << " don't fit an essential matrix" << std::endl;
+            return false;
+        }
+
+        // Of the four poses the essential matrix decomposes into, keep the one that puts the most markers in front of both cameras.
+        cv::SVD svd ( essential );
+        cv::Mat u = svd.u, vt = svd.vt;
+        if ( cv::determinant ( u ) < 0.0 ) {
+            u = -u;
+        }
+        if ( cv::determinant ( vt ) < 0.0 ) {
+            vt = -vt;
+        }
+        cv::Mat rotate = cv::Mat::zeros ( 3, 3, CV_64F );
+        rotate.at<double> ( 0, 1 ) = -1.0;
+        rotate.at<double> ( 1, 0 ) = 1.0;
+        rotate.at<double> ( 2, 2 ) = 1.0;
+        cv::Mat const rotations[2] = { u * rotate * vt, u * rotate.t () * vt };
+        VEC(cv::Mat) projections ( 2 );
+        projections[0] = cv::Mat::eye ( 3, 4, CV_64F );
+        size_t bestCount = 0u;
+        double bestPose[6];
+        for ( int candidate = 0; candidate < 4; candidate++ ) {
+            double pose[6];
+            cv::Mat rvec ( 3, 1, CV_64F, pose );
+            cv::Rodrigues ( rotations[candidate / 2], rvec );
+            double const sign = ( candidate % 2 == 0 ) ? 1.0 : -1.0;
+            for ( int k = 0; k < 3; k++ ) {
+                pose[3 + k] = sign * u.at<double> ( k, 2 );
+            }
+            projections[1] = ProjectionMatrix ( pose );
+
+            size_t count = 0u;
+            VEC(cv::Point2f) points ( 2 );
+            cv::Point3d point;
+            for ( size_t p = 0; p < worldPoints.size (); p++ ) {
+                points[0] = worldPoints[p];
+                points[1] = secondPoints[p];
+                count += PcTriangulate ( projections, points, point ) ? 1u : 0u;
+            }
+            if ( count > bestCount ) {
+                bestCount = count;
+                std::copy ( pose, pose + 6, bestPose );
+            }
+        }
+        if ( bestCount == 0u ) {
+            return false;
+        }
+
+        // The translation has unit length: scale it so that the triangulated wands have their known length.
+        std::copy ( bestPose, bestPose + 6, &cameras[second * 6u] );
+        isPosed[world] = true;
+        isPosed[second] = true;
+        VEC(double) lengths;
+        for ( size_t s = 0; s < worldSources.size (); s++ ) {
+            VEC(PcWandObservation) pair ( 2 );
+            pair[0].Camera = world;
+            pair[0].Source = worldSources[s];
+            pair[1].Camera = second;
+            pair[1].Source = secondSources[s];
+            VEC(cv::Point3d) markers;
+            if ( TriangulateView ( problem, pair, cameras, isPosed, markers ) ) {
+                cv::Point3d const d = markers.back () - markers.front ();
+                lengths.push_back ( std::sqrt ( d.x * d.x + d.y * d.y + d.z * d.z ) );
+            }
+        }
+        if ( lengths.empty () ) {
+            return false;
+        }
+        std::nth_element ( lengths.begin (), lengths.begin () + lengths.size () / 2, lengths.end () );
+        double const scale = ( m_markerPositions.back () - m_markerPositions.front () ) / lengths[lengths.size () / 2];
+        for ( int k = 3; k < 6; k++ ) {
+            cameras[second * 6u + k] *= scale;
+        }
+    }
+
+    // Resect the other cameras, the one sharing the most views with the posed cameras first.
+    VEC(bool) isRejected ( cameraCount, false );
+    for ( ;; ) {
+        VEC(size_t) shared ( cameraCount, 0u );
+        for ( auto view = views.begin (); view != views.end (); view++ ) {
+            size_t posedCount = 0u;
+            for ( auto o = view->begin (); o != view->end (); o++ ) {
+                posedCount += isPosed[o->Camera] ? 1u : 0u;
+            }
+            for ( auto o = view->begin (); o != view->end () && posedCount >= 2u; o++ ) {
+                if ( !isPosed[o->Camera] && !isRejected[o->Camera] ) {
+                    shared[o->Camera]++;
+                }
+            }
+        }
+        unsigned int const camera = (unsigned int)( std::max_element ( shared.begin (), shared.end () ) - shared.begin () );
+        if ( shared[camera] < MIN_RESECTION_VIEWS ) {
+            break;
+        }
+
+        VEC(cv::Point3f) objectPoints;
+        VEC(cv::Point2f) imagePoints;
+        for ( auto view = views.begin (); view != views.end (); view++ ) {
+            size_t source = problem.Markers.size ();
+            for ( auto o = view->begin (); o != view->end (); o++ ) {
+                if ( o->Camera == camera ) {
+                    source = o->Source;
+                }
+            }
+            VEC(cv::Point3d) markers;
+            if ( source == problem.Markers.size () || !TriangulateView ( problem, *view, cameras, isPosed, markers ) ) {
+                continue;
+            }
+            for ( size_t m = 0; m < markers.size (); m++ ) {
+                objectPoints.push_back ( cv::Point3f ( (float)markers[m].x, (float)markers[m].y, (float)markers[m].z ) );
+                imagePoints.push_back ( problem.Markers[source][m] );
+            }
+        }
+
+        // The resection holds if most triangulated markers agree with it.
+        cv::Mat rvec, tvec;
+        VEC(int) inliers;
+        if ( objectPoints.size () >= 6u ) {
+            cv::solvePnPRansac ( objectPoints, imagePoints, problem.CameraMatrices[camera], problem.DistCoeffs[camera], rvec, tvec,
+                false, 100, 8.0f, (int)objectPoints.size (), inliers );
+        }
+        if ( rvec.empty () || tvec.empty () || inliers.size () * 2u < objectPoints.size () ) {
+            isRejected[camera] = true;
+            continue;
+        }
+        for ( int k = 0; k < 3; k++ ) {
+            cameras[camera * 6u + k] = rvec.at<double> ( k );
+            cameras[camera * 6u + 3u + k] = tvec.at<double> ( k );
+        }
+        isPosed[camera] = true;
+    }
+
+    // Keep the views seen by at least two posed cameras, and initialise their wands from the triangulated markers.
+    VEC(double) wands;
+    for ( auto view = views.begin (); view != views.end (); view++ ) {
+        VEC(PcWandObservation) kept;
+        for ( auto o = view->begin (); o != view->end (); o++ ) {
+            if ( isPosed[o->Camera] ) {
+                kept.push_back ( *o );
+            }
+        }
+        VEC(cv::Point3d) markers;
+        if ( kept.size () < 2u || !TriangulateView ( problem, kept, cameras, isPosed, markers ) ) {
+            continue;
+        }
+
+        // The wand frame is its direction, then two unit vectors orthogonal to it and to each other.
+        cv::Point3d direction = markers.back () - markers.front ();
+        double const norm = std::sqrt ( direction.dot ( direction ) );
+        if ( norm <= 0.0 ) {
+            continue;
+        }
+        direction *= 1.0 / norm;
+        cv::Point3d const axis = ( std::abs ( direction.x ) < 0.9 ) ? cv::Point3d ( 1.0, 0.0, 0.0 ) : cv::Point3d ( 0.0, 1.0, 0.0 );
+        cv::Point3d first = axis - direction * axis.dot ( direction );
+        first *= 1.0 / std::sqrt ( first.dot ( first ) );
+        cv::Point3d const second = direction.cross ( first );
+        double const frame[9] = { direction.x, direction.y, direction.z, first.x, first.y, first.z, second.x, second.y, second.z };
+        problem.Frames.insert ( problem.Frames.end (), frame, frame + 9 );
+
+        cv::Point3d origin ( 0.0, 0.0, 0.0 );
+        for ( size_t m = 0; m < markers.size (); m++ ) {
+            origin += markers[m] - direction * ( m_markerPositions[m] - m_markerPositions[0] );
+        }
+        origin *= 1.0 / (double)markers.size ();
+        double const wand[WAND] = { origin.x, origin.y, origin.z, 0.0, 0.0 };
+        wands.insert ( wands.end (), wand, wand + WAND );
+        problem.Views.push_back ( kept );
+    }
+
+    // Refine, drop the observations that fit far worse than the others, and refine again.
+    double cost = 0.0;
+    size_t pointCount = 0u;
+    VECOFVECS(double) costs;
+    for ( int pass = 0; pass < 2; pass++ ) {
+        int const freeCount = IndexCameras ( problem, world, isPosed );
+        if ( freeCount == 0 || problem.Views.empty () ) {
+            std::cout << "The wand views don't connect two cameras" << std::endl;
+            return false;
+        }
+        cost = Refine ( problem, freeCount, cameras, wands, iMaxIterations );
+
+        costs.assign ( problem.Views.size (), VEC(double) () );
+        PcThreadPool::GetInstance ().ParallelFor ( 0u, problem.Views.size (), boost::bind ( &EvaluateView, &problem, &cameras, &wands, &costs, _1 ) );
+        pointCount = 0u;
+        for ( auto view = problem.Views.begin (); view != problem.Views.end (); view++ ) {
+            pointCount += view->size () * m_markerPositions.size ();
+        }
+        if ( pass > 0 ) {
+            break;
+        }
+
+        double const limit = std::max ( MIN_OUTLIER_ERROR, OUTLIER_FACTOR * std::sqrt ( cost / (double)pointCount ) );
+        double const maxCost = limit * limit * (double)m_markerPositions.size ();
+        VECOFVECS(PcWandObservation) inliers;
+        VEC(double) inlierWands, inlierFrames;
+        bool hasOutliers = false;
+        for ( size_t v = 0; v < problem.Views.size (); v++ ) {
+            VEC(PcWandObservation) kept;
+            for ( size_t o = 0; o < problem.Views[v].size (); o++ ) {
+                if ( costs[v][o] <= maxCost ) {
+                    kept.push_back ( problem.Views[v][o] );
+                }
+            }
+            hasOutliers = hasOutliers || kept.size () < problem.Views[v].size ();
+            if ( kept.size () >= 2u ) {
+                inliers.push_back ( kept );
+                inlierWands.insert ( inlierWands.end (), wands.begin () + v * WAND, wands.begin () + ( v + 1 ) * WAND );
+                inlierFrames.insert ( inlierFrames.end (), problem.Frames.begin () + v * 9, problem.Frames.begin () + ( v + 1 ) * 9 );
+            }
+        }
+        if ( !hasOutliers ) {
+            break;
+        }
+        problem.Views.swap ( inliers );
+        wands.swap ( inlierWands );
+        problem.Frames.swap ( inlierFrames );
+    }
+
+    VEC(double) cameraCosts ( cameraCount, 0.0 );
+    VEC(size_t) cameraPoints ( cameraCount, 0u );
+    for ( size_t v = 0; v < problem.Views.size (); v++ ) {
+        for ( size_t o = 0; o < problem.Views[v].size (); o++ ) {
+            cameraCosts[problem.Views[v][o].Camera] += costs[v][o];
+            cameraPoints[problem.Views[v][o].Camera] += m_markerPositions.size ();
+        }
+    }
+
+    boost::shared_ptr<PcRigSolution> poses ( new PcRigSolution () );
+    boost::shared_ptr<PcWandSolution> solution ( new PcWandSolution () );
+    for ( unsigned int c = 0; c < cameraCount; c++ ) {
+        if ( !isPosed[c] ) {
+            std::cout << "Camera " << cameraIds[c] << " shares too few wand views with the rig" << std::endl;
+            continue;
+        }
+        cv::Mat rotation;
+        cv::Rodrigues ( cv::Mat ( 3, 1, CV_64F, &cameras[c * 6u] ), rotation );
+        poses->Rotations[cameraIds[c]] = rotation;
+        poses->Translations[cameraIds[c]] = cv::Mat ( 3, 1, CV_64F, &cameras[c * 6u + 3u] ).clone ();
+        solution->CameraRms[cameraIds[c]] = ( cameraPoints[c] > 0u ) ? std::sqrt ( cameraCosts[c] / (double)cameraPoints[c] ) : 0.0;
+    }
+    poses->WorldCamera = cameraIds[world];
+    poses->Rms = ( pointCount > 0u ) ? std::sqrt ( cost / (double)pointCount ) : 0.0;
+    solution->Poses = poses;
+    solution->ViewCount = problem.Views.size ();
+    solution->ObservationCount = observations.size ();
+    boost::atomic_store ( &m_solution, PcWandSolutionPtr ( solution ) );
+    return true;
+}
@@ -89,14 +89,19 @@ namespace pcm
         /// PTP synchronisation is either disabled or has failed, a yellow square indicated the synchronisation is in progress, a green
         /// square indicates the master camera and a blue square indicares slave cameras.
         /// 
-        /// Additionaly, writes the calibration progress over the image.
+        /// Additionaly, writes the calibration progress over the image, followed by the reprojection error of the
+        /// latest intrinsic solve once there is one, the sharpness of the latest candidate frame, and the instruction
+        /// guiding the operator toward the missing views.
         /// 
         /// \param [in] row             the row of the grid cell
         /// \param [in] col             the column of the grid cell
         /// \param [in] frame           the frame to be displayed
         /// \param [in] cameraStatus    the status of the PTP synchronisation
         /// \param [in] progress        the progress of the calibration
-        void DrawFrame ( int const& row, int const& col, pcc::PcFramePtr const& frame, std::string const& cameraStatus, float const& progress );
+        /// \param [in] rms             the RMS reprojection error of the calibration, in pixels, negative if unknown
+        /// \param [in] sharpness       the sharpness of the latest candidate calibration frame, negative if unknown
+        /// \param [in] guidance        the instruction toward the missing calibration views, empty if none
+        void DrawFrame ( int const& row, int const& col, pcc::PcFramePtr const& frame, std::string const& cameraStatus, float const& progress, float const& rms, float const& sharpness, std::string const& guidance );
 
         /// \brief Adjusts the number of rows on the grid to match the number of elements that need to be displayed.
         /// 
@@ -89,13 +89,16 @@ void PcFrameViewer::paintGL ()
         const int c = f % m_nCols;
 
         float progress = cs.GetCameraCalibrationProgress ( cameras[f] );
+        float rms = cs.GetCameraCalibrationRms ( cameras[f] );
+        float sharpness = cs.GetCameraCalibrationSharpness ( cameras[f] );
+        std::string const guidance = cs.GetCameraCalibrationGuidance ( cameras[f] );
         std::string const& status = cs.GetCameraStatus ( cameras[f] );
         PcFramePtr const frame = cs.GetFrameFromCamera ( cameras[f] );
 
         //std::cout << "Camera " << cameras[f] << ": " << status << std::endl;
         
         glBindTexture (GL_TEXTURE_2D, m_textures[f]);
-        DrawFrame ( r, c, frame, status, (progress < 100.0f)?progress:-1.0f);
+        DrawFrame ( r, c, frame, status, (progress < 100.0f)?progress:-1.0f, rms, sharpness, guidance );
     }
     //DrawFrame ( 0, 0, frames[0] );
     //DrawFrame ( 0, 1, frames[1] );
@@ -114,7 +117,7 @@ void PcFrameViewer::calibrateCameras ()
     cs.CalibrateCameras ();
 }
 
-void PcFrameViewer::DrawFrame ( int const& row, int const& col, PcFramePtr const& frame, std::string const& cameraStatus, float const& progress )
+void PcFrameViewer::DrawFrame ( int const& row, int const& col, PcFramePtr const& frame, std::string const& cameraStatus, float const& progress, float const& rms, float const& sharpness, std::string const& guidance )
 {
     int vpw = m_width  / m_nCols;
     int vph = m_height / m_nRows;
@@ -236,10 +239,25 @@ void PcFrameViewer::DrawFrame ( int const& row, int const& col, PcFramePtr const
     if ( progress >= 0 ) {
         std::stringstream ss;
         ss << std::setw (3) << (unsigned int)(progress * 100) << "%";
+        if ( rms >= 0 ) {
+            ss << " " << std::fixed << std::setprecision (2) << rms << "px";
+        }
+        if ( sharpness >= 0 ) {
+            ss << " S:" << (unsigned int)sharpness;
+        }
         glColor3f ( 1.0f, 1.0f, 0.0f );
         glRasterPos2f ( 0.0f, 0.0f );
         glLineWidth ( 3.0f );
         glutStrokeString ( GLUT_STROKE_MONO_ROMAN, (const unsigned char*)ss.str ().c_str () );
+
+        if ( !guidance.empty () ) {
+            // The stroke string moved the origin, so the guidance line starts over from the left.
+            glLoadIdentity ();
+            glScalef ( 0.25f, 0.25f, 1.f );
+            glOrtho ( 0.0, (GLdouble)vpw, 0.0, (GLdouble)vph, -1.0, 1.0 );
+            glTranslatef ( 0.0f, 150.0f, 0.0f );
+            glutStrokeString ( GLUT_STROKE_MONO_ROMAN, (const unsigned char*)guidance.c_str () );
+        }
     }
     glEnable ( GL_TEXTURE_2D );
 
@@ -0,0 +1,146 @@
+#include "PcSandboxTools.h"
+
+#include "PcChessboardDetector.h"
+#include "PcTakeReader.h"
+
+#include <opencv2/opencv.hpp>
+
+#define BOOST_ALL_DYN_LINK
+#include <boost/chrono.hpp>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace pcc;
+
+typedef boost::chrono::steady_clock ClockType;
+
+/// \brief Accumulates the results of one detection method.
+struct DetectionStats
+{
+    DetectionStats () : Frames ( 0u ), Detections ( 0u ), HitSeconds ( 0.0 ), MissSeconds ( 0.0 ) {}
+
+    unsigned int    Frames;         ///< The number of frames processed.
+    unsigned int    Detections;     ///< The number of frames where the chessboard was found.
+    double          HitSeconds;     ///< The time spent on frames where the chessboard was found.
+    double          MissSeconds;    ///< The time spent on frames where it wasn't.
+
+    /// \brief Records the outcome of one detection.
+    void Add ( bool const& iFound, double const& iSeconds )
+    {
+        Frames++;
+        if ( iFound ) {
+            Detections++;
+            HitSeconds += iSeconds;
+        } else {
+            MissSeconds += iSeconds;
+        }
+    }
+
+    /// \brief Prints the statistics as one table row.
+    void Print ( std::string const& iName ) const
+    {
+        unsigned int const misses = Frames - Detections;
+        std::cout   << std::setw ( 14 ) << std::left << iName << std::right
+                    << std::setw ( 8 ) << Detections << " / " << std::setw ( 5 ) << Frames
+                    << std::fixed << std::setprecision ( 2 )
+                    << std::setw ( 12 ) << ( Frames ? 1000.0 * ( HitSeconds + MissSeconds ) / Frames : 0.0 )
+                    << std::setw ( 12 ) << ( Detections ? 1000.0 * HitSeconds / Detections : 0.0 )
+                    << std::setw ( 12 ) << ( misses ? 1000.0 * MissSeconds / misses : 0.0 )
+                    << std::endl;
+    }
+};
+
+/// \brief Runs both detectors on one frame and accumulates the results.
+static void BenchmarkFrame (
+    cv::Mat const&          iFrame,
+    cv::Size const&         iPatternSize,
+    PcChessboardDetector&   ioDetector,
+    DetectionStats&         ioFullStats,
+    DetectionStats&         ioScaledStats,
+    double&                 ioDeviation,
+    unsigned int&           ioCommon
+) {
+    // The former calibration path: a fast-check search on the full-resolution frame.
+    VEC(cv::Point2f) fullCorners;
+    ClockType::time_point start = ClockType::now ();
+    bool const fullFound = cv::findChessboardCorners ( iFrame, iPatternSize, fullCorners, cv::CALIB_CB_FAST_CHECK );
+    ioFullStats.Add ( fullFound, boost::chrono::duration<double> ( ClockType::now () - start ).count () );
+
+    VEC(cv::Point2f) scaledCorners;
+    start = ClockType::now ();
+    bool const scaledFound = ioDetector.Detect ( iFrame, scaledCorners );
+    ioScaledStats.Add ( scaledFound, boost::chrono::duration<double> ( ClockType::now () - start ).count () );
+
+    if ( fullFound && scaledFound && fullCorners.size () == scaledCorners.size () ) {
+        // The reference corners are refined at full resolution, outside of the timed section.
+        cv::cornerSubPix ( iFrame, fullCorners, cv::Size ( 11, 11 ), cv::Size ( -1, -1 ),
+            cv::TermCriteria ( cv::TermCriteria::EPS | cv::TermCriteria::COUNT, 30, 0.01 ) );
+
+        double sum = 0.0;
+        for ( size_t i = 0; i < fullCorners.size (); i++ ) {
+            cv::Point2f const d = fullCorners[i] - scaledCorners[i];
+            sum += std::sqrt ( d.x * d.x + d.y * d.y );
+        }
+        ioDeviation += sum / fullCorners.size ();
+        ioCommon++;
+    }
+}
+
+int RunChessboardBenchmark ( int argc, char** argv )
+{
+    if ( argc < 3 ) {
+        std::cout << "Usage: PCSandbox benchmark-chessboard <rows> <cols> <take.pctake | image...>" << std::endl;
+        return 1;
+    }
+
+    // Same convention as PcChessboard: rows of inner corners per column, columns of inner corners per row.
+    cv::Size const patternSize ( atoi ( argv[1] ), atoi ( argv[0] ) );
+    PcChessboardDetector detector ( patternSize );
+
+    DetectionStats fullStats;
+    DetectionStats scaledStats;
+    double deviation = 0.0;
+    unsigned int common = 0u;
+
+    std::string const first ( argv[2] );
+    if ( first.size () > strlen ( PCC_TAKE_EXTENSION ) &&
+         first.compare ( first.size () - strlen ( PCC_TAKE_EXTENSION ), std::string::npos, PCC_TAKE_EXTENSION ) == 0 ) {
+        PcTakeReader take ( first );
+        if ( !take.IsOpen () ) {
+            return 1;
+        }
+        cv::Mat frame;
+        for ( size_t f = 0; f < take.GetFrameCount (); f++ ) {
+            if ( take.ReadFrame ( f, frame ) ) {
+                BenchmarkFrame ( frame, patternSize, detector, fullStats, scaledStats, deviation, common );
+            }
+        }
+    } else {
+        for ( int i = 2; i < argc; i++ ) {
+            cv::Mat const frame = cv::imread ( argv[i], cv::IMREAD_GRAYSCALE );
+            if ( frame.empty () ) {
+                std::cout << "Skipping unreadable image " << argv[i] << std::endl;
+                continue;
+            }
+            BenchmarkFrame ( frame, patternSize, detector, fullStats, scaledStats, deviation, common );
+        }
+    }
+
+    std::cout   << std::setw ( 14 ) << std::left << "Method" << std::right
+                << std::setw ( 16 ) << "Found"
+                << std::setw ( 12 ) << "ms/frame"
+                << std::setw ( 12 ) << "ms/hit"
+                << std::setw ( 12 ) << "ms/miss" << std::endl;
+    fullStats.Print ( "Full-res" );
+    scaledStats.Print ( "Multi-scale" );
+    if ( common ) {
+        std::cout   << "Mean corner deviation over " << common << " common detections: "
+                    << std::setprecision ( 3 ) << deviation / common << " px" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,171 @@
+#include "PcSandboxTools.h"
+
+#include "PcIntrinsicSolver.h"
+#include "PcThreadPool.h"
+
+#include <opencv2/opencv.hpp>
+
+#define BOOST_ALL_DYN_LINK
+#include <boost/chrono.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace pcc;
+
+typedef boost::chrono::steady_clock ClockType;
+
+// The frame size and intrinsics the views are generated with: a 1920x1080 camera with a strong barrel distortion.
+static cv::Size const IMAGE_SIZE ( 1920, 1080 );
+static double const CAMERA_MATRIX[9] = { 1400.0, 0.0, 960.5, 0.0, 1395.0, 541.3, 0.0, 0.0, 1.0 };
+static double const DIST_COEFFS[5] = { -0.32, 0.14, 0.0008, -0.0005, -0.03 };
+
+// The generated board: 9x7 inner corners, 10 units apart.
+static int const BOARD_COLUMNS = 9;
+static int const BOARD_ROWS = 7;
+static float const BOARD_SPACING = 10.0f;
+
+// The standard deviation of the detection noise added to the projected corners, in pixels.
+static double const CORNER_NOISE = 0.1;
+
+// The number of solves timed per method and view count.
+static int const REPETITIONS = 5;
+
+// The view counts benchmarked when none are given.
+static unsigned int const DEFAULT_VIEW_COUNTS[] = { 10u, 20u, 40u, 80u };
+
+/// \brief Generates views of the board from random poses, entirely within the frame.
+static void GenerateViews (
+    unsigned int const&         iViewCount,
+    cv::RNG&                    ioRng,
+    VECOFVECS(cv::Point3f)&     oObjectPoints,
+    VECOFVECS(cv::Point2f)&     oImagePoints
+) {
+    VEC(cv::Point3f) board;
+    for ( int r = 0; r < BOARD_ROWS; r++ ) {
+        for ( int c = 0; c < BOARD_COLUMNS; c++ ) {
+            board.push_back ( cv::Point3f ( c * BOARD_SPACING, r * BOARD_SPACING, 0.0f ) );
+        }
+    }
+    cv::Mat const cameraMatrix ( 3, 3, CV_64F, (void*)CAMERA_MATRIX );
+    cv::Mat const distCoeffs ( 5, 1, CV_64F, (void*)DIST_COEFFS );
+
+    oObjectPoints.clear ();
+    oImagePoints.clear ();
+    while ( oImagePoints.size () < iViewCount ) {
+        cv::Mat rvec ( 3, 1, CV_64F );
+        rvec.at<double> ( 0 ) = ioRng.uniform ( -0.6, 0.6 );
+        rvec.at<double> ( 1 ) = ioRng.uniform ( -0.6, 0.6 );
+        rvec.at<double> ( 2 ) = ioRng.uniform ( -0.4, 0.4 );
+        cv::Mat tvec ( 3, 1, CV_64F );
+        tvec.at<double> ( 0 ) = ioRng.uniform ( -200.0, 120.0 );
+        tvec.at<double> ( 1 ) = ioRng.uniform ( -120.0, 60.0 );
+        tvec.at<double> ( 2 ) = ioRng.uniform ( 250.0, 600.0 );
+
+        VEC(cv::Point2f) corners;
+        cv::projectPoints ( board, rvec, tvec, cameraMatrix, distCoeffs, corners );
+
+        // Views reaching past the frame would be partial detections, so they are drawn again.
+        bool isInside = true;
+        for ( size_t i = 0; i < corners.size () && isInside; i++ ) {
+            isInside = corners[i].x >= 0.0f && corners[i].y >= 0.0f && corners[i].x < IMAGE_SIZE.width && corners[i].y < IMAGE_SIZE.height;
+        }
+        if ( !isInside ) {
+            continue;
+        }
+        for ( size_t i = 0; i < corners.size (); i++ ) {
+            corners[i].x += (float)ioRng.gaussian ( CORNER_NOISE );
+            corners[i].y += (float)ioRng.gaussian ( CORNER_NOISE );
+        }
+        oObjectPoints.push_back ( board );
+        oImagePoints.push_back ( corners );
+    }
+}
+
+/// \brief Gets the largest relative difference between the fx, fy, cx and cy of two camera matrices.
+static double IntrinsicDifference ( cv::Mat const& iFirst, cv::Mat const& iSecond )
+{
+    int const rows[4] = { 0, 1, 0, 1 };
+    int const cols[4] = { 0, 1, 2, 2 };
+    double difference = 0.0;
+    for ( int i = 0; i < 4; i++ ) {
+        double const a = iFirst.at<double> ( rows[i], cols[i] );
+        double const b = iSecond.at<double> ( rows[i], cols[i] );
+        difference = std::max ( difference, std::abs ( a - b ) / std::abs ( b ) );
+    }
+    return difference;
+}
+
+int RunIntrinsicsBenchmark ( int argc, char** argv )
+{
+    VEC(unsigned int) viewCounts;
+    for ( int i = 0; i < argc; i++ ) {
+        int const count = atoi ( argv[i] );
+        if ( count < 3 ) {
+            std::cout << "Usage: PCSandbox benchmark-intrinsics [views...]" << std::endl;
+            return 1;
+        }
+        viewCounts.push_back ( (unsigned int)count );
+    }
+    if ( viewCounts.empty () ) {
+        viewCounts.assign ( DEFAULT_VIEW_COUNTS, DEFAULT_VIEW_COUNTS + sizeof ( DEFAULT_VIEW_COUNTS ) / sizeof ( DEFAULT_VIEW_COUNTS[0] ) );
+    }
+
+    // Same flags as PcCalibrateIntrinsics, so that both methods solve the same problem.
+    int const flags = CV_CALIB_FIX_K4|CV_CALIB_FIX_K5|CV_CALIB_FIX_K6;
+
+    std::cout   << "Solving on " << PcThreadPool::GetInstance ().GetWorkerCount () << " threads, "
+                << REPETITIONS << " solves per method" << std::endl;
+    std::cout   << std::setw ( 8 ) << "Views"
+                << std::setw ( 14 ) << "OpenCV ms"
+                << std::setw ( 14 ) << "Solver ms"
+                << std::setw ( 10 ) << "Speedup"
+                << std::setw ( 12 ) << "OpenCV RMS"
+                << std::setw ( 12 ) << "Solver RMS"
+                << std::setw ( 12 ) << "Max diff" << std::endl;
+
+    cv::RNG rng ( 0x5043 );
+    for ( size_t v = 0; v < viewCounts.size (); v++ ) {
+        VECOFVECS(cv::Point3f) objectPoints;
+        VECOFVECS(cv::Point2f) imagePoints;
+        GenerateViews ( viewCounts[v], rng, objectPoints, imagePoints );
+
+        VEC(cv::Mat) rvecs, tvecs;
+        cv::Mat cvCameraMatrix, cvDistCoeffs;
+        double cvRms = 0.0;
+        ClockType::time_point start = ClockType::now ();
+        for ( int r = 0; r < REPETITIONS; r++ ) {
+            cvCameraMatrix = cv::Mat ();
+            cvDistCoeffs = cv::Mat ();
+            cvRms = cv::calibrateCamera ( objectPoints, imagePoints, IMAGE_SIZE, cvCameraMatrix, cvDistCoeffs, rvecs, tvecs, flags );
+        }
+        double const cvSeconds = boost::chrono::duration<double> ( ClockType::now () - start ).count () / REPETITIONS;
+
+        cv::Mat cameraMatrix, distCoeffs;
+        double rms = 0.0;
+        start = ClockType::now ();
+        for ( int r = 0; r < REPETITIONS; r++ ) {
+            cameraMatrix = cv::Mat ();
+            distCoeffs = cv::Mat ();
+            rms = PcSolveIntrinsics ( objectPoints, imagePoints, IMAGE_SIZE, cameraMatrix, distCoeffs, rvecs, tvecs, false );
+        }
+        double const seconds = boost::chrono::duration<double> ( ClockType::now () - start ).count () / REPETITIONS;
+
+        std::cout   << std::setw ( 8 ) << viewCounts[v] << std::fixed
+                    << std::setprecision ( 2 ) << std::setw ( 14 ) << 1000.0 * cvSeconds
+                    << std::setw ( 14 ) << 1000.0 * seconds
+                    << std::setprecision ( 1 ) << std::setw ( 9 ) << cvSeconds / seconds << "x"
+                    << std::setprecision ( 4 ) << std::setw ( 12 ) << cvRms
+                    << std::setw ( 12 ) << rms;
+        if ( rms < 0.0 ) {
+            std::cout << std::setw ( 12 ) << "failed" << std::endl;
+        } else {
+            std::cout << std::scientific << std::setprecision ( 1 ) << std::setw ( 12 ) << IntrinsicDifference ( cameraMatrix, cvCameraMatrix ) << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include "PcSandboxTools.h"
+
+#include "PcCalibrationCache.h"
+#include "PcCalibrationTarget.h"
+#include "PcOfflineCalibrator.h"
+#include "PcThreadPool.h"
+
+#define BOOST_ALL_DYN_LINK
+#include <boost/chrono.hpp>
+#include <boost/filesystem.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace pcc;
+
+typedef boost::chrono::steady_clock ClockType;
+
+static char const* const USAGE =
+    "Usage: PCSandbox calibrate-offline <chessboard|circles|asymmetric> <rows> <cols> <spacing> <cache.pccal> "
+    "<take.pctake | camera=directory>...";
+
+int RunOfflineCalibration ( int argc, char** argv )
+{
+    if ( argc < 6 ) {
+        std::cout << USAGE << std::endl;
+        return 1;
+    }
+
+    std::string const type ( argv[0] );
+    PcTargetType targetType;
+    if ( type.compare ( "chessboard" ) == 0 ) {
+        targetType = PCC_TARGET_CHESSBOARD;
+    } else if ( type.compare ( "circles" ) == 0 ) {
+        targetType = PCC_TARGET_CIRCLES;
+    } else if ( type.compare ( "asymmetric" ) == 0 ) {
+        targetType = PCC_TARGET_ASYMMETRIC_CIRCLES;
+    } else {
+        std::cout << USAGE << std::endl;
+        return 1;
+    }
+    PcOfflineCalibrator calibrator ( PcCalibrationTarget ( targetType, atoi ( argv[1] ), atoi ( argv[2] ), (float)atof ( argv[3] ) ) );
+
+    for ( int i = 5; i < argc; i++ ) {
+        std::string const source ( argv[i] );
+        size_t const separator = source.find ( '=' );
+        bool const isAdded = ( separator == std::string::npos )
+            ?   calibrator.AddTake ( source )
+            :   calibrator.AddImageDirectory ( source.substr ( 0, separator ), source.substr ( separator + 1 ) );
+        if ( !isAdded ) {
+            return 1;
+        }
+    }
+
+    ClockType::time_point const start = ClockType::now ();
+    bool const isCalibrated = calibrator.Calibrate ();
+    std::cout   << "Calibrated on " << PcThreadPool::GetInstance ().GetWorkerCount () << " threads in " << std::fixed
+                << std::setprecision ( 1 ) << boost::chrono::duration<double> ( ClockType::now () - start ).count () << " s" << std::endl;
+    if ( !isCalibrated ) {
+        return 1;
+    }
+
+    // Records of the cameras that weren't calibrated again are kept.
+    std::string const cachePath ( argv[4] );
+    PcCalibrationCache cache;
+    if ( boost::filesystem::exists ( cachePath ) && !cache.Load ( cachePath ) ) {
+        std::cout << "Couldn't read the calibration cache " << cachePath << std::endl;
+        return 1;
+    }
+    calibrator.StoreResults ( cache );
+    if ( !cache.Save ( cachePath ) ) {
+        std::cout << "Couldn't write the calibration cache " << cachePath << std::endl;
+        return 1;
+    }
+    return 0;
+}
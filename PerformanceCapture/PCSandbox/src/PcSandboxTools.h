@@ -0,0 +1,41 @@
+#ifndef PCSANDBOXTOOLS_H
+#define PCSANDBOXTOOLS_H
+
+/// \brief Compares the multi-scale chessboard detector with a full-resolution search.
+///
+/// Usage: PCSandbox benchmark-chessboard <rows> <cols> <take.pctake | image...>
+///
+/// \param [in] argc    the number of tool arguments
+/// \param [in] argv    the tool arguments, the tool name excluded
+/// \return the process exit code
+int RunChessboardBenchmark ( int argc, char** argv );
+
+/// \brief Calibrates cameras from recorded frames, and stores the calibrations into a calibration cache.
+///
+/// Usage: PCSandbox calibrate-offline <chessboard|circles|asymmetric> <rows> <cols> <spacing> <cache.pccal>
+///        <take.pctake | camera=directory>...
+///
+/// \param [in] argc    the number of tool arguments
+/// \param [in] argv    the tool arguments, the tool name excluded
+/// \return the process exit code
+int RunOfflineCalibration ( int argc, char** argv );
+
+/// \brief Compares PcSolveIntrinsics with cv::calibrateCamera on views generated from a known camera.
+///
+/// Usage: PCSandbox benchmark-intrinsics [views...]
+///
+/// \param [in] argc    the number of tool arguments
+/// \param [in] argv    the tool arguments, the tool name excluded
+/// \return the process exit code
+int RunIntrinsicsBenchmark ( int argc, char** argv );
+
+/// \brief Compares PcPointUndistorter with cv::undistortPoints on points generated from known distortion models.
+///
+/// Usage: PCSandbox benchmark-undistort [points]
+///
+/// \param [in] argc    the number of tool arguments
+/// \param [in] argv    the tool arguments, the tool name excluded
+/// \return the process exit code
+int RunUndistortBenchmark ( int argc, char** argv );
+
+#endif // PCSANDBOXTOOLS_H
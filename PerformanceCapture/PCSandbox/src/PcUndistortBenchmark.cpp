@@ -0,0 +1,151 @@
+#include "PcSandboxTools.h"
+
+#include "PcPointUndistorter.h"
+
+#include <opencv2/opencv.hpp>
+
+#define BOOST_ALL_DYN_LINK
+#include <boost/chrono.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace pcc;
+
+typedef boost::chrono::steady_clock ClockType;
+
+// The frame size and camera matrix the points are generated with.
+static cv::Size const IMAGE_SIZE ( 1920, 1080 );
+static double const CAMERA_MATRIX[9] = { 1400.0, 0.0, 960.5, 0.0, 1395.0, 541.3, 0.0, 0.0, 1.0 };
+
+// The distortion models benchmarked. The thin prism model has more than 8 coefficients, so the undistorter falls back to
+// cv::undistortPoints.
+static double const BARREL_COEFFS[5] = { -0.32, 0.14, 0.0008, -0.0005, -0.03 };
+static double const WIDE_COEFFS[5] = { -0.40, 0.21, 0.0012, -0.0009, -0.045 };
+static double const RATIONAL_COEFFS[8] = { 2.1, 0.9, 0.0008, -0.0006, 0.02, 2.4, 1.6, 0.15 };
+static double const THIN_PRISM_COEFFS[12] = { -0.32, 0.14, 0.0008, -0.0005, -0.03, 0.0, 0.0, 0.0, 0.0012, -0.0004, 0.0009, -0.0003 };
+
+// The number of points undistorted when none is given: a few seconds of marker centroids of a large rig.
+static int const DEFAULT_POINT_COUNT = 1000000;
+
+// The number of undistortions timed per method and model.
+static int const REPETITIONS = 5;
+
+/// \brief Generates points spread over the frame, along with their exact undistorted coordinates.
+///
+/// The undistorted points are drawn first and distorted with cv::projectPoints, so that the reference doesn't depend on
+/// any inversion of the model. The points distorted out of the frame, or past the radius where the model folds back,
+/// are drawn again.
+static void GeneratePoints (
+    int const&                  iCount,
+    cv::Mat const&              iCameraMatrix,
+    cv::Mat const&              iDistCoeffs,
+    cv::RNG&                    ioRng,
+    VEC(cv::Point2f)&           oDistorted,
+    VEC(cv::Point2f)&           oUndistorted
+) {
+    double const cx = iCameraMatrix.at<double> ( 0, 2 );
+    double const cy = iCameraMatrix.at<double> ( 1, 2 );
+    cv::Mat const zero = cv::Mat::zeros ( 3, 1, CV_64F );
+
+    oDistorted.clear ();
+    oUndistorted.clear ();
+    while ( (int)oDistorted.size () < iCount ) {
+        // Each candidate is paired with a slightly farther one, to check that the model still grows outwards.
+        VEC(cv::Point3f) candidates;
+        for ( int i = 0; i < 4096; i++ ) {
+            float const x = (float)ioRng.uniform ( -1.2, 1.2 );
+            float const y = (float)ioRng.uniform ( -0.8, 0.8 );
+            candidates.push_back ( cv::Point3f ( x, y, 1.0f ) );
+            candidates.push_back ( cv::Point3f ( 1.01f * x, 1.01f * y, 1.0f ) );
+        }
+        VEC(cv::Point2f) projected;
+        cv::projectPoints ( candidates, zero, zero, iCameraMatrix, iDistCoeffs, projected );
+
+        for ( size_t i = 0; i < projected.size () && (int)oDistorted.size () < iCount; i += 2 ) {
+            cv::Point2f const& point = projected[i];
+            if ( point.x < 0.0f || point.y < 0.0f || point.x >= IMAGE_SIZE.width || point.y >= IMAGE_SIZE.height ) {
+                continue;
+            }
+            double const radius = std::hypot ( point.x - cx, point.y - cy );
+            double const fartherRadius = std::hypot ( projected[i + 1].x - cx, projected[i + 1].y - cy );
+            if ( fartherRadius <= radius ) {
+                continue;
+            }
+            oDistorted.push_back ( point );
+            oUndistorted.push_back ( cv::Point2f ( candidates[i].x, candidates[i].y ) );
+        }
+    }
+}
+
+/// \brief Gets the largest distance between undistorted points and their reference, in pixels.
+static double MaxError ( VEC(cv::Point2f) const& iPoints, VEC(cv::Point2f) const& iReference, cv::Mat const& iCameraMatrix )
+{
+    double const fx = iCameraMatrix.at<double> ( 0, 0 );
+    double const fy = iCameraMatrix.at<double> ( 1, 1 );
+    double error = 0.0;
+    for ( size_t i = 0; i < iPoints.size (); i++ ) {
+        error = std::max ( error, std::hypot ( fx * ( iPoints[i].x - iReference[i].x ), fy * ( iPoints[i].y - iReference[i].y ) ) );
+    }
+    return error;
+}
+
+int RunUndistortBenchmark ( int argc, char** argv )
+{
+    int pointCount = DEFAULT_POINT_COUNT;
+    if ( argc > 1 || ( argc == 1 && ( pointCount = atoi ( argv[0] ) ) <= 0 ) ) {
+        std::cout << "Usage: PCSandbox benchmark-undistort [points]" << std::endl;
+        return 1;
+    }
+
+    std::string const names[4] = { "barrel", "wide-angle", "rational", "thin prism" };
+    cv::Mat const models[4] = {
+        cv::Mat ( 5, 1, CV_64F, (void*)BARREL_COEFFS ),
+        cv::Mat ( 5, 1, CV_64F, (void*)WIDE_COEFFS ),
+        cv::Mat ( 8, 1, CV_64F, (void*)RATIONAL_COEFFS ),
+        cv::Mat ( 12, 1, CV_64F, (void*)THIN_PRISM_COEFFS )
+    };
+    cv::Mat const cameraMatrix ( 3, 3, CV_64F, (void*)CAMERA_MATRIX );
+
+    std::cout   << "Undistorting " << pointCount << " points, " << REPETITIONS << " times per method" << std::endl;
+    std::cout   << std::setw ( 12 ) << "Model"
+                << std::setw ( 14 ) << "OpenCV ms"
+                << std::setw ( 14 ) << "Grid ms"
+                << std::setw ( 10 ) << "Speedup"
+                << std::setw ( 14 ) << "OpenCV px"
+                << std::setw ( 14 ) << "Grid px" << std::endl;
+
+    cv::RNG rng ( 0x5043 );
+    for ( int m = 0; m < 4; m++ ) {
+        VEC(cv::Point2f) distorted, reference;
+        GeneratePoints ( pointCount, cameraMatrix, models[m], rng, distorted, reference );
+
+        VEC(cv::Point2f) cvPoints;
+        ClockType::time_point start = ClockType::now ();
+        for ( int r = 0; r < REPETITIONS; r++ ) {
+            cv::undistortPoints ( distorted, cvPoints, cameraMatrix, models[m] );
+        }
+        double const cvSeconds = boost::chrono::duration<double> ( ClockType::now () - start ).count () / REPETITIONS;
+
+        // Built once per camera calibration, so not timed.
+        PcPointUndistorter const undistorter ( cameraMatrix, models[m], IMAGE_SIZE );
+        VEC(cv::Point2f) points;
+        start = ClockType::now ();
+        for ( int r = 0; r < REPETITIONS; r++ ) {
+            undistorter.Undistort ( distorted, points );
+        }
+        double const seconds = boost::chrono::duration<double> ( ClockType::now () - start ).count () / REPETITIONS;
+
+        std::cout   << std::setw ( 12 ) << names[m] << std::fixed
+                    << std::setprecision ( 2 ) << std::setw ( 14 ) << 1000.0 * cvSeconds
+                    << std::setw ( 14 ) << 1000.0 * seconds
+                    << std::setprecision ( 1 ) << std::setw ( 9 ) << cvSeconds / seconds << "x"
+                    << std::setprecision ( 5 ) << std::setw ( 14 ) << MaxError ( cvPoints, reference, cameraMatrix )
+                    << std::setw ( 14 ) << MaxError ( points, reference, cameraMatrix ) << std::endl;
+    }
+    return 0;
+}
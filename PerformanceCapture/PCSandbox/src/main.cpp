@@ -1,8 +1,29 @@
+#include "PcSandboxTools.h"
+
 #include <iostream>
+#include <string>
 
 int main ( int argc, char** argv )
 {
-	std::cout << "Hello, World!" << std::endl;
+	if ( argc >= 2 && std::string ( argv[1] ).compare ( "benchmark-chessboard" ) == 0 ) {
+		return RunChessboardBenchmark ( argc - 2, argv + 2 );
+	}
+	if ( argc >= 2 && std::string ( argv[1] ).compare ( "calibrate-offline" ) == 0 ) {
+		return RunOfflineCalibration ( argc - 2, argv + 2 );
+	}
+	if ( argc >= 2 && std::string ( argv[1] ).compare ( "benchmark-intrinsics" ) == 0 ) {
+		return RunIntrinsicsBenchmark ( argc - 2, argv + 2 );
+	}
+	if ( argc >= 2 && std::string ( argv[1] ).compare ( "benchmark-undistort" ) == 0 ) {
+		return RunUndistortBenchmark ( argc - 2, argv + 2 );
+	}
+
+	std::cout << "Usage: PCSandbox <tool> [arguments]" << std::endl;
+	std::cout << "Tools:" << std::endl;
+	std::cout << "  benchmark-chessboard <rows> <cols> <take.pctake | image...>" << std::endl;
+	std::cout << "  calibrate-offline <chessboard|circles|asymmetric> <rows> <cols> <spacing> <cache.pccal> <take.pctake | camera=directory>..." << std::endl;
+	std::cout << "  benchmark-intrinsics [views...]" << std::endl;
+	std::cout << "  benchmark-undistort [points]" << std::endl;
 
-	return 0;
+	return 1;
 }
\ No newline at end of file